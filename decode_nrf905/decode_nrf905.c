@@ -1,7 +1,14 @@
 /**
  * decode_nrf905.c - Find and decode NRF905 frames from a demodulated GFSK stream
  *
- * The input is expected to be the output of nrf905_demod.py.
+ * The input is expected to be the output of nrf905_demod.py, one byte per
+ * demodulated bit, or the same packed into bytes MSB first. The format is
+ * auto-detected unless given with -f. Use -p to convert a capture to the
+ * packed format, which is 8 times smaller.
+ *
+ * With -f cu8 or cs16 the input is raw IQ, as written by rtl_sdr, which is
+ * demodulated first with nrf905_gfsk. With -C the IQ capture is split in
+ * channels by nrf905_chan, which are demodulated and decoded in parallel.
  *
  * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
  * All rights reserved.
@@ -29,128 +36,983 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nrf905_decoder.h"
+#include "nrf905_fec.h"
+#include "nrf905_gfsk.h"
+#include "nrf905_chan.h"
+
+enum input_format {
+	FORMAT_AUTO,
+	FORMAT_UNPACKED,	// One byte per sample
+	FORMAT_PACKED,		// 8 samples per byte, MSB first
+	FORMAT_CU8,		// IQ, demodulated first
+	FORMAT_CS16,
+};
+
+#define BUF_SIZE (64 * 1024)
+#define DETECT_LEN (4096)
+
+/**
+ * File mode chunking
+ *
+ * Chunks are decoded in parallel, each starting OVERLAP_SAMPLES early so the
+ * decoder state at the start of the chunk is most likely the same as when
+ * decoding the file sequentially. That is twice a max. length frame with
+ * preamble.
+ */
+#define CHUNK_SIZE (16 * 1024 * 1024)
+#define CHECKPOINT_SIZE (64 * 1024)
+#define OVERLAP_SAMPLES (2 * (20 + NRF905_MAX_FRAME_LEN * 16))
+
+// Default max. encoding errors when correcting, these mark the suspect bits
+#define FEC_ENCODING_ERRORS (4)
 
-#include "lib_crc.h"
+void frame_print(nrf905_decoder_t *d, const nrf905_decoder_frame_t *frame)
+{
+	unsigned int i;
 
-#define NRF905_MAX_FRAME_LEN (4+32+2)
+	for (i=0; i < frame->len; i++) {
+		printf("%.2x ", frame->data[i]);
+	}
+	if (frame->crc8_ok) {
+		printf("(CRC-8 OK) ");
+	}
+	if (frame->crc16_ok) {
+		printf("(CRC-16 OK) ");
+	}
+	if (frame->corrected) {
+		printf("(CORRECTED %u) ", frame->corrected);
+	}
+	putchar('\n');
+}
 
-const uint32_t PREAMBLE_ENCODED = 0xAAA66; // apparantly bits are inverted...
-const uint16_t PREAMBLE = 0x3F5;
-const int max_encoding_errors = 0;
+void decode_buf(nrf905_decoder_t *d, enum input_format format,
+		const uint8_t *buf, size_t len)
+{
+	if (format == FORMAT_PACKED) {
+		nrf905_decoder_push_packed(d, buf, len);
+	} else {
+		nrf905_decoder_push(d, buf, len);
+	}
+}
 
-struct frame_decoder_state_t {
-	int prev_sample;
-	uint8_t byte_val;
+/**
+ * Guess format from start of capture
+ *
+ * An unpacked capture only contains 0 and 1 bytes, a packed capture of
+ * anything but silence doesn't.
+ */
+enum input_format detect_format(const uint8_t *buf, size_t len)
+{
+	size_t i;
 
-	int encoding_errors;
-	int sample_cnt;
+	if (len > DETECT_LEN) {
+		len = DETECT_LEN;
+	}
+	for (i=0; i < len; i++) {
+		if (buf[i] > 1) {
+			return FORMAT_PACKED;
+		}
+	}
+	return FORMAT_UNPACKED;
+}
 
-	int bit_cnt;
-	int byte_cnt;
+/**
+ * Convert unpacked capture on stdin to packed capture on stdout
+ *
+ * Up to 7 trailing samples that don't fill a byte are dropped. Padding them
+ * could end a frame that is still open at the end of the capture.
+ */
+int convert_to_packed(void)
+{
+	static uint8_t in[BUF_SIZE];
+	static uint8_t out[BUF_SIZE / 8 + 1];
+	uint8_t val = 0;
+	int nbits = 0;
+	size_t out_len;
+	size_t len;
+	size_t i;
+
+	while ((len = fread(in, 1, sizeof(in), stdin)) > 0) {
+		out_len = 0;
+		for (i=0; i < len; i++) {
+			val = (val << 1) | (in[i] ? 1 : 0);
+			if (++nbits == 8) {
+				out[out_len++] = val;
+				nbits = 0;
+			}
+		}
+		if (fwrite(out, 1, out_len, stdout) != out_len) {
+			return -1;
+		}
+	}
+	return ferror(stdin) ? -1 : 0;
+}
+
+struct frame_rec {
+	nrf905_decoder_frame_t f;
 	uint8_t data[NRF905_MAX_FRAME_LEN];
 };
 
-void frame_clear_state(struct frame_decoder_state_t *frame)
+struct frame_list {
+	struct frame_rec *frames;
+	size_t cnt;
+	size_t size;
+};
+
+struct checkpoint {
+	nrf905_decoder_t state;
+	size_t frame_cnt;	// Frames decoded up to the checkpoint
+};
+
+struct chunk {
+	size_t off;		// Owned part of the file
+	size_t len;
+	int done;
+
+	nrf905_decoder_t start_state;	// Guessed state at off
+	struct checkpoint *cps;			// Every CHECKPOINT_SIZE bytes
+	size_t cp_cnt;
+	struct frame_list frames;
+	int failed;
+};
+
+struct file_decoder {
+	const uint8_t *map;
+	size_t size;
+	enum input_format format;
+	const nrf905_decoder_t *settings;
+
+	struct chunk *chunks;
+	size_t chunk_cnt;
+	size_t next_chunk;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+void frame_drop(nrf905_decoder_t *d, const nrf905_decoder_frame_t *frame)
 {
-	memset(frame, 0, sizeof(struct frame_decoder_state_t));
 }
 
-void frame_finish(struct frame_decoder_state_t *frame)
+/**
+ * Append copy of frame to list
+ *
+ * @returns	0 on success, -1 if out of memory
+ */
+int frame_list_add(struct frame_list *l, const nrf905_decoder_frame_t *frame)
 {
-	int i;
-        unsigned short crc16 = 0xffff;
+	struct frame_rec *frames;
+	struct frame_rec *rec;
 
-	if (frame->byte_cnt == 0)
-		return;
+	if (l->cnt == l->size) {
+		l->size = l->size ? l->size * 2 : 256;
+		frames = realloc(l->frames, l->size * sizeof(*frames));
+		if (frames == NULL) {
+			return -1;
+		}
+		l->frames = frames;
+	}
+	rec = &l->frames[l->cnt++];
+	rec->f = *frame;
+	memcpy(rec->data, frame->data, frame->len);
+	// f.data is pointed at rec->data when printing, the list can still
+	// move on realloc
+	return 0;
+}
 
-	for (i=0; i < frame->byte_cnt; i++) {
-		printf("%.2x ", frame->data[i]);
-		crc16 = update_crc_ccitt(crc16, frame->data[i]);
+void frame_collect(nrf905_decoder_t *d, const nrf905_decoder_frame_t *frame)
+{
+	struct chunk *c = d->priv;
+
+	if (frame_list_add(&c->frames, frame) != 0) {
+		c->failed = 1;
 	}
+}
 
-	
-	// Check CRC-8
-	if (frame->byte_cnt >= 3) {
-//TODO: check CRC-8
+void *chunk_worker(void *arg)
+{
+	struct file_decoder *fd = arg;
+	nrf905_decoder_t d;
+	struct chunk *c;
+	size_t overlap;
+	size_t warm;
+	size_t pos, n;
+	size_t k;
+
+	overlap = OVERLAP_SAMPLES;
+	if (fd->format == FORMAT_PACKED) {
+		overlap = (overlap + 7) / 8;
 	}
-	// Check CRC-16
-	if (frame->byte_cnt >= 4) {
-		if (crc16 == 0) {
-			printf("(CRC-16 OK) ");
+
+	while (1) {
+		pthread_mutex_lock(&fd->lock);
+		k = fd->next_chunk++;
+		pthread_mutex_unlock(&fd->lock);
+		if (k >= fd->chunk_cnt) {
+			break;
+		}
+		c = &fd->chunks[k];
+
+		d = *fd->settings;
+		d.cb = frame_drop;
+		d.priv = NULL;
+
+		// Warm up on the end of the previous chunk, its frames are
+		// owned by that chunk
+		warm = (overlap < c->off) ? overlap : c->off;
+		d.pos = c->off - warm;
+		if (fd->format == FORMAT_PACKED) {
+			d.pos *= 8;
+		}
+		decode_buf(&d, fd->format, &fd->map[c->off - warm], warm);
+		c->start_state = d;
+
+		d.cb = frame_collect;
+		d.priv = c;
+		c->cp_cnt = (c->len + CHECKPOINT_SIZE - 1) / CHECKPOINT_SIZE;
+		c->cps = malloc(c->cp_cnt * sizeof(*c->cps));
+		if (c->cps == NULL) {
+			c->failed = 1;
+			c->cp_cnt = 0;
 		}
+		for (pos=0, k=0; k < c->cp_cnt; pos += n, k++) {
+			n = c->len - pos;
+			if (n > CHECKPOINT_SIZE) {
+				n = CHECKPOINT_SIZE;
+			}
+			decode_buf(&d, fd->format, &fd->map[c->off + pos], n);
+			c->cps[k].state = d;
+			c->cps[k].frame_cnt = c->frames.cnt;
+		}
+
+		pthread_mutex_lock(&fd->lock);
+		c->done = 1;
+		pthread_cond_broadcast(&fd->cond);
+		pthread_mutex_unlock(&fd->lock);
 	}
-	putchar('\n');
-}
 
+	return NULL;
+}
 
-int main(int argc, char *argv[])
+/**
+ * Decode capture file in parallel
+ *
+ * The file is mapped and split in chunks that are decoded by a pool of
+ * threads, each chunk starting with a guessed decoder state. The chunks are
+ * merged in file order: if the guessed state of a chunk differs from the
+ * state at the end of the previous chunk, for example because a frame
+ * crosses the boundary, the chunk is decoded again from the right state
+ * until its state matches one of the chunk's checkpoints. From there on the
+ * parallel result is used. Every frame belongs to the chunk it ends in, so
+ * frames aren't duplicated across boundaries and the output is identical to
+ * sequential decoding.
+ *
+ * @param path		Capture file
+ * @param format	Input format, returns the detected format if auto
+ * @param settings	Initialized decoder to copy the settings from
+ * @param thread_cnt	Amount of decoding threads
+ *
+ * @returns	Amount of bytes decoded, or -1 on error
+ */
+long long decode_file(const char *path, enum input_format *format,
+			const nrf905_decoder_t *settings, int thread_cnt)
 {
-	int i, j;
-	unsigned int sample_cnt=0;
+	struct file_decoder fd;
+	nrf905_decoder_t state;
+	pthread_t *threads;
+	struct stat st;
+	struct chunk *c;
+	struct frame_rec *rec;
+	size_t k, i, j;
+	size_t pos, n;
+	int converged;
+	int file;
+	int err = 0;
 
-	int in_sync=0;
-	uint32_t preamble=0;
+	file = open(path, O_RDONLY);
+	if (file == -1) {
+		return -1;
+	}
+	if (fstat(file, &st) != 0) {
+		close(file);
+		return -1;
+	}
 
-	struct frame_decoder_state_t frame;
+	memset(&fd, 0, sizeof(fd));
+	fd.size = st.st_size;
+	fd.settings = settings;
+	if (fd.size == 0) {
+		close(file);
+		return 0;
+	}
+	fd.map = mmap(NULL, fd.size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (fd.map == MAP_FAILED) {
+		return -1;
+	}
+	madvise((void *) fd.map, fd.size, MADV_SEQUENTIAL);
 
-	size_t len=0;
-	unsigned char buf[1024];
+	if (*format == FORMAT_AUTO) {
+		*format = detect_format(fd.map, fd.size);
+	}
+	fd.format = *format;
 
-	while ((len = fread(buf, 1, sizeof(buf), stdin)) > 0) {
-		for (i=0; i < len; i++) {
-			sample_cnt++;
+	fd.chunk_cnt = (fd.size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	fd.chunks = calloc(fd.chunk_cnt, sizeof(*fd.chunks));
+	threads = calloc(thread_cnt, sizeof(*threads));
+	if (fd.chunks == NULL || threads == NULL) {
+		munmap((void *) fd.map, fd.size);
+		free(fd.chunks);
+		free(threads);
+		return -1;
+	}
+	for (k=0; k < fd.chunk_cnt; k++) {
+		fd.chunks[k].off = k * CHUNK_SIZE;
+		fd.chunks[k].len = fd.size - fd.chunks[k].off;
+		if (fd.chunks[k].len > CHUNK_SIZE) {
+			fd.chunks[k].len = CHUNK_SIZE;
+		}
+	}
+	pthread_mutex_init(&fd.lock, NULL);
+	pthread_cond_init(&fd.cond, NULL);
 
-			if (!in_sync) {
-				preamble = ((preamble << 1) & 0xFFFFF) | (buf[i] ? 0 : 1);
-				if (preamble == PREAMBLE_ENCODED) {
-					// Preamble detected
-					frame_clear_state(&frame);
+	for (i=0; i < (size_t) thread_cnt; i++) {
+		if (pthread_create(&threads[i], NULL, chunk_worker, &fd) != 0) {
+			break;
+		}
+	}
+	thread_cnt = i;
+	if (thread_cnt == 0) {
+		// Decode on this thread
+		chunk_worker(&fd);
+	}
+
+	state = *settings;
+	state.cb = frame_print;
+	for (k=0; k < fd.chunk_cnt; k++) {
+		c = &fd.chunks[k];
+
+		pthread_mutex_lock(&fd.lock);
+		while (!c->done) {
+			pthread_cond_wait(&fd.cond, &fd.lock);
+		}
+		pthread_mutex_unlock(&fd.lock);
 
-					in_sync = 1;
+		if (c->failed) {
+			err = ENOMEM;
+		}
+		if (err != 0) {
+			goto next;
+		}
+
+		// Decode sequentially until this chunk's state is known to be
+		// right, from there on use its frames
+		j = 0;
+		converged = nrf905_decoder_same_state(&state, &c->start_state);
+		if (!converged) {
+			state.cb = frame_print;
+			for (pos=0; j < c->cp_cnt && !converged; pos += n, j++) {
+				n = c->len - pos;
+				if (n > CHECKPOINT_SIZE) {
+					n = CHECKPOINT_SIZE;
 				}
+				decode_buf(&state, fd.format, &fd.map[c->off + pos],
+						n);
+				converged = nrf905_decoder_same_state(&state, &c->cps[j].state);
+			}
+		}
+		if (converged) {
+			i = (j > 0) ? c->cps[j - 1].frame_cnt : 0;
+			for (; i < c->frames.cnt; i++) {
+				rec = &c->frames.frames[i];
+				rec->f.data = rec->data;
+				frame_print(NULL, &rec->f);
+			}
+			state = c->cps[c->cp_cnt - 1].state;
+		}
+
+next:
+		free(c->frames.frames);
+		free(c->cps);
+	}
+
+	for (i=0; i < (size_t) thread_cnt; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&fd.lock);
+	pthread_cond_destroy(&fd.cond);
+	munmap((void *) fd.map, fd.size);
+	free(fd.chunks);
+	free(threads);
+
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+	return fd.size;
+}
+
+/**
+ * Demodulate and decode IQ capture
+ *
+ * IQ is decoded sequentially, the demodulator state can't be recovered at
+ * an arbitrary point like the decoder's.
+ *
+ * @returns	Amount of bytes read, -1 on error
+ */
+long long decode_iq(FILE *fp, enum input_format format,
+		unsigned int samp_rate, nrf905_decoder_t *d)
+{
+	static uint8_t buf[BUF_SIZE];
+	static nrf905_gfsk_t g;
+	long long bytes = 0;
+	size_t len;
+
+	if (nrf905_gfsk_init(&g, format == FORMAT_CU8 ? NRF905_GFSK_CU8 :
+				NRF905_GFSK_CS16, samp_rate, d) != 0) {
+		return -1;
+	}
+
+	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		nrf905_gfsk_push(&g, buf, len);
+		bytes += len;
+	}
+	if (ferror(fp)) {
+		return -1;
+	}
+
+	return bytes;
+}
+
+struct wide_channel {
+	nrf905_gfsk_t g;
+	nrf905_decoder_t d;
+	int offset;			// In channel spacings
+	struct frame_list frames;	// Frames of the current block
+	int failed;
+};
+
+struct wide_decoder {
+	nrf905_chan_t chan;
+	struct wide_channel *chans;
+	unsigned int spacing;
+	unsigned int center;		// Center frequency, 0 if unknown
+
+	// Channelizer output, double buffered so the next block is
+	// channelized while the workers demodulate this one
+	float *out_i[2][NRF905_CHAN_MAX_CHANNELS];
+	float *out_q[2][NRF905_CHAN_MAX_CHANNELS];
+	size_t out_cnt;
+	int cur;
+
+	unsigned long block;		// Incremented for every block
+	unsigned int busy;		// Workers still working on the block
+	unsigned int worker_cnt;
+	int stop;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+struct wide_worker {
+	struct wide_decoder *wd;
+	unsigned int idx;
+};
+
+void wide_frame_collect(nrf905_decoder_t *d,
+			const nrf905_decoder_frame_t *frame)
+{
+	struct wide_channel *ch = d->priv;
+
+	if (frame_list_add(&ch->frames, frame) != 0) {
+		ch->failed = 1;
+	}
+}
+
+/**
+ * Demodulate the current block of every stride'th channel from first
+ */
+void wide_demod(struct wide_decoder *wd, unsigned int first,
+		unsigned int stride)
+{
+	unsigned int k;
+
+	for (k=first; k < wd->chan.chan_cnt; k += stride) {
+		nrf905_gfsk_push_float(&wd->chans[k].g, wd->out_i[wd->cur][k],
+				wd->out_q[wd->cur][k], wd->out_cnt);
+	}
+}
+
+void *wide_worker(void *arg)
+{
+	struct wide_worker *w = arg;
+	struct wide_decoder *wd = w->wd;
+	unsigned long block = 0;
+
+	pthread_mutex_lock(&wd->lock);
+	while (1) {
+		while (wd->block == block && !wd->stop) {
+			pthread_cond_wait(&wd->cond, &wd->lock);
+		}
+		if (wd->block == block) {
+			break;
+		}
+		block = wd->block;
+		pthread_mutex_unlock(&wd->lock);
+
+		wide_demod(wd, w->idx, wd->worker_cnt);
+
+		pthread_mutex_lock(&wd->lock);
+		if (--wd->busy == 0) {
+			pthread_cond_broadcast(&wd->cond);
+		}
+	}
+	pthread_mutex_unlock(&wd->lock);
+
+	return NULL;
+}
+
+/**
+ * Wait for the workers to finish the block and print its frames
+ *
+ * The frames of all channels are merged in order of offset.
+ *
+ * @returns	0 on success, -1 if frames were lost for lack of memory
+ */
+int wide_finish_block(struct wide_decoder *wd)
+{
+	struct wide_channel *ch;
+	struct frame_rec *rec;
+	size_t next[NRF905_CHAN_MAX_CHANNELS] = { 0 };
+	unsigned int k, best;
+	int err = 0;
+
+	pthread_mutex_lock(&wd->lock);
+	while (wd->busy > 0) {
+		pthread_cond_wait(&wd->cond, &wd->lock);
+	}
+	pthread_mutex_unlock(&wd->lock);
+
+	while (1) {
+		best = wd->chan.chan_cnt;
+		for (k=0; k < wd->chan.chan_cnt; k++) {
+			ch = &wd->chans[k];
+			if (next[k] < ch->frames.cnt && (best == wd->chan.chan_cnt ||
+			    ch->frames.frames[next[k]].f.offset <
+			    wd->chans[best].frames.frames[next[best]].f.offset)) {
+				best = k;
+			}
+		}
+		if (best == wd->chan.chan_cnt) {
+			break;
+		}
+
+		ch = &wd->chans[best];
+		rec = &ch->frames.frames[next[best]++];
+		rec->f.data = rec->data;
+		printf("%+3d", ch->offset);
+		if (wd->center != 0) {
+			printf(" %.3f MHz", (wd->center +
+				(double) ch->offset * wd->spacing) / 1e6);
+		}
+		printf(": ");
+		frame_print(NULL, &rec->f);
+	}
+
+	for (k=0; k < wd->chan.chan_cnt; k++) {
+		ch = &wd->chans[k];
+		ch->frames.cnt = 0;
+		if (ch->failed) {
+			err = -1;
+		}
+	}
+	return err;
+}
+
+/**
+ * Channelize, demodulate and decode wideband IQ capture
+ *
+ * The main thread converts and channelizes the IQ samples, the channels are
+ * divided over the worker threads that run a demodulator and decoder per
+ * channel. Frames are printed per block of input, tagged with the channel
+ * offset, and the frequency if the center frequency is known.
+ *
+ * @param fp		Capture
+ * @param format	IQ sample format
+ * @param samp_rate	IQ sample rate
+ * @param spacing	Channel spacing, must divide samp_rate
+ * @param center	Center frequency of the capture, or 0
+ * @param settings	Initialized decoder to copy the settings from
+ * @param thread_cnt	Amount of demodulator threads
+ *
+ * @returns	Amount of bytes read, -1 on error
+ */
+long long decode_wide(FILE *fp, enum input_format format,
+		unsigned int samp_rate, unsigned int spacing,
+		unsigned int center, const nrf905_decoder_t *settings,
+		int thread_cnt)
+{
+	static uint8_t buf[BUF_SIZE];
+	static float in_i[BUF_SIZE / 2];
+	static float in_q[BUF_SIZE / 2];
+	nrf905_gfsk_format_t gfsk_format;
+	struct wide_decoder wd;
+	struct wide_worker *workers;
+	pthread_t *threads;
+	long long bytes = 0;
+	size_t sample_size;
+	size_t max_out;
+	size_t n;
+	unsigned int k, i;
+	int err = 0;
+
+	gfsk_format = (format == FORMAT_CU8) ? NRF905_GFSK_CU8 : NRF905_GFSK_CS16;
+	sample_size = (format == FORMAT_CU8) ? 2 : 4;
+
+	memset(&wd, 0, sizeof(wd));
+	if (nrf905_chan_init(&wd.chan, samp_rate, spacing) != 0) {
+		return -1;
+	}
+	wd.spacing = spacing;
+	wd.center = center;
+
+	max_out = nrf905_chan_max_out(&wd.chan, BUF_SIZE / sample_size);
+	wd.chans = calloc(wd.chan.chan_cnt, sizeof(*wd.chans));
+	workers = calloc(thread_cnt, sizeof(*workers));
+	threads = calloc(thread_cnt, sizeof(*threads));
+	if (wd.chans == NULL || workers == NULL || threads == NULL) {
+		err = ENOMEM;
+		goto out;
+	}
+	for (k=0; k < wd.chan.chan_cnt; k++) {
+		for (i=0; i < 2; i++) {
+			wd.out_i[i][k] = malloc(max_out * sizeof(float));
+			wd.out_q[i][k] = malloc(max_out * sizeof(float));
+			if (wd.out_i[i][k] == NULL || wd.out_q[i][k] == NULL) {
+				err = ENOMEM;
+				goto out;
+			}
+		}
+
+		wd.chans[k].d = *settings;
+		wd.chans[k].d.cb = wide_frame_collect;
+		wd.chans[k].d.priv = &wd.chans[k];
+		wd.chans[k].offset = nrf905_chan_offset(&wd.chan, k);
+		if (nrf905_gfsk_init(&wd.chans[k].g, gfsk_format,
+				wd.chan.out_rate, &wd.chans[k].d) != 0) {
+			err = errno;
+			goto out;
+		}
+	}
+
+	pthread_mutex_init(&wd.lock, NULL);
+	pthread_cond_init(&wd.cond, NULL);
+	for (i=0; i < (unsigned int) thread_cnt; i++) {
+		workers[i].wd = &wd;
+		workers[i].idx = i;
+		if (pthread_create(&threads[i], NULL, wide_worker,
+					&workers[i]) != 0) {
+			break;
+		}
+	}
+	wd.worker_cnt = i;
+
+	while ((n = fread(buf, sample_size, BUF_SIZE / sample_size, fp)) > 0) {
+		bytes += n * sample_size;
+		nrf905_gfsk_convert(gfsk_format, buf, n, in_i, in_q);
+
+		// Channelize in the buffer the workers aren't using
+		k = nrf905_chan_push(&wd.chan, in_i, in_q, n,
+			wd.out_i[!wd.cur], wd.out_q[!wd.cur]);
+
+		if (wide_finish_block(&wd) != 0) {
+			err = ENOMEM;
+			break;
+		}
+
+		pthread_mutex_lock(&wd.lock);
+		wd.cur = !wd.cur;
+		wd.out_cnt = k;
+		if (wd.worker_cnt == 0) {
+			// Demodulate on this thread
+			wide_demod(&wd, 0, 1);
+		} else {
+			wd.busy = wd.worker_cnt;
+			wd.block++;
+			pthread_cond_broadcast(&wd.cond);
+		}
+		pthread_mutex_unlock(&wd.lock);
+	}
+	if (ferror(fp)) {
+		err = errno;
+	}
+	if (wide_finish_block(&wd) != 0 && err == 0) {
+		err = ENOMEM;
+	}
+
+	pthread_mutex_lock(&wd.lock);
+	wd.stop = 1;
+	pthread_cond_broadcast(&wd.cond);
+	pthread_mutex_unlock(&wd.lock);
+	for (i=0; i < wd.worker_cnt; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&wd.lock);
+	pthread_cond_destroy(&wd.cond);
+
+out:
+	if (wd.chans != NULL) {
+		for (k=0; k < wd.chan.chan_cnt; k++) {
+			free(wd.chans[k].frames.frames);
+			for (i=0; i < 2; i++) {
+				free(wd.out_i[i][k]);
+				free(wd.out_q[i][k]);
+			}
+		}
+	}
+	free(wd.chans);
+	free(workers);
+	free(threads);
+	nrf905_chan_destroy(&wd.chan);
+
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+	return bytes;
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f auto|unpacked|packed] [-e ERRORS] [-c CRC:LEN [-b BITS]] [-t] [-s] < capture\n", name);
+	fprintf(stderr, "       %s [-f auto|unpacked|packed] [-e ERRORS] [-c CRC:LEN [-b BITS]] [-t] [-s] [-j THREADS] capture\n", name);
+	fprintf(stderr, "       %s -f cu8|cs16 [-r RATE] [-e ERRORS] [-c CRC:LEN [-b BITS]] [-t] [capture]\n", name);
+	fprintf(stderr, "       %s -f cu8|cs16 -r RATE -C SPACING [-F FREQ] [-e ERRORS] [-c CRC:LEN [-b BITS]] [-t] [-j THREADS] [capture]\n", name);
+	fprintf(stderr, "       %s -p < capture > packed_capture\n\n", name);
+	fprintf(stderr, "  -f FORMAT  Input format, default auto-detect. cu8 and cs16 are IQ\n");
+	fprintf(stderr, "             samples as written by rtl_sdr, centered on the channel\n");
+	fprintf(stderr, "  -r RATE    IQ sample rate, default %d\n", NRF905_GFSK_DEMOD_RATE);
+	fprintf(stderr, "  -C SPACING Decode all channels SPACING Hz apart in the IQ capture,\n");
+	fprintf(stderr, "             frames are prefixed with the channel offset from the center\n");
+	fprintf(stderr, "  -F FREQ    Center frequency of the IQ capture, to print channel\n");
+	fprintf(stderr, "             frequencies with -C\n");
+	fprintf(stderr, "  -e ERRORS  Max. Manchester encoding errors in a frame, default %d,\n", NRF905_DECODER_MAX_ENCODING_ERRORS);
+	fprintf(stderr, "             or %d with -c\n", FEC_ENCODING_ERRORS);
+	fprintf(stderr, "  -c CRC:LEN Correct up to 2 bit errors in frames of LEN bytes, including\n");
+	fprintf(stderr, "             a CRC of 8 or 16 bits. For example 16:38 for 32 byte payloads\n");
+	fprintf(stderr, "  -b BITS    Max. corrected bits that had no encoding error, 0 to 2,\n");
+	fprintf(stderr, "             default %d\n", NRF905_DECODER_FEC_MAX_BLIND);
+	fprintf(stderr, "  -j THREADS Amount of threads decoding a capture file, or the\n");
+	fprintf(stderr, "             channels with -C, default one per CPU\n");
+	fprintf(stderr, "  -p         Convert unpacked capture to packed format\n");
+	fprintf(stderr, "  -t         Print decoding throughput to stderr\n");
+	fprintf(stderr, "  -s         Decode one sample at a time, for benchmarking\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t buf[BUF_SIZE];
+	static nrf905_fec_t fec;
+	enum input_format format = FORMAT_AUTO;
+	nrf905_decoder_t d;
+	struct timespec start, end;
+	unsigned long long bytes = 0;
+	double elapsed;
+	int timing = 0;
+	int per_sample = 0;
+	int max_errors = -1;
+	int crc_bits = 0;
+	unsigned int frame_len = 0;
+	int max_blind = NRF905_DECODER_FEC_MAX_BLIND;
+	int thread_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int samp_rate = NRF905_GFSK_DEMOD_RATE;
+	unsigned int spacing = 0;
+	unsigned int center = 0;
+	FILE *fp;
+	long long ret;
+	size_t len=0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:r:C:F:e:c:b:ptsj:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (strcmp(optarg, "auto") == 0) {
+				format = FORMAT_AUTO;
+			} else if (strcmp(optarg, "unpacked") == 0) {
+				format = FORMAT_UNPACKED;
+			} else if (strcmp(optarg, "packed") == 0) {
+				format = FORMAT_PACKED;
+			} else if (strcmp(optarg, "cu8") == 0) {
+				format = FORMAT_CU8;
+			} else if (strcmp(optarg, "cs16") == 0) {
+				format = FORMAT_CS16;
 			} else {
-				if ((frame.sample_cnt++ & 1) == 0) {
-					frame.prev_sample = buf[i];
-				} else {
-					if (buf[i] == frame.prev_sample) {
-						// Manchester decoding error
-						if (++frame.encoding_errors > max_encoding_errors) {
-							frame_finish(&frame);
-							in_sync = 0;
-							continue;
-						}
-					}
-
-					frame.byte_val = frame.byte_val << 1;
-					if (frame.prev_sample) {
-						frame.byte_val |= 0;
-					} else {
-						frame.byte_val |= 1;
-					}
-					frame.bit_cnt++;
-					if ((frame.bit_cnt % 8) == 2 && frame.byte_cnt > 1) {
-						if (frame.data[frame.byte_cnt-1] == (PREAMBLE >> 2) &&
-						    (frame.byte_val & 0x3) == (PREAMBLE & 0x3))
-						{
-							// Preamble detected in frame, possibly auto-retransmit mode
-							frame.byte_cnt--;
-							frame_finish(&frame);
-							frame_clear_state(&frame);
-						}
-					}
-					if ((frame.bit_cnt % 8) == 0) {
-						frame.data[frame.byte_cnt++] = frame.byte_val;
-						if (frame.byte_cnt == NRF905_MAX_FRAME_LEN) {
-							// Frame at max. length
-							frame_finish(&frame);
-							in_sync = 0;
-						}
-					}
-				}
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'r':
+			samp_rate = atoi(optarg);
+			break;
+		case 'C':
+			spacing = atoi(optarg);
+			if (spacing == 0) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'F':
+			center = strtod(optarg, NULL);
+			break;
+		case 'e':
+			max_errors = atoi(optarg);
+			if (max_errors < 0) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'c':
+			if (sscanf(optarg, "%d:%u", &crc_bits, &frame_len) != 2 ||
+			    (crc_bits != 8 && crc_bits != 16) ||
+			    frame_len < 3 || frame_len > NRF905_MAX_FRAME_LEN) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'b':
+			max_blind = atoi(optarg);
+			if (max_blind < 0 || max_blind > 2) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
 			}
+			break;
+		case 'p':
+			if (convert_to_packed() != 0) {
+				perror("Failed to convert capture");
+				exit(EXIT_FAILURE);
+			}
+			return 0;
+		case 't':
+			timing = 1;
+			break;
+		case 's':
+			per_sample = 1;
+			break;
+		case 'j':
+			thread_cnt = atoi(optarg);
+			if (thread_cnt < 1) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (argc - optind > 1 || (spacing != 0 && format != FORMAT_CU8 &&
+				format != FORMAT_CS16)) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	nrf905_decoder_init(&d, frame_print, NULL);
+	d.per_sample = per_sample;
+	if (crc_bits != 0) {
+		nrf905_fec_init(&fec);
+		d.fec = &fec;
+		d.fec_crc_bits = crc_bits;
+		d.fec_len = frame_len;
+		d.fec_max_blind = max_blind;
+		d.max_encoding_errors = FEC_ENCODING_ERRORS;
+	}
+	if (max_errors >= 0) {
+		d.max_encoding_errors = max_errors;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (format == FORMAT_CU8 || format == FORMAT_CS16) {
+		fp = stdin;
+		if (optind < argc) {
+			fp = fopen(argv[optind], "rb");
+			if (fp == NULL) {
+				perror("Failed to open capture");
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (spacing != 0) {
+			ret = decode_wide(fp, format, samp_rate, spacing,
+					center, &d, thread_cnt);
+		} else {
+			ret = decode_iq(fp, format, samp_rate, &d);
+		}
+		if (ret < 0) {
+			perror("Failed to decode capture");
+			exit(EXIT_FAILURE);
+		}
+		bytes = ret;
+		if (fp != stdin) {
+			fclose(fp);
+		}
+	} else if (optind < argc) {
+		ret = decode_file(argv[optind], &format, &d, thread_cnt);
+		if (ret < 0) {
+			perror("Failed to decode capture");
+			exit(EXIT_FAILURE);
+		}
+		bytes = ret;
+	} else {
+		while ((len = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+			if (format == FORMAT_AUTO) {
+				format = detect_format(buf, len);
+			}
+			decode_buf(&d, format, buf, len);
+			bytes += len;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (timing) {
+		elapsed = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+		if (format == FORMAT_CU8 || format == FORMAT_CS16) {
+			ret = bytes / (format == FORMAT_CU8 ? 2 : 4);
+			fprintf(stderr, "%s: ", format == FORMAT_CU8 ? "cu8" : "cs16");
+			if (spacing != 0) {
+				fprintf(stderr, "%u channels, %d threads, ",
+					samp_rate / spacing, thread_cnt);
+			}
+			fprintf(stderr, "%llu bytes, %lld IQ samples in %.3f s, %.1f Msamples/s, %.1fx real time\n",
+				bytes, ret,
+				elapsed, ret / elapsed / 1e6,
+				(double) ret / samp_rate / elapsed);
+			return 0;
+		}
+		if (format == FORMAT_PACKED) {
+			fprintf(stderr, "packed: ");
+		} else {
+			fprintf(stderr, "unpacked: ");
+		}
+		if (optind < argc) {
+			fprintf(stderr, "%d threads, ", thread_cnt);
 		}
+		fprintf(stderr, "%llu bytes, %llu samples in %.3f s, %.1f Msamples/s, %.1f MB/s\n",
+			bytes, format == FORMAT_PACKED ? bytes * 8 : bytes,
+			elapsed, (format == FORMAT_PACKED ? bytes * 8 : bytes) / elapsed / 1e6,
+			bytes / elapsed / 1e6);
 	}
 
 	return 0;
@@ -0,0 +1,226 @@
+/**
+ * gen_nrf905.c - Generate synthetic nRF905 captures
+ *
+ * Writes frames to stdout, either demodulated in the formats decode_nrf905
+ * reads, or GFSK modulated as raw IQ. With -l the sent frames are written to
+ * a file, one per line, in the same format decode_nrf905 prints them.
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "nrf905_gen.h"
+
+#define BUF_SIZE (1024 * 1024)
+#define DEFAULT_FRAMES (1000)
+
+static void frame_log(nrf905_gen_t *g, const uint8_t *data, unsigned int len,
+			uint64_t offset)
+{
+	FILE *fp = g->priv;
+	unsigned int i;
+
+	for (i=0; i < len; i++) {
+		fprintf(fp, "%.2x ", data[i]);
+	}
+	fputc('\n', fp);
+}
+
+static int parse_hex(const char *s, uint8_t *buf, unsigned int max)
+{
+	unsigned int len = 0;
+	unsigned int v;
+
+	while (*s != '\0') {
+		if (len == max || sscanf(s, "%2x", &v) != 1 || s[1] == '\0') {
+			return -1;
+		}
+		buf[len++] = v;
+		s += 2;
+	}
+	return len;
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f FORMAT] [-r RATE] [-n FRAMES] [-s SEED] [-a ADDR] [-w WIDTH]\n", name);
+	fprintf(stderr, "       %*s [-p LEN | -d HEX] [-c CRC] [-g MIN[:MAX]] [-S SNR] [-o OFFSET]\n", (int) strlen(name), "");
+	fprintf(stderr, "       %*s [-D PPM] [-e RATE] [-l FILE] [-t] > capture\n\n", (int) strlen(name), "");
+	fprintf(stderr, "  -f FORMAT   unpacked, packed, cu8 or cs16, default cu8\n");
+	fprintf(stderr, "  -r RATE     IQ sample rate, default 1000000\n");
+	fprintf(stderr, "  -n FRAMES   Amount of frames, 0 for endless, default %d\n", DEFAULT_FRAMES);
+	fprintf(stderr, "  -s SEED     Random seed, default 1\n");
+	fprintf(stderr, "  -a ADDR     Hex address, default E7E7E7E7\n");
+	fprintf(stderr, "  -w WIDTH    Address width in bytes, 1 to 4, default 4\n");
+	fprintf(stderr, "  -p LEN      Random payloads of LEN bytes, 1 to 32, default 32\n");
+	fprintf(stderr, "  -d HEX      Fixed payload\n");
+	fprintf(stderr, "  -c CRC      CRC length in bits, 0, 8 or 16, default 16\n");
+	fprintf(stderr, "  -g MIN[:MAX] Gap between frames in us, default 1000:2000\n");
+	fprintf(stderr, "  -S SNR      IQ signal to noise ratio in dB, default 20\n");
+	fprintf(stderr, "  -o OFFSET   IQ carrier frequency offset in Hz\n");
+	fprintf(stderr, "  -D PPM      Transmitter chip clock error in ppm\n");
+	fprintf(stderr, "  -e RATE     Chip error probability of demodulated formats\n");
+	fprintf(stderr, "  -l FILE     Write sent frames to FILE\n");
+	fprintf(stderr, "  -t          Print generation throughput to stderr\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t buf[BUF_SIZE];
+	static nrf905_gen_t gen;
+	static uint8_t payload[32];
+	nrf905_gen_config_t cfg;
+	FILE *log_fp = NULL;
+	struct timespec start, end;
+	unsigned long long bytes = 0;
+	double elapsed;
+	int timing = 0;
+	int ret;
+	size_t len;
+	int opt;
+
+	nrf905_gen_config_init(&cfg);
+	cfg.frame_cnt = DEFAULT_FRAMES;
+	while ((opt = getopt(argc, argv, "f:r:n:s:a:w:p:d:c:g:S:o:D:e:l:th")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (strcmp(optarg, "unpacked") == 0) {
+				cfg.format = NRF905_GEN_UNPACKED;
+			} else if (strcmp(optarg, "packed") == 0) {
+				cfg.format = NRF905_GEN_PACKED;
+			} else if (strcmp(optarg, "cu8") == 0) {
+				cfg.format = NRF905_GEN_CU8;
+			} else if (strcmp(optarg, "cs16") == 0) {
+				cfg.format = NRF905_GEN_CS16;
+			} else {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'r':
+			cfg.samp_rate = atoi(optarg);
+			break;
+		case 'n':
+			cfg.frame_cnt = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'a':
+			cfg.addr = strtoul(optarg, NULL, 16);
+			break;
+		case 'w':
+			cfg.addr_width = atoi(optarg);
+			break;
+		case 'p':
+			cfg.payload_len = atoi(optarg);
+			cfg.payload = NULL;
+			break;
+		case 'd':
+			ret = parse_hex(optarg, payload, sizeof(payload));
+			if (ret <= 0) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			cfg.payload_len = ret;
+			cfg.payload = payload;
+			break;
+		case 'c':
+			cfg.crc_bits = atoi(optarg);
+			break;
+		case 'g':
+			if (sscanf(optarg, "%u:%u", &cfg.gap_min_us,
+					&cfg.gap_max_us) == 1) {
+				cfg.gap_max_us = cfg.gap_min_us;
+			}
+			break;
+		case 'S':
+			cfg.snr_db = atof(optarg);
+			break;
+		case 'o':
+			cfg.freq_offset = atof(optarg);
+			break;
+		case 'D':
+			cfg.drift_ppm = atof(optarg);
+			break;
+		case 'e':
+			cfg.error_rate = atof(optarg);
+			break;
+		case 'l':
+			log_fp = fopen(optarg, "w");
+			if (log_fp == NULL) {
+				perror("Failed to open frame log");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 't':
+			timing = 1;
+			break;
+		default:
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind != argc) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (nrf905_gen_init(&gen, &cfg, log_fp ? frame_log : NULL,
+				log_fp) != 0) {
+		perror("Invalid generator settings");
+		exit(EXIT_FAILURE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while ((len = nrf905_gen_read(&gen, buf, sizeof(buf))) > 0) {
+		if (fwrite(buf, 1, len, stdout) != len) {
+			perror("Failed to write capture");
+			exit(EXIT_FAILURE);
+		}
+		bytes += len;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (log_fp != NULL) {
+		fclose(log_fp);
+	}
+
+	if (timing) {
+		elapsed = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+		fprintf(stderr, "%lu frames, %llu bytes in %.3f s, %.1f MB/s\n",
+			gen.frames, bytes, elapsed, bytes / elapsed / 1e6);
+	}
+
+	return 0;
+}
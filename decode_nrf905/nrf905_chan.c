@@ -0,0 +1,327 @@
+/**
+ * nrf905_chan.c - Polyphase filter bank channelizer
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define NRF905_CHAN_NEON
+#endif
+
+#include "nrf905_chan.h"
+
+/**
+ * Mixed radix FFT, decimation in time
+ *
+ * Transforms n points of in, stride apart, to out. The twiddle factors have
+ * the positive sign, so this is an inverse DFT without scaling.
+ */
+static void _nrf905_chan_fft(const nrf905_chan_t *c, const float *in_re,
+		const float *in_im, size_t stride, float *out_re,
+		float *out_im, unsigned int n, const unsigned int *factors)
+{
+	const unsigned int p = factors[0];
+	const unsigned int m = n / p;
+	const unsigned int tw_step = c->chan_cnt / n;
+	float t_re[NRF905_CHAN_MAX_CHANNELS];
+	float t_im[NRF905_CHAN_MAX_CHANNELS];
+	float re, im, b_re, b_im;
+	unsigned int k, s, q, w, kk;
+
+	if (m == 1) {
+		for (q=0; q < p; q++) {
+			out_re[q] = in_re[q * stride];
+			out_im[q] = in_im[q * stride];
+		}
+	} else {
+		for (q=0; q < p; q++) {
+			_nrf905_chan_fft(c, &in_re[q * stride], &in_im[q * stride],
+				stride * p, &out_re[q * m], &out_im[q * m], m,
+				&factors[1]);
+		}
+	}
+
+	if (p == 2) {
+		// W^(k + m) = -W^k
+		for (k=0; k < m; k++) {
+			w = k * tw_step;
+			b_re = out_re[k + m] * c->tw_re[w] -
+				out_im[k + m] * c->tw_im[w];
+			b_im = out_re[k + m] * c->tw_im[w] +
+				out_im[k + m] * c->tw_re[w];
+			out_re[k + m] = out_re[k] - b_re;
+			out_im[k + m] = out_im[k] - b_im;
+			out_re[k] += b_re;
+			out_im[k] += b_im;
+		}
+		return;
+	}
+
+	// Generic radix-p butterflies, twiddle W^(q * kk) for output kk
+	for (k=0; k < m; k++) {
+		for (q=0; q < p; q++) {
+			t_re[q] = out_re[q * m + k];
+			t_im[q] = out_im[q * m + k];
+		}
+		for (s=0, kk=k; s < p; s++, kk += m) {
+			re = t_re[0];
+			im = t_im[0];
+			w = 0;
+			for (q=1; q < p; q++) {
+				w += kk;
+				if (w >= n) {
+					w -= n;
+				}
+				re += t_re[q] * c->tw_re[w * tw_step] -
+					t_im[q] * c->tw_im[w * tw_step];
+				im += t_re[q] * c->tw_im[w * tw_step] +
+					t_im[q] * c->tw_re[w * tw_step];
+			}
+			out_re[kk] = re;
+			out_im[kk] = im;
+		}
+	}
+}
+
+/**
+ * Compute the filter bank output for the input at hist[idx]
+ *
+ * @param phase	Input offset modulo chan_cnt
+ */
+static void _nrf905_chan_output(nrf905_chan_t *c, unsigned int idx,
+		unsigned int phase, float * const *out_i, float * const *out_q,
+		size_t cnt)
+{
+	const unsigned int M = c->chan_cnt;
+	const float *h = c->taps;
+	const float *si = &c->hist_i[idx + 1 - c->tap_cnt];
+	const float *sq = &c->hist_q[idx + 1 - c->tap_cnt];
+	unsigned int r = 0;
+	unsigned int l, k;
+
+	// Every branch sums the products of taps chan_cnt apart
+#if defined(__SSE2__)
+	__m128 ai, aq, ht;
+
+	for (; r + 4 <= M; r += 4) {
+		ai = _mm_setzero_ps();
+		aq = _mm_setzero_ps();
+		for (l=r; l < c->tap_cnt; l += M) {
+			ht = _mm_loadu_ps(&h[l]);
+			ai = _mm_add_ps(ai, _mm_mul_ps(ht, _mm_loadu_ps(&si[l])));
+			aq = _mm_add_ps(aq, _mm_mul_ps(ht, _mm_loadu_ps(&sq[l])));
+		}
+		_mm_storeu_ps(&c->acc_re[r], ai);
+		_mm_storeu_ps(&c->acc_im[r], aq);
+	}
+#elif defined(NRF905_CHAN_NEON)
+	float32x4_t ai, aq, ht;
+
+	for (; r + 4 <= M; r += 4) {
+		ai = vdupq_n_f32(0);
+		aq = vdupq_n_f32(0);
+		for (l=r; l < c->tap_cnt; l += M) {
+			ht = vld1q_f32(&h[l]);
+			ai = vmlaq_f32(ai, ht, vld1q_f32(&si[l]));
+			aq = vmlaq_f32(aq, ht, vld1q_f32(&sq[l]));
+		}
+		vst1q_f32(&c->acc_re[r], ai);
+		vst1q_f32(&c->acc_im[r], aq);
+	}
+#endif
+	for (; r < M; r++) {
+		c->acc_re[r] = 0;
+		c->acc_im[r] = 0;
+		for (l=r; l < c->tap_cnt; l += M) {
+			c->acc_re[r] += h[l] * si[l];
+			c->acc_im[r] += h[l] * sq[l];
+		}
+	}
+
+	// The taps are reversed, so sum r holds branch M - 1 - r. Rotating
+	// the branches by the input phase moves every channel to DC.
+	for (k=0, r=M - 1 - phase; k < M - phase; k++, r--) {
+		c->branch_re[k] = c->acc_re[r];
+		c->branch_im[k] = c->acc_im[r];
+	}
+	for (r=M - 1; k < M; k++, r--) {
+		c->branch_re[k] = c->acc_re[r];
+		c->branch_im[k] = c->acc_im[r];
+	}
+
+	_nrf905_chan_fft(c, c->branch_re, c->branch_im, 1, c->fft_re, c->fft_im,
+			M, c->factors);
+
+	for (k=0; k < M; k++) {
+		out_i[k][cnt] = c->fft_re[k];
+		out_q[k][cnt] = c->fft_im[k];
+	}
+}
+
+int nrf905_chan_init(nrf905_chan_t *c, unsigned int samp_rate,
+			unsigned int spacing)
+{
+	unsigned int M, D, n, f, k;
+	double fc, x, sum;
+
+	if (spacing == 0 || samp_rate % spacing != 0 ||
+	    samp_rate / spacing < 2 ||
+	    samp_rate / spacing > NRF905_CHAN_MAX_CHANNELS) {
+		errno = EINVAL;
+		return -1;
+	}
+	M = samp_rate / spacing;
+
+	// Largest decimation that keeps the channel rate
+	for (D=M; D > 1; D--) {
+		if (M % D == 0 && samp_rate / D >= NRF905_CHAN_MIN_RATE) {
+			break;
+		}
+	}
+
+	memset(c, 0, sizeof(*c));
+	c->chan_cnt = M;
+	c->decim = D;
+	c->out_rate = samp_rate / D;
+	c->tap_cnt = M * NRF905_CHAN_TAPS_PER_BRANCH;
+
+	c->taps = malloc(c->tap_cnt * sizeof(float));
+	c->hist_i = malloc((c->tap_cnt + NRF905_CHAN_BLOCK) * sizeof(float));
+	c->hist_q = malloc((c->tap_cnt + NRF905_CHAN_BLOCK) * sizeof(float));
+	c->tw_re = malloc(8 * M * sizeof(float));
+	if (c->taps == NULL || c->hist_i == NULL || c->hist_q == NULL ||
+	    c->tw_re == NULL) {
+		nrf905_chan_destroy(c);
+		errno = ENOMEM;
+		return -1;
+	}
+	c->tw_im = &c->tw_re[M];
+	c->acc_re = &c->tw_re[2 * M];
+	c->acc_im = &c->tw_re[3 * M];
+	c->branch_re = &c->tw_re[4 * M];
+	c->branch_im = &c->tw_re[5 * M];
+	c->fft_re = &c->tw_re[6 * M];
+	c->fft_im = &c->tw_re[7 * M];
+
+	// Hamming windowed sinc, reversed. It's symmetric apart from the
+	// half sample offset of an even length.
+	fc = (double) NRF905_CHAN_CUTOFF / samp_rate;
+	sum = 0;
+	for (k=0; k < c->tap_cnt; k++) {
+		x = k - (c->tap_cnt - 1) / 2.0;
+		c->taps[k] = sin(2 * M_PI * fc * x) / (M_PI * x);
+		c->taps[k] *= 0.54 - 0.46 * cos(2 * M_PI * k / (c->tap_cnt - 1));
+		sum += c->taps[k];
+	}
+	for (k=0; k < c->tap_cnt; k++) {
+		c->taps[k] /= sum;
+	}
+
+	// History starts with zeros
+	memset(c->hist_i, 0, (c->tap_cnt - 1) * sizeof(float));
+	memset(c->hist_q, 0, (c->tap_cnt - 1) * sizeof(float));
+	c->hist_len = c->tap_cnt - 1;
+
+	for (k=0; k < M; k++) {
+		c->tw_re[k] = cos(2 * M_PI * k / M);
+		c->tw_im[k] = sin(2 * M_PI * k / M);
+	}
+
+	k = 0;
+	n = M;
+	for (f=2; n > 1; f++) {
+		while (n % f == 0) {
+			c->factors[k++] = f;
+			n /= f;
+		}
+	}
+	c->factors[k] = 1;
+
+	return 0;
+}
+
+void nrf905_chan_destroy(nrf905_chan_t *c)
+{
+	free(c->taps);
+	free(c->hist_i);
+	free(c->hist_q);
+	free(c->tw_re);
+	c->taps = NULL;
+	c->hist_i = NULL;
+	c->hist_q = NULL;
+	c->tw_re = NULL;
+}
+
+size_t nrf905_chan_max_out(const nrf905_chan_t *c, size_t n)
+{
+	return n / c->decim + 1;
+}
+
+size_t nrf905_chan_push(nrf905_chan_t *c, const float *i, const float *q,
+			size_t n, float * const *out_i, float * const *out_q)
+{
+	const unsigned int keep = c->tap_cnt - 1;
+	size_t cnt = 0;
+	size_t m, j;
+
+	while (n > 0) {
+		m = (n < NRF905_CHAN_BLOCK) ? n : NRF905_CHAN_BLOCK;
+		memcpy(&c->hist_i[c->hist_len], i, m * sizeof(float));
+		memcpy(&c->hist_q[c->hist_len], q, m * sizeof(float));
+
+		// Outputs at input offsets that are a multiple of decim
+		j = (c->decim - c->pos % c->decim) % c->decim;
+		for (; j < m; j += c->decim) {
+			_nrf905_chan_output(c, c->hist_len + j,
+				(c->pos + j) % c->chan_cnt, out_i, out_q,
+				cnt++);
+		}
+
+		memmove(c->hist_i, &c->hist_i[c->hist_len + m - keep],
+			keep * sizeof(float));
+		memmove(c->hist_q, &c->hist_q[c->hist_len + m - keep],
+			keep * sizeof(float));
+		c->pos += m;
+		i += m;
+		q += m;
+		n -= m;
+	}
+
+	return cnt;
+}
+
+int nrf905_chan_offset(const nrf905_chan_t *c, unsigned int k)
+{
+	return (k < c->chan_cnt / 2) ? (int) k : (int) k - (int) c->chan_cnt;
+}
@@ -0,0 +1,141 @@
+/**
+ * nrf905_chan.h - Polyphase filter bank channelizer
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_CHAN_H__
+#define __NRF905_CHAN_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Channelizer limits
+ *
+ * The channel outputs are decimated to at least NRF905_CHAN_MIN_RATE, the
+ * channel filter passes the +-150 kHz the nRF905 signal occupies.
+ */
+#define NRF905_CHAN_MAX_CHANNELS (128)
+#define NRF905_CHAN_TAPS_PER_BRANCH (12)
+#define NRF905_CHAN_MIN_RATE (400000)
+#define NRF905_CHAN_CUTOFF (150000)
+
+/**
+ * Amount of input samples processed per step
+ */
+#define NRF905_CHAN_BLOCK (4096)
+
+/**
+ * Channelizer
+ *
+ * Splits a wideband IQ stream in chan_cnt channels of equal spacing, with a
+ * polyphase filter bank and an FFT. Channel k is centered at k * spacing,
+ * channels from chan_cnt / 2 on are the negative frequencies. The channels
+ * are decimated by decim, which divides chan_cnt, so the filter bank is
+ * oversampled by chan_cnt / decim.
+ */
+typedef struct {
+	unsigned int chan_cnt;
+	unsigned int decim;
+	unsigned int out_rate;		// Channel sample rate
+
+	// Prototype low-pass filter, reversed
+	float *taps;
+	unsigned int tap_cnt;
+
+	// Input history, tap_cnt - 1 samples followed by the current block
+	float *hist_i;
+	float *hist_q;
+	unsigned int hist_len;
+	uint64_t pos;			// Input offset of next sample
+
+	// FFT
+	unsigned int factors[16];	// Prime factors of chan_cnt, then 1
+	float *tw_re;			// exp(2 pi j k / chan_cnt)
+	float *tw_im;
+	float *acc_re;			// Filter bank outputs
+	float *acc_im;
+	float *branch_re;		// ... rotated to the output phase
+	float *branch_im;
+	float *fft_re;
+	float *fft_im;
+} nrf905_chan_t;
+
+/**
+ * Initialize channelizer
+ *
+ * @param c		Channelizer object to initialize
+ * @param samp_rate	Input sample rate
+ * @param spacing	Channel spacing in Hz, must divide samp_rate
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if the spacing
+ *		doesn't give 2 to NRF905_CHAN_MAX_CHANNELS channels, or to
+ *		ENOMEM.
+ */
+int nrf905_chan_init(nrf905_chan_t *c, unsigned int samp_rate,
+			unsigned int spacing);
+
+/**
+ * Free resources of channelizer
+ */
+void nrf905_chan_destroy(nrf905_chan_t *c);
+
+/**
+ * Max. amount of outputs per channel of one nrf905_chan_push() call
+ */
+size_t nrf905_chan_max_out(const nrf905_chan_t *c, size_t n);
+
+/**
+ * Channelize samples
+ *
+ * @param c	Channelizer object
+ * @param i	In-phase samples
+ * @param q	Quadrature samples
+ * @param n	Amount of samples
+ * @param out_i	Per channel array to return in-phase samples in, with room
+ *		for nrf905_chan_max_out() samples
+ * @param out_q	Per channel array to return quadrature samples in
+ *
+ * @returns	Amount of samples returned per channel
+ */
+size_t nrf905_chan_push(nrf905_chan_t *c, const float *i, const float *q,
+			size_t n, float * const *out_i, float * const *out_q);
+
+/**
+ * Frequency offset of channel in spacing units, from -chan_cnt / 2
+ */
+int nrf905_chan_offset(const nrf905_chan_t *c, unsigned int k);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_CHAN_H__
@@ -0,0 +1,253 @@
+/**
+ * nrf905_chan_bench.c - Benchmark channelizing and decoding wideband IQ
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nrf905_decoder.h"
+#include "nrf905_gfsk.h"
+#include "nrf905_gen.h"
+#include "nrf905_chan.h"
+#include "nrf905_bench_util.h"
+
+#define FRAME_CNT (300)
+#define FRAME_LEN (4 + 32 + 2)
+#define MAX_TX (16)
+#define TX_SPACING (3)		// Channels between transmitters
+#define PUSH_SIZE (65536)
+
+struct transmitter {
+	int chan;			// Channel offset
+	uint8_t frames[FRAME_CNT][FRAME_LEN];
+	unsigned int frame_cnt;
+	unsigned int next;		// Next sent frame to look for
+	unsigned long ok;
+};
+
+struct capture {
+	float *i;
+	float *q;
+	size_t len;
+	struct transmitter tx[MAX_TX];
+	unsigned int tx_cnt;
+};
+
+static void frame_sent(nrf905_gen_t *g, const uint8_t *data,
+			unsigned int len, uint64_t offset)
+{
+	struct transmitter *tx = g->priv;
+
+	memcpy(tx->frames[tx->frame_cnt++], data, FRAME_LEN);
+}
+
+/**
+ * Generate capture with a transmitter on every TX_SPACING'th channel
+ *
+ * The transmitters are generated one after the other and summed, every one
+ * with its own seed.
+ */
+static void gen_capture(struct capture *cap, unsigned int samp_rate,
+			unsigned int spacing)
+{
+	static nrf905_gen_t gen;
+	static uint8_t buf[PUSH_SIZE];
+	static float in_i[PUSH_SIZE / 4];
+	static float in_q[PUSH_SIZE / 4];
+	nrf905_gen_config_t cfg;
+	struct transmitter *tx;
+	int max_chan = samp_rate / spacing / 2 - 1;
+	size_t size = 0;
+	size_t pos, n, k;
+	int chan;
+
+	free(cap->i);
+	free(cap->q);
+	memset(cap, 0, sizeof(*cap));
+
+	for (chan = -max_chan / TX_SPACING * TX_SPACING; chan <= max_chan &&
+			cap->tx_cnt < MAX_TX; chan += TX_SPACING) {
+		tx = &cap->tx[cap->tx_cnt++];
+		tx->chan = chan;
+
+		nrf905_gen_config_init(&cfg);
+		cfg.format = NRF905_GEN_CS16;
+		cfg.samp_rate = samp_rate;
+		cfg.seed = cap->tx_cnt;
+		cfg.frame_cnt = FRAME_CNT;
+		cfg.snr_db = 30;
+		cfg.freq_offset = (double) chan * spacing;
+		if (nrf905_gen_init(&gen, &cfg, frame_sent, tx) != 0) {
+			perror("nrf905_gen_init");
+			exit(EXIT_FAILURE);
+		}
+
+		pos = 0;
+		while ((n = nrf905_gen_read(&gen, buf, sizeof(buf)) / 4) > 0) {
+			if (pos + n > size) {
+				size = size ? 2 * size : 4 * 1024 * 1024;
+				cap->i = realloc(cap->i, size * sizeof(float));
+				cap->q = realloc(cap->q, size * sizeof(float));
+				if (cap->i == NULL || cap->q == NULL) {
+					fprintf(stderr, "Out of memory\n");
+					exit(EXIT_FAILURE);
+				}
+				memset(&cap->i[cap->len], 0,
+					(size - cap->len) * sizeof(float));
+				memset(&cap->q[cap->len], 0,
+					(size - cap->len) * sizeof(float));
+			}
+			nrf905_gfsk_convert(NRF905_GFSK_CS16, buf, n, in_i, in_q);
+			for (k=0; k < n; k++) {
+				cap->i[pos + k] += in_i[k];
+				cap->q[pos + k] += in_q[k];
+			}
+			pos += n;
+			if (pos > cap->len) {
+				cap->len = pos;
+			}
+		}
+	}
+}
+
+/**
+ * Count decoded frames that were sent, frames are decoded in order
+ */
+static void check_frame(nrf905_decoder_t *d, const nrf905_decoder_frame_t *f)
+{
+	struct transmitter *tx = d->priv;
+	unsigned int i;
+
+	if (tx == NULL || !f->crc16_ok || f->len < FRAME_LEN) {
+		return;
+	}
+	for (i=tx->next; i < tx->frame_cnt && i < tx->next + 16; i++) {
+		if (memcmp(f->data, tx->frames[i], FRAME_LEN) == 0) {
+			tx->ok++;
+			tx->next = i + 1;
+			break;
+		}
+	}
+}
+
+static void run(unsigned int samp_rate, unsigned int spacing)
+{
+	static struct capture cap;
+	static nrf905_gfsk_t g;
+	nrf905_chan_t c;
+	nrf905_decoder_t d;
+	float *out_i[NRF905_CHAN_MAX_CHANNELS];
+	float *out_q[NRF905_CHAN_MAX_CHANNELS];
+	float *pi[NRF905_CHAN_MAX_CHANNELS];
+	float *pq[NRF905_CHAN_MAX_CHANNELS];
+	struct transmitter *tx;
+	size_t out_cnt = 0;
+	size_t pos, n;
+	unsigned long sent = 0, ok = 0;
+	unsigned int k, t;
+	double start, t_chan, t_demod, duration;
+
+	gen_capture(&cap, samp_rate, spacing);
+	duration = (double) cap.len / samp_rate;
+
+	if (nrf905_chan_init(&c, samp_rate, spacing) != 0) {
+		perror("nrf905_chan_init");
+		exit(EXIT_FAILURE);
+	}
+	for (k=0; k < c.chan_cnt; k++) {
+		out_i[k] = malloc(nrf905_chan_max_out(&c, cap.len) * sizeof(float));
+		out_q[k] = malloc(nrf905_chan_max_out(&c, cap.len) * sizeof(float));
+		if (out_i[k] == NULL || out_q[k] == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	start = nrf905_bench_now();
+	for (pos=0; pos < cap.len; pos += n) {
+		n = (cap.len - pos < PUSH_SIZE) ? cap.len - pos : PUSH_SIZE;
+		for (k=0; k < c.chan_cnt; k++) {
+			pi[k] = &out_i[k][out_cnt];
+			pq[k] = &out_q[k][out_cnt];
+		}
+		out_cnt += nrf905_chan_push(&c, &cap.i[pos], &cap.q[pos], n,
+				pi, pq);
+	}
+	t_chan = nrf905_bench_now() - start;
+
+	// Demodulate every channel, the ones without transmitter too
+	start = nrf905_bench_now();
+	for (k=0; k < c.chan_cnt; k++) {
+		tx = NULL;
+		for (t=0; t < cap.tx_cnt; t++) {
+			if (cap.tx[t].chan == nrf905_chan_offset(&c, k)) {
+				tx = &cap.tx[t];
+			}
+		}
+		nrf905_decoder_init(&d, check_frame, tx);
+		if (nrf905_gfsk_init(&g, NRF905_GFSK_CS16, c.out_rate, &d) != 0) {
+			perror("nrf905_gfsk_init");
+			exit(EXIT_FAILURE);
+		}
+		nrf905_gfsk_push_float(&g, out_i[k], out_q[k], out_cnt);
+	}
+	t_demod = nrf905_bench_now() - start;
+
+	for (t=0; t < cap.tx_cnt; t++) {
+		sent += cap.tx[t].frame_cnt;
+		ok += cap.tx[t].ok;
+	}
+
+	printf("%4.1f Msps, %3u kHz spacing, %3u channels at %3u ksps, %2u transmitters: %5.1f%% frames ok\n",
+		samp_rate / 1e6, spacing / 1000, c.chan_cnt, c.out_rate / 1000,
+		cap.tx_cnt, 100.0 * ok / sent);
+	printf("    channelizer %6.1f Msamples/s, %5.1fx real time\n",
+		cap.len / t_chan / 1e6, duration / t_chan);
+	printf("    demodulator %6.1f Msamples/s, %5.1f channels real time\n",
+		c.chan_cnt * out_cnt / t_demod / 1e6,
+		c.chan_cnt * duration / t_demod);
+	printf("    total       %5.1f channels per core real time\n",
+		c.chan_cnt * duration / (t_chan + t_demod));
+
+	for (k=0; k < c.chan_cnt; k++) {
+		free(out_i[k]);
+		free(out_q[k]);
+	}
+	nrf905_chan_destroy(&c);
+}
+
+int main(int argc, char *argv[])
+{
+	run(2400000, 100000);
+	run(2400000, 200000);
+	run(2000000, 100000);
+	run(3200000, 100000);
+
+	return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * nrf905_crc_bench.c - CRC throughput compared to lib_crc
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "nrf905_crc.h"
+#include "lib_crc.h"
+#include "nrf905_bench_util.h"
+
+#define BUF_SIZE (1024 * 1024)
+#define BYTES_PER_RUN (256 * 1024 * 1024)
+
+typedef unsigned int (*crc_fn_t)(unsigned int crc, const uint8_t *p,
+				size_t len);
+
+static unsigned int lib_crc_ccitt(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	while (len--) {
+		crc = update_crc_ccitt(crc, *p++);
+	}
+	return crc;
+}
+
+static unsigned int crc16_bytewise(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	while (len--) {
+		crc = nrf905_crc16_update(crc, *p++);
+	}
+	return crc;
+}
+
+static unsigned int crc16_slice4(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	return nrf905_crc16_update_slice4(crc, p, len);
+}
+
+static unsigned int crc16_slice8(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	return nrf905_crc16_update_slice8(crc, p, len);
+}
+
+static unsigned int crc16_clmul(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	return nrf905_crc16_update_clmul(crc, p, len);
+}
+
+static unsigned int crc16_buf(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	return nrf905_crc16_update_buf(crc, p, len);
+}
+
+static unsigned int crc8_bytewise(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	while (len--) {
+		crc = nrf905_crc8_update(crc, *p++);
+	}
+	return crc;
+}
+
+static unsigned int crc8_slice4(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	return nrf905_crc8_update_slice4(crc, p, len);
+}
+
+static unsigned int crc8_slice8(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	return nrf905_crc8_update_slice8(crc, p, len);
+}
+
+static unsigned int crc8_clmul(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	return nrf905_crc8_update_clmul(crc, p, len);
+}
+
+static unsigned int crc8_buf(unsigned int crc, const uint8_t *p,
+				size_t len)
+{
+	return nrf905_crc8_update_buf(crc, p, len);
+}
+
+static const struct {
+	const char *name;
+	crc_fn_t fn;
+	unsigned int init;
+} impls[] = {
+	{ "lib_crc ccitt",	lib_crc_ccitt,	0xffff },
+	{ "crc16 bytewise",	crc16_bytewise,	NRF905_CRC16_INIT },
+	{ "crc16 slice4",	crc16_slice4,	NRF905_CRC16_INIT },
+	{ "crc16 slice8",	crc16_slice8,	NRF905_CRC16_INIT },
+	{ "crc16 clmul",	crc16_clmul,	NRF905_CRC16_INIT },
+	{ "crc16 buf",		crc16_buf,	NRF905_CRC16_INIT },
+	{ "crc8 bytewise",	crc8_bytewise,	NRF905_CRC8_INIT },
+	{ "crc8 slice4",	crc8_slice4,	NRF905_CRC8_INIT },
+	{ "crc8 slice8",	crc8_slice8,	NRF905_CRC8_INIT },
+	{ "crc8 clmul",		crc8_clmul,	NRF905_CRC8_INIT },
+	{ "crc8 buf",		crc8_buf,	NRF905_CRC8_INIT },
+};
+
+int main(int argc, char *argv[])
+{
+	// Frame lengths: 4 address, 32 payload and 2 CRC bytes
+	static const size_t lens[] = { 38, 256, 4096, BUF_SIZE };
+	uint8_t *buf;
+	unsigned int i, j;
+	unsigned int crc;
+	unsigned int ref;
+	size_t off, runs, r;
+	double start, elapsed;
+
+	buf = malloc(BUF_SIZE);
+	if (buf == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	srand(1);
+	for (off=0; off < BUF_SIZE; off++) {
+		buf[off] = rand();
+	}
+
+	printf("clmul %ssupported\n", nrf905_crc_clmul_supported() ? "" : "not ");
+	for (j=0; j < sizeof(lens) / sizeof(lens[0]); j++) {
+		runs = BYTES_PER_RUN / lens[j];
+		ref = 0;
+		for (i=0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+			crc = impls[i].init;
+			off = 0;
+			start = nrf905_bench_now();
+			for (r=0; r < runs; r++) {
+				crc = impls[i].fn(crc, &buf[off], lens[j]);
+				off += lens[j];
+				if (off + lens[j] > BUF_SIZE) {
+					off = 0;
+				}
+			}
+			elapsed = nrf905_bench_now() - start;
+
+			// All CRC-16 implementations, and all CRC-8 ones,
+			// must agree
+			if (impls[i].fn == lib_crc_ccitt ||
+			    impls[i].fn == crc8_bytewise) {
+				ref = crc;
+			}
+			printf("%7zu bytes %-16s %9.1f MB/s%s\n", lens[j],
+				impls[i].name, runs * lens[j] / elapsed / 1e6,
+				(crc == ref) ? "" : " MISMATCH");
+		}
+	}
+
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,528 @@
+/**
+ * nrf905_decoder.c - Streaming NRF905 frame decoder
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "nrf905_decoder.h"
+#include "nrf905_crc.h"
+#include "nrf905_fec.h"
+
+static const uint32_t PREAMBLE_ENCODED = 0xAAA66; // apparantly bits are inverted...
+static const uint16_t PREAMBLE = 0x3F5;
+
+/**
+ * Manchester decoding tables
+ *
+ * Map 8 samples, 4 symbols, to the 4 data bits in the high nibble and a mask
+ * of symbols with an encoding error in the low nibble. The first symbol is
+ * in the MSB of both nibbles. The msb table is indexed with the first sample
+ * in the MSB, as in packed captures, the lsb table with the first sample in
+ * the LSB.
+ */
+#define _SYM(i, first, second) \
+	((!(((i) >> (first)) & 1) << 4) | \
+	 ((((i) >> (first)) & 1) == (((i) >> (second)) & 1)))
+#define _MSB(i) ((_SYM(i, 7, 6) << 3) | (_SYM(i, 5, 4) << 2) | \
+		 (_SYM(i, 3, 2) << 1) | _SYM(i, 1, 0))
+#define _LSB(i) ((_SYM(i, 0, 1) << 3) | (_SYM(i, 2, 3) << 2) | \
+		 (_SYM(i, 4, 5) << 1) | _SYM(i, 6, 7))
+#define _T4(f, i) f(i), f(i + 1), f(i + 2), f(i + 3)
+#define _T16(f, i) _T4(f, i), _T4(f, i + 4), _T4(f, i + 8), _T4(f, i + 12)
+#define _T64(f, i) _T16(f, i), _T16(f, i + 16), _T16(f, i + 32), _T16(f, i + 48)
+#define _T256(f) _T64(f, 0), _T64(f, 64), _T64(f, 128), _T64(f, 192)
+
+static const uint8_t manchester_lut_msb[256] = { _T256(_MSB) };
+static const uint8_t manchester_lut_lsb[256] = { _T256(_LSB) };
+
+static void _nrf905_decoder_clear_frame(nrf905_decoder_t *d, uint64_t offset)
+{
+	memset(&d->frame, 0, sizeof(d->frame));
+	d->frame.offset = offset;
+}
+
+static void _nrf905_decoder_sync(nrf905_decoder_t *d, uint64_t offset)
+{
+	// Preamble detected
+	_nrf905_decoder_clear_frame(d, offset);
+	d->in_sync = 1;
+}
+
+static void _nrf905_decoder_finish(nrf905_decoder_t *d)
+{
+	nrf905_decoder_frame_state_t *frame = &d->frame;
+	nrf905_decoder_frame_t f;
+	uint8_t fixed[NRF905_MAX_FRAME_LEN];
+	unsigned int len;
+	int ret;
+
+	if (frame->byte_cnt == 0)
+		return;
+
+	f.data = frame->data;
+	f.len = frame->byte_cnt;
+	f.offset = frame->offset;
+	f.encoding_errors = frame->encoding_errors;
+
+	// Check CRC-8
+	f.crc8_ok = (frame->byte_cnt >= 3 &&
+			nrf905_crc8(frame->data, frame->byte_cnt) == 0);
+	// Check CRC-16
+	f.crc16_ok = (frame->byte_cnt >= 4 &&
+			nrf905_crc16(frame->data, frame->byte_cnt) == 0);
+	f.corrected = 0;
+
+	// Correct bit errors
+	len = d->fec_len ? d->fec_len : (unsigned int) frame->byte_cnt;
+	if (d->fec != NULL && len <= (unsigned int) frame->byte_cnt &&
+	    !(d->fec_crc_bits == 16 ? f.crc16_ok : f.crc8_ok)) {
+		memcpy(fixed, frame->data, len);
+		ret = nrf905_fec_correct(d->fec, d->fec_crc_bits, fixed, len,
+				frame->suspects, frame->suspect_cnt,
+				d->fec_max_blind);
+		if (ret >= 0) {
+			f.data = fixed;
+			f.len = len;
+			f.crc8_ok = (d->fec_crc_bits == 8);
+			f.crc16_ok = (d->fec_crc_bits == 16);
+			f.corrected = ret;
+		}
+	}
+
+	d->cb(d, &f);
+}
+
+/**
+ * Remember position of a bit with a Manchester encoding error
+ */
+static void _nrf905_decoder_suspect(nrf905_decoder_frame_state_t *frame,
+					int bit)
+{
+	if (frame->suspect_cnt < NRF905_DECODER_MAX_SUSPECTS) {
+		frame->suspects[frame->suspect_cnt++] =
+			frame->byte_cnt * 8 + frame->bit_cnt % 8 + bit;
+	}
+}
+
+/**
+ * Mark the symbols of a byte set in mask as suspect, first symbol in the MSB
+ */
+static void _nrf905_decoder_suspects(nrf905_decoder_frame_state_t *frame,
+					uint8_t mask)
+{
+	int k;
+
+	for (k=0; mask != 0 && k < 8; k++) {
+		if (mask & (0x80 >> k)) {
+			_nrf905_decoder_suspect(frame, k);
+		}
+	}
+}
+
+/**
+ * Add decoded bit to frame
+ *
+ * @param d	Decoder object
+ * @param bit	Data bit
+ * @param end	Offset of the sample following the bit's symbol
+ */
+static void _nrf905_decoder_push_bit(nrf905_decoder_t *d, int bit,
+					uint64_t end)
+{
+	nrf905_decoder_frame_state_t *frame = &d->frame;
+
+	frame->byte_val = (frame->byte_val << 1) | bit;
+	frame->bit_cnt++;
+	if ((frame->bit_cnt % 8) == 2 && frame->byte_cnt > 1) {
+		if (frame->data[frame->byte_cnt-1] == (PREAMBLE >> 2) &&
+		    (frame->byte_val & 0x3) == (PREAMBLE & 0x3))
+		{
+			// Preamble detected in frame, possibly auto-retransmit mode
+			frame->byte_cnt--;
+			_nrf905_decoder_finish(d);
+			_nrf905_decoder_clear_frame(d, end);
+		}
+	}
+	if ((frame->bit_cnt % 8) == 0) {
+		frame->data[frame->byte_cnt++] = frame->byte_val;
+		if (frame->byte_cnt == NRF905_MAX_FRAME_LEN) {
+			// Frame at max. length
+			_nrf905_decoder_finish(d);
+			d->in_sync = 0;
+		}
+	}
+}
+
+/**
+ * Decode sample at d->pos
+ */
+static void _nrf905_decoder_sample(nrf905_decoder_t *d, int sample)
+{
+	nrf905_decoder_frame_state_t *frame = &d->frame;
+
+	if (!d->in_sync) {
+		d->preamble = ((d->preamble << 1) & 0xFFFFF) | (sample ? 0 : 1);
+		if (d->preamble == PREAMBLE_ENCODED) {
+			_nrf905_decoder_sync(d, d->pos + 1);
+		}
+	} else {
+		if ((frame->sample_cnt++ & 1) == 0) {
+			frame->prev_sample = sample;
+		} else {
+			if (sample == frame->prev_sample) {
+				// Manchester decoding error
+				if (++frame->encoding_errors > d->max_encoding_errors) {
+					_nrf905_decoder_finish(d);
+					d->in_sync = 0;
+					return;
+				}
+				_nrf905_decoder_suspect(frame, 0);
+			}
+
+			_nrf905_decoder_push_bit(d, frame->prev_sample ? 0 : 1,
+						d->pos + 1);
+		}
+	}
+}
+
+/**
+ * Decode a whole Manchester symbol, only when in sync at a symbol boundary
+ */
+static void _nrf905_decoder_pair(nrf905_decoder_t *d, int first, int second)
+{
+	nrf905_decoder_frame_state_t *frame = &d->frame;
+
+	frame->sample_cnt += 2;
+	if (first == second) {
+		// Manchester decoding error
+		if (++frame->encoding_errors > d->max_encoding_errors) {
+			_nrf905_decoder_finish(d);
+			d->in_sync = 0;
+			return;
+		}
+		_nrf905_decoder_suspect(frame, 0);
+	}
+
+	_nrf905_decoder_push_bit(d, !first, d->pos + 2);
+}
+
+/**
+ * Decode a whole byte, only when in sync at a byte boundary
+ *
+ * Equivalent to decoding its 16 samples one at a time: the in-frame preamble
+ * check, which is done after the second bit, and the encoding error limit
+ * can end the byte early.
+ *
+ * @param d	Decoder object
+ * @param hi	Table entry of the first 8 samples
+ * @param lo	Table entry of the last 8 samples
+ *
+ * @returns	Amount of samples consumed
+ */
+static int _nrf905_decoder_byte(nrf905_decoder_t *d, uint8_t hi, uint8_t lo)
+{
+	nrf905_decoder_frame_state_t *frame = &d->frame;
+	uint8_t val = (hi & 0xf0) | (lo >> 4);
+	uint8_t err = (hi << 4) | (lo & 0x0f);
+	int errors = frame->encoding_errors;
+	int end = 8;	// Symbol exceeding the error limit
+	int k;
+
+	for (k=0; err != 0 && k < 8; k++) {
+		if ((err & (0x80 >> k)) && ++errors > d->max_encoding_errors) {
+			end = k;
+			break;
+		}
+	}
+
+	if (end >= 2 && frame->byte_cnt > 1 &&
+	    frame->data[frame->byte_cnt-1] == (PREAMBLE >> 2) &&
+	    (val >> 6) == (PREAMBLE & 0x3))
+	{
+		// Preamble detected in frame, possibly auto-retransmit mode.
+		// Only the first 2 symbols are decoded by then.
+		_nrf905_decoder_suspects(frame, err & 0xc0);
+		frame->encoding_errors += __builtin_popcount(err & 0xc0);
+		frame->byte_cnt--;
+		_nrf905_decoder_finish(d);
+		_nrf905_decoder_clear_frame(d, d->pos + 4);
+		// The cleared bit count stores a byte, as in push_bit()
+		frame->data[frame->byte_cnt++] = 0;
+		return 4;
+	}
+
+	if (end < 8) {
+		// Manchester decoding error, the frame ends with the count
+		// including the symbol that exceeded the limit
+		_nrf905_decoder_suspects(frame, err & ~(0xff >> end));
+		frame->encoding_errors = errors;
+		_nrf905_decoder_finish(d);
+		d->in_sync = 0;
+		return 2 * (end + 1);
+	}
+
+	_nrf905_decoder_suspects(frame, err);
+	frame->encoding_errors = errors;
+	frame->sample_cnt += 16;
+	frame->bit_cnt += 8;
+	frame->byte_val = val;
+	frame->data[frame->byte_cnt++] = val;
+	if (frame->byte_cnt == NRF905_MAX_FRAME_LEN) {
+		// Frame at max. length
+		_nrf905_decoder_finish(d);
+		d->in_sync = 0;
+	}
+
+	return 16;
+}
+
+/**
+ * Search preamble in up to 64 samples at once
+ *
+ * inv holds inverted samples, first sample in the MSB, of which the top nbits
+ * are valid. All sample positions are compared with the 20 preamble bits in
+ * parallel: for every preamble bit the stream is shifted by its distance to
+ * the end of the preamble, with the preamble register shifted in from the
+ * left, and compared to the expected value. Lane j of the resulting mask is
+ * set if the 20 samples ending at sample j are a preamble.
+ *
+ * @returns	Amount of samples consumed. If a preamble is found, up to and
+ *		including it, and the decoder is synced.
+ */
+static int _nrf905_decoder_search(nrf905_decoder_t *d, uint64_t inv,
+					int nbits)
+{
+	uint64_t prev = d->preamble;
+	uint64_t match;
+	uint64_t s;
+	int k;
+
+	match = ~(uint64_t) 0;
+	if (nbits < 64) {
+		match = ~(match >> nbits);
+	}
+	for (k=0; k < 20; k++) {
+		s = (k == 0) ? inv : (inv >> k) | (prev << (64 - k));
+		if ((PREAMBLE_ENCODED >> k) & 1) {
+			match &= s;
+		} else {
+			match &= ~s;
+		}
+	}
+
+	if (match == 0) {
+		if (nbits < 64) {
+			inv = (inv >> (64 - nbits)) | (prev << nbits);
+		}
+		d->preamble = inv & 0xFFFFF;
+		return nbits;
+	}
+
+	k = __builtin_clzll(match) + 1;
+	d->preamble = PREAMBLE_ENCODED;
+	_nrf905_decoder_sync(d, d->pos + k);
+
+	return k;
+}
+
+/**
+ * Get 64 unpacked samples as inverted bits, first sample in the MSB
+ */
+static uint64_t _nrf905_decoder_inv_word(const uint8_t *buf)
+{
+	uint64_t m = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v;
+	int i;
+
+	// Byte compares give the first sample in the LSB
+	for (i=0; i < 4; i++) {
+		v = _mm_loadu_si128((const __m128i *) &buf[i * 16]);
+		m |= (uint64_t) (uint16_t) _mm_movemask_epi8(
+				_mm_cmpeq_epi8(v, zero)) << (i * 16);
+	}
+	m = ((m >> 1) & 0x5555555555555555ULL) |
+		((m & 0x5555555555555555ULL) << 1);
+	m = ((m >> 2) & 0x3333333333333333ULL) |
+		((m & 0x3333333333333333ULL) << 2);
+	m = ((m >> 4) & 0x0F0F0F0F0F0F0F0FULL) |
+		((m & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	m = __builtin_bswap64(m);
+#else
+	int i;
+
+	for (i=0; i < 64; i++) {
+		m = (m << 1) | (buf[i] == 0);
+	}
+#endif
+	return m;
+}
+
+/**
+ * Get table entries for 16 unpacked samples
+ *
+ * @returns	0 on success, -1 if a sample isn't 0 or 1. Other values
+ *		compare differently than they decode, so need to be decoded
+ *		one at a time.
+ */
+static int _nrf905_decoder_lut(const uint8_t *buf, uint8_t *hi, uint8_t *lo)
+{
+	unsigned int m;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v;
+
+	v = _mm_loadu_si128((const __m128i *) buf);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v,
+				_mm_set1_epi8(0xfe)), zero)) != 0xffff) {
+		return -1;
+	}
+	// Move the sample bit to the byte's sign, first sample in the LSB
+	m = _mm_movemask_epi8(_mm_slli_epi64(v, 7));
+#else
+	int i;
+
+	m = 0;
+	for (i=0; i < 16; i++) {
+		if (buf[i] > 1) {
+			return -1;
+		}
+		m |= buf[i] << i;
+	}
+#endif
+	*hi = manchester_lut_lsb[m & 0xff];
+	*lo = manchester_lut_lsb[m >> 8];
+	return 0;
+}
+
+void nrf905_decoder_init(nrf905_decoder_t *d, nrf905_decoder_cb_t cb,
+			void *priv)
+{
+	memset(d, 0, sizeof(*d));
+	d->max_encoding_errors = NRF905_DECODER_MAX_ENCODING_ERRORS;
+	d->fec_crc_bits = 16;
+	d->fec_max_blind = NRF905_DECODER_FEC_MAX_BLIND;
+	d->cb = cb;
+	d->priv = priv;
+}
+
+void nrf905_decoder_push(nrf905_decoder_t *d, const uint8_t *samples,
+			size_t n)
+{
+	size_t i = 0;
+	uint8_t hi, lo;
+	int step;
+
+	while (i < n) {
+		if (d->per_sample) {
+			_nrf905_decoder_sample(d, samples[i]);
+			step = 1;
+		} else if (!d->in_sync) {
+			if (n - i >= 64) {
+				step = _nrf905_decoder_search(d,
+					_nrf905_decoder_inv_word(&samples[i]), 64);
+			} else {
+				_nrf905_decoder_sample(d, samples[i]);
+				step = 1;
+			}
+		} else if ((d->frame.sample_cnt & 15) == 0 && n - i >= 16 &&
+				_nrf905_decoder_lut(&samples[i], &hi, &lo) == 0) {
+			step = _nrf905_decoder_byte(d, hi, lo);
+		} else {
+			_nrf905_decoder_sample(d, samples[i]);
+			step = 1;
+		}
+		i += step;
+		d->pos += step;
+	}
+}
+
+void nrf905_decoder_push_packed(nrf905_decoder_t *d, const uint8_t *buf,
+			size_t len)
+{
+	uint64_t w = 0;
+	int nbits = 0;
+	int n;
+	size_t i = 0;
+
+	while (true) {
+		// Keep up to 64 samples in w, first sample in the MSB
+		while (nbits <= 56 && i < len) {
+			w |= (uint64_t) buf[i++] << (56 - nbits);
+			nbits += 8;
+		}
+		if (nbits == 0) {
+			break;
+		}
+
+		if (!d->in_sync && !d->per_sample) {
+			n = _nrf905_decoder_search(d, ~w, nbits);
+		} else if ((d->frame.sample_cnt & 15) == 0 && nbits >= 16 &&
+				d->in_sync && !d->per_sample) {
+			n = _nrf905_decoder_byte(d, manchester_lut_msb[w >> 56],
+					manchester_lut_msb[(w >> 48) & 0xff]);
+		} else if ((d->frame.sample_cnt & 1) == 0 && nbits >= 2 &&
+				d->in_sync) {
+			_nrf905_decoder_pair(d, w >> 63, (w >> 62) & 1);
+			n = 2;
+		} else {
+			_nrf905_decoder_sample(d, w >> 63);
+			n = 1;
+		}
+
+		w = (n < 64) ? w << n : 0;
+		nbits -= n;
+		d->pos += n;
+	}
+}
+
+bool nrf905_decoder_same_state(const nrf905_decoder_t *a,
+			const nrf905_decoder_t *b)
+{
+	if (a->in_sync != b->in_sync || a->preamble != b->preamble) {
+		return false;
+	}
+	if (!a->in_sync) {
+		// Frame is cleared on sync
+		return true;
+	}
+
+	return a->frame.prev_sample == b->frame.prev_sample &&
+		a->frame.byte_val == b->frame.byte_val &&
+		a->frame.encoding_errors == b->frame.encoding_errors &&
+		a->frame.sample_cnt == b->frame.sample_cnt &&
+		a->frame.bit_cnt == b->frame.bit_cnt &&
+		a->frame.byte_cnt == b->frame.byte_cnt &&
+		memcmp(a->frame.data, b->frame.data, a->frame.byte_cnt) == 0 &&
+		a->frame.suspect_cnt == b->frame.suspect_cnt &&
+		memcmp(a->frame.suspects, b->frame.suspects,
+			a->frame.suspect_cnt * sizeof(a->frame.suspects[0])) == 0;
+}
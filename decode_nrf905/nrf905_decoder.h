@@ -0,0 +1,178 @@
+/**
+ * nrf905_decoder.h - Streaming NRF905 frame decoder
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_DECODER_H__
+#define __NRF905_DECODER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NRF905_MAX_FRAME_LEN (4+32+2)
+
+/**
+ * Default max. amount of Manchester encoding errors in a frame
+ */
+#define NRF905_DECODER_MAX_ENCODING_ERRORS (0)
+
+/**
+ * Max. amount of Manchester encoding errors whose position is remembered
+ */
+#define NRF905_DECODER_MAX_SUSPECTS (8)
+
+/**
+ * Default max. amount of bits without encoding error the FEC stage corrects
+ */
+#define NRF905_DECODER_FEC_MAX_BLIND (1)
+
+/**
+ * Decoded frame as passed to the frame callback
+ */
+typedef struct {
+	const uint8_t *data;		// Only valid during the callback
+	unsigned int len;
+	uint64_t offset;		// Sample offset of first data sample
+	unsigned int encoding_errors;	// Manchester encoding errors
+	bool crc8_ok;			// At least 3 bytes with a valid CRC-8
+	bool crc16_ok;			// At least 4 bytes with a valid CRC-16
+	unsigned int corrected;		// Bits corrected by the FEC stage
+} nrf905_decoder_frame_t;
+
+struct nrf905_decoder;
+struct nrf905_fec;
+
+typedef void (*nrf905_decoder_cb_t)(struct nrf905_decoder *d,
+			const nrf905_decoder_frame_t *frame);
+
+/**
+ * Frame state
+ */
+typedef struct {
+	int prev_sample;
+	uint8_t byte_val;
+
+	int encoding_errors;
+	int sample_cnt;
+
+	int bit_cnt;
+	int byte_cnt;
+	uint8_t data[NRF905_MAX_FRAME_LEN];
+
+	// Bit indices of Manchester encoding errors
+	uint16_t suspects[NRF905_DECODER_MAX_SUSPECTS];
+	int suspect_cnt;
+
+	uint64_t offset;
+} nrf905_decoder_frame_state_t;
+
+/**
+ * Streaming decoder
+ *
+ * Finds and decodes NRF905 frames in a demodulated GFSK stream, as produced
+ * by nrf905_demod.py. Samples are pushed in buffers of any size, the
+ * decoding state is kept between pushes. Nothing is allocated, so a decoder
+ * can be copied to save its state.
+ *
+ * Frames end on a Manchester encoding error, at max. length or at the
+ * preamble of an auto-retransmitted copy. A frame still open when the stream
+ * ends is not reported.
+ *
+ * If fec is set, frames with an invalid CRC are corrected with
+ * nrf905_fec_correct(). The bits of symbols with a Manchester encoding error
+ * are the suspects, so allow a few encoding errors for it to be useful. If
+ * fec_len is set, frames are cut to that length first, dropping the noise
+ * decoded after the end of the frame. Frames shorter than fec_len aren't
+ * corrected.
+ */
+typedef struct nrf905_decoder {
+	int in_sync;
+	uint32_t preamble;
+	uint64_t pos;			// Offset of next sample
+
+	nrf905_decoder_frame_state_t frame;
+
+	// Settings
+	int max_encoding_errors;
+	bool per_sample;		// Decode one sample at a time
+	const struct nrf905_fec *fec;	// Syndrome tables, NULL to not correct
+	int fec_crc_bits;		// CRC length to correct with, 8 or 16
+	unsigned int fec_len;		// Frame length incl. CRC, 0 if unknown
+	int fec_max_blind;		// Max. corrected bits that aren't suspect
+
+	nrf905_decoder_cb_t cb;
+	void *priv;
+} nrf905_decoder_t;
+
+/**
+ * Initialize decoder
+ *
+ * @param d	Decoder object to initialize
+ * @param cb	Called for every decoded frame
+ * @param priv	Free for use by the caller
+ */
+void nrf905_decoder_init(nrf905_decoder_t *d, nrf905_decoder_cb_t cb,
+			void *priv);
+
+/**
+ * Decode samples
+ *
+ * @param d		Decoder object
+ * @param samples	One byte per sample, 0 for a zero, else a one
+ * @param n		Amount of samples
+ */
+void nrf905_decoder_push(nrf905_decoder_t *d, const uint8_t *samples,
+			size_t n);
+
+/**
+ * Decode packed samples
+ *
+ * @param d	Decoder object
+ * @param buf	8 samples per byte, first sample in the MSB
+ * @param len	Amount of bytes
+ */
+void nrf905_decoder_push_packed(nrf905_decoder_t *d, const uint8_t *buf,
+			size_t len);
+
+/**
+ * Check if two decoders will decode the following samples the same
+ *
+ * Ignores the sample offset, settings and callback.
+ */
+bool nrf905_decoder_same_state(const nrf905_decoder_t *a,
+			const nrf905_decoder_t *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_DECODER_H__
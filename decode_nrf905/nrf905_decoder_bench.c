@@ -0,0 +1,291 @@
+/**
+ * nrf905_decoder_bench.c - Per-sample cost of the streaming decoder
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nrf905_decoder.h"
+#include "nrf905_fec.h"
+#include "nrf905_bench_util.h"
+
+#define DEFAULT_SAMPLES (64 * 1024 * 1024)
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static size_t put_bit(uint8_t *buf, size_t pos, size_t len, int bit)
+{
+	// Manchester encoded and inverted, as received
+	if (pos + 2 <= len) {
+		buf[pos] = !bit;
+		buf[pos + 1] = bit;
+	}
+	return pos + 2;
+}
+
+/**
+ * Fill buffer with noise and frames of random length, half of the time
+ */
+static void gen_samples(uint8_t *buf, size_t len)
+{
+	size_t pos = 0;
+	unsigned int noise;
+	unsigned int frame_len;
+	unsigned int i, j;
+	uint8_t val;
+
+	while (pos < len) {
+		noise = rnd() % 1200;
+		for (i=0; i < noise && pos < len; i++) {
+			buf[pos++] = rnd() & 1;
+		}
+		for (i=0; i < 10; i++) {
+			pos = put_bit(buf, pos, len, (0x3F5 >> (9 - i)) & 1);
+		}
+		frame_len = 6 + rnd() % 33;
+		for (i=0; i < frame_len; i++) {
+			val = rnd();
+			for (j=0; j < 8; j++) {
+				pos = put_bit(buf, pos, len, (val >> (7 - j)) & 1);
+			}
+		}
+	}
+}
+
+static void pack_samples(uint8_t *packed, const uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	memset(packed, 0, len / 8);
+	for (i=0; i < len / 8 * 8; i++) {
+		packed[i / 8] |= buf[i] << (7 - i % 8);
+	}
+}
+
+static void count_frame(nrf905_decoder_t *d, const nrf905_decoder_frame_t *f)
+{
+	(*(unsigned long *) d->priv)++;
+}
+
+struct frame_log {
+	nrf905_decoder_frame_t *frames;
+	uint8_t (*data)[NRF905_MAX_FRAME_LEN];
+	size_t cnt;
+	size_t size;
+};
+
+static void log_frame(nrf905_decoder_t *d, const nrf905_decoder_frame_t *f)
+{
+	struct frame_log *log = d->priv;
+
+	if (log->cnt == log->size) {
+		log->size = log->size ? 2 * log->size : 4096;
+		log->frames = realloc(log->frames,
+				log->size * sizeof(*log->frames));
+		log->data = realloc(log->data, log->size * sizeof(*log->data));
+		if (log->frames == NULL || log->data == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	log->frames[log->cnt] = *f;
+	log->frames[log->cnt].data = NULL;
+	memcpy(log->data[log->cnt], f->data, f->len);
+	log->cnt++;
+}
+
+static void decode_log(struct frame_log *log, const nrf905_decoder_t *settings,
+			const uint8_t *buf, size_t len, size_t push_size,
+			int packed, int per_sample)
+{
+	nrf905_decoder_t d = *settings;
+	size_t i, n;
+
+	log->cnt = 0;
+	d.cb = log_frame;
+	d.priv = log;
+	d.per_sample = per_sample;
+	for (i=0; i < len; i += n) {
+		n = (len - i < push_size) ? len - i : push_size;
+		if (packed) {
+			nrf905_decoder_push_packed(&d, &buf[i], n);
+		} else {
+			nrf905_decoder_push(&d, &buf[i], n);
+		}
+	}
+}
+
+/**
+ * Check that all decoding paths report the same frames as decoding one
+ * sample at a time, compared field by field
+ */
+static void verify(const uint8_t *buf, const uint8_t *packed, size_t len)
+{
+	static const int max_errors[] = { 0, 3, NRF905_DECODER_MAX_ENCODING_ERRORS };
+	static nrf905_fec_t fec;
+	struct frame_log ref = { 0 };
+	struct frame_log log = { 0 };
+	nrf905_decoder_t d;
+	const nrf905_decoder_frame_t *a, *b;
+	unsigned int e, fec_on, p;
+	size_t i;
+
+	nrf905_fec_init(&fec);
+	for (e=0; e < sizeof(max_errors) / sizeof(max_errors[0]); e++) {
+		for (fec_on=0; fec_on < 2; fec_on++) {
+			nrf905_decoder_init(&d, NULL, NULL);
+			d.max_encoding_errors = max_errors[e];
+			d.fec = fec_on ? &fec : NULL;
+
+			decode_log(&ref, &d, buf, len, 65536, 0, 1);
+			for (p=0; p < 2; p++) {
+				if (p) {
+					decode_log(&log, &d, packed, len / 8,
+						8192, 1, 0);
+				} else {
+					decode_log(&log, &d, buf, len, 65536,
+						0, 0);
+				}
+
+				for (i=0; i < ref.cnt && i < log.cnt; i++) {
+					a = &ref.frames[i];
+					b = &log.frames[i];
+					if (a->len != b->len ||
+					    a->offset != b->offset ||
+					    a->encoding_errors != b->encoding_errors ||
+					    a->crc8_ok != b->crc8_ok ||
+					    a->crc16_ok != b->crc16_ok ||
+					    a->corrected != b->corrected ||
+					    memcmp(ref.data[i], log.data[i],
+						    a->len) != 0) {
+						break;
+					}
+				}
+				if (i < ref.cnt || i < log.cnt) {
+					fprintf(stderr, "%s, max. %d errors%s: frame %zu differs from per sample decoding\n",
+						p ? "packed" : "unpacked",
+						max_errors[e],
+						fec_on ? ", FEC" : "", i);
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+	}
+	printf("verify: all paths decode the same frames\n");
+
+	free(ref.frames);
+	free(ref.data);
+	free(log.frames);
+	free(log.data);
+}
+
+static void run(const char *what, const uint8_t *buf, size_t len,
+		size_t push_size, int packed, int per_sample)
+{
+	nrf905_decoder_t d;
+	unsigned long frames = 0;
+	size_t samples = packed ? len * 8 : len;
+	size_t i, n;
+	double start, elapsed;
+
+	nrf905_decoder_init(&d, count_frame, &frames);
+	d.per_sample = per_sample;
+
+	start = nrf905_bench_now();
+	for (i=0; i < len; i += n) {
+		n = len - i;
+		if (n > push_size) {
+			n = push_size;
+		}
+		if (packed) {
+			nrf905_decoder_push_packed(&d, &buf[i], n);
+		} else {
+			nrf905_decoder_push(&d, &buf[i], n);
+		}
+	}
+	elapsed = nrf905_bench_now() - start;
+
+	printf("%-10s push %6zu: %8.3f ns/sample %8.1f Msamples/s %8lu frames\n",
+		what, push_size, elapsed * 1e9 / samples, samples / elapsed / 1e6,
+		frames);
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t push_sizes[] = { 1, 16, 256, 4096, 65536 };
+	size_t len = DEFAULT_SAMPLES;
+	uint8_t *buf;
+	uint8_t *packed;
+	unsigned int i;
+
+	if (argc > 2) {
+		fprintf(stderr, "usage: %s [SAMPLES]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if (argc == 2) {
+		len = strtoul(argv[1], NULL, 0) / 8 * 8;
+		if (len == 0) {
+			fprintf(stderr, "Invalid sample count\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	buf = malloc(len);
+	packed = malloc(len / 8);
+	if (buf == NULL || packed == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	gen_samples(buf, len);
+	pack_samples(packed, buf, len);
+	verify(buf, packed, len);
+
+	// Push size 1 can't use the word and byte paths, packed push size
+	// is in bytes of 8 samples
+	for (i=0; i < sizeof(push_sizes) / sizeof(push_sizes[0]); i++) {
+		run("unpacked", buf, len, push_sizes[i], 0, 0);
+	}
+	run("unpacked/s", buf, len, 65536, 0, 1);
+	for (i=0; i < sizeof(push_sizes) / sizeof(push_sizes[0]); i++) {
+		run("packed", packed, len / 8, push_sizes[i], 1, 0);
+	}
+	run("packed/s", packed, len / 8, 65536, 1, 1);
+
+	free(buf);
+	free(packed);
+	return 0;
+}
@@ -0,0 +1,248 @@
+/**
+ * nrf905_fec.c - CRC syndrome based bit error correction
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "nrf905_fec.h"
+#include "nrf905_crc.h"
+
+/**
+ * Look up single bit error with syndrome
+ *
+ * @returns	Distance of the bit from the end of the frame, -1 if there is
+ *		none, or -2 if there are multiple in a frame of nbits.
+ */
+static int _nrf905_fec_single(const nrf905_fec_t *fec, int crc_bits,
+				unsigned int syn, unsigned int nbits)
+{
+	const uint16_t *e = (crc_bits == 16) ? fec->single16[syn] :
+						fec->single8[syn];
+
+	if (e[0] == 0 || e[0] > nbits) {
+		return -1;
+	}
+	if (e[1] != 0 && e[1] <= nbits) {
+		return -2;
+	}
+	return e[0] - 1;
+}
+
+static unsigned int _nrf905_fec_syn(const nrf905_fec_t *fec, int crc_bits,
+				unsigned int dist)
+{
+	return (crc_bits == 16) ? fec->syn16[dist] : fec->syn8[dist];
+}
+
+static void _nrf905_fec_flip(uint8_t *data, unsigned int nbits,
+				unsigned int dist)
+{
+	unsigned int bit = nbits - 1 - dist;
+
+	data[bit / 8] ^= 0x80 >> (bit % 8);
+}
+
+void nrf905_fec_init(nrf905_fec_t *fec)
+{
+	unsigned int r16 = 0x1021;	// x^16 mod P, a bit error at the end
+	unsigned int r8 = 0x07;
+	unsigned int syn;
+	unsigned int i, j;
+
+	memset(fec, 0, sizeof(*fec));
+
+	for (i=0; i < NRF905_FEC_MAX_BITS; i++) {
+		fec->syn16[i] = r16;
+		fec->syn8[i] = r8;
+		r16 = ((r16 << 1) ^ ((r16 >> 15) * 0x1021)) & 0xffff;
+		r8 = ((r8 << 1) ^ ((r8 >> 7) * 0x07)) & 0xff;
+	}
+
+	for (i=0; i < NRF905_FEC_MAX_BITS; i++) {
+		syn = fec->syn16[i];
+		if (fec->single16[syn][0] == 0) {
+			fec->single16[syn][0] = i + 1;
+		} else if (fec->single16[syn][1] == 0) {
+			fec->single16[syn][1] = i + 1;
+		}
+		syn = fec->syn8[i];
+		if (fec->single8[syn][0] == 0) {
+			fec->single8[syn][0] = i + 1;
+		} else if (fec->single8[syn][1] == 0) {
+			fec->single8[syn][1] = i + 1;
+		}
+	}
+
+	// Ordered by max. distance, so the first pair is the nearest
+	for (j=1; j < NRF905_FEC_MAX_BITS; j++) {
+		for (i=0; i < j; i++) {
+			syn = fec->syn16[i] ^ fec->syn16[j];
+			if (fec->double16[syn][0] == 0) {
+				fec->double16[syn][0] = i + 1;
+				fec->double16[syn][1] = j + 1;
+			} else if (fec->double16[syn][2] == 0) {
+				fec->double16[syn][2] = j + 1;
+			}
+		}
+	}
+}
+
+int nrf905_fec_correct(const nrf905_fec_t *fec, int crc_bits, uint8_t *data,
+			unsigned int len, const uint16_t *suspects,
+			unsigned int suspect_cnt, int max_blind)
+{
+	const unsigned int nbits = len * 8;
+	unsigned int dist[NRF905_DECODER_MAX_SUSPECTS];
+	unsigned int n = 0;
+	unsigned int syn;
+	unsigned int found;
+	unsigned int a = 0, b = 0;
+	bool ambiguous;
+	int x;
+	unsigned int k, l;
+
+	if ((crc_bits != 8 && crc_bits != 16) || len < 3 ||
+	    nbits > NRF905_FEC_MAX_BITS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (crc_bits == 16) {
+		syn = nrf905_crc16(data, len);
+	} else {
+		syn = nrf905_crc8(data, len);
+	}
+	if (syn == 0) {
+		return 0;
+	}
+
+	for (k=0; k < suspect_cnt && n < NRF905_DECODER_MAX_SUSPECTS; k++) {
+		if (suspects[k] < nbits) {
+			dist[n++] = nbits - 1 - suspects[k];
+		}
+	}
+
+	// With only 255 CRC-8 syndromes, a frame with more errors matches a
+	// suspect by chance too often. Only correct a single suspect bit, of
+	// frames with few suspects.
+	if (crc_bits == 8 && n > NRF905_FEC_CRC8_MAX_SUSPECTS) {
+		goto fail;
+	}
+
+	// One suspect bit
+	found = 0;
+	for (k=0; k < n; k++) {
+		if (_nrf905_fec_syn(fec, crc_bits, dist[k]) == syn) {
+			a = dist[k];
+			found++;
+		}
+	}
+	if (found == 1) {
+		_nrf905_fec_flip(data, nbits, a);
+		return 1;
+	}
+	if (found > 1 || crc_bits == 8) {
+		goto fail;
+	}
+
+	// Two suspect bits
+	for (k=0; k < n; k++) {
+		for (l=k + 1; l < n; l++) {
+			if ((_nrf905_fec_syn(fec, crc_bits, dist[k]) ^
+			     _nrf905_fec_syn(fec, crc_bits, dist[l])) == syn) {
+				a = dist[k];
+				b = dist[l];
+				found++;
+			}
+		}
+	}
+	if (found == 1) {
+		_nrf905_fec_flip(data, nbits, a);
+		_nrf905_fec_flip(data, nbits, b);
+		return 2;
+	}
+	if (found > 1) {
+		goto fail;
+	}
+
+	// More suspects than correctable bits means more errors than that
+	// are likely, blind corrections would mostly be wrong
+	if (n > 2 || max_blind < 1) {
+		goto fail;
+	}
+
+	// Any single bit
+	x = _nrf905_fec_single(fec, crc_bits, syn, nbits);
+	if (x >= 0) {
+		_nrf905_fec_flip(data, nbits, x);
+		return 1;
+	}
+	if (x == -2) {
+		goto fail;
+	}
+
+	// One suspect and any other bit
+	ambiguous = false;
+	for (k=0; k < n; k++) {
+		x = _nrf905_fec_single(fec, crc_bits,
+				syn ^ _nrf905_fec_syn(fec, crc_bits, dist[k]),
+				nbits);
+		if (x == -2) {
+			ambiguous = true;
+		} else if (x >= 0 && (unsigned int) x != dist[k]) {
+			a = dist[k];
+			b = x;
+			found++;
+		}
+	}
+	if (found == 1 && !ambiguous) {
+		_nrf905_fec_flip(data, nbits, a);
+		_nrf905_fec_flip(data, nbits, b);
+		return 2;
+	}
+	if (found > 1 || ambiguous) {
+		goto fail;
+	}
+
+	// Any two bits, CRC-8 has too few syndromes for this
+	if (crc_bits == 16 && max_blind >= 2) {
+		const uint16_t *e = fec->double16[syn];
+
+		if (e[0] != 0 && e[1] <= nbits &&
+		    (e[2] == 0 || e[2] > nbits)) {
+			_nrf905_fec_flip(data, nbits, e[0] - 1);
+			_nrf905_fec_flip(data, nbits, e[1] - 1);
+			return 2;
+		}
+	}
+
+fail:
+	errno = EBADMSG;
+	return -1;
+}
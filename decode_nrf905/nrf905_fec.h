@@ -0,0 +1,119 @@
+/**
+ * nrf905_fec.h - CRC syndrome based bit error correction
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_FEC_H__
+#define __NRF905_FEC_H__
+
+#include <stdint.h>
+
+#include "nrf905_decoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NRF905_FEC_MAX_BITS (NRF905_MAX_FRAME_LEN * 8)
+
+/**
+ * Max. amount of suspect bits for which CRC-8 frames are corrected
+ */
+#define NRF905_FEC_CRC8_MAX_SUSPECTS (2)
+
+/**
+ * Syndrome tables
+ *
+ * The CRC is linear, so the CRC of a received frame, including its CRC, is
+ * the XOR of the syndromes of its bit errors. The syndrome of a bit error
+ * only depends on its distance from the end of the frame, so one set of
+ * tables serves all frame lengths.
+ *
+ * Distances in the lookup tables are stored plus 1, 0 means no entry. Per
+ * syndrome the nearest entry, with the smallest max. distance, is stored
+ * together with the max. distance of the next one. The nearest entry is
+ * a unique correction for all frames that are too short to contain the
+ * next one.
+ */
+typedef struct nrf905_fec {
+	uint16_t syn16[NRF905_FEC_MAX_BITS];	// Syndrome by bit distance
+	uint8_t syn8[NRF905_FEC_MAX_BITS];
+
+	uint16_t single16[65536][2];	// Nearest, next distance
+	uint16_t single8[256][2];
+	uint16_t double16[65536][3];	// Nearest pair, next max. distance
+} nrf905_fec_t;
+
+/**
+ * Build syndrome tables
+ *
+ * The object is about 650 KiB, so better not put it on the stack.
+ */
+void nrf905_fec_init(nrf905_fec_t *fec);
+
+/**
+ * Correct bit errors in frame
+ *
+ * Corrects up to 2 bit errors. Bits that had a Manchester encoding error
+ * are most likely to be wrong, so corrections are tried in order: 1 suspect
+ * bit, 2 suspect bits, any single bit, 1 suspect and any other bit, and any
+ * 2 bits. The first level with a correction is used, but only if that
+ * correction is unique.
+ *
+ * Corrections of bits that aren't suspect are blind guesses: any 2 bits
+ * match about 70% of the CRC-16 syndromes of a 38 byte frame, so frames
+ * that were never valid get corrected as well. Use max_blind to limit them.
+ * They are only tried for frames with at most 2 suspects, on noisier frames
+ * they mostly produce wrong corrections.
+ *
+ * CRC-8 has only 255 syndromes, so even suspect corrections often match
+ * frames with more errors by chance. CRC-8 frames are only corrected by a
+ * single suspect bit, if they have at most NRF905_FEC_CRC8_MAX_SUSPECTS
+ * suspects. max_blind is ignored for them.
+ *
+ * @param fec		Syndrome tables
+ * @param crc_bits	CRC length, 8 or 16
+ * @param data		Frame including CRC, corrected in place
+ * @param len		Length of frame in bytes
+ * @param suspects	Indices of suspect bits, bit 0 is the MSB of data[0].
+ *			Indices outside of the frame are ignored.
+ * @param suspect_cnt	Amount of suspect bits
+ * @param max_blind	Max. amount of bits to correct that aren't suspect,
+ *			0 to 2
+ *
+ * @returns	Amount of corrected bits, 0 if the CRC is valid, or -1 and
+ *		set errno to EBADMSG if the frame can't be corrected.
+ */
+int nrf905_fec_correct(const nrf905_fec_t *fec, int crc_bits, uint8_t *data,
+			unsigned int len, const uint16_t *suspects,
+			unsigned int suspect_cnt, int max_blind);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_FEC_H__
@@ -0,0 +1,289 @@
+/**
+ * nrf905_fec_bench.c - Frame recovery of the FEC stage on noisy captures
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nrf905_decoder.h"
+#include "nrf905_fec.h"
+#include "nrf905_crc.h"
+#include "nrf905_bench_util.h"
+
+#define FRAME_CNT (20000)
+#define GAP_SAMPLES (400)
+#define CORRECT_RUNS (1000000)
+
+struct sent_frame {
+	uint64_t offset;	// Sample offset of first data sample
+	unsigned int len;
+	uint8_t data[NRF905_MAX_FRAME_LEN];
+};
+
+struct capture {
+	uint8_t *samples;
+	size_t len;
+	struct sent_frame frames[FRAME_CNT];
+};
+
+struct result {
+	const struct capture *cap;
+	int crc_bits;
+	unsigned long ok;		// Frames received with the right data
+	unsigned long corrected;	// ... of which corrected
+	unsigned long false_ok;		// Full frames with valid CRC, wrong data
+	unsigned long false_corr;	// ... of which corrected
+};
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static size_t put_bit(uint8_t *buf, size_t pos, int bit)
+{
+	// Manchester encoded and inverted, as received
+	buf[pos] = !bit;
+	buf[pos + 1] = bit;
+	return pos + 2;
+}
+
+/**
+ * Generate capture of frames with random sample errors
+ *
+ * @param cap		Capture to fill
+ * @param crc_bits	CRC length, 8 or 16
+ * @param p		Probability of a sample error in a frame
+ */
+static void gen_capture(struct capture *cap, int crc_bits, double p)
+{
+	const unsigned int len = 4 + 32 + crc_bits / 8;
+	const uint32_t thres = p * 4294967296.0;
+	struct sent_frame *f;
+	uint16_t crc;
+	size_t pos = 0;
+	size_t start;
+	unsigned int i, j;
+
+	rnd_state = 1;
+	for (i=0; i < FRAME_CNT; i++) {
+		f = &cap->frames[i];
+		for (j=0; j < GAP_SAMPLES; j++) {
+			cap->samples[pos++] = rnd() & 1;
+		}
+
+		start = pos;
+		for (j=0; j < 10; j++) {
+			pos = put_bit(cap->samples, pos, (0x3F5 >> (9 - j)) & 1);
+		}
+		f->offset = pos;
+		f->len = len;
+		for (j=0; j < len - crc_bits / 8; j++) {
+			f->data[j] = rnd();
+		}
+		if (crc_bits == 16) {
+			crc = nrf905_crc16(f->data, len - 2);
+			f->data[len - 2] = crc >> 8;
+			f->data[len - 1] = crc & 0xff;
+		} else {
+			f->data[len - 1] = nrf905_crc8(f->data, len - 1);
+		}
+		for (j=0; j < len * 8; j++) {
+			pos = put_bit(cap->samples, pos,
+					(f->data[j / 8] >> (7 - j % 8)) & 1);
+		}
+
+		for (; start < pos; start++) {
+			if (rnd() < thres) {
+				cap->samples[start] ^= 1;
+			}
+		}
+	}
+	cap->len = pos;
+}
+
+static void check_frame(nrf905_decoder_t *d, const nrf905_decoder_frame_t *f)
+{
+	struct result *res = d->priv;
+	const struct sent_frame *sent = NULL;
+	unsigned int lo = 0, hi = FRAME_CNT, mid;
+
+	if (!(res->crc_bits == 16 ? f->crc16_ok : f->crc8_ok)) {
+		return;
+	}
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (res->cap->frames[mid].offset < f->offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo < FRAME_CNT && res->cap->frames[lo].offset == f->offset) {
+		sent = &res->cap->frames[lo];
+	}
+
+	if (sent != NULL && f->len >= sent->len &&
+	    memcmp(f->data, sent->data, sent->len) == 0) {
+		res->ok++;
+		if (f->corrected) {
+			res->corrected++;
+		}
+	} else if (f->len >= res->cap->frames[0].len) {
+		// Shorter frames in the noise pass the CRC by chance without
+		// any correction
+		res->false_ok++;
+		if (f->corrected) {
+			res->false_corr++;
+		}
+	}
+}
+
+static void run(const struct capture *cap, const nrf905_fec_t *fec,
+		int crc_bits, int max_errors, int max_blind, double p)
+{
+	nrf905_decoder_t d;
+	struct result res;
+	double start, elapsed;
+
+	memset(&res, 0, sizeof(res));
+	res.cap = cap;
+	res.crc_bits = crc_bits;
+	nrf905_decoder_init(&d, check_frame, &res);
+	d.max_encoding_errors = max_errors;
+	if (fec != NULL) {
+		d.fec = fec;
+		d.fec_crc_bits = crc_bits;
+		d.fec_len = cap->frames[0].len;
+		d.fec_max_blind = max_blind;
+	}
+
+	start = nrf905_bench_now();
+	nrf905_decoder_push(&d, cap->samples, cap->len);
+	elapsed = nrf905_bench_now() - start;
+
+	printf("CRC-%-2d p=%.3f %-6s errors %d blind %d: %5.1f%% ok, %5.1f%% corrected, %4lu false (%4lu corrected), %6.1f Msamples/s\n",
+		crc_bits, p, fec ? "fec" : "no fec", max_errors, max_blind,
+		100.0 * res.ok / FRAME_CNT, 100.0 * res.corrected / FRAME_CNT,
+		res.false_ok, res.false_corr, cap->len / elapsed / 1e6);
+}
+
+/**
+ * Time nrf905_fec_correct() on frames with 1 or 2 bit errors
+ */
+static void time_correct(const nrf905_fec_t *fec, int crc_bits,
+			bool suspects)
+{
+	const unsigned int len = 4 + 32 + crc_bits / 8;
+	uint8_t frame[NRF905_MAX_FRAME_LEN];
+	uint8_t work[NRF905_MAX_FRAME_LEN];
+	uint16_t susp[2];
+	uint16_t crc;
+	unsigned long fixed = 0;
+	unsigned int i, k, bits;
+	double start, elapsed;
+
+	rnd_state = 1;
+	for (i=0; i < len; i++) {
+		frame[i] = rnd();
+	}
+	if (crc_bits == 16) {
+		crc = nrf905_crc16(frame, len - 2);
+		frame[len - 2] = crc >> 8;
+		frame[len - 1] = crc & 0xff;
+	} else {
+		frame[len - 1] = nrf905_crc8(frame, len - 1);
+	}
+
+	start = nrf905_bench_now();
+	for (i=0; i < CORRECT_RUNS; i++) {
+		memcpy(work, frame, len);
+		bits = 1 + (i & 1);
+		for (k=0; k < bits; k++) {
+			susp[k] = rnd() % (len * 8);
+			work[susp[k] / 8] ^= 0x80 >> (susp[k] % 8);
+		}
+		if (nrf905_fec_correct(fec, crc_bits, work, len, susp,
+				suspects ? bits : 0, 2) > 0 &&
+		    memcmp(work, frame, len) == 0) {
+			fixed++;
+		}
+	}
+	elapsed = nrf905_bench_now() - start;
+
+	printf("CRC-%-2d correct, %s suspects: %5.1f%% fixed, %.1f ns/frame\n",
+		crc_bits, suspects ? "with" : "no", 100.0 * fixed / CORRECT_RUNS,
+		elapsed * 1e9 / CORRECT_RUNS);
+}
+
+int main(int argc, char *argv[])
+{
+	static const double probs[] = { 0.001, 0.003, 0.01, 0.02 };
+	static const int crcs[] = { 16, 8 };
+	static nrf905_fec_t fec;
+	static struct capture cap;
+	double start;
+	unsigned int i, j;
+
+	start = nrf905_bench_now();
+	nrf905_fec_init(&fec);
+	printf("Syndrome tables built in %.1f ms\n", (nrf905_bench_now() - start) * 1e3);
+
+	cap.samples = malloc(FRAME_CNT * (GAP_SAMPLES + 2 * (10 + 8 *
+						NRF905_MAX_FRAME_LEN)));
+	if (cap.samples == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (j=0; j < sizeof(crcs) / sizeof(crcs[0]); j++) {
+		time_correct(&fec, crcs[j], true);
+		time_correct(&fec, crcs[j], false);
+	}
+	for (j=0; j < sizeof(crcs) / sizeof(crcs[0]); j++) {
+		for (i=0; i < sizeof(probs) / sizeof(probs[0]); i++) {
+			gen_capture(&cap, crcs[j], probs[i]);
+			run(&cap, NULL, crcs[j], 0, 0, probs[i]);
+			run(&cap, NULL, crcs[j], 4, 0, probs[i]);
+			run(&cap, &fec, crcs[j], 4, 0, probs[i]);
+			run(&cap, &fec, crcs[j], 4, 1, probs[i]);
+			run(&cap, &fec, crcs[j], 4, 2, probs[i]);
+			run(&cap, &fec, crcs[j], 6, 1, probs[i]);
+		}
+	}
+
+	free(cap.samples);
+	return 0;
+}
@@ -0,0 +1,544 @@
+/**
+ * nrf905_gen.c - Synthetic nRF905 capture generator
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "nrf905_gen.h"
+#include "nrf905_crc.h"
+
+static const uint16_t PREAMBLE = 0x3F5;
+#define PREAMBLE_CHIPS (20)
+
+// Amplitude of the carrier in output units
+#define CU8_AMPLITUDE (80)
+#define CS16_AMPLITUDE (8192)
+
+/**
+ * xorshift64*
+ */
+static inline uint64_t _nrf905_gen_rnd(uint64_t *s)
+{
+	uint64_t x = *s;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*s = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * 64-bit LCG, for the noise. Only the upper 32 bits are used, its short
+ * dependency chain is what limits the IQ generation speed.
+ */
+static inline uint64_t _nrf905_gen_lcg(uint64_t *s)
+{
+	*s = *s * 6364136223846793005ULL + 1442695040888963407ULL;
+	return *s;
+}
+
+/**
+ * splitmix64, to derive non-zero xorshift states from the seed
+ */
+static uint64_t _nrf905_gen_seed(uint64_t seed)
+{
+	uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	return z ? z : 1;
+}
+
+/**
+ * Uniform random value in (0, 1]
+ */
+static double _nrf905_gen_uniform(uint64_t *s)
+{
+	return ((_nrf905_gen_rnd(s) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Chips until the next chip error, geometric distribution
+ */
+static uint64_t _nrf905_gen_error_dist(nrf905_gen_t *g)
+{
+	double d;
+
+	if (g->cfg.error_rate <= 0) {
+		return UINT64_MAX;
+	}
+	if (g->cfg.error_rate >= 1) {
+		return 0;
+	}
+	d = floor(log(_nrf905_gen_uniform(&g->noise_rnd)) /
+			log1p(-g->cfg.error_rate));
+	return (d >= 1.8e19) ? UINT64_MAX : (uint64_t) d;
+}
+
+/**
+ * Load and store 8 chips, first chip in the lowest byte
+ */
+static inline uint64_t _nrf905_gen_load8(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline void _nrf905_gen_store8(uint8_t *p, uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	memcpy(p, &v, sizeof(v));
+}
+
+static bool _nrf905_gen_is_iq(const nrf905_gen_t *g)
+{
+	return g->cfg.format == NRF905_GEN_CU8 ||
+		g->cfg.format == NRF905_GEN_CS16;
+}
+
+/**
+ * Random gap length in samples
+ */
+static uint64_t _nrf905_gen_gap(nrf905_gen_t *g)
+{
+	uint64_t us = g->cfg.gap_min_us;
+	uint64_t rate;
+
+	us += _nrf905_gen_rnd(&g->frame_rnd) %
+		(g->cfg.gap_max_us - g->cfg.gap_min_us + 1);
+	rate = _nrf905_gen_is_iq(g) ? g->cfg.samp_rate : NRF905_GEN_CHIP_RATE;
+	return us * rate / 1000000;
+}
+
+static void _nrf905_gen_put_bit(nrf905_gen_t *g, unsigned int *pos, int bit)
+{
+	// Manchester encoded and inverted, as demodulated
+	g->chips[1 + (*pos)++] = !bit;
+	g->chips[1 + (*pos)++] = bit;
+}
+
+/**
+ * Start next frame, followed by a gap
+ */
+static void _nrf905_gen_frame(nrf905_gen_t *g)
+{
+	const nrf905_gen_config_t *cfg = &g->cfg;
+	uint8_t data[4 + 32 + 2];
+	unsigned int len = 0;
+	unsigned int pos = 0;
+	uint64_t offset;
+	uint16_t crc;
+	unsigned int i;
+
+	for (i=0; i < cfg->addr_width; i++) {
+		data[len++] = cfg->addr >> (8 * (cfg->addr_width - 1 - i));
+	}
+	for (i=0; i < cfg->payload_len; i++) {
+		if (cfg->payload != NULL) {
+			data[len++] = cfg->payload[i];
+		} else {
+			data[len++] = _nrf905_gen_rnd(&g->frame_rnd) >> 56;
+		}
+	}
+	if (cfg->crc_bits == 16) {
+		crc = nrf905_crc16(data, len);
+		data[len++] = crc >> 8;
+		data[len++] = crc & 0xff;
+	} else if (cfg->crc_bits == 8) {
+		data[len] = nrf905_crc8(data, len);
+		len++;
+	}
+
+	for (i=0; i < 10; i++) {
+		_nrf905_gen_put_bit(g, &pos, (PREAMBLE >> (9 - i)) & 1);
+	}
+	for (i=0; i < len; i++) {
+		memcpy(&g->chips[1 + pos], g->manchester[data[i]], 16);
+		pos += 16;
+	}
+	g->chips[0] = g->chips[1];
+	g->chips[pos + 1] = g->chips[pos];
+	g->chip_cnt = pos;
+	g->chip_idx = 0;
+	g->t = 0;
+	g->gap_left = _nrf905_gen_gap(g);
+	g->frames++;
+
+	if (_nrf905_gen_is_iq(g)) {
+		offset = g->pos + (((uint64_t) PREAMBLE_CHIPS << 32) +
+				g->step - 1) / g->step;
+	} else {
+		offset = g->pos + PREAMBLE_CHIPS;
+	}
+	if (g->cb != NULL) {
+		g->cb(g, data, len, offset);
+	}
+}
+
+/**
+ * Start the next frame if the current frame and gap are done
+ *
+ * @returns	false if all frames are generated
+ */
+static bool _nrf905_gen_next(nrf905_gen_t *g)
+{
+	if (g->chip_idx < g->chip_cnt || g->gap_left > 0) {
+		return true;
+	}
+	if (g->cfg.frame_cnt != 0 && g->frames >= g->cfg.frame_cnt) {
+		g->done = true;
+		return false;
+	}
+	_nrf905_gen_frame(g);
+	return true;
+}
+
+/**
+ * Generate demodulated chips, one per byte
+ *
+ * @returns	Amount of chips
+ */
+static size_t _nrf905_gen_chips(nrf905_gen_t *g, uint8_t *out, size_t n)
+{
+	size_t k = 0;
+	size_t m, j;
+	unsigned int p;
+	uint64_t v;
+
+	while (k < n && _nrf905_gen_next(g)) {
+		if (g->chip_idx < g->chip_cnt) {
+			m = g->chip_cnt - g->chip_idx;
+			if (m > n - k) {
+				m = n - k;
+			}
+			memcpy(&out[k], &g->chips[1 + g->chip_idx], m);
+			g->chip_idx += m;
+		} else {
+			m = (g->gap_left < n - k) ? g->gap_left : n - k;
+			// A new random word every 64 output chips, so the
+			// output doesn't depend on the buffer sizes
+			for (j=0; j < m; ) {
+				p = (g->pos + j) % 64;
+				if (p == 0) {
+					g->gap_bits = _nrf905_gen_rnd(&g->noise_rnd);
+				}
+				if (p % 8 == 0 && j + 8 <= m) {
+					// Spread 8 random bits to 8 chips
+					v = ((g->gap_bits >> p) & 0xff) *
+						0x0101010101010101ULL;
+					v &= 0x8040201008040201ULL;
+					v = ((v + 0x7f7f7f7f7f7f7f7fULL) >> 7) &
+						0x0101010101010101ULL;
+					_nrf905_gen_store8(&out[k + j], v);
+					j += 8;
+				} else {
+					out[k + j] = (g->gap_bits >> p) & 1;
+					j++;
+				}
+			}
+			g->gap_left -= m;
+		}
+		k += m;
+		g->pos += m;
+	}
+
+	for (j=0; g->next_error < k - j; j++) {
+		j += g->next_error;
+		out[j] ^= 1;
+		g->next_error = _nrf905_gen_error_dist(g);
+	}
+	if (g->next_error != UINT64_MAX) {
+		g->next_error -= k - j;
+	}
+
+	return k;
+}
+
+static inline __attribute__((always_inline)) void _nrf905_gen_put_iq(
+		uint8_t *buf, nrf905_gen_format_t format, int32_t i, int32_t q)
+{
+	if (format == NRF905_GEN_CU8) {
+		i = (i + 2040 + 8) >> 4;
+		q = (q + 2040 + 8) >> 4;
+		buf[0] = (i < 0) ? 0 : (i > 255) ? 255 : i;
+		buf[1] = (q < 0) ? 0 : (q > 255) ? 255 : q;
+	} else {
+		i = (i + 8) >> 4;
+		q = (q + 8) >> 4;
+		i = (i < -32768) ? -32768 : (i > 32767) ? 32767 : i;
+		q = (q < -32768) ? -32768 : (q > 32767) ? 32767 : q;
+		buf[0] = i & 0xff;
+		buf[1] = (i >> 8) & 0xff;
+		buf[2] = q & 0xff;
+		buf[3] = (q >> 8) & 0xff;
+	}
+}
+
+/**
+ * Generate IQ samples
+ *
+ * Inlined per format, so the sample conversion is resolved at compile time.
+ *
+ * @returns	Amount of samples
+ */
+static inline __attribute__((always_inline)) size_t _nrf905_gen_iq(
+		nrf905_gen_t *g, uint8_t *buf, size_t n,
+		nrf905_gen_format_t format)
+{
+	const unsigned int size = (format == NRF905_GEN_CU8) ? 2 : 4;
+	const unsigned int phase_shift = 32 - NRF905_GEN_PHASE_BITS;
+	const unsigned int shape_shift = 32 - NRF905_GEN_SHAPE_BITS;
+	const int32_t *noise = g->noise;
+	const int32_t *carrier_i = g->carrier_i;
+	const int32_t *carrier_q = g->carrier_q;
+	const uint32_t step = g->step;
+	const uint32_t offset_inc = g->offset_inc;
+	uint32_t phase = g->phase;
+	uint32_t t = g->t;
+	uint64_t rnd = g->noise_rnd;
+	const uint32_t *shape;
+	const uint8_t *c;
+	unsigned int idx, cnt;
+	uint64_t r;
+	size_t k = 0;
+	size_t start, m;
+
+	// State is kept in locals in the loops, buf may alias anything
+	while (k < n) {
+		g->t = t;
+		g->noise_rnd = rnd;
+		if (!_nrf905_gen_next(g)) {
+			break;
+		}
+		// A new frame restarts the chip clock
+		t = g->t;
+		rnd = g->noise_rnd;
+
+		start = k;
+		idx = g->chip_idx;
+		cnt = g->chip_cnt;
+		if (idx < cnt) {
+			// Carrier, until the end of the frame
+			c = &g->chips[idx];
+			shape = g->shape[(c[0] << 2) | (c[1] << 1) | c[2]];
+			for (; k < n; k++) {
+				phase += shape[t >> shape_shift] + offset_inc;
+				r = _nrf905_gen_lcg(&rnd);
+				_nrf905_gen_put_iq(&buf[k * size], format,
+					carrier_i[phase >> phase_shift] +
+						noise[(r >> 32) & 0xffff],
+					carrier_q[phase >> phase_shift] +
+						noise[r >> 48]);
+				t += step;
+				if (t < step) {
+					if (++idx == cnt) {
+						k++;
+						break;
+					}
+					c = &g->chips[idx];
+					shape = g->shape[(c[0] << 2) | (c[1] << 1) |
+							 c[2]];
+				}
+			}
+			g->chip_idx = idx;
+		} else {
+			// Noise only
+			m = (g->gap_left < n - k) ? g->gap_left : n - k;
+			g->gap_left -= m;
+			m += k;
+			for (; k < m; k++) {
+				r = _nrf905_gen_lcg(&rnd);
+				_nrf905_gen_put_iq(&buf[k * size], format,
+					noise[(r >> 32) & 0xffff], noise[r >> 48]);
+			}
+		}
+		g->pos += k - start;
+	}
+
+	g->phase = phase;
+	g->t = t;
+	g->noise_rnd = rnd;
+	return k;
+}
+
+/**
+ * Frequency shape of a Gaussian filtered chip, centered at tau
+ */
+static double _nrf905_gen_pulse(double tau)
+{
+	const double k = M_PI * NRF905_GEN_BT * sqrt(2 / M_LN2);
+
+	return 0.5 * (erf(k * (tau + 0.5)) - erf(k * (tau - 0.5)));
+}
+
+void nrf905_gen_config_init(nrf905_gen_config_t *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->format = NRF905_GEN_CU8;
+	cfg->samp_rate = 1000000;
+	cfg->seed = 1;
+	cfg->addr = 0xE7E7E7E7;
+	cfg->addr_width = 4;
+	cfg->payload_len = 32;
+	cfg->crc_bits = 16;
+	cfg->gap_min_us = 1000;
+	cfg->gap_max_us = 2000;
+	cfg->snr_db = 20;
+}
+
+int nrf905_gen_init(nrf905_gen_t *g, const nrf905_gen_config_t *cfg,
+			nrf905_gen_cb_t cb, void *priv)
+{
+	const unsigned int shape_len = 1 << NRF905_GEN_SHAPE_BITS;
+	const unsigned int phase_len = 1 << NRF905_GEN_PHASE_BITS;
+	double step, amp, sigma, tau, f, norm, u, v;
+	unsigned int ctx, k, i;
+
+	if (cfg->format > NRF905_GEN_CS16 ||
+	    cfg->addr_width < 1 || cfg->addr_width > 4 ||
+	    cfg->payload_len < 1 || cfg->payload_len > 32 ||
+	    (cfg->crc_bits != 0 && cfg->crc_bits != 8 && cfg->crc_bits != 16) ||
+	    cfg->gap_min_us > cfg->gap_max_us ||
+	    !(cfg->error_rate >= 0 && cfg->error_rate <= 1)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// At least 2 samples per chip
+	step = 4294967296.0 * NRF905_GEN_CHIP_RATE *
+		(1 + cfg->drift_ppm * 1e-6) / cfg->samp_rate;
+	if ((cfg->format == NRF905_GEN_CU8 || cfg->format == NRF905_GEN_CS16) &&
+	    !(step >= 1 && step <= 2147483648.0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(g, 0, sizeof(*g));
+	g->cfg = *cfg;
+	g->cb = cb;
+	g->priv = priv;
+	g->frame_rnd = _nrf905_gen_seed(cfg->seed);
+	g->noise_rnd = _nrf905_gen_seed(~cfg->seed);
+	g->next_error = _nrf905_gen_error_dist(g);
+	g->gap_left = _nrf905_gen_gap(g);
+
+	// Manchester encoded and inverted, as demodulated
+	for (k=0; k < 256; k++) {
+		for (i=0; i < 8; i++) {
+			g->manchester[k][2 * i] = !((k >> (7 - i)) & 1);
+			g->manchester[k][2 * i + 1] = (k >> (7 - i)) & 1;
+		}
+	}
+
+	if (!_nrf905_gen_is_iq(g)) {
+		return 0;
+	}
+
+	g->step = step;
+	g->offset_inc = (uint32_t) (int64_t) llrint(4294967296.0 *
+			cfg->freq_offset / cfg->samp_rate);
+
+	// Frequency in the middle of each fractional chip position, for
+	// every combination of previous, current and next chip
+	for (k=0; k < shape_len; k++) {
+		tau = (k + 0.5) / shape_len - 0.5;
+		norm = _nrf905_gen_pulse(tau + 1) + _nrf905_gen_pulse(tau) +
+			_nrf905_gen_pulse(tau - 1);
+		for (ctx=0; ctx < 8; ctx++) {
+			f = (((ctx & 4) ? 1 : -1) * _nrf905_gen_pulse(tau + 1) +
+			     ((ctx & 2) ? 1 : -1) * _nrf905_gen_pulse(tau) +
+			     ((ctx & 1) ? 1 : -1) * _nrf905_gen_pulse(tau - 1)) /
+				norm * NRF905_GEN_DEVIATION;
+			g->shape[ctx][k] = (uint32_t) (int32_t) lrint(
+				4294967296.0 * f / cfg->samp_rate);
+		}
+	}
+
+	amp = (cfg->format == NRF905_GEN_CU8) ? CU8_AMPLITUDE : CS16_AMPLITUDE;
+	for (k=0; k < phase_len; k++) {
+		g->carrier_i[k] = lrint(16 * amp * cos(2 * M_PI * k / phase_len));
+		g->carrier_q[k] = lrint(16 * amp * sin(2 * M_PI * k / phase_len));
+	}
+
+	// Box-Muller
+	sigma = amp / sqrt(2 * pow(10, cfg->snr_db / 10));
+	for (k=0; k < 65536; k += 2) {
+		u = sqrt(-2 * log(_nrf905_gen_uniform(&g->noise_rnd)));
+		v = 2 * M_PI * _nrf905_gen_uniform(&g->noise_rnd);
+		g->noise[k] = lrint(16 * sigma * u * cos(v));
+		g->noise[k + 1] = lrint(16 * sigma * u * sin(v));
+	}
+
+	return 0;
+}
+
+size_t nrf905_gen_read(nrf905_gen_t *g, uint8_t *buf, size_t len)
+{
+	uint8_t chips[4096];
+	size_t k = 0;
+	size_t n, j;
+
+	switch (g->cfg.format) {
+	case NRF905_GEN_UNPACKED:
+		return _nrf905_gen_chips(g, buf, len);
+	case NRF905_GEN_PACKED:
+		while (k < len && !g->done) {
+			n = (len - k) * 8;
+			if (n > sizeof(chips)) {
+				n = sizeof(chips);
+			}
+			n = _nrf905_gen_chips(g, chips, n);
+			// Last byte is padded with zeros
+			memset(&chips[n], 0, (8 - n % 8) % 8);
+			for (j=0; j < n; j += 8) {
+				// Gathers the lowest bit of every byte, first in
+				// the MSB
+				buf[k++] = (_nrf905_gen_load8(&chips[j]) *
+						0x8040201008040201ULL) >> 56;
+			}
+		}
+		return k;
+	case NRF905_GEN_CU8:
+		return 2 * _nrf905_gen_iq(g, buf, len / 2, NRF905_GEN_CU8);
+	case NRF905_GEN_CS16:
+		return 4 * _nrf905_gen_iq(g, buf, len / 4, NRF905_GEN_CS16);
+	}
+
+	return 0;
+}
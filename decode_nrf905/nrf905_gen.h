@@ -0,0 +1,192 @@
+/**
+ * nrf905_gen.h - Synthetic nRF905 capture generator
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_GEN_H__
+#define __NRF905_GEN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Modulation, see nrf905_gfsk.h
+ *
+ * 50 kbit/s Manchester encoded, so 100 k chips/s, with +-50 kHz deviation
+ * and a Gaussian filter with BT = 0.5.
+ */
+#define NRF905_GEN_CHIP_RATE (100000)
+#define NRF905_GEN_DEVIATION (50000)
+#define NRF905_GEN_BT (0.5)
+
+/**
+ * Max. chips in a frame: preamble, 4 address bytes, 32 payload bytes, CRC-16
+ */
+#define NRF905_GEN_MAX_CHIPS (2 * (10 + 8 * (4 + 32 + 2)))
+
+/**
+ * Phase steps of the carrier and fractional chip positions in the
+ * frequency shape table
+ */
+#define NRF905_GEN_PHASE_BITS (10)
+#define NRF905_GEN_SHAPE_BITS (6)
+
+/**
+ * Output formats
+ */
+typedef enum {
+	NRF905_GEN_UNPACKED,	// Demodulated, one byte per chip
+	NRF905_GEN_PACKED,	// Demodulated, 8 chips per byte, MSB first
+	NRF905_GEN_CU8,		// IQ, unsigned 8-bit
+	NRF905_GEN_CS16,	// IQ, signed 16-bit little-endian
+} nrf905_gen_format_t;
+
+/**
+ * Generator configuration
+ *
+ * The SNR is the ratio of carrier to noise power over the full sample rate.
+ * Between frames the carrier is off. The demodulated formats have random
+ * chips between frames instead, as the demodulator produces from noise.
+ */
+typedef struct {
+	nrf905_gen_format_t format;
+	unsigned int samp_rate;		// IQ sample rate
+	uint64_t seed;
+
+	// Frames
+	unsigned long frame_cnt;	// Amount of frames, 0 for endless
+	uint32_t addr;			// Address, sent MSB first
+	unsigned int addr_width;	// Address width in bytes, 1 to 4
+	unsigned int payload_len;	// Payload width in bytes, 1 to 32
+	const uint8_t *payload;		// Fixed payload, NULL for random
+	int crc_bits;			// 0, 8 or 16
+	unsigned int gap_min_us;	// Gap between frames, random from
+	unsigned int gap_max_us;	// ... gap_min_us to gap_max_us
+
+	// Impairments
+	double snr_db;			// IQ signal to noise ratio
+	double freq_offset;		// IQ carrier offset in Hz
+	double drift_ppm;		// Transmitter chip clock error
+	double error_rate;		// Chip error probability, demodulated
+} nrf905_gen_config_t;
+
+struct nrf905_gen;
+
+/**
+ * Called for every frame, before its first sample is returned
+ *
+ * @param data		Address, payload and CRC
+ * @param offset	Sample offset of first data sample, in IQ samples or
+ *			chips
+ */
+typedef void (*nrf905_gen_cb_t)(struct nrf905_gen *g, const uint8_t *data,
+			unsigned int len, uint64_t offset);
+
+/**
+ * Generator
+ *
+ * Everything is deterministic from the seed. Frame contents and gaps use
+ * their own random generator, so a seed gives the same frames in every
+ * format.
+ */
+typedef struct nrf905_gen {
+	nrf905_gen_config_t cfg;
+	uint64_t frame_rnd;
+	uint64_t noise_rnd;
+
+	unsigned long frames;		// Frames started
+	uint64_t pos;			// Samples generated
+	bool done;
+
+	// Current frame chips, with the first and last repeated around it for
+	// the frequency shaping
+	uint8_t chips[NRF905_GEN_MAX_CHIPS + 2];
+	unsigned int chip_cnt;
+	unsigned int chip_idx;
+	uint64_t gap_left;		// Samples left of the gap
+	uint64_t next_error;		// Chips until next chip error
+	uint64_t gap_bits;		// Random chips between frames
+	uint8_t manchester[256][16];	// Chips of a byte
+
+	// IQ, phases are in units of 2^-32 turn
+	uint32_t t;			// Position in chip, 2^-32 chip units
+	uint32_t step;			// Chip position step per sample
+	uint32_t phase;
+	uint32_t offset_inc;
+	uint32_t shape[8][1 << NRF905_GEN_SHAPE_BITS];
+	int32_t carrier_i[1 << NRF905_GEN_PHASE_BITS];
+	int32_t carrier_q[1 << NRF905_GEN_PHASE_BITS];
+	int32_t noise[65536];		// Gaussian, in 1/16 output units
+
+	nrf905_gen_cb_t cb;
+	void *priv;
+} nrf905_gen_t;
+
+/**
+ * Initialize configuration with defaults
+ *
+ * 1 Msps cu8 at 20 dB SNR, endless 32 byte random payloads to address
+ * 0xE7E7E7E7 with CRC-16, 1 to 2 ms apart.
+ */
+void nrf905_gen_config_init(nrf905_gen_config_t *cfg);
+
+/**
+ * Initialize generator
+ *
+ * @param g	Generator object to initialize
+ * @param cfg	Configuration, copied
+ * @param cb	Called for every frame, may be NULL
+ * @param priv	Free for use by the caller
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if the configuration
+ *		is invalid.
+ */
+int nrf905_gen_init(nrf905_gen_t *g, const nrf905_gen_config_t *cfg,
+			nrf905_gen_cb_t cb, void *priv);
+
+/**
+ * Generate samples
+ *
+ * @param g	Generator object
+ * @param buf	Buffer to write to
+ * @param len	Length of buf in bytes
+ *
+ * @returns	Amount of bytes written, a multiple of the sample size. Less
+ *		than len only when all frames are generated, 0 at the end.
+ */
+size_t nrf905_gen_read(nrf905_gen_t *g, uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_GEN_H__
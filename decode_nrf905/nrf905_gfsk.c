@@ -0,0 +1,490 @@
+/**
+ * nrf905_gfsk.c - GFSK demodulator for rtl_sdr IQ captures
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define NRF905_GFSK_NEON
+#endif
+
+#include "nrf905_gfsk.h"
+
+/**
+ * atan() polynomial for 0 <= x <= 1, max. error about 1e-5 rad
+ */
+#define ATAN_C1 (0.99997726f)
+#define ATAN_C3 (-0.33262347f)
+#define ATAN_C5 (0.19354346f)
+#define ATAN_C7 (-0.11643287f)
+#define ATAN_C9 (0.05265332f)
+#define ATAN_C11 (-0.01172120f)
+
+static float _nrf905_gfsk_atan2(float y, float x)
+{
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+	float mx = (ax > ay) ? ax : ay;
+	float mn = (ax > ay) ? ay : ax;
+	float a = mn / (mx + 1e-30f);
+	float s = a * a;
+	float r;
+
+	r = (((((ATAN_C11 * s + ATAN_C9) * s + ATAN_C7) * s + ATAN_C5) * s +
+		ATAN_C3) * s + ATAN_C1) * a;
+	if (ay > ax) {
+		r = (float) M_PI_2 - r;
+	}
+	if (x < 0) {
+		r = (float) M_PI - r;
+	}
+	return (y < 0) ? -r : r;
+}
+
+void nrf905_gfsk_convert(nrf905_gfsk_format_t format, const uint8_t *buf,
+			size_t n, float *fi, float *fq)
+{
+	size_t k = 0;
+
+	if (format == NRF905_GFSK_CU8) {
+#if defined(__SSE2__)
+		const __m128i lo_mask = _mm_set1_epi16(0x00ff);
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 scale = _mm_set1_ps(1.0f / 128);
+		const __m128 offset = _mm_set1_ps(127.5f / 128);
+		__m128i v, vi, vq;
+
+		for (; k + 8 <= n; k += 8) {
+			v = _mm_loadu_si128((const __m128i *) &buf[2 * k]);
+			vi = _mm_and_si128(v, lo_mask);
+			vq = _mm_srli_epi16(v, 8);
+			_mm_storeu_ps(&fi[k], _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(
+				_mm_unpacklo_epi16(vi, zero)), scale), offset));
+			_mm_storeu_ps(&fi[k + 4], _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(
+				_mm_unpackhi_epi16(vi, zero)), scale), offset));
+			_mm_storeu_ps(&fq[k], _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(
+				_mm_unpacklo_epi16(vq, zero)), scale), offset));
+			_mm_storeu_ps(&fq[k + 4], _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(
+				_mm_unpackhi_epi16(vq, zero)), scale), offset));
+		}
+#elif defined(NRF905_GFSK_NEON)
+		const float32x4_t offset = vdupq_n_f32(127.5f / 128);
+		uint8x8x2_t v;
+		uint16x8_t vi, vq;
+
+		for (; k + 8 <= n; k += 8) {
+			v = vld2_u8(&buf[2 * k]);
+			vi = vmovl_u8(v.val[0]);
+			vq = vmovl_u8(v.val[1]);
+			vst1q_f32(&fi[k], vsubq_f32(vmulq_n_f32(vcvtq_f32_u32(
+				vmovl_u16(vget_low_u16(vi))), 1.0f / 128), offset));
+			vst1q_f32(&fi[k + 4], vsubq_f32(vmulq_n_f32(vcvtq_f32_u32(
+				vmovl_u16(vget_high_u16(vi))), 1.0f / 128), offset));
+			vst1q_f32(&fq[k], vsubq_f32(vmulq_n_f32(vcvtq_f32_u32(
+				vmovl_u16(vget_low_u16(vq))), 1.0f / 128), offset));
+			vst1q_f32(&fq[k + 4], vsubq_f32(vmulq_n_f32(vcvtq_f32_u32(
+				vmovl_u16(vget_high_u16(vq))), 1.0f / 128), offset));
+		}
+#endif
+		for (; k < n; k++) {
+			fi[k] = buf[2 * k] * (1.0f / 128) - 127.5f / 128;
+			fq[k] = buf[2 * k + 1] * (1.0f / 128) - 127.5f / 128;
+		}
+	} else {
+#if defined(__SSE2__)
+		const __m128 scale = _mm_set1_ps(1.0f / 32768);
+		__m128i v;
+
+		for (; k + 4 <= n; k += 4) {
+			v = _mm_loadu_si128((const __m128i *) &buf[4 * k]);
+			_mm_storeu_ps(&fi[k], _mm_mul_ps(_mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_slli_epi32(v, 16), 16)), scale));
+			_mm_storeu_ps(&fq[k], _mm_mul_ps(_mm_cvtepi32_ps(
+				_mm_srai_epi32(v, 16)), scale));
+		}
+#elif defined(NRF905_GFSK_NEON)
+		int16x4x2_t v;
+
+		for (; k + 4 <= n; k += 4) {
+			v = vld2_s16((const int16_t *) &buf[4 * k]);
+			vst1q_f32(&fi[k], vmulq_n_f32(vcvtq_f32_s32(
+				vmovl_s16(v.val[0])), 1.0f / 32768));
+			vst1q_f32(&fq[k], vmulq_n_f32(vcvtq_f32_s32(
+				vmovl_s16(v.val[1])), 1.0f / 32768));
+		}
+#endif
+		for (; k < n; k++) {
+			fi[k] = (int16_t) (buf[4 * k] | (buf[4 * k + 1] << 8)) *
+				(1.0f / 32768);
+			fq[k] = (int16_t) (buf[4 * k + 2] | (buf[4 * k + 3] << 8)) *
+				(1.0f / 32768);
+		}
+	}
+}
+
+/**
+ * Low-pass filter and decimate
+ *
+ * @returns	Amount of filtered samples, stored from lp_i[1]
+ */
+static unsigned int _nrf905_gfsk_filter(nrf905_gfsk_t *g)
+{
+	const float *h = g->taps;
+	unsigned int cnt = 0;
+	unsigned int j, t;
+
+	for (j=0; j + g->tap_cnt <= g->in_len; j += g->decim) {
+		const float *xi = &g->in_i[j];
+		const float *xq = &g->in_q[j];
+#if defined(__SSE2__)
+		__m128 ai = _mm_setzero_ps();
+		__m128 aq = _mm_setzero_ps();
+		__m128 ht;
+
+		for (t=0; t < g->tap_cnt; t += 4) {
+			ht = _mm_load_ps(&h[t]);
+			ai = _mm_add_ps(ai, _mm_mul_ps(ht, _mm_loadu_ps(&xi[t])));
+			aq = _mm_add_ps(aq, _mm_mul_ps(ht, _mm_loadu_ps(&xq[t])));
+		}
+		// Horizontal sums of both accumulators at once
+		ht = _mm_add_ps(_mm_unpacklo_ps(ai, aq), _mm_unpackhi_ps(ai, aq));
+		ht = _mm_add_ps(ht, _mm_movehl_ps(ht, ht));
+		_mm_store_ss(&g->lp_i[1 + cnt], ht);
+		_mm_store_ss(&g->lp_q[1 + cnt], _mm_shuffle_ps(ht, ht, 1));
+#elif defined(NRF905_GFSK_NEON)
+		float32x4_t ai = vdupq_n_f32(0);
+		float32x4_t aq = vdupq_n_f32(0);
+		float32x4_t ht;
+		float32x2_t s;
+
+		for (t=0; t < g->tap_cnt; t += 4) {
+			ht = vld1q_f32(&h[t]);
+			ai = vmlaq_f32(ai, ht, vld1q_f32(&xi[t]));
+			aq = vmlaq_f32(aq, ht, vld1q_f32(&xq[t]));
+		}
+		s = vpadd_f32(vadd_f32(vget_low_f32(ai), vget_high_f32(ai)),
+			      vadd_f32(vget_low_f32(aq), vget_high_f32(aq)));
+		g->lp_i[1 + cnt] = vget_lane_f32(s, 0);
+		g->lp_q[1 + cnt] = vget_lane_f32(s, 1);
+#else
+		float ai = 0;
+		float aq = 0;
+
+		for (t=0; t < g->tap_cnt; t++) {
+			ai += h[t] * xi[t];
+			aq += h[t] * xq[t];
+		}
+		g->lp_i[1 + cnt] = ai;
+		g->lp_q[1 + cnt] = aq;
+#endif
+		cnt++;
+	}
+
+	// Keep the samples of the next output
+	memmove(g->in_i, &g->in_i[j], (g->in_len - j) * sizeof(float));
+	memmove(g->in_q, &g->in_q[j], (g->in_len - j) * sizeof(float));
+	g->in_len -= j;
+
+	return cnt;
+}
+
+/**
+ * FM discriminator, phase difference between filtered samples
+ */
+static void _nrf905_gfsk_discriminate(nrf905_gfsk_t *g, unsigned int cnt)
+{
+	const float *ci = &g->lp_i[1];
+	const float *cq = &g->lp_q[1];
+	const float *pi = g->lp_i;
+	const float *pq = g->lp_q;
+	float *out = &g->freq[g->freq_len];
+	unsigned int k = 0;
+#if defined(__SSE2__)
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 tiny = _mm_set1_ps(1e-30f);
+	__m128 re, im, ax, ay, mx, mn, a, s, r, m;
+
+	for (; k + 4 <= cnt; k += 4) {
+		re = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&ci[k]), _mm_loadu_ps(&pi[k])),
+				_mm_mul_ps(_mm_loadu_ps(&cq[k]), _mm_loadu_ps(&pq[k])));
+		im = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&cq[k]), _mm_loadu_ps(&pi[k])),
+				_mm_mul_ps(_mm_loadu_ps(&ci[k]), _mm_loadu_ps(&pq[k])));
+
+		ax = _mm_andnot_ps(sign, re);
+		ay = _mm_andnot_ps(sign, im);
+		mx = _mm_max_ps(ax, ay);
+		mn = _mm_min_ps(ax, ay);
+		a = _mm_div_ps(mn, _mm_add_ps(mx, tiny));
+		s = _mm_mul_ps(a, a);
+		r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_C11), s),
+			       _mm_set1_ps(ATAN_C9));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C7));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C5));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C3));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C1));
+		r = _mm_mul_ps(r, a);
+
+		m = _mm_cmpgt_ps(ay, ax);
+		r = _mm_or_ps(_mm_andnot_ps(m, r), _mm_and_ps(m,
+			_mm_sub_ps(_mm_set1_ps((float) M_PI_2), r)));
+		m = _mm_cmplt_ps(re, _mm_setzero_ps());
+		r = _mm_or_ps(_mm_andnot_ps(m, r), _mm_and_ps(m,
+			_mm_sub_ps(_mm_set1_ps((float) M_PI), r)));
+		m = _mm_cmplt_ps(im, _mm_setzero_ps());
+		r = _mm_or_ps(_mm_andnot_ps(m, r), _mm_and_ps(m,
+			_mm_sub_ps(_mm_setzero_ps(), r)));
+
+		_mm_storeu_ps(&out[k], r);
+	}
+#elif defined(NRF905_GFSK_NEON)
+	const float32x4_t tiny = vdupq_n_f32(1e-30f);
+	float32x4_t re, im, ax, ay, mx, mn, d, a, s, r;
+	uint32x4_t m;
+
+	for (; k + 4 <= cnt; k += 4) {
+		re = vmlaq_f32(vmulq_f32(vld1q_f32(&ci[k]), vld1q_f32(&pi[k])),
+			       vld1q_f32(&cq[k]), vld1q_f32(&pq[k]));
+		im = vmlsq_f32(vmulq_f32(vld1q_f32(&cq[k]), vld1q_f32(&pi[k])),
+			       vld1q_f32(&ci[k]), vld1q_f32(&pq[k]));
+
+		ax = vabsq_f32(re);
+		ay = vabsq_f32(im);
+		mx = vaddq_f32(vmaxq_f32(ax, ay), tiny);
+		mn = vminq_f32(ax, ay);
+		// Reciprocal estimate with two Newton-Raphson steps, ARMv7
+		// has no vector division
+		d = vrecpeq_f32(mx);
+		d = vmulq_f32(d, vrecpsq_f32(mx, d));
+		d = vmulq_f32(d, vrecpsq_f32(mx, d));
+		a = vmulq_f32(mn, d);
+		s = vmulq_f32(a, a);
+		r = vmlaq_f32(vdupq_n_f32(ATAN_C9), vdupq_n_f32(ATAN_C11), s);
+		r = vmlaq_f32(vdupq_n_f32(ATAN_C7), r, s);
+		r = vmlaq_f32(vdupq_n_f32(ATAN_C5), r, s);
+		r = vmlaq_f32(vdupq_n_f32(ATAN_C3), r, s);
+		r = vmlaq_f32(vdupq_n_f32(ATAN_C1), r, s);
+		r = vmulq_f32(r, a);
+
+		m = vcgtq_f32(ay, ax);
+		r = vbslq_f32(m, vsubq_f32(vdupq_n_f32((float) M_PI_2), r), r);
+		m = vcltq_f32(re, vdupq_n_f32(0));
+		r = vbslq_f32(m, vsubq_f32(vdupq_n_f32((float) M_PI), r), r);
+		m = vcltq_f32(im, vdupq_n_f32(0));
+		r = vbslq_f32(m, vnegq_f32(r), r);
+
+		vst1q_f32(&out[k], r);
+	}
+#endif
+	for (; k < cnt; k++) {
+		out[k] = _nrf905_gfsk_atan2(cq[k] * pi[k] - ci[k] * pq[k],
+					    ci[k] * pi[k] + cq[k] * pq[k]);
+	}
+
+	g->lp_i[0] = g->lp_i[cnt];
+	g->lp_q[0] = g->lp_q[cnt];
+	g->freq_len += cnt;
+}
+
+/**
+ * Mueller and Mueller clock recovery and slicer
+ *
+ * Same loop as GNU Radio's clock_recovery_mm_ff, with a cubic interpolator
+ * instead of the 8-tap MMSE one.
+ *
+ * @returns	Amount of symbols
+ */
+static unsigned int _nrf905_gfsk_clock_recovery(nrf905_gfsk_t *g)
+{
+	const float *x;
+	unsigned int ii = g->ii;
+	unsigned int cnt = 0;
+	float mu = g->mu;
+	float out, mm_val;
+	float f;
+
+	while (ii + 3 < g->freq_len) {
+		x = &g->freq[ii];
+		out = x[1] + 0.5f * mu * (x[2] - x[0] + mu * (2 * x[0] -
+			5 * x[1] + 4 * x[2] - x[3] + mu * (3 * (x[1] - x[2]) +
+			x[3] - x[0])));
+
+		mm_val = ((g->last_sample < 0) ? -out : out) -
+			 ((out < 0) ? -g->last_sample : g->last_sample);
+		g->last_sample = out;
+		g->symbols[cnt++] = (out >= 0);
+
+		g->omega += g->gain_omega * mm_val;
+		if (g->omega > g->omega_mid + g->omega_lim) {
+			g->omega = g->omega_mid + g->omega_lim;
+		} else if (g->omega < g->omega_mid - g->omega_lim) {
+			g->omega = g->omega_mid - g->omega_lim;
+		}
+
+		mu += g->omega + g->gain_mu * mm_val;
+		f = floorf(mu);
+		ii += (int) f;
+		mu -= f;
+	}
+	g->mu = mu;
+
+	if (ii < g->freq_len) {
+		memmove(g->freq, &g->freq[ii],
+			(g->freq_len - ii) * sizeof(float));
+		g->freq_len -= ii;
+		g->ii = 0;
+	} else {
+		g->ii = ii - g->freq_len;
+		g->freq_len = 0;
+	}
+
+	return cnt;
+}
+
+/**
+ * Demodulate the samples in in_i and in_q
+ */
+static void _nrf905_gfsk_run(nrf905_gfsk_t *g)
+{
+	unsigned int cnt;
+
+	cnt = _nrf905_gfsk_filter(g);
+	_nrf905_gfsk_discriminate(g, cnt);
+	cnt = _nrf905_gfsk_clock_recovery(g);
+	nrf905_decoder_push(g->decoder, g->symbols, cnt);
+}
+
+static void _nrf905_gfsk_block(nrf905_gfsk_t *g, const uint8_t *buf,
+				unsigned int n)
+{
+	nrf905_gfsk_convert(g->format, buf, n, &g->in_i[g->in_len],
+			&g->in_q[g->in_len]);
+	g->in_len += n;
+	_nrf905_gfsk_run(g);
+}
+
+int nrf905_gfsk_init(nrf905_gfsk_t *g, nrf905_gfsk_format_t format,
+			unsigned int samp_rate, nrf905_decoder_t *decoder)
+{
+	unsigned int decim;
+	unsigned int n, k;
+	double fc, x, sum;
+
+	decim = (samp_rate + NRF905_GFSK_DEMOD_RATE / 2) /
+			NRF905_GFSK_DEMOD_RATE;
+	if (decim < 1) {
+		decim = 1;
+	}
+	if ((format != NRF905_GFSK_CU8 && format != NRF905_GFSK_CS16) ||
+	    samp_rate < NRF905_GFSK_MIN_RATE ||
+	    decim > NRF905_GFSK_MAX_DECIM) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(g, 0, sizeof(*g));
+	g->decoder = decoder;
+	g->format = format;
+	g->decim = decim;
+
+	// Hamming windowed sinc
+	n = NRF905_GFSK_TAPS_PER_DECIM * decim + 1;
+	fc = (double) NRF905_GFSK_CUTOFF / samp_rate;
+	sum = 0;
+	for (k=0; k < n; k++) {
+		x = k - (n - 1) / 2.0;
+		g->taps[k] = (x == 0) ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+		g->taps[k] *= 0.54 - 0.46 * cos(2 * M_PI * k / (n - 1));
+		sum += g->taps[k];
+	}
+	for (k=0; k < n; k++) {
+		g->taps[k] /= sum;
+	}
+	g->tap_cnt = (n + 3) & ~3;
+
+	g->omega_mid = (float) samp_rate / decim / NRF905_GFSK_SYMBOL_RATE;
+	g->omega = g->omega_mid;
+	g->omega_lim = g->omega_mid * NRF905_GFSK_OMEGA_LIMIT;
+	g->gain_mu = NRF905_GFSK_GAIN_MU;
+	g->gain_omega = 0.25f * g->gain_mu * g->gain_mu;
+	g->mu = 0.5f;
+
+	return 0;
+}
+
+void nrf905_gfsk_push(nrf905_gfsk_t *g, const uint8_t *buf, size_t len)
+{
+	const unsigned int size = (g->format == NRF905_GFSK_CU8) ? 2 : 4;
+	size_t n;
+
+	if (g->partial_len > 0) {
+		while (g->partial_len < size && len > 0) {
+			g->partial[g->partial_len++] = *buf++;
+			len--;
+		}
+		if (g->partial_len < size) {
+			return;
+		}
+		_nrf905_gfsk_block(g, g->partial, 1);
+		g->partial_len = 0;
+	}
+
+	while (len >= size) {
+		n = len / size;
+		if (n > NRF905_GFSK_BLOCK) {
+			n = NRF905_GFSK_BLOCK;
+		}
+		_nrf905_gfsk_block(g, buf, n);
+		buf += n * size;
+		len -= n * size;
+	}
+
+	memcpy(g->partial, buf, len);
+	g->partial_len = len;
+}
+
+void nrf905_gfsk_push_float(nrf905_gfsk_t *g, const float *i, const float *q,
+			size_t n)
+{
+	size_t m;
+
+	while (n > 0) {
+		m = (n < NRF905_GFSK_BLOCK) ? n : NRF905_GFSK_BLOCK;
+		memcpy(&g->in_i[g->in_len], i, m * sizeof(float));
+		memcpy(&g->in_q[g->in_len], q, m * sizeof(float));
+		g->in_len += m;
+		_nrf905_gfsk_run(g);
+		i += m;
+		q += m;
+		n -= m;
+	}
+}
@@ -0,0 +1,175 @@
+/**
+ * nrf905_gfsk.h - GFSK demodulator for rtl_sdr IQ captures
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_GFSK_H__
+#define __NRF905_GFSK_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "nrf905_decoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Demodulator parameters, as used by nrf905_demod.py
+ *
+ * The nRF905 sends 50 kbit/s Manchester encoded, so 100 k symbols/s, with
+ * +-50 kHz deviation. The IQ stream is decimated to about 1 Msps, 10
+ * samples per symbol.
+ */
+#define NRF905_GFSK_SYMBOL_RATE (100000)
+#define NRF905_GFSK_DEMOD_RATE (1000000)
+#define NRF905_GFSK_MIN_RATE (300000)
+#define NRF905_GFSK_GAIN_MU (0.175f)
+#define NRF905_GFSK_OMEGA_LIMIT (0.005f)
+
+/**
+ * Low-pass cutoff frequency and length per decimation step
+ */
+#define NRF905_GFSK_CUTOFF (150000)
+#define NRF905_GFSK_TAPS_PER_DECIM (16)
+#define NRF905_GFSK_MAX_DECIM (8)
+#define NRF905_GFSK_MAX_TAPS \
+	(NRF905_GFSK_TAPS_PER_DECIM * NRF905_GFSK_MAX_DECIM + 4)
+
+/**
+ * Amount of IQ samples processed per step
+ */
+#define NRF905_GFSK_BLOCK (4096)
+
+/**
+ * IQ sample formats
+ */
+typedef enum {
+	NRF905_GFSK_CU8,	// Unsigned 8-bit I and Q, as written by rtl_sdr
+	NRF905_GFSK_CS16,	// Signed 16-bit little-endian I and Q
+} nrf905_gfsk_format_t;
+
+/**
+ * Demodulator
+ *
+ * Low-pass filters and decimates the IQ stream, takes the phase difference
+ * between samples as frequency, recovers the symbol clock with the
+ * Mueller and Mueller algorithm and slices the symbols, which are pushed to
+ * the decoder. Everything is kept in the object, nothing is allocated.
+ */
+typedef struct {
+	nrf905_decoder_t *decoder;
+	nrf905_gfsk_format_t format;
+	unsigned int decim;
+
+	// Low-pass filter, taps padded with zeros to a multiple of 4
+	float taps[NRF905_GFSK_MAX_TAPS] __attribute__((aligned(16)));
+	unsigned int tap_cnt;
+	float in_i[NRF905_GFSK_MAX_TAPS + NRF905_GFSK_BLOCK];
+	float in_q[NRF905_GFSK_MAX_TAPS + NRF905_GFSK_BLOCK];
+	unsigned int in_len;
+
+	// Filtered samples, the first one is the previous block's last
+	float lp_i[NRF905_GFSK_BLOCK + 1];
+	float lp_q[NRF905_GFSK_BLOCK + 1];
+
+	// Frequency, kept until the clock recovery is done with it
+	float freq[NRF905_GFSK_BLOCK + 8];
+	unsigned int freq_len;
+
+	// Clock recovery
+	float omega;
+	float omega_mid;
+	float omega_lim;
+	float gain_omega;
+	float gain_mu;
+	float mu;
+	float last_sample;
+	unsigned int ii;		// Next sample, may be beyond freq_len
+
+	uint8_t symbols[NRF905_GFSK_BLOCK];
+
+	// Part of an IQ sample left over from the previous push
+	uint8_t partial[4];
+	unsigned int partial_len;
+} nrf905_gfsk_t;
+
+/**
+ * Initialize demodulator
+ *
+ * @param g		Demodulator object to initialize
+ * @param format	IQ sample format of nrf905_gfsk_push()
+ * @param samp_rate	IQ sample rate, 300 ksps to 8 Msps. From 1.5 Msps it
+ *			is decimated by the closest integer to 1 Msps.
+ * @param decoder	Decoder to push the symbols to
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if the sample rate is
+ *		out of range.
+ */
+int nrf905_gfsk_init(nrf905_gfsk_t *g, nrf905_gfsk_format_t format,
+			unsigned int samp_rate, nrf905_decoder_t *decoder);
+
+/**
+ * Demodulate IQ samples
+ *
+ * @param g	Demodulator object
+ * @param buf	Interleaved I and Q samples, may end in the middle of one
+ * @param len	Length of buf in bytes
+ */
+void nrf905_gfsk_push(nrf905_gfsk_t *g, const uint8_t *buf, size_t len);
+
+/**
+ * Demodulate float IQ samples
+ *
+ * @param g	Demodulator object
+ * @param i	In-phase samples
+ * @param q	Quadrature samples
+ * @param n	Amount of samples
+ */
+void nrf905_gfsk_push_float(nrf905_gfsk_t *g, const float *i, const float *q,
+			size_t n);
+
+/**
+ * Convert IQ samples to float, I and Q in separate arrays
+ *
+ * Samples are scaled to -1 to 1.
+ *
+ * @param format	IQ sample format
+ * @param buf		Interleaved I and Q samples
+ * @param n		Amount of samples
+ * @param i		Returns the in-phase samples
+ * @param q		Returns the quadrature samples
+ */
+void nrf905_gfsk_convert(nrf905_gfsk_format_t format, const uint8_t *buf,
+			size_t n, float *i, float *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_GFSK_H__
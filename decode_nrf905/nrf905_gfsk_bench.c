@@ -0,0 +1,192 @@
+/**
+ * nrf905_gfsk_bench.c - Benchmark GFSK demodulator on synthetic IQ
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nrf905_decoder.h"
+#include "nrf905_gfsk.h"
+#include "nrf905_gen.h"
+#include "nrf905_bench_util.h"
+
+#define FRAME_CNT (2000)
+#define FRAME_LEN (4 + 32 + 2)
+#define PUSH_SIZE (65536)
+
+struct capture {
+	uint8_t *buf;
+	size_t len;
+	uint8_t frames[FRAME_CNT][FRAME_LEN];
+	unsigned int frame_cnt;
+};
+
+struct result {
+	const struct capture *cap;
+	unsigned int next;		// Next sent frame to look for
+	unsigned long ok;
+};
+
+static void frame_sent(nrf905_gen_t *g, const uint8_t *data,
+			unsigned int len, uint64_t offset)
+{
+	struct capture *cap = g->priv;
+
+	memcpy(cap->frames[cap->frame_cnt++], data, FRAME_LEN);
+}
+
+/**
+ * Generate capture in memory
+ */
+static void gen_capture(struct capture *cap, const nrf905_gen_config_t *cfg)
+{
+	static nrf905_gen_t gen;
+	size_t size = 0;
+	size_t n;
+
+	free(cap->buf);
+	cap->buf = NULL;
+	cap->len = 0;
+	cap->frame_cnt = 0;
+	if (nrf905_gen_init(&gen, cfg, frame_sent, cap) != 0) {
+		perror("nrf905_gen_init");
+		exit(EXIT_FAILURE);
+	}
+
+	do {
+		if (cap->len == size) {
+			size = size ? 2 * size : 16 * 1024 * 1024;
+			cap->buf = realloc(cap->buf, size);
+			if (cap->buf == NULL) {
+				fprintf(stderr, "Out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		n = nrf905_gen_read(&gen, &cap->buf[cap->len], size - cap->len);
+		cap->len += n;
+	} while (n > 0);
+}
+
+/**
+ * Count decoded frames that were sent, frames are decoded in order
+ */
+static void check_frame(nrf905_decoder_t *d, const nrf905_decoder_frame_t *f)
+{
+	struct result *res = d->priv;
+	unsigned int i;
+
+	if (!f->crc16_ok || f->len < FRAME_LEN) {
+		return;
+	}
+	for (i=res->next; i < res->cap->frame_cnt && i < res->next + 16; i++) {
+		if (memcmp(f->data, res->cap->frames[i], FRAME_LEN) == 0) {
+			res->ok++;
+			res->next = i + 1;
+			break;
+		}
+	}
+}
+
+static void run(struct capture *cap, nrf905_gen_format_t format,
+		unsigned int samp_rate, double offset, double snr_db,
+		double drift_ppm)
+{
+	static nrf905_gfsk_t g;
+	nrf905_gen_config_t cfg;
+	nrf905_decoder_t d;
+	struct result res;
+	size_t pos, n;
+	double start, elapsed, samples;
+
+	nrf905_gen_config_init(&cfg);
+	cfg.format = format;
+	cfg.samp_rate = samp_rate;
+	cfg.frame_cnt = FRAME_CNT;
+	cfg.freq_offset = offset;
+	cfg.snr_db = snr_db;
+	cfg.drift_ppm = drift_ppm;
+	gen_capture(cap, &cfg);
+
+	memset(&res, 0, sizeof(res));
+	res.cap = cap;
+	nrf905_decoder_init(&d, check_frame, &res);
+
+	if (format == NRF905_GEN_UNPACKED) {
+		// Reference, frames with the preamble in the payload are cut by
+		// the decoder
+		nrf905_decoder_push(&d, cap->buf, cap->len);
+		printf("demodulated:                                 %5.1f%% frames ok\n",
+			100.0 * res.ok / FRAME_CNT);
+		return;
+	}
+
+	if (nrf905_gfsk_init(&g, (format == NRF905_GEN_CU8) ?
+			NRF905_GFSK_CU8 : NRF905_GFSK_CS16, samp_rate, &d) == -1) {
+		perror("nrf905_gfsk_init");
+		exit(EXIT_FAILURE);
+	}
+	samples = cap->len / ((format == NRF905_GEN_CU8) ? 2 : 4);
+
+	start = nrf905_bench_now();
+	for (pos=0; pos < cap->len; pos += n) {
+		n = (cap->len - pos < PUSH_SIZE) ? cap->len - pos : PUSH_SIZE;
+		nrf905_gfsk_push(&g, &cap->buf[pos], n);
+	}
+	elapsed = nrf905_bench_now() - start;
+
+	printf("%-4s %4.1f Msps %+6.0f Hz %+4.0f ppm SNR %4.1f dB: %5.1f%% frames ok, %6.1f Msamples/s, %5.1fx real time\n",
+		(format == NRF905_GEN_CU8) ? "cu8" : "cs16", samp_rate / 1e6,
+		offset, drift_ppm, snr_db, 100.0 * res.ok / FRAME_CNT,
+		samples / elapsed / 1e6, samples / samp_rate / elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int rates[] = { 1000000, 2000000, 2400000 };
+	static const double offsets[] = { 5000, 15000 };
+	static const double snrs[] = { 12, 9, 6 };
+	static struct capture cap;
+	unsigned int i;
+
+	run(&cap, NRF905_GEN_UNPACKED, 0, 0, 0, 0);
+	for (i=0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+		run(&cap, NRF905_GEN_CU8, rates[i], 0, 20, 0);
+	}
+	run(&cap, NRF905_GEN_CS16, 1000000, 0, 20, 0);
+	for (i=0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+		run(&cap, NRF905_GEN_CU8, 1000000, offsets[i], 20, 0);
+	}
+	run(&cap, NRF905_GEN_CU8, 1000000, 0, 20, 200);
+	for (i=0; i < sizeof(snrs) / sizeof(snrs[0]); i++) {
+		run(&cap, NRF905_GEN_CU8, 1000000, 0, snrs[i], 0);
+	}
+
+	free(cap.buf);
+	return 0;
+}
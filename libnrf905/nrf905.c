@@ -32,20 +32,80 @@
 #include <assert.h>
 #include <errno.h>
 #include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
 
 #include "nrf905.h"
+#include "nrf905_csma.h"
+#include "nrf905_dedup.h"
+#include "nrf905_filter.h"
+#include "nrf905_time.h"
+
+/**
+ * Busy wait instead of sleep for settling times shorter then this
+ */
+#define NRF905_SPIN_THRESHOLD_US (100)
+
+/**
+ * Pin levels for every operating mode
+ */
+struct nrf905_mode_pins {
+	uint8_t pwr;
+	uint8_t ce;
+	uint8_t txen;
+};
+
+static const struct nrf905_mode_pins nrf905_mode_pins[4] = {
+	[NRF905_MODE_POWER_DOWN]	= { LOW,  LOW,  LOW  },
+	[NRF905_MODE_STANDBY]		= { HIGH, LOW,  LOW  },
+	[NRF905_MODE_RX]		= { HIGH, HIGH, LOW  },
+	[NRF905_MODE_TX]		= { HIGH, HIGH, HIGH },
+};
+
+static uint32_t _nrf905_pin_mask(uint8_t pin, uint8_t level)
+{
+	if (pin == NRF905_PIN_NC || level == LOW) {
+		return 0;
+	}
+	return (uint32_t) 1 << pin;
+}
 
 int nrf905_init(nrf905_t *nrf, uint8_t pin_pwr, uint8_t pin_ce,
 		uint8_t pin_txen, uint8_t pin_dr, uint8_t spi_cs)
 {
+	int i;
+
+	if ((pin_pwr >= 32 && pin_pwr != NRF905_PIN_NC) ||
+	    pin_ce >= 32 || pin_txen >= 32)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
 	nrf->pin_pwr	= pin_pwr;
 	nrf->pin_ce	= pin_ce;
 	nrf->pin_txen	= pin_txen;
 	nrf->pin_dr	= pin_dr;
+	nrf->pin_am	= NRF905_PIN_NC;
+	nrf->pin_cd	= NRF905_PIN_NC;
 	nrf->spi_cs	= spi_cs;
 
 	nrf->status = 0;
-	nrf->recv_enabled = false;
+	nrf->csma = NULL;
+	nrf->filter = NULL;
+	nrf->dedup = NULL;
+	nrf->dr_event_fd = -1;
+	nrf->am_event_fd = -1;
+
+	for (i=0; i < 4; i++) {
+		nrf->mode_pins[i] =
+			_nrf905_pin_mask(pin_pwr, nrf905_mode_pins[i].pwr) |
+			_nrf905_pin_mask(pin_ce, nrf905_mode_pins[i].ce) |
+			_nrf905_pin_mask(pin_txen, nrf905_mode_pins[i].txen);
+	}
 
 	// Defaults
 	nrf->ch_no	 = 108;
@@ -88,11 +148,19 @@ int nrf905_init(nrf905_t *nrf, uint8_t pin_pwr, uint8_t pin_ce,
 		bcm2835_gpio_write(nrf->pin_pwr, HIGH);
 	}
 
+	// Give the device time to power up, if PWR is hard wired this is only
+	// needed if we where started right after power on, but better be safe.
+	nrf->mode = NRF905_MODE_STANDBY;
+	clock_gettime(CLOCK_MONOTONIC, &nrf->ready_at);
+	_timespec_add_us(&nrf->ready_at, NRF905_T_PWR_UP_US);
+	nrf->mode_ts = nrf->ready_at;
+
 	return 0;
 }
 
 void nrf905_destroy(nrf905_t *nrf)
 {
+	nrf905_disable_edge_events(nrf);
 	bcm2835_spi_end();
 	bcm2835_close(); //TODO: should we do this or the caller?
 }
@@ -126,31 +194,55 @@ int nrf905_read_config(nrf905_t *nrf)
 	return 0;
 }
 
+/**
+ * Encode the cached configuration into the configuration register layout
+ */
+static void _nrf905_encode_config(nrf905_t *nrf, uint8_t *conf)
+{
+	conf[0]  = (nrf->ch_no & 0xff);
+	conf[1]  = (nrf->ch_no >> 8) & 0x1;
+	conf[1] |= (nrf->hfreq_pll & 0x1) << 1;
+	conf[1] |= (nrf->pa_pwr & 0x3) << 2;
+	conf[1] |= (nrf->rx_red_pwr & 0x1) << 4;
+	conf[1] |= (nrf->auto_retran & 0x1) << 5;
+	conf[2]  = (nrf->rx_afw & 0x7);
+	conf[2] |= (nrf->tx_afw & 0x7) << 4;
+	conf[3]  = (nrf->rx_pw & 0x3F);
+	conf[4]  = (nrf->tx_pw & 0x3F);
+	conf[5]  =  nrf->rx_addr & 0xff;
+	conf[6]  = (nrf->rx_addr >> 8) & 0xff;
+	conf[7]  = (nrf->rx_addr >> 16) & 0xff;
+	conf[8]  = (nrf->rx_addr >> 24) & 0xff;
+	conf[9]  = (nrf->up_clk_freq & 0x3);
+	conf[9] |= (nrf->up_clk_en & 0x1) << 2;
+	conf[9] |= (nrf->xof & 0x7) << 3;
+	conf[9] |= (nrf->crc_en & 0x1) << 6;
+	conf[9] |= (nrf->crc_mode & 0x1) << 7;
+}
+
 int nrf905_write_config(nrf905_t *nrf)
 {
-	uint8_t transfer_buf[11] = {0x00, 0x00};
-
-	transfer_buf[1]  = (nrf->ch_no & 0xff);
-	transfer_buf[2]  = (nrf->ch_no >> 8) & 0x1;
-	transfer_buf[2] |= (nrf->hfreq_pll & 0x1) << 1;
-	transfer_buf[2] |= (nrf->pa_pwr & 0x3) << 2;
-	transfer_buf[2] |= (nrf->rx_red_pwr & 0x1) << 4;
-	transfer_buf[2] |= (nrf->auto_retran & 0x1) << 5;
-	transfer_buf[3]  = (nrf->rx_afw & 0x7);
-	transfer_buf[3] |= (nrf->tx_afw & 0x7) << 4;
-	transfer_buf[4]  = (nrf->rx_pw & 0x3F);
-	transfer_buf[5]  = (nrf->tx_pw & 0x3F);
-	transfer_buf[6]  =  nrf->rx_addr & 0xff;
-	transfer_buf[7]  = (nrf->rx_addr >> 8) & 0xff;
-	transfer_buf[8]  = (nrf->rx_addr >> 16) & 0xff;
-	transfer_buf[9]  = (nrf->rx_addr >> 24) & 0xff;
-	transfer_buf[10]  = (nrf->up_clk_freq & 0x3);
-	transfer_buf[10] |= (nrf->up_clk_en & 0x1) << 2;
-	transfer_buf[10] |= (nrf->xof & 0x7) << 3;
-	transfer_buf[10] |= (nrf->crc_en & 0x1) << 6;
-	transfer_buf[10] |= (nrf->crc_mode & 0x1) << 7;
+	return nrf905_write_config_bytes(nrf, 0, NRF905_CONF_LEN);
+}
 
-	bcm2835_spi_transfern((char *) transfer_buf, sizeof(transfer_buf));
+int nrf905_write_config_bytes(nrf905_t *nrf, uint8_t offset, uint8_t len)
+{
+	uint8_t conf[NRF905_CONF_LEN];
+	uint8_t transfer_buf[1 + NRF905_CONF_LEN];
+
+	if (len == 0 || offset >= NRF905_CONF_LEN ||
+	    len > NRF905_CONF_LEN - offset)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	_nrf905_encode_config(nrf, conf);
+
+	transfer_buf[0] = 0x00 | offset;
+	memcpy(&transfer_buf[1], &conf[offset], len);
+
+	bcm2835_spi_transfern((char *) transfer_buf, 1 + len);
 
 	nrf->status = transfer_buf[0];
 	//TODO: detect incorrect results?
@@ -170,13 +262,13 @@ uint32_t nrf905_get_freq(nrf905_t *nrf)
 	return freq;
 }
 
-int nrf905_set_freq(nrf905_t *nrf, uint32_t freq)
+int nrf905_freq_to_channel(uint32_t freq, uint16_t *ch_no, bool *hfreq_pll)
 {
-	bool hfreq_pll = false;
-	int ch_no;
+	bool hfreq = false;
+	uint16_t ch;
 
 	if (freq > 473500000) {
-		hfreq_pll = true; // Change hfreq_pll after error checking
+		hfreq = true; // Change hfreq_pll after error checking
 		freq = freq / 2;
 	}
 
@@ -187,9 +279,24 @@ int nrf905_set_freq(nrf905_t *nrf, uint32_t freq)
 	}
 
 	freq -= 422400000;
-	ch_no = freq / 100000;
+	ch = freq / 100000;
 	if (freq % 100000 >= 50000) {
-		ch_no++;
+		ch++;
+	}
+
+	*hfreq_pll = hfreq;
+	*ch_no = ch;
+
+	return 0;
+}
+
+int nrf905_set_freq(nrf905_t *nrf, uint32_t freq)
+{
+	bool hfreq_pll;
+	uint16_t ch_no;
+
+	if (nrf905_freq_to_channel(freq, &ch_no, &hfreq_pll) != 0) {
+		return -1;
 	}
 
 	nrf->hfreq_pll = hfreq_pll;
@@ -395,6 +502,406 @@ int nrf905_set_crc_mode(nrf905_t *nrf, uint8_t crc_mode)
 	return 0;
 }
 
+static uint32_t _nrf905_airtime(nrf905_t *nrf, uint8_t afw, uint8_t pw)
+{
+	uint32_t bits;
+
+	bits = NRF905_PREAMBLE_BITS + (afw + pw) * 8;
+	if (nrf->crc_en) {
+		bits += (nrf->crc_mode == NRF905_CRC_MODE_CRC16) ? 16 : 8;
+	}
+
+	return bits * NRF905_BIT_TIME_US;
+}
+
+uint32_t nrf905_get_tx_airtime(nrf905_t *nrf)
+{
+	return _nrf905_airtime(nrf, nrf->tx_afw, nrf->tx_pw);
+}
+
+uint32_t nrf905_get_rx_airtime(nrf905_t *nrf)
+{
+	return _nrf905_airtime(nrf, nrf->rx_afw, nrf->rx_pw);
+}
+
+uint8_t nrf905_get_mode(nrf905_t *nrf)
+{
+	return nrf->mode;
+}
+
+/**
+ * Sleep until deadline
+ */
+static void _nrf905_wait_until(const struct timespec *deadline)
+{
+	struct timespec now;
+	int64_t remaining;
+	int err;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	remaining = _timespec_diff_ns(deadline, &now);
+	if (remaining <= 0) {
+		return;
+	}
+
+	if (remaining < NRF905_SPIN_THRESHOLD_US * 1000) {
+		// Sleeping would overshoot the deadline, spin instead
+		do {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+		} while (_timespec_cmp(&now, deadline) < 0);
+		return;
+	}
+
+	do {
+		err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					deadline, NULL);
+	} while (err == EINTR);
+}
+
+void nrf905_wait_ready(nrf905_t *nrf)
+{
+	_nrf905_wait_until(&nrf->ready_at);
+}
+
+void nrf905_wait_settled(nrf905_t *nrf)
+{
+	_nrf905_wait_until(&nrf->mode_ts);
+}
+
+/**
+ * Drive the pins that differ between two modes
+ *
+ * All pins going low are cleared in one register write, followed by one
+ * write setting all pins going high. This way TRX_CE is dropped before TX_EN
+ * changes when leaving RX or TX mode.
+ */
+static void _nrf905_write_mode_pins(nrf905_t *nrf, uint8_t from, uint8_t to)
+{
+	uint32_t old = nrf->mode_pins[from];
+	uint32_t new = nrf->mode_pins[to];
+
+	if (old & ~new) {
+		bcm2835_gpio_clr_multi(old & ~new);
+	}
+	if (new & ~old) {
+		bcm2835_gpio_set_multi(new & ~old);
+	}
+}
+
+/**
+ * Time until the device is settled after a mode transition
+ */
+static uint32_t _nrf905_settle_us(uint8_t from, uint8_t to)
+{
+	uint32_t settle_us = 0;
+
+	switch (to) {
+	case NRF905_MODE_POWER_DOWN:
+		break;
+	case NRF905_MODE_STANDBY:
+		if (from == NRF905_MODE_POWER_DOWN) {
+			settle_us = NRF905_T_PWR_UP_US;
+		}
+		break;
+	case NRF905_MODE_RX:
+	case NRF905_MODE_TX:
+		if (from == NRF905_MODE_POWER_DOWN) {
+			settle_us = NRF905_T_PWR_UP_US + NRF905_T_STBY_TRX_US;
+		} else if (from == NRF905_MODE_STANDBY) {
+			settle_us = NRF905_T_STBY_TRX_US;
+		} else {
+			settle_us = NRF905_T_RX_TX_US;
+		}
+		break;
+	}
+
+	return settle_us;
+}
+
+int nrf905_set_mode(nrf905_t *nrf, uint8_t mode)
+{
+	struct timespec now;
+	struct timespec tx_end = { 0, 0 };
+	uint8_t old_mode = nrf->mode;
+
+	if (mode > NRF905_MODE_TX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (mode == old_mode) {
+		return 0;
+	}
+
+	nrf905_wait_ready(nrf);
+
+	if (old_mode == NRF905_MODE_TX) {
+		// A frame that is in the air is always completed by the device.
+		// With auto retransmit this is the frame currently being send.
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		tx_end = nrf->mode_ts;
+		if (nrf->auto_retran && _timespec_cmp(&now, &tx_end) > 0) {
+			tx_end = now;
+		}
+		_timespec_add_us(&tx_end, nrf905_get_tx_airtime(nrf));
+
+		if (mode != NRF905_MODE_STANDBY) {
+			nrf->ready_at = tx_end;
+			nrf905_wait_ready(nrf);
+		}
+	}
+
+	_nrf905_write_mode_pins(nrf, old_mode, mode);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	nrf->mode = mode;
+	nrf->mode_ts = now;
+	_timespec_add_us(&nrf->mode_ts, _nrf905_settle_us(old_mode, mode));
+
+	// Determine earliest time to leave this mode
+	nrf->ready_at = now;
+	if (mode == NRF905_MODE_TX) {
+		_timespec_add_us(&nrf->ready_at, NRF905_T_CE_PULSE_US);
+	} else if (old_mode == NRF905_MODE_TX) {
+		// Device is busy until the frame is send
+		if (_timespec_cmp(&tx_end, &now) > 0) {
+			nrf->ready_at = tx_end;
+		}
+	} else if (mode == NRF905_MODE_STANDBY) {
+		nrf->ready_at = nrf->mode_ts;
+	}
+
+	return 0;
+}
+
+int nrf905_set_pin_am(nrf905_t *nrf, uint8_t pin_am)
+{
+	nrf->pin_am = pin_am;
+	if (pin_am != NRF905_PIN_NC) {
+		bcm2835_gpio_fsel(pin_am, BCM2835_GPIO_FSEL_INPT);
+	}
+
+	return 0;
+}
+
+int nrf905_set_pin_cd(nrf905_t *nrf, uint8_t pin_cd)
+{
+	nrf->pin_cd = pin_cd;
+	if (pin_cd != NRF905_PIN_NC) {
+		bcm2835_gpio_fsel(pin_cd, BCM2835_GPIO_FSEL_INPT);
+	}
+
+	return 0;
+}
+
+uint8_t nrf905_read_status(nrf905_t *nrf)
+{
+	// Status is clocked out during the command byte of any instruction
+	uint8_t transfer_buf[1] = { 0x10 };
+
+	bcm2835_spi_transfern((char *) transfer_buf, sizeof(transfer_buf));
+
+	nrf->status = transfer_buf[0];
+
+	return nrf->status;
+}
+
+bool nrf905_data_ready(nrf905_t *nrf)
+{
+	if (nrf->pin_dr != NRF905_PIN_NC) {
+		return bcm2835_gpio_lev(nrf->pin_dr) == HIGH;
+	}
+	return (nrf905_read_status(nrf) & NRF905_STATUS_DR) != 0;
+}
+
+bool nrf905_address_match(nrf905_t *nrf)
+{
+	if (nrf->pin_am != NRF905_PIN_NC) {
+		return bcm2835_gpio_lev(nrf->pin_am) == HIGH;
+	}
+	return (nrf905_read_status(nrf) & NRF905_STATUS_AM) != 0;
+}
+
+int nrf905_carrier_detect(nrf905_t *nrf)
+{
+	if (nrf->pin_cd == NRF905_PIN_NC) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	return bcm2835_gpio_lev(nrf->pin_cd) == HIGH;
+}
+
+long nrf905_sample_carrier(nrf905_t *nrf, uint32_t dwell_us,
+			unsigned long *busy, unsigned long *bursts)
+{
+	struct timespec end;
+	struct timespec now;
+	unsigned long samples = 0;
+	bool prev = false;
+	bool cd;
+
+	if (nrf->pin_cd == NRF905_PIN_NC) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (nrf->mode != NRF905_MODE_RX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*busy = 0;
+	*bursts = 0;
+
+	nrf905_wait_settled(nrf);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	_timespec_add_us(&end, dwell_us);
+	do {
+		cd = (bcm2835_gpio_lev(nrf->pin_cd) == HIGH);
+		if (cd) {
+			(*busy)++;
+			if (!prev) {
+				(*bursts)++;
+			}
+		}
+		prev = cd;
+		samples++;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (_timespec_cmp(&now, &end) < 0);
+
+	return samples;
+}
+
+void nrf905_set_csma(nrf905_t *nrf, struct nrf905_csma *csma)
+{
+	nrf->csma = csma;
+}
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+/**
+ * Request rising edge events for a GPIO line
+ *
+ * @returns	Line file descriptor, or -1 on error
+ */
+static int _nrf905_request_edge(int chip_fd, uint8_t pin)
+{
+	struct gpio_v2_line_request req;
+	int flags;
+
+	memset(&req, 0, sizeof(req));
+	req.offsets[0] = pin;
+	req.num_lines = 1;
+	req.config.flags = GPIO_V2_LINE_FLAG_INPUT |
+				GPIO_V2_LINE_FLAG_EDGE_RISING;
+	strncpy(req.consumer, "nrf905", sizeof(req.consumer) - 1);
+
+	if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+		return -1;
+	}
+
+	flags = fcntl(req.fd, F_GETFL);
+	fcntl(req.fd, F_SETFL, flags | O_NONBLOCK);
+
+	return req.fd;
+}
+
+int nrf905_enable_edge_events(nrf905_t *nrf, const char *chip)
+{
+	int chip_fd;
+	int err_save;
+
+	if (nrf->pin_dr == NRF905_PIN_NC) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	nrf905_disable_edge_events(nrf);
+
+	chip_fd = open(chip, O_RDONLY | O_CLOEXEC);
+	if (chip_fd < 0) {
+		return -1;
+	}
+
+	nrf->dr_event_fd = _nrf905_request_edge(chip_fd, nrf->pin_dr);
+	if (nrf->dr_event_fd >= 0 && nrf->pin_am != NRF905_PIN_NC) {
+		nrf->am_event_fd = _nrf905_request_edge(chip_fd, nrf->pin_am);
+		if (nrf->am_event_fd < 0) {
+			err_save = errno;
+			nrf905_disable_edge_events(nrf);
+			errno = err_save;
+		}
+	}
+
+	err_save = errno;
+	close(chip_fd);
+	errno = err_save;
+
+	return (nrf->dr_event_fd >= 0) ? 0 : -1;
+}
+
+/**
+ * Read all pending edge events
+ *
+ * @param fd	Line file descriptor
+ * @param last	If not NULL, returns timestamp of the last event
+ *
+ * @returns	Amount of events read
+ */
+static int _nrf905_drain_events(int fd, struct timespec *last)
+{
+	struct gpio_v2_line_event ev[16];
+	ssize_t n;
+	int cnt = 0;
+
+	while ((n = read(fd, ev, sizeof(ev))) > 0) {
+		cnt += n / sizeof(ev[0]);
+		if (last != NULL) {
+			last->tv_sec = ev[n / sizeof(ev[0]) - 1].timestamp_ns /
+					1000000000;
+			last->tv_nsec = ev[n / sizeof(ev[0]) - 1].timestamp_ns %
+					1000000000;
+		}
+	}
+
+	return cnt;
+}
+#else
+int nrf905_enable_edge_events(nrf905_t *nrf, const char *chip)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+static int _nrf905_drain_events(int fd, struct timespec *last)
+{
+	return 0;
+}
+#endif
+
+void nrf905_disable_edge_events(nrf905_t *nrf)
+{
+	if (nrf->dr_event_fd >= 0) {
+		close(nrf->dr_event_fd);
+		nrf->dr_event_fd = -1;
+	}
+	if (nrf->am_event_fd >= 0) {
+		close(nrf->am_event_fd);
+		nrf->am_event_fd = -1;
+	}
+}
+
+void nrf905_set_filter(nrf905_t *nrf, struct nrf905_filter *filter)
+{
+	nrf->filter = filter;
+}
+
+void nrf905_set_dedup(nrf905_t *nrf, struct nrf905_dedup *dedup)
+{
+	nrf->dedup = dedup;
+}
+
 int nrf905_write_tx_addr(nrf905_t *nrf, uint32_t addr)
 {
 	uint8_t transfer_buf[5] = { 0x22, 0 };
@@ -412,11 +919,7 @@ int nrf905_write_tx_addr(nrf905_t *nrf, uint32_t addr)
 	return 0;
 }
 
-/**
- * Start sending data
- */
-static int _nrf905_start_send(nrf905_t *nrf, const void *data, size_t len,
-		bool auto_retran)
+int nrf905_write_tx_payload(nrf905_t *nrf, const void *data, size_t len)
 {
 	uint8_t transfer_buf[33] = { 0x20, 0 };
 	int err;
@@ -427,32 +930,81 @@ static int _nrf905_start_send(nrf905_t *nrf, const void *data, size_t len,
 	}
 	assert(len <= 32);
 
-	if (nrf->auto_retran != auto_retran) {
-		nrf->auto_retran = auto_retran;
-		//TODO: write only 2th byte of config
-		err = nrf905_write_config(nrf);
+	// Don't touch the payload register while a frame is in the air
+	if (nrf->mode == NRF905_MODE_TX) {
+		err = nrf905_set_mode(nrf, NRF905_MODE_STANDBY);
 		if (err != 0) {
 			return -1;
 		}
 	}
+	nrf905_wait_ready(nrf);
 
 	memcpy(transfer_buf + 1, data, len);
 
-	bcm2835_gpio_write(nrf->pin_ce, LOW);
-	bcm2835_gpio_write(nrf->pin_txen, HIGH);
-
 	bcm2835_spi_transfern((char *) transfer_buf, 1 + nrf->tx_pw);
 
 	nrf->status = transfer_buf[0];
 	//TODO: detect incorrect results?
 
-	bcm2835_gpio_write(nrf->pin_ce, HIGH);
+	return 0;
+}
+
+/**
+ * Select single shot or auto retransmit
+ */
+static int _nrf905_set_auto_retran(nrf905_t *nrf, bool auto_retran)
+{
+	if (nrf->auto_retran != auto_retran) {
+		nrf->auto_retran = auto_retran;
+		return nrf905_write_config_bytes(nrf, NRF905_CONF_FLAGS, 1);
+	}
 
 	return 0;
 }
 
+/**
+ * Start sending data
+ *
+ * Loads the TX payload register, waits for a clear channel if listen before
+ * talk is enabled and switches to TX mode. The caller is responsible for
+ * leaving TX mode again.
+ */
+static int _nrf905_start_send(nrf905_t *nrf, const void *data, size_t len,
+		bool auto_retran)
+{
+	int err;
+
+	err = nrf905_write_tx_payload(nrf, data, len);
+	if (err != 0) {
+		return -1;
+	}
+
+	err = _nrf905_set_auto_retran(nrf, auto_retran);
+	if (err != 0) {
+		return -1;
+	}
+
+	if (nrf->csma != NULL) {
+		err = nrf905_csma_wait_clear(nrf, nrf->csma);
+		if (err != 0) {
+			return -1;
+		}
+	}
+
+	return nrf905_set_mode(nrf, NRF905_MODE_TX);
+}
+
+/**
+ * Mode to return to after sending
+ */
+static uint8_t _nrf905_after_send_mode(uint8_t mode)
+{
+	return (mode == NRF905_MODE_RX) ? NRF905_MODE_RX : NRF905_MODE_STANDBY;
+}
+
 int nrf905_send(nrf905_t *nrf, const void *data, size_t len)
 {
+	uint8_t old_mode = nrf->mode;
 	int err = 0;
 
 	err = _nrf905_start_send(nrf, data, len, false);
@@ -460,12 +1012,7 @@ int nrf905_send(nrf905_t *nrf, const void *data, size_t len)
 		return err;
 	}
 
-//TODO: wait DR, either through pin or through spi... or just time based?
-
-	bcm2835_gpio_write(nrf->pin_ce, LOW);
-	bcm2835_gpio_write(nrf->pin_txen, LOW);
-
-	return 0;
+	return nrf905_set_mode(nrf, _nrf905_after_send_mode(old_mode));
 }
 
 int nrf905_send_to(nrf905_t *nrf, uint32_t addr, const void *data, size_t len)
@@ -480,10 +1027,110 @@ int nrf905_send_to(nrf905_t *nrf, uint32_t addr, const void *data, size_t len)
 	return retval;
 }
 
+int nrf905_send_fanout(nrf905_t *nrf, const uint32_t *addrs,
+		unsigned int cnt, const void *data, size_t len,
+		struct timespec *key_ts)
+{
+	uint8_t old_mode = nrf->mode;
+	unsigned int i;
+	int err;
+
+	err = nrf905_write_tx_payload(nrf, data, len);
+	if (err != 0) {
+		return -1;
+	}
+
+	err = _nrf905_set_auto_retran(nrf, false);
+	if (err != 0) {
+		return -1;
+	}
+
+	for (i=0; i < cnt; i++) {
+		// Previous frame must be out before the address is changed
+		nrf905_wait_ready(nrf);
+
+		err = nrf905_write_tx_addr(nrf, addrs[i]);
+		if (err != 0) {
+			return -1;
+		}
+
+		if (nrf->csma != NULL) {
+			err = nrf905_csma_wait_clear(nrf, nrf->csma);
+			if (err != 0) {
+				return -1;
+			}
+		}
+
+		// Pulse TRX_CE, the device completes the frame in standby
+		err = nrf905_set_mode(nrf, NRF905_MODE_TX);
+		if (err != 0) {
+			return -1;
+		}
+		if (key_ts != NULL) {
+			clock_gettime(CLOCK_MONOTONIC, &key_ts[i]);
+		}
+		err = nrf905_set_mode(nrf, NRF905_MODE_STANDBY);
+		if (err != 0) {
+			return -1;
+		}
+	}
+
+	return nrf905_set_mode(nrf, _nrf905_after_send_mode(old_mode));
+}
+
+int nrf905_transmit_at(nrf905_t *nrf, const struct timespec *start)
+{
+	struct timespec key;
+	struct timespec now;
+	uint8_t old_mode;
+	uint32_t settle_us;
+	int err;
+
+	// A previous frame must be completed before the transmitter can be
+	// keyed again.
+	if (nrf->mode == NRF905_MODE_TX) {
+		err = nrf905_set_mode(nrf, NRF905_MODE_STANDBY);
+		if (err != 0) {
+			return -1;
+		}
+	}
+
+	err = _nrf905_set_auto_retran(nrf, false);
+	if (err != 0) {
+		return -1;
+	}
+
+	old_mode = nrf->mode;
+	nrf905_wait_ready(nrf);
+
+	settle_us = _nrf905_settle_us(old_mode, NRF905_MODE_TX);
+	key = *start;
+	key.tv_nsec -= (long) settle_us * 1000;
+	while (key.tv_nsec < 0) {
+		key.tv_sec--;
+		key.tv_nsec += 1000000000;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (_timespec_cmp(&now, &key) > 0) {
+		errno = ETIME;
+		return -1;
+	}
+	_nrf905_wait_until(&key);
+
+	err = nrf905_set_mode(nrf, NRF905_MODE_TX);
+	if (err != 0) {
+		return -1;
+	}
+
+	return nrf905_set_mode(nrf, _nrf905_after_send_mode(old_mode));
+}
+
 int nrf905_send_for(nrf905_t *nrf, const void *data, size_t len,
 			const struct timespec *duration)
 {
 	struct timespec ts;
+	uint8_t old_mode = nrf->mode;
 	int err;
 	int retval = 0;
 
@@ -500,9 +1147,11 @@ int nrf905_send_for(nrf905_t *nrf, const void *data, size_t len,
 			break;
 		}
 	} while (err != 0);
-	
-	bcm2835_gpio_write(nrf->pin_ce, LOW);
-	bcm2835_gpio_write(nrf->pin_txen, LOW);
+
+	err = nrf905_set_mode(nrf, _nrf905_after_send_mode(old_mode));
+	if (err != 0) {
+		retval = -1;
+	}
 
 	return retval;
 }
@@ -522,57 +1171,73 @@ int nrf905_send_to_for(nrf905_t *nrf, uint32_t addr, const void *data, size_t le
 
 int nrf905_recv_enable(nrf905_t *nrf)
 {
-	bcm2835_gpio_write(nrf->pin_txen, LOW);
-	bcm2835_gpio_write(nrf->pin_ce, HIGH);
-	nrf->recv_enabled = true;
-
-	return 0;
+	return nrf905_set_mode(nrf, NRF905_MODE_RX);
 }
 
 int nrf905_recv_disable(nrf905_t *nrf)
 {
-	bcm2835_gpio_write(nrf->pin_txen, LOW);
-	bcm2835_gpio_write(nrf->pin_ce, LOW);
-	nrf->recv_enabled = false;
-
-	return 0;
+	return nrf905_set_mode(nrf, NRF905_MODE_STANDBY);
 }
 
-int nrf905_recv(nrf905_t *nrf, void *data, size_t len)
+/**
+ * Read RX payload register
+ *
+ * @returns	false if the frame was dropped as duplicate
+ */
+static bool _nrf905_read_rx_payload(nrf905_t *nrf, void *data, size_t len)
 {
 	uint8_t transfer_buf[33] = { 0x24, 0 };
-	bool old_recv_enabled;
-	int err;
 
 	assert(nrf->rx_pw <= 32);
 
-	old_recv_enabled = nrf->recv_enabled;
-	if (! old_recv_enabled) {
-		err = nrf905_recv_enable(nrf);
-		if (err != 0) {
-			return -1;
-		}
-	}
-
-// wait DR
-//TODO: in seperate func?
-while (bcm2835_gpio_lev(nrf->pin_dr) != HIGH) bcm2835_delayMicroseconds(1000);
-
 	bcm2835_spi_transfern((char *) transfer_buf, 1 + nrf->rx_pw);
 
 	nrf->status = transfer_buf[0];
 
+	if (nrf->filter != NULL &&
+	    !nrf905_filter_any(nrf->filter, nrf->rx_addr, &transfer_buf[1],
+				nrf->rx_pw))
+	{
+		return false;
+	}
+
+	if (nrf->dedup != NULL &&
+	    nrf905_dedup_check(nrf->dedup, nrf->rx_addr, &transfer_buf[1],
+				nrf->rx_pw))
+	{
+		return false;
+	}
+
 	if (len < nrf->rx_pw) {
 		memcpy(data, &transfer_buf[1], len);
 	} else {
 		memcpy(data, &transfer_buf[1], nrf->rx_pw);
 	}
 
-	if (! old_recv_enabled) {
-		err = nrf905_recv_disable(nrf);
-		if (err != 0) {
-			return -1;
+	return true;
+}
+
+int nrf905_recv(nrf905_t *nrf, void *data, size_t len)
+{
+	uint8_t old_mode;
+	int err;
+
+	old_mode = nrf->mode;
+	err = nrf905_recv_enable(nrf);
+	if (err != 0) {
+		return -1;
+	}
+
+	// wait DR
+	do {
+		while (!nrf905_data_ready(nrf)) {
+			bcm2835_delayMicroseconds(1000);
 		}
+	} while (!_nrf905_read_rx_payload(nrf, data, len));
+
+	err = nrf905_set_mode(nrf, old_mode);
+	if (err != 0) {
+		return -1;
 	}
 
 	return 0;
@@ -580,65 +1245,214 @@ while (bcm2835_gpio_lev(nrf->pin_dr) != HIGH) bcm2835_delayMicroseconds(1000);
 
 int nrf905_recv_nb(nrf905_t *nrf, void *data, size_t len)
 {
-	uint8_t transfer_buf[33] = { 0x24, 0 };
-
-	assert(nrf->rx_pw <= 32);
+	// check DR
+	if (!nrf905_data_ready(nrf) || !_nrf905_read_rx_payload(nrf, data, len)) {
+		errno = EWOULDBLOCK;
+		return -1;
+	}
 
-// check DR
-//TODO: in seperate func?
-if (bcm2835_gpio_lev(nrf->pin_dr) != HIGH) { errno = EWOULDBLOCK; return -1; }
+	return 0;
+}
 
-	bcm2835_spi_transfern((char *) transfer_buf, 1 + nrf->rx_pw);
+/**
+ * Milliseconds until deadline for poll(), -1 if no deadline
+ */
+static int _nrf905_poll_timeout(const struct timespec *deadline)
+{
+	struct timespec now;
+	int64_t remaining;
 
-	nrf->status = transfer_buf[0];
+	if (deadline == NULL) {
+		return -1;
+	}
 
-	if (len < nrf->rx_pw) {
-		memcpy(data, &transfer_buf[1], len);
-	} else {
-		memcpy(data, &transfer_buf[1], nrf->rx_pw);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	remaining = _timespec_diff_ns(deadline, &now);
+	if (remaining <= 0) {
+		return 0;
 	}
 
-	return 0;
+	return (remaining + 999999) / 1000000;
+}
+
+/**
+ * Wait for a frame using kernel edge events
+ */
+static int _nrf905_recv_ts_events(nrf905_t *nrf, void *data, size_t len,
+			nrf905_rx_ts_t *ts, const struct timespec *deadline)
+{
+	struct pollfd pfd = { nrf->dr_event_fd, POLLIN, 0 };
+	struct timespec now;
+	int timeout;
+	int n;
+
+	ts->clock = CLOCK_MONOTONIC;
+
+	while (true) {
+		// Edges of frames read by other functions are still queued,
+		// so take the last one once DR is seen high.
+		n = _nrf905_drain_events(nrf->dr_event_fd, &ts->dr);
+
+		if (nrf905_data_ready(nrf)) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+
+			// The edge event may be delivered slightly after the
+			// level changed. An event older then the frame belongs
+			// to a frame read elsewhere.
+			if (n == 0 || _timespec_diff_ns(&now, &ts->dr) >
+					(int64_t) (nrf905_get_rx_airtime(nrf) +
+						1000) * 1000)
+			{
+				if (poll(&pfd, 1, 1) > 0 &&
+				    _nrf905_drain_events(nrf->dr_event_fd,
+							&ts->dr) > 0)
+				{
+					n = 1;
+				} else {
+					n = 0;
+				}
+			}
+			ts->kernel = (n != 0);
+			if (n == 0) {
+				ts->dr = now;
+			}
+
+			// An address match more than a frame before data
+			// ready is of a frame that failed its CRC
+			ts->has_am = false;
+			if (nrf->am_event_fd >= 0 &&
+			    _nrf905_drain_events(nrf->am_event_fd, &ts->am) > 0 &&
+			    _timespec_cmp(&ts->am, &ts->dr) <= 0 &&
+			    _timespec_diff_ns(&ts->dr, &ts->am) <=
+					(int64_t) (nrf905_get_rx_airtime(nrf) +
+						1000) * 1000)
+			{
+				ts->has_am = true;
+			}
+
+			if (_nrf905_read_rx_payload(nrf, data, len)) {
+				return 0;
+			}
+			continue;
+		}
+
+		timeout = _nrf905_poll_timeout(deadline);
+		if (timeout == 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+			return -1;
+		}
+	}
 }
 
+/**
+ * Wait for a frame by polling DR and AM
+ */
+static int _nrf905_recv_ts_poll(nrf905_t *nrf, void *data, size_t len,
+			nrf905_rx_ts_t *ts, const struct timespec *deadline)
+{
+	const struct timespec poll_ts = { 0, NRF905_TS_POLL_US * 1000 };
+	struct timespec now;
+	bool am;
+
+	ts->clock = CLOCK_MONOTONIC_RAW;
+	ts->kernel = false;
+	ts->has_am = false;
+
+	while (true) {
+		am = (nrf->pin_am != NRF905_PIN_NC && nrf905_address_match(nrf));
+		if (am && !ts->has_am) {
+			clock_gettime(CLOCK_MONOTONIC_RAW, &ts->am);
+			ts->has_am = true;
+		}
 
-int nrf905_recv_to(nrf905_t *nrf, void *data, size_t len,
+		if (nrf905_data_ready(nrf)) {
+			clock_gettime(CLOCK_MONOTONIC_RAW, &ts->dr);
+			if (_nrf905_read_rx_payload(nrf, data, len)) {
+				return 0;
+			}
+			ts->has_am = false;
+			continue;
+		}
+		if (!am) {
+			// AM stays high until the payload is read, if it
+			// dropped without data ready the frame failed its CRC
+			ts->has_am = false;
+		}
+
+		if (deadline != NULL) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (_timespec_cmp(&now, deadline) >= 0) {
+				errno = ETIMEDOUT;
+				return -1;
+			}
+		}
+
+		nanosleep(&poll_ts, NULL);
+	}
+}
+
+int nrf905_recv_ts(nrf905_t *nrf, void *data, size_t len, nrf905_rx_ts_t *ts,
 			const struct timespec *to)
 {
-	uint8_t transfer_buf[33] = { 0x24, 0 };
-	bool old_recv_enabled;
+	struct timespec deadline;
+	uint8_t old_mode;
+	int retval;
 	int err;
 
-	assert(nrf->rx_pw <= 32);
+	if (to != NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += to->tv_sec;
+		_timespec_add_us(&deadline, to->tv_nsec / 1000);
+	}
 
-	old_recv_enabled = nrf->recv_enabled;
-	if (! old_recv_enabled) {
-		err = nrf905_recv_enable(nrf);
-		if (err != 0) {
-			return -1;
-		}
+	old_mode = nrf->mode;
+	err = nrf905_recv_enable(nrf);
+	if (err != 0) {
+		return -1;
 	}
 
-// wait DR
-//TODO: in seperate func?
-//TODO: add timeout
-while (bcm2835_gpio_lev(nrf->pin_dr) != HIGH) bcm2835_delayMicroseconds(1000);
+	if (nrf->dr_event_fd >= 0) {
+		retval = _nrf905_recv_ts_events(nrf, data, len, ts,
+					(to != NULL) ? &deadline : NULL);
+	} else {
+		retval = _nrf905_recv_ts_poll(nrf, data, len, ts,
+					(to != NULL) ? &deadline : NULL);
+	}
 
-	bcm2835_spi_transfern((char *) transfer_buf, 1 + nrf->rx_pw);
+	err = nrf905_set_mode(nrf, old_mode);
+	if (err != 0) {
+		return -1;
+	}
 
-	nrf->status = transfer_buf[0];
+	return retval;
+}
 
-	if (len < nrf->rx_pw) {
-		memcpy(data, &transfer_buf[1], len);
-	} else {
-		memcpy(data, &transfer_buf[1], nrf->rx_pw);
+int nrf905_recv_to(nrf905_t *nrf, void *data, size_t len,
+			const struct timespec *to)
+{
+	uint8_t old_mode;
+	int err;
+
+	old_mode = nrf->mode;
+	err = nrf905_recv_enable(nrf);
+	if (err != 0) {
+		return -1;
 	}
 
-	if (! old_recv_enabled) {
-		err = nrf905_recv_disable(nrf);
-		if (err != 0) {
-			return -1;
+	// wait DR
+	//TODO: add timeout
+	do {
+		while (!nrf905_data_ready(nrf)) {
+			bcm2835_delayMicroseconds(1000);
 		}
+	} while (!_nrf905_read_rx_payload(nrf, data, len));
+
+	err = nrf905_set_mode(nrf, old_mode);
+	if (err != 0) {
+		return -1;
 	}
 
 	return 0;
@@ -82,6 +82,72 @@ enum {
 	NRF905_CRC_MODE_CRC16 = 1,
 };
 
+/**
+ * Configuration register byte offsets
+ */
+enum {
+	NRF905_CONF_CH_NO = 0,		// ch_no[7:0]
+	NRF905_CONF_FLAGS = 1,		// ch_no[8], hfreq_pll, pa_pwr, rx_red_pwr,
+					// auto_retran
+	NRF905_CONF_AFW = 2,		// rx_afw, tx_afw
+	NRF905_CONF_RX_PW = 3,
+	NRF905_CONF_TX_PW = 4,
+	NRF905_CONF_RX_ADDR = 5,	// 4 bytes, LSB first
+	NRF905_CONF_MISC = 9,		// up_clk_freq, up_clk_en, xof, crc_en,
+					// crc_mode
+	NRF905_CONF_LEN = 10,
+};
+
+/**
+ * Status register bits
+ */
+#define NRF905_STATUS_DR (1 << 5)
+#define NRF905_STATUS_AM (1 << 7)
+
+/**
+ * Operating modes
+ */
+enum {
+	NRF905_MODE_POWER_DOWN = 0,
+	NRF905_MODE_STANDBY = 1,
+	NRF905_MODE_RX = 2,
+	NRF905_MODE_TX = 3,
+};
+
+/**
+ * Mode transition timing in microseconds, as specified in the datasheet
+ */
+#define NRF905_T_PWR_UP_US	(3000)	// Power down -> standby
+#define NRF905_T_STBY_TRX_US	(650)	// Standby -> RX or TX
+#define NRF905_T_RX_TX_US	(550)	// RX <-> TX turnaround
+#define NRF905_T_CE_PULSE_US	(10)	// Min. TRX_CE high time to start TX
+
+/**
+ * Air time of a single bit in microseconds (50 kbps Manchester encoded)
+ */
+#define NRF905_BIT_TIME_US	(20)
+
+/**
+ * Preamble length in bits
+ */
+#define NRF905_PREAMBLE_BITS	(10)
+
+/**
+ * Frame reception timestamps
+ */
+typedef struct {
+	clockid_t clock;	// Clock the timestamps are taken from
+	bool kernel;		// Timestamps of kernel GPIO edge events
+	bool has_am;		// am is valid
+	struct timespec dr;	// Data ready raised, end of frame
+	struct timespec am;	// Address match raised, start of payload
+} nrf905_rx_ts_t;
+
+/**
+ * Poll interval for DR and AM when no edge events are available
+ */
+#define NRF905_TS_POLL_US	(20)
+
 /**
  * NRF905 data object structure
  */
@@ -91,11 +157,27 @@ typedef struct {
 	uint8_t pin_ce;
 	uint8_t pin_txen;
 	uint8_t pin_dr;
+	uint8_t pin_am;
+	uint8_t pin_cd;
 	uint8_t spi_cs;
 
 	// status
 	uint8_t status;
-	bool recv_enabled;
+
+	// mode state machine
+	uint32_t mode_pins[4];		// mask of pins driven high per mode
+	uint8_t mode;
+	struct timespec mode_ts;	// time at which current mode is settled
+	struct timespec ready_at;	// earliest time for next mode transition
+
+	// channel access
+	struct nrf905_csma *csma;	// listen before talk, NULL if disabled
+
+	// receive path
+	struct nrf905_filter *filter;	// frame filter, NULL if disabled
+	struct nrf905_dedup *dedup;	// duplicate suppression, NULL if disabled
+	int dr_event_fd;		// kernel edge events, -1 if disabled
+	int am_event_fd;
 
 	// config
 	uint16_t ch_no;
@@ -119,6 +201,9 @@ typedef struct {
 /**
  * Initialize a NRF905 object on the given pins
  *
+ * The pwr_up, trx_ce and tx_en pins must all be in the first GPIO bank
+ * (GPIO 0-31), so they can be changed in a single register access.
+ *
  * @param nrf		NRF905 object to initialize
  * @param pin_pwr	GPIO pin connected to the NRF905 'pwr_up' pin. If pin is
  *			hard wired to Vcc, then use NRF905_PIN_NC.
@@ -128,6 +213,9 @@ typedef struct {
  *			connected use NRF905_PIN_NC, in this case the status
  *			register will be polled to get the data ready status.
  * @param spi_cs	SPI Chip Select pin to use
+ *
+ * @returns	0 on success, -1 on error. errno is set to EINVAL if one of the
+ *		control pins is not in the first GPIO bank.
  */
 int nrf905_init(nrf905_t *nrf, uint8_t pin_pwr, uint8_t pin_ce,
 		uint8_t pin_txen, uint8_t pin_dr, uint8_t spi_cs);
@@ -160,6 +248,23 @@ int nrf905_read_config(nrf905_t *nrf);
  */
 int nrf905_write_config(nrf905_t *nrf);
 
+/**
+ * Apply part of the current configuration to device
+ *
+ * Same as nrf905_write_config(), but only writes the configuration register
+ * bytes offset up to offset + len. Use this to cheaply apply a change that
+ * only affects a few bytes, for example NRF905_CONF_RX_ADDR to change the RX
+ * address.
+ *
+ * @param nrf		NRF905 object
+ * @param offset	First byte to write, one of the NRF905_CONF_* values
+ * @param len		Amount of bytes to write
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if the range is outside
+ *		of the configuration register.
+ */
+int nrf905_write_config_bytes(nrf905_t *nrf, uint8_t offset, uint8_t len);
+
 /**
  * Get Carrier Frequency
  *
@@ -189,6 +294,21 @@ uint32_t nrf905_get_freq(nrf905_t *nrf);
  */
 int nrf905_set_freq(nrf905_t *nrf, uint32_t freq);
 
+/**
+ * Convert carrier frequency to channel settings
+ *
+ * Calculate the ch_no and hfreq_pll settings that match freq as close as
+ * possible, without changing any configuration.
+ *
+ * @param freq		Frequency in Hz
+ * @param ch_no		Returns channel number
+ * @param hfreq_pll	Returns PLL band
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if frequency is
+ *		outside of tuneable range
+ */
+int nrf905_freq_to_channel(uint32_t freq, uint16_t *ch_no, bool *hfreq_pll);
+
 ///@{
 /**
  * Configuration set functions
@@ -235,6 +355,208 @@ bool nrf905_get_crc_en(nrf905_t *nrf);
 uint8_t nrf905_get_crc_mode(nrf905_t *nrf);
 ///@}
 
+/**
+ * Get transmit air time
+ *
+ * Calculate the time needed to transmit a single frame with the cached
+ * configuration, excluding the transmitter settling time.
+ *
+ * @returns	Air time of one frame in microseconds
+ */
+uint32_t nrf905_get_tx_airtime(nrf905_t *nrf);
+
+/**
+ * Get receive air time
+ *
+ * Same as nrf905_get_tx_airtime(), but for a frame matching the RX address
+ * and payload width.
+ *
+ * @returns	Air time of one frame in microseconds
+ */
+uint32_t nrf905_get_rx_airtime(nrf905_t *nrf);
+
+/**
+ * Get current operating mode
+ *
+ * @returns	One of the NRF905_MODE_* values
+ */
+uint8_t nrf905_get_mode(nrf905_t *nrf);
+
+/**
+ * Change operating mode
+ *
+ * Drive the PWR, TRX_CE and TX_EN pins to put the device in the requested
+ * mode. If the device is already in the requested mode nothing is done. Else
+ * the function first waits until the previous transition has settled, see
+ * nrf905_wait_ready(), and then changes all pins that differ using one clear
+ * and one set register access.
+ *
+ * Note that switching to NRF905_MODE_TX starts transmission of the frame in
+ * the TX payload register. When leaving TX mode for anything other than
+ * standby, the function waits until the frame has been transmitted.
+ *
+ * @param nrf	NRF905 object
+ * @param mode	One of the NRF905_MODE_* values
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if mode is invalid.
+ */
+int nrf905_set_mode(nrf905_t *nrf, uint8_t mode);
+
+/**
+ * Wait until the current mode is settled
+ *
+ * Sleep until the device is operational in the current mode, e.g. until the
+ * receiver is active after switching to RX mode.
+ *
+ * @param nrf	NRF905 object
+ */
+void nrf905_wait_settled(nrf905_t *nrf);
+
+/**
+ * Wait until the next mode transition is allowed
+ *
+ * Sleep for the remaining settling time of the last mode transition. Returns
+ * directly if the device is already settled.
+ *
+ * @param nrf	NRF905 object
+ */
+void nrf905_wait_ready(nrf905_t *nrf);
+
+/**
+ * Set Address Match pin
+ *
+ * Optionally configure the GPIO pin connected to the NRF905 'am' pin. If not
+ * set, or set to NRF905_PIN_NC, the status register is read to get the
+ * address match status.
+ *
+ * @param nrf		NRF905 object
+ * @param pin_am	GPIO pin connected to the 'am' pin
+ */
+int nrf905_set_pin_am(nrf905_t *nrf, uint8_t pin_am);
+
+/**
+ * Set Carrier Detect pin
+ *
+ * Configure the GPIO pin connected to the NRF905 'cd' pin. The carrier detect
+ * status is not available in the status register, so this is required for
+ * nrf905_carrier_detect() and nrf905_sample_carrier().
+ *
+ * @param nrf		NRF905 object
+ * @param pin_cd	GPIO pin connected to the 'cd' pin
+ */
+int nrf905_set_pin_cd(nrf905_t *nrf, uint8_t pin_cd);
+
+/**
+ * Read status register
+ *
+ * @returns	Status register value, see NRF905_STATUS_*
+ */
+uint8_t nrf905_read_status(nrf905_t *nrf);
+
+/**
+ * Get Data Ready status
+ *
+ * @returns	true if a received frame is waiting in the RX payload register,
+ *		or the last transmission has completed.
+ */
+bool nrf905_data_ready(nrf905_t *nrf);
+
+/**
+ * Get Address Match status
+ *
+ * @returns	true if a frame to our RX address is currently being received
+ */
+bool nrf905_address_match(nrf905_t *nrf);
+
+/**
+ * Get Carrier Detect status
+ *
+ * Only valid while the receiver is enabled and settled.
+ *
+ * @returns	1 if a carrier is detected on the current channel, 0 if not,
+ *		-1 and set errno to ENODEV if the CD pin is not configured.
+ */
+int nrf905_carrier_detect(nrf905_t *nrf);
+
+/**
+ * Sample Carrier Detect
+ *
+ * Wait until the receiver is settled and sample the carrier detect status
+ * as fast as possible during dwell_us microseconds.
+ *
+ * @param nrf		NRF905 object, with receiver enabled
+ * @param dwell_us	Sample duration
+ * @param busy		Returns amount of samples with carrier detected
+ * @param bursts	Returns amount of times carrier detect was raised
+ *
+ * @returns	Amount of samples taken, or -1 and set errno to ENODEV if the
+ *		CD pin is not configured, or EINVAL if not in RX mode.
+ */
+long nrf905_sample_carrier(nrf905_t *nrf, uint32_t dwell_us,
+			unsigned long *busy, unsigned long *bursts);
+
+/**
+ * Enable or disable listen before talk
+ *
+ * If enabled, all send functions first wait for a clear channel using
+ * nrf905_csma_wait_clear(). If the channel stays busy they fail with errno
+ * set to EBUSY.
+ *
+ * @param nrf	NRF905 object
+ * @param csma	CSMA/CA object, see nrf905_csma.h. NULL to transmit without
+ *		listening first.
+ */
+void nrf905_set_csma(nrf905_t *nrf, struct nrf905_csma *csma);
+
+/**
+ * Enable or disable frame filtering
+ *
+ * If enabled, the receive functions drop frames that don't match any
+ * subscription of the filter. Filtering is done before duplicate suppression,
+ * so dropped frames don't take up space in the duplicate table.
+ * nrf905_recv_nb() fails with EWOULDBLOCK for a dropped frame.
+ *
+ * @param nrf		NRF905 object
+ * @param filter	Compiled filter, see nrf905_filter.h. NULL to pass all
+ *			frames.
+ */
+void nrf905_set_filter(nrf905_t *nrf, struct nrf905_filter *filter);
+
+/**
+ * Enable or disable duplicate suppression
+ *
+ * If enabled, the receive functions drop frames that were already received
+ * on the same RX address within the table's time to live, as send by a
+ * sender using auto retransmit. nrf905_recv_nb() fails with EWOULDBLOCK
+ * for a dropped frame.
+ *
+ * @param nrf	NRF905 object
+ * @param dedup	Duplicate table, see nrf905_dedup.h. NULL to pass all frames.
+ */
+void nrf905_set_dedup(nrf905_t *nrf, struct nrf905_dedup *dedup);
+
+/**
+ * Enable kernel GPIO edge events
+ *
+ * Requests rising edge events for the DR pin, and the AM pin if configured,
+ * from the kernel GPIO character device. The kernel timestamps the edges in
+ * its interrupt handler, which is used by nrf905_recv_ts(). Configure the AM
+ * pin using nrf905_set_pin_am() before calling this.
+ *
+ * @param nrf	NRF905 object
+ * @param chip	GPIO chip device, for example "/dev/gpiochip0"
+ *
+ * @returns	0 on success, -1 on error. errno is set to EINVAL if the DR pin
+ *		is not connected, or ENOSYS if not supported by the kernel
+ *		headers the library was build with.
+ */
+int nrf905_enable_edge_events(nrf905_t *nrf, const char *chip);
+
+/**
+ * Release kernel GPIO edge events
+ */
+void nrf905_disable_edge_events(nrf905_t *nrf);
+
 /**
  * Set TX address register
  *
@@ -243,9 +565,69 @@ uint8_t nrf905_get_crc_mode(nrf905_t *nrf);
  */
 int nrf905_write_tx_addr(nrf905_t *nrf, uint32_t addr);
 
+/**
+ * Load TX payload register
+ *
+ * If a frame is being transmitted, waits until it is completed and leaves
+ * the device in standby mode.
+ *
+ * @param nrf	NRF905 object
+ * @param data	Data to send
+ * @param len	Length of data. Should be <= TX payload width. If smaller then
+ *		the TX payload width, buffer is padded with 0 bytes.
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if len is greater then
+ *		the TX payload width.
+ */
+int nrf905_write_tx_payload(nrf905_t *nrf, const void *data, size_t len);
+
+/**
+ * Send the same data to multiple addresses
+ *
+ * The TX payload register keeps its contents after a transmission, so the
+ * payload is only written once. Per destination only the TX address is
+ * written and TRX_CE is pulsed. Every frame is send once, without auto
+ * retransmit, and each frame is completed before the next address is
+ * written.
+ *
+ * @param nrf		NRF905 object
+ * @param addrs		Destination addresses
+ * @param cnt		Amount of destinations
+ * @param data		Data to send
+ * @param len		Length of data. Should be <= TX payload width.
+ * @param key_ts	If not NULL, returns for every destination the time at
+ *			which the transmitter was keyed. Must hold cnt entries.
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if len is greater then
+ *		the TX payload width.
+ */
+int nrf905_send_fanout(nrf905_t *nrf, const uint32_t *addrs,
+		unsigned int cnt, const void *data, size_t len,
+		struct timespec *key_ts);
+
+/**
+ * Transmit loaded payload at a given time
+ *
+ * Transmits the contents of the TX payload register once, keying the
+ * transmitter so that the frame starts at the given CLOCK_MONOTONIC time.
+ * Listen before talk is not applied. Afterwards the device is switched back
+ * as done by nrf905_send().
+ *
+ * @param nrf	NRF905 object
+ * @param start	Time at which the frame should start
+ *
+ * @returns	0 on success, -1 on error. errno is set to ETIME if start is
+ *		closer then the settling time of the transmitter.
+ */
+int nrf905_transmit_at(nrf905_t *nrf, const struct timespec *start);
+
 /**
  * Send data
  *
+ * If the receiver was enabled, the device is switched back to RX mode
+ * directly after the frame has been transmitted. Else the device is left in
+ * standby mode while it finishes transmitting the frame.
+ *
  * @param nrf	NRF905 object to initialize
  * @param data	Data to send
  * @param len	Length of data. Should be <= TX payload width. If smaller then
@@ -292,10 +674,11 @@ int nrf905_send_to_for(nrf905_t *nrf, uint32_t addr, const void *data,
 /**
  * Enable receiver
  *
- * Enables the receiver. After calling this frames to the configured RX address
- * will be received. If a frame is received it must be obtained using one of
- * the nrf905_receive*() functions. During the periode between receiving the
- * frame and it being fetched by the software, no new frames can be received.
+ * Enables the receiver by switching to NRF905_MODE_RX. After calling this
+ * frames to the configured RX address will be received. If a frame is
+ * received it must be obtained using one of the nrf905_receive*() functions.
+ * During the periode between receiving the frame and it being fetched by the
+ * software, no new frames can be received.
  *
  * @param nrf	NRF905 object to initialize
  */
@@ -304,6 +687,8 @@ int nrf905_recv_enable(nrf905_t *nrf);
 /**
  * Disable receiver
  *
+ * Put the device in standby mode.
+ *
  * @param nrf	NRF905 object to initialize
  */
 int nrf905_recv_disable(nrf905_t *nrf);
@@ -338,6 +723,27 @@ int nrf905_recv(nrf905_t *nrf, void *data, size_t len);
  */
 int nrf905_recv_nb(nrf905_t *nrf, void *data, size_t len);
 
+/**
+ * Receive data with arrival timestamp
+ *
+ * Like nrf905_recv_to(), additionally returning when the frame arrived. If
+ * edge events are enabled the kernel's CLOCK_MONOTONIC timestamp of the DR
+ * edge is used, and the AM edge if available. Else DR, and AM if its pin is
+ * configured, are polled every NRF905_TS_POLL_US and timestamped on
+ * detection using CLOCK_MONOTONIC_RAW.
+ *
+ * @param nrf	NRF905 object
+ * @param data	Buffer to return data in
+ * @param len	Length of data buffer. If buffer is smaller then RX payload
+ *		width, the received data is silently truncated
+ * @param ts	Returns the timestamps
+ * @param to	Timeout, NULL to block until a frame is received
+ *
+ * @returns	0 on success, -1 and set errno to ETIMEDOUT if timeout expired.
+ */
+int nrf905_recv_ts(nrf905_t *nrf, void *data, size_t len, nrf905_rx_ts_t *ts,
+			const struct timespec *to);
+
 /**
  * Receive data with timeout
  *
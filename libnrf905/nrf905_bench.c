@@ -0,0 +1,1391 @@
+/**
+ * nrf905_bench.c - Benchmarks for the nRF905 library
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "nrf905.h"
+#include "nrf905_crc.h"
+#include "nrf905_hop.h"
+#include "nrf905_sniff.h"
+#include "nrf905_csma.h"
+#include "nrf905_tdma.h"
+#include "nrf905_dedup.h"
+#include "nrf905_frame.h"
+#include "nrf905_rt.h"
+#include "nrf905_shm.h"
+#include "nrf905_filter.h"
+#include "nrf905_bench_util.h"
+#include "bcm2835.h"
+
+#define PIN_PWR	(22)
+#define PIN_CE	(23)
+#define PIN_TXEN (27)
+#define PIN_DR (25)
+#define PIN_AM (7)
+#define PIN_CD (24)
+#define SPI_CS	(BCM2835_SPI_CS0)
+
+#define DEFAULT_ITERATIONS (100000)
+
+struct benchmark {
+	const char *name;
+	const char *descr;
+	bool needs_radio;
+	void (*run)(nrf905_t *nrf, unsigned long iterations);
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void report(const char *what, unsigned long iterations, double elapsed)
+{
+	printf("%-24s %10lu iter %10.3f s %10.3f us/iter\n", what, iterations,
+		elapsed, elapsed * 1e6 / iterations);
+}
+
+/**
+ * Pin changes of a standby -> TX -> RX -> standby cycle
+ *
+ * The device is kept powered down, so toggling TRX_CE and TX_EN doesn't
+ * actually key the transmitter.
+ */
+static void bench_gpio(nrf905_t *nrf, unsigned long iterations)
+{
+	uint32_t ce = (uint32_t) 1 << nrf->pin_ce;
+	uint32_t txen = (uint32_t) 1 << nrf->pin_txen;
+	unsigned long i;
+	double start;
+	double single;
+	double multi;
+
+	nrf905_set_mode(nrf, NRF905_MODE_POWER_DOWN);
+
+	// One write per pin, as done by the library before
+	start = nrf905_bench_now();
+	for (i=0; i < iterations; i++) {
+		// standby -> TX
+		bcm2835_gpio_write(nrf->pin_ce, LOW);
+		bcm2835_gpio_write(nrf->pin_txen, HIGH);
+		bcm2835_gpio_write(nrf->pin_ce, HIGH);
+		// TX -> RX
+		bcm2835_gpio_write(nrf->pin_txen, LOW);
+		bcm2835_gpio_write(nrf->pin_ce, HIGH);
+		// RX -> standby
+		bcm2835_gpio_write(nrf->pin_txen, LOW);
+		bcm2835_gpio_write(nrf->pin_ce, LOW);
+	}
+	single = nrf905_bench_now() - start;
+	report("gpio single pin", iterations, single);
+
+	// Combined set/clear per transition
+	start = nrf905_bench_now();
+	for (i=0; i < iterations; i++) {
+		// standby -> TX
+		bcm2835_gpio_set_multi(ce | txen);
+		// TX -> RX
+		bcm2835_gpio_clr_multi(txen);
+		// RX -> standby
+		bcm2835_gpio_clr_multi(ce);
+	}
+	multi = nrf905_bench_now() - start;
+	report("gpio multi pin", iterations, multi);
+
+	printf("saved per TX/RX cycle: %.3f us\n",
+		(single - multi) * 1e6 / iterations);
+}
+
+/**
+ * Check if a CRC-16 frame also has a valid CRC for a shorter payload
+ */
+static bool sniff_ambiguous(const uint8_t *raw, int len)
+{
+	uint16_t crc;
+	int i;
+
+	for (i=1; i < len; i++) {
+		crc = nrf905_crc16(raw, 4 + i);
+		if (raw[4 + i] == (crc >> 8) && raw[4 + i + 1] == (crc & 0xff)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Software reconstruction of captured frames in promiscuous mode
+ *
+ * Uses random frames with 4 byte addresses, random payload length and CRC
+ * mode, followed by random data. Half of the addresses are in the filter.
+ * Every 8th frame uses the max. payload width with CRC-16, which must be
+ * reconstructed completely.
+ */
+#define SNIFF_FRAME_CNT (1024)
+#define SNIFF_PW NRF905_SNIFF_MAX_PW(4, 2)
+
+static void bench_sniff(nrf905_t *nrf, unsigned long iterations)
+{
+	static uint8_t raw[SNIFF_FRAME_CNT][NRF905_SNIFF_RAW_LEN];
+	uint32_t filter_table[64];
+	nrf905_addr_set_t filter;
+	nrf905_sniff_frame_t frame;
+	nrf905_sniff_t sniff;
+	unsigned long accepted = 0;
+	unsigned long i;
+	double elapsed;
+	double start;
+	uint32_t min_airtime_us;
+	unsigned long max_pw_cnt = 0;
+	int j;
+
+	srand(1);
+	nrf905_addr_set_init(&filter, filter_table, 64);
+	for (i=0; i < SNIFF_FRAME_CNT; i++) {
+		int len = (i % 8 == 0) ? SNIFF_PW : 1 + rand() % SNIFF_PW;
+		bool crc16 = (i % 8 == 0) || (rand() & 1);
+		uint16_t crc;
+
+		for (j=0; j < NRF905_SNIFF_RAW_LEN; j++) {
+			raw[i][j] = rand();
+		}
+		raw[i][0] = 0x16;
+		raw[i][1] = rand() % 32;	// 32 distinct addresses
+		raw[i][2] = 0x61;
+		raw[i][3] = 0xaa;
+
+		if (crc16) {
+			crc = nrf905_crc16(raw[i], 4 + len);
+			raw[i][4 + len] = crc >> 8;
+			raw[i][4 + len + 1] = crc & 0xff;
+
+			// Random payload can contain a valid CRC-16 for a
+			// shorter length, pick other data for the reference
+			// frames.
+			if (len == SNIFF_PW && sniff_ambiguous(raw[i], len)) {
+				i--;
+				continue;
+			}
+		} else {
+			raw[i][4 + len] = nrf905_crc8(raw[i], 4 + len);
+		}
+
+		if (raw[i][1] < 16) {
+			nrf905_addr_set_add(&filter, raw[i][0] | (raw[i][1] << 8) |
+					(raw[i][2] << 16) | (raw[i][3] << 24));
+		}
+	}
+
+	// Only set up the software part of the sniffer
+	memset(&sniff, 0, sizeof(sniff));
+	sniff.afw = 4;
+	sniff.pw = SNIFF_PW;
+	sniff.crc_mode = NRF905_SNIFF_CRC_AUTO;
+	sniff.match_byte = 0x16;
+	nrf905_sniff_set_filter(&sniff, &filter);
+
+	start = nrf905_bench_now();
+	for (i=0; i < iterations; i++) {
+		if (nrf905_sniff_decode(&sniff, raw[i % SNIFF_FRAME_CNT],
+					&frame) == 0)
+		{
+			accepted++;
+		}
+	}
+	elapsed = nrf905_bench_now() - start;
+	report("sniff decode", iterations, elapsed);
+
+	printf("crc ok: %lu, crc error: %lu, filtered: %lu, accepted: %lu\n",
+		sniff.crc_ok, sniff.crc_err, sniff.filtered, accepted);
+
+	// Max. payload width frames must come out complete, wider frames can't
+	// be captured and must be rejected on start
+	nrf905_sniff_set_filter(&sniff, NULL);
+	for (i=0; i < SNIFF_FRAME_CNT; i += 8) {
+		if (nrf905_sniff_decode(&sniff, raw[i], &frame) != 0 ||
+		    frame.len != SNIFF_PW ||
+		    memcmp(frame.payload, &raw[i][4], SNIFF_PW) != 0)
+		{
+			fprintf(stderr, "Max. payload width frame %lu not "
+				"reconstructed\n", i);
+			exit(EXIT_FAILURE);
+		}
+		max_pw_cnt++;
+	}
+	if (nrf905_sniff_start(&sniff, nrf, 0x16, 4, SNIFF_PW + 1,
+				NRF905_CRC_MODE_CRC16) == 0 || errno != EINVAL)
+	{
+		fprintf(stderr, "Payload width %d not rejected\n", SNIFF_PW + 1);
+		exit(EXIT_FAILURE);
+	}
+	printf("max. payload width %d: %lu frames ok\n", SNIFF_PW, max_pw_cnt);
+
+	// Shortest frame: 4 byte address, 1 byte payload, CRC-8
+	min_airtime_us = (NRF905_PREAMBLE_BITS + (4 + 1 + 1) * 8) *
+				NRF905_BIT_TIME_US;
+	printf("decode rate %.0f frames/s, full channel utilization %.0f frames/s\n",
+		iterations / elapsed, 1e6 / min_airtime_us);
+}
+
+/**
+ * Retune speed, full config write vs. hop list
+ */
+#define HOP_CHANNELS (16)
+
+static void bench_hop(nrf905_t *nrf, unsigned long iterations)
+{
+	uint16_t table[HOP_CHANNELS];
+	uint32_t freqs[HOP_CHANNELS];
+	nrf905_hop_t hop;
+	unsigned long i;
+	double elapsed;
+	double start;
+
+	for (i=0; i < HOP_CHANNELS; i++) {
+		freqs[i] = 868000000 + i * 100000;
+	}
+	nrf905_hop_init(&hop, nrf, table, freqs, HOP_CHANNELS);
+
+	nrf905_set_mode(nrf, NRF905_MODE_STANDBY);
+	nrf905_wait_ready(nrf);
+
+	start = nrf905_bench_now();
+	for (i=0; i < iterations; i++) {
+		nrf905_set_freq(nrf, freqs[i % HOP_CHANNELS]);
+		nrf905_write_config(nrf);
+	}
+	elapsed = nrf905_bench_now() - start;
+	report("set_freq+write_config", iterations, elapsed);
+	printf("  %.0f hops/s\n", iterations / elapsed);
+
+	start = nrf905_bench_now();
+	for (i=0; i < iterations; i++) {
+		nrf905_hop_next(nrf, &hop);
+	}
+	elapsed = nrf905_bench_now() - start;
+	report("hop standby", iterations, elapsed);
+	printf("  %.0f hops/s\n", iterations / elapsed);
+
+	// Including PLL settling, until receiver is active on the new channel
+	nrf905_recv_enable(nrf);
+	start = nrf905_bench_now();
+	for (i=0; i < iterations; i++) {
+		nrf905_hop_next(nrf, &hop);
+		nrf905_wait_settled(nrf);
+	}
+	elapsed = nrf905_bench_now() - start;
+	nrf905_recv_disable(nrf);
+	report("hop RX settled", iterations, elapsed);
+	printf("  %.0f hops/s\n", iterations / elapsed);
+}
+
+/**
+ * Simulated shared channel, blind transmit vs. listen before talk
+ *
+ * Every node sends a 32 byte frame with a 4 byte address and CRC-16 at
+ * random intervals. Nodes start from standby, so a blind transmit takes the
+ * standby -> TX time before keying. With CSMA/CA the receiver is enabled
+ * first, the channel is sensed and after a clear assessment the RX -> TX
+ * turnaround follows. Overlapping frames are lost. Backoff is drawn using
+ * the library's CSMA/CA code.
+ */
+#define CSMA_SIM_PERIOD_US (500000)
+#define CSMA_SIM_MAX_NODES (200)
+
+enum csma_sim_state {
+	SIM_IDLE,
+	SIM_SENSE,
+	SIM_TURNAROUND,
+	SIM_TX,
+};
+
+struct csma_sim_node {
+	enum csma_sim_state state;
+	uint64_t next;		// time of next event
+	uint64_t tx_start;	// last transmission
+	uint64_t tx_end;
+	bool collided;
+	unsigned int attempt;
+	nrf905_csma_t csma;
+};
+
+struct csma_sim_result {
+	uint64_t duration;
+	unsigned long good;
+	unsigned long collided;
+	unsigned long dropped;
+	unsigned long deferrals;
+};
+
+static uint64_t csma_sim_interval(void)
+{
+	return -log(1 - drand48()) * CSMA_SIM_PERIOD_US;
+}
+
+static void csma_sim_run(unsigned int node_cnt, bool lbt, unsigned long frames,
+			uint32_t airtime_us, struct csma_sim_result *res)
+{
+	static struct csma_sim_node nodes[CSMA_SIM_MAX_NODES];
+	struct csma_sim_node *n;
+	unsigned long done = 0;
+	uint64_t now = 0;
+	unsigned int i, j;
+	bool busy;
+
+	memset(res, 0, sizeof(*res));
+	srand48(1);
+	for (i=0; i < node_cnt; i++) {
+		memset(&nodes[i], 0, sizeof(nodes[i]));
+		nodes[i].state = SIM_IDLE;
+		nodes[i].next = csma_sim_interval();
+		nrf905_csma_init(&nodes[i].csma, i + 1);
+	}
+
+	while (done < frames) {
+		n = &nodes[0];
+		for (i=1; i < node_cnt; i++) {
+			if (nodes[i].next < n->next) {
+				n = &nodes[i];
+			}
+		}
+		now = n->next;
+
+		switch (n->state) {
+		case SIM_IDLE:
+			// New frame, power up receiver or transmitter
+			n->attempt = 1;
+			if (lbt) {
+				n->state = SIM_SENSE;
+				n->next = now + NRF905_T_STBY_TRX_US +
+						n->csma.sense_us;
+			} else {
+				n->state = SIM_TURNAROUND;
+				n->next = now + NRF905_T_STBY_TRX_US;
+			}
+			break;
+		case SIM_SENSE:
+			busy = false;
+			for (j=0; j < node_cnt; j++) {
+				if (nodes[j].tx_start < now &&
+				    nodes[j].tx_end > now - n->csma.sense_us)
+				{
+					busy = true;
+					break;
+				}
+			}
+			if (!busy) {
+				n->state = SIM_TURNAROUND;
+				n->next = now + NRF905_T_RX_TX_US;
+			} else if (n->attempt == n->csma.max_attempts) {
+				res->deferrals++;
+				res->dropped++;
+				done++;
+				n->state = SIM_IDLE;
+				n->next = now + csma_sim_interval();
+			} else {
+				res->deferrals++;
+				n->next = now + nrf905_csma_backoff(&n->csma,
+							n->attempt) +
+						n->csma.sense_us;
+				n->attempt++;
+			}
+			break;
+		case SIM_TURNAROUND:
+			// Key transmitter
+			n->collided = false;
+			for (j=0; j < node_cnt; j++) {
+				if (nodes[j].state == SIM_TX &&
+				    nodes[j].tx_end > now)
+				{
+					nodes[j].collided = true;
+					n->collided = true;
+				}
+			}
+			n->state = SIM_TX;
+			n->tx_start = now;
+			n->tx_end = now + airtime_us;
+			n->next = n->tx_end;
+			break;
+		case SIM_TX:
+			if (n->collided) {
+				res->collided++;
+			} else {
+				res->good++;
+			}
+			done++;
+			n->state = SIM_IDLE;
+			n->next = now + csma_sim_interval();
+			break;
+		}
+	}
+
+	res->duration = now;
+}
+
+static void bench_csma_sim(nrf905_t *nrf, unsigned long iterations)
+{
+	static const unsigned int node_cnts[] = { 2, 5, 10, 20, 50, 100, 200 };
+	struct csma_sim_result blind, lbt;
+	uint32_t airtime_us;
+	unsigned int i;
+	double start;
+
+	airtime_us = (NRF905_PREAMBLE_BITS + (4 + 32 + 2) * 8) *
+			NRF905_BIT_TIME_US;
+
+	printf("frame air time %u us, mean interval per node %u us, %lu frames per run\n",
+		airtime_us, CSMA_SIM_PERIOD_US, iterations);
+	printf("%6s %7s | %8s %9s | %8s %9s %8s %9s\n", "nodes", "load",
+		"blind", "collided", "csma", "collided", "dropped",
+		"defer/fr");
+
+	start = nrf905_bench_now();
+	for (i=0; i < sizeof(node_cnts) / sizeof(node_cnts[0]); i++) {
+		csma_sim_run(node_cnts[i], false, iterations, airtime_us,
+				&blind);
+		csma_sim_run(node_cnts[i], true, iterations, airtime_us, &lbt);
+
+		printf("%6u %7.3f | %8.3f %8.1f%% | %8.3f %8.1f%% %7.1f%% %9.2f\n",
+			node_cnts[i],
+			(double) node_cnts[i] * airtime_us / CSMA_SIM_PERIOD_US,
+			(double) blind.good * airtime_us / blind.duration,
+			100.0 * blind.collided / iterations,
+			(double) lbt.good * airtime_us / lbt.duration,
+			100.0 * lbt.collided / iterations,
+			100.0 * lbt.dropped / iterations,
+			(double) lbt.deferrals / iterations);
+	}
+	printf("goodput in fraction of channel time, simulated in %.3f s\n",
+		nrf905_bench_now() - start);
+}
+
+/**
+ * Simulated TDMA network
+ *
+ * Every node has a frame ready at a random moment in each superframe and
+ * sends it in its next slot. Node clocks drift up to TDMA_SIM_DRIFT_PPM
+ * relative to the gateway. The first superframe is send uncompensated,
+ * after that the drift is compensated up to the measurement error. Frames
+ * that end up further from the slot center than the guard interval are
+ * counted as lost. Slot layout and guard interval come from the library.
+ */
+#define TDMA_SIM_DRIFT_PPM (20)
+#define TDMA_SIM_DRIFT_ERR_PPM (1)
+#define TDMA_SIM_NET_ADDR (0x5c27fe22)
+
+static uint32_t tdma_sim_addr(unsigned int node)
+{
+	return 0x10000000 + node * 2654435761u % 0x0fffffff;
+}
+
+
+static void tdma_sim_run(unsigned int node_cnt, unsigned long iterations)
+{
+	nrf905_t nrf;
+	nrf905_tdma_gw_t gw;
+	uint32_t *addrs;
+	unsigned int *slots;
+	double *drift;
+	double *latency;
+	unsigned long frames = 0;
+	unsigned long lost = 0;
+	unsigned long sf, sf_cnt;
+	uint32_t airtime_us;
+	uint32_t guard_us;
+	uint64_t sf_us;
+	double sum = 0;
+	unsigned int i;
+
+	// Configuration cache only, the gateway object doesn't access the
+	// hardware until the first beacon
+	memset(&nrf, 0, sizeof(nrf));
+	nrf905_set_afw(&nrf, 4);
+	nrf905_set_pw(&nrf, 32);
+	nrf905_set_crc_en(&nrf, true);
+	nrf905_set_crc_mode(&nrf, NRF905_CRC_MODE_CRC16);
+	airtime_us = nrf905_get_tx_airtime(&nrf);
+
+	guard_us = nrf905_tdma_guard_us(airtime_us, node_cnt,
+				TDMA_SIM_DRIFT_PPM, NRF905_TDMA_JITTER_US);
+
+	addrs = malloc(node_cnt * sizeof(addrs[0]));
+	slots = malloc(node_cnt * sizeof(slots[0]));
+	drift = malloc(node_cnt * sizeof(drift[0]));
+	sf_cnt = (iterations + node_cnt - 1) / node_cnt;
+	if (sf_cnt < 2) {
+		sf_cnt = 2;
+	}
+	latency = malloc(sf_cnt * node_cnt * sizeof(latency[0]));
+	if (!addrs || !slots || !drift || !latency) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	srand48(node_cnt);
+	for (i=0; i < node_cnt; i++) {
+		addrs[i] = tdma_sim_addr(i);
+	}
+	if (nrf905_tdma_gw_init(&gw, &nrf, TDMA_SIM_NET_ADDR, addrs, node_cnt,
+				guard_us) != 0)
+	{
+		perror("Failed to initialize gateway");
+		exit(EXIT_FAILURE);
+	}
+	for (i=0; i < node_cnt; i++) {
+		slots[i] = nrf905_tdma_gw_slot(&gw, tdma_sim_addr(i));
+		drift[i] = (2 * drand48() - 1) * TDMA_SIM_DRIFT_PPM;
+	}
+	sf_us = nrf905_tdma_superframe_us(node_cnt, gw.slot_us);
+
+	for (sf=0; sf < sf_cnt; sf++) {
+		for (i=0; i < node_cnt; i++) {
+			double ready_us = drand48() * sf_us;
+			double start_us = (double) slots[i] * gw.slot_us +
+						guard_us;
+			double residual_ppm;
+			double err_us;
+
+			// Frame waits for the slot, possibly in the next
+			// superframe
+			if (ready_us > start_us) {
+				start_us += sf_us;
+			}
+
+			residual_ppm = drift[i];
+			if (sf > 0) {
+				residual_ppm += (2 * drand48() - 1) *
+						TDMA_SIM_DRIFT_ERR_PPM;
+			}
+			// Beacon timestamp and wakeup latency
+			err_us = residual_ppm / 1e6 * slots[i] * gw.slot_us +
+				(drand48() - 0.5) * NRF905_TDMA_POLL_US +
+				drand48() * (NRF905_TDMA_JITTER_US -
+						NRF905_TDMA_POLL_US);
+			if (err_us > guard_us || err_us < -(double) guard_us) {
+				lost++;
+				continue;
+			}
+
+			latency[frames] = start_us + err_us + airtime_us -
+						ready_us;
+			sum += latency[frames];
+			frames++;
+		}
+	}
+
+	qsort(latency, frames, sizeof(latency[0]), cmp_double);
+
+	printf("%6u %8u %8u %10.1f %8.1f%% %7lu %10.1f %10.1f\n",
+		node_cnt, gw.slot_us, guard_us, sf_us / 1e3,
+		100.0 * frames * airtime_us / (sf_cnt * sf_us), lost,
+		sum / frames / 1e3,
+		latency[(unsigned long) (frames * 0.99)] / 1e3);
+
+	free(addrs);
+	free(slots);
+	free(drift);
+	free(latency);
+}
+
+static void bench_tdma_sim(nrf905_t *nrf, unsigned long iterations)
+{
+	double start;
+
+	printf("drift +-%d ppm, jitter %d us, %lu frames per run\n",
+		TDMA_SIM_DRIFT_PPM, NRF905_TDMA_JITTER_US, iterations);
+	printf("%6s %8s %8s %10s %9s %7s %10s %10s\n", "nodes", "slot us",
+		"guard us", "sframe ms", "util", "lost", "lat ms",
+		"p99 ms");
+
+	start = nrf905_bench_now();
+	tdma_sim_run(10, iterations);
+	tdma_sim_run(100, iterations);
+	tdma_sim_run(1000, iterations);
+	printf("simulated in %.3f s\n", nrf905_bench_now() - start);
+}
+
+/**
+ * Same payload to many destinations, send_to() loop vs. fan-out
+ */
+#define FANOUT_DESTINATIONS (16)
+
+static void bench_fanout(nrf905_t *nrf, unsigned long iterations)
+{
+	uint32_t addrs[FANOUT_DESTINATIONS];
+	struct timespec key_ts[FANOUT_DESTINATIONS];
+	uint8_t data[32];
+	unsigned long frames;
+	unsigned long i;
+	double elapsed;
+	double start;
+	unsigned int j;
+
+	for (j=0; j < FANOUT_DESTINATIONS; j++) {
+		addrs[j] = 0xaa61cc00 | j;
+	}
+	for (j=0; j < sizeof(data); j++) {
+		data[j] = j;
+	}
+	frames = iterations * FANOUT_DESTINATIONS;
+
+	nrf905_write_config(nrf);
+
+	start = nrf905_bench_now();
+	for (i=0; i < iterations; i++) {
+		for (j=0; j < FANOUT_DESTINATIONS; j++) {
+			nrf905_send_to(nrf, addrs[j], data, sizeof(data));
+		}
+	}
+	nrf905_wait_ready(nrf);
+	elapsed = nrf905_bench_now() - start;
+	report("send_to loop", frames, elapsed);
+	printf("  %.1f frames/s\n", frames / elapsed);
+
+	start = nrf905_bench_now();
+	for (i=0; i < iterations; i++) {
+		nrf905_send_fanout(nrf, addrs, FANOUT_DESTINATIONS, data,
+				sizeof(data), key_ts);
+	}
+	nrf905_wait_ready(nrf);
+	elapsed = nrf905_bench_now() - start;
+	report("send_fanout", frames, elapsed);
+	printf("  %.1f frames/s, air time limit %.1f frames/s\n",
+		frames / elapsed,
+		1e6 / (nrf905_get_tx_airtime(nrf) + NRF905_T_STBY_TRX_US));
+
+	printf("key time of last fan-out relative to first destination:\n");
+	for (j=0; j < FANOUT_DESTINATIONS; j++) {
+		printf("  0x%.8x %10.1f us\n", addrs[j],
+			(key_ts[j].tv_sec - key_ts[0].tv_sec) * 1e6 +
+			(key_ts[j].tv_nsec - key_ts[0].tv_nsec) / 1e3);
+	}
+}
+
+/**
+ * Duplicate suppression of auto retransmit bursts
+ *
+ * DEDUP_SENDERS senders transmit interleaved bursts of repeats copies of
+ * the same 32 byte frame. Time advances 1 ms every 4 frames, the maximum
+ * frame rate of the shortest frames.
+ */
+#define DEDUP_TABLE_SIZE (16384)
+#define DEDUP_TTL_MS (1000)
+#define DEDUP_SENDERS (8)
+
+static void dedup_bench_frame(uint8_t *frame, unsigned int sender,
+				unsigned long id)
+{
+	uint32_t x = (id * DEDUP_SENDERS + sender) * 2654435761u + 1;
+	unsigned int j;
+
+	for (j=0; j < 32; j++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		frame[j] = x;
+	}
+}
+
+static void bench_dedup(nrf905_t *nrf, unsigned long iterations)
+{
+	static nrf905_dedup_entry_t table[DEDUP_TABLE_SIZE];
+	static const unsigned int repeats[] = { 1, 10, 100, 1000 };
+	nrf905_dedup_t dedup;
+	uint8_t frame[32];
+	unsigned long wrong;
+	unsigned long i;
+	unsigned long copy;
+	unsigned int sender;
+	unsigned int r;
+	char what[32];
+	double overhead;
+	double elapsed;
+	double start;
+	unsigned int sink = 0;
+	bool dup;
+
+	// Cost of generating the frames, subtracted from the results
+	start = nrf905_bench_now();
+	for (i=0; i < iterations; i++) {
+		dedup_bench_frame(frame, i % DEDUP_SENDERS, i);
+		sink ^= frame[i % 32];
+	}
+	overhead = nrf905_bench_now() - start;
+
+	for (r=0; r < sizeof(repeats) / sizeof(repeats[0]); r++) {
+		nrf905_dedup_init(&dedup, table, DEDUP_TABLE_SIZE, DEDUP_TTL_MS);
+		wrong = 0;
+
+		start = nrf905_bench_now();
+		for (i=0; i < iterations; i++) {
+			sender = i % DEDUP_SENDERS;
+			copy = i / DEDUP_SENDERS;
+			dedup_bench_frame(frame, sender, copy / repeats[r]);
+
+			dup = nrf905_dedup_check_at(&dedup, 0xaa61cc16, frame,
+						sizeof(frame), i / 4);
+			if (dup != (copy % repeats[r] != 0)) {
+				wrong++;
+			}
+		}
+		elapsed = nrf905_bench_now() - start - overhead;
+
+		snprintf(what, sizeof(what), "dedup %.1f%% duplicates",
+			100.0 - 100.0 / repeats[r]);
+		report(what, iterations, elapsed);
+		printf("  passed %lu, suppressed %lu, evicted %lu, wrong %lu\n",
+			dedup.passed, dedup.suppressed, dedup.evicted, wrong);
+	}
+	if (sink == 0x100) {
+		printf("\n");
+	}
+}
+
+/**
+ * Variable length framing vs. fixed payload width
+ *
+ * Messages are drawn from a few size distributions and send using the
+ * framing layer with widths 4, 8, 16 and 32. The same messages are send with
+ * a fixed 32 byte payload width for comparison.
+ */
+enum frame_dist {
+	FRAME_DIST_SENSOR,	// Mostly short readings, some status reports
+	FRAME_DIST_UNIFORM,	// Uniform 1-31 bytes
+	FRAME_DIST_FIXED,	// Always 4 bytes
+	FRAME_DIST_BURSTY,	// 20 short messages alternated with 5 long ones
+	FRAME_DIST_CNT,
+};
+
+static const char *frame_dist_names[FRAME_DIST_CNT] = {
+	"sensor", "uniform", "fixed 4", "bursty"
+};
+
+static size_t frame_bench_len(enum frame_dist dist, unsigned long i)
+{
+	int r = rand() % 100;
+
+	switch (dist) {
+	case FRAME_DIST_SENSOR:
+		if (r < 70) {
+			return 2 + rand() % 5;
+		} else if (r < 90) {
+			return 8 + rand() % 7;
+		}
+		return 20 + rand() % 12;
+	case FRAME_DIST_UNIFORM:
+		return 1 + rand() % 31;
+	case FRAME_DIST_FIXED:
+		return 4;
+	case FRAME_DIST_BURSTY:
+	default:
+		return (i % 25 < 20) ? 2 + rand() % 3 : 24 + rand() % 8;
+	}
+}
+
+static void bench_frame(nrf905_t *nrf, unsigned long iterations)
+{
+	static const uint8_t widths[] = { 4, 8, 16, 32 };
+	nrf905_frame_t frame;
+	uint8_t data[32];
+	enum frame_dist dist;
+	unsigned long i;
+	double fixed;
+	double adaptive;
+	double start;
+
+	memset(data, 0x5a, sizeof(data));
+	nrf905_write_config(nrf);
+
+	printf("%-8s %9s %9s %7s %7s %9s %9s %7s\n", "dist", "fixed us",
+		"adapt us", "saved", "switch", "fixed/s", "adapt/s", "gain");
+	for (dist=0; dist < FRAME_DIST_CNT; dist++) {
+		// Fixed width with length prefix
+		nrf905_set_pw(nrf, 32);
+		nrf905_write_config_bytes(nrf, NRF905_CONF_RX_PW, 2);
+		srand(dist);
+		start = nrf905_bench_now();
+		for (i=0; i < iterations; i++) {
+			size_t len = frame_bench_len(dist, i);
+			data[0] = len;
+			nrf905_send(nrf, data, 1 + len);
+		}
+		nrf905_wait_ready(nrf);
+		fixed = nrf905_bench_now() - start;
+
+		nrf905_frame_init(&frame, nrf, widths, sizeof(widths), 1000);
+		srand(dist);
+		start = nrf905_bench_now();
+		for (i=0; i < iterations; i++) {
+			nrf905_frame_send(&frame, data,
+					frame_bench_len(dist, i));
+		}
+		nrf905_wait_ready(nrf);
+		adaptive = nrf905_bench_now() - start;
+
+		printf("%-8s %9.0f %9.0f %6.1f%% %6.1f%% %9.1f %9.1f %6.2fx\n",
+			frame_dist_names[dist],
+			(double) frame.base_air_us / iterations,
+			(double) frame.air_us / iterations,
+			100.0 - 100.0 * frame.air_us / frame.base_air_us,
+			100.0 * frame.switches / iterations,
+			iterations / fixed, iterations / adaptive,
+			fixed / adaptive);
+	}
+	printf("air time per message, switch frames per message, messages/s\n");
+}
+
+/**
+ * Latency with and without real-time profile
+ *
+ * Send latency is measured from calling the send function until TRX_CE is
+ * raised. DR latency is from the kernel timestamp of the DR edge until the
+ * frame is returned to userspace; this needs GPIO edge events and another
+ * node sending frames to our address.
+ */
+#define LATENCY_GPIO_CHIP "/dev/gpiochip0"
+#define LATENCY_RX_TIMEOUT_S (2)
+
+static void latency_report(const char *what, double *lat, unsigned long cnt)
+{
+	if (cnt == 0) {
+		printf("%-24s no samples\n", what);
+		return;
+	}
+
+	qsort(lat, cnt, sizeof(lat[0]), cmp_double);
+	printf("%-24s %8lu p50 %9.1f us p99 %9.1f us p99.9 %9.1f us max %9.1f us\n",
+		what, cnt, lat[cnt / 2], lat[(unsigned long) (cnt * 0.99)],
+		lat[(unsigned long) (cnt * 0.999)], lat[cnt - 1]);
+}
+
+static void latency_run(nrf905_t *nrf, unsigned long iterations, double *lat,
+			bool events, const char *profile)
+{
+	const struct timespec to = { LATENCY_RX_TIMEOUT_S, 0 };
+	uint32_t addr = 0xaa61cc16;
+	uint8_t data[32];
+	struct timespec start, key, now;
+	nrf905_rx_ts_t ts;
+	char what[48];
+	unsigned long cnt;
+	unsigned long i;
+
+	memset(data, 0, sizeof(data));
+	for (i=0; i < iterations; i++) {
+		// Previous frame must be out, else its air time is measured
+		nrf905_wait_ready(nrf);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		nrf905_send_fanout(nrf, &addr, 1, data, sizeof(data), &key);
+		lat[i] = (key.tv_sec - start.tv_sec) * 1e6 +
+			(key.tv_nsec - start.tv_nsec) / 1e3;
+	}
+	snprintf(what, sizeof(what), "send to CE, %s", profile);
+	latency_report(what, lat, iterations);
+
+	cnt = 0;
+	if (events) {
+		for (i=0; i < iterations; i++) {
+			if (nrf905_recv_ts(nrf, data, sizeof(data), &ts, &to) != 0) {
+				fprintf(stderr, "No frames received\n");
+				break;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (ts.kernel) {
+				lat[cnt++] = (now.tv_sec - ts.dr.tv_sec) * 1e6 +
+					(now.tv_nsec - ts.dr.tv_nsec) / 1e3;
+			}
+		}
+	}
+	snprintf(what, sizeof(what), "DR to user, %s", profile);
+	latency_report(what, lat, cnt);
+}
+
+static void bench_latency(nrf905_t *nrf, unsigned long iterations)
+{
+	nrf905_rt_profile_t rt;
+	double *lat;
+	bool events;
+
+	lat = malloc(iterations * sizeof(lat[0]));
+	if (lat == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	nrf905_write_config(nrf);
+	events = (nrf905_enable_edge_events(nrf, LATENCY_GPIO_CHIP) == 0);
+	if (!events) {
+		perror("GPIO edge events unavailable, skipping DR latency");
+	}
+
+	latency_run(nrf, iterations, lat, events, "default");
+
+	nrf905_rt_profile_init(&rt);
+	if (nrf905_rt_apply(&rt) != 0) {
+		perror("Failed to apply real-time profile");
+	}
+	nrf905_rt_prefault(lat, iterations * sizeof(lat[0]));
+
+	latency_run(nrf, iterations, lat, events, "rt profile");
+
+	free(lat);
+}
+
+/**
+ * Shared memory fan-out to local reader processes
+ *
+ * First the writer publishes as fast as it can while the readers busy poll
+ * the ring in place, this gives the throughput and how many frames readers
+ * lose to overruns. Then frames are published paced, and the readers sleep
+ * on their eventfd, this gives the publish to reader latency including the
+ * wakeup.
+ */
+#define SHM_SLOTS (1024)
+#define SHM_MAX_READERS (16)
+#define SHM_LAT_FRAMES (2000)
+#define SHM_LAT_PACE_US (200)
+#define SHM_END_ADDR (0xffffffff)
+
+struct shm_bench_reader {
+	unsigned long received;
+	unsigned long lost;
+	unsigned long torn;
+	double elapsed;
+	unsigned long lat_cnt;
+};
+
+static void shm_bench_publish_end(nrf905_shm_writer_t *w)
+{
+	uint8_t data[32];
+
+	memset(data, 0, sizeof(data));
+	nrf905_shm_publish(w, SHM_END_ADDR, data, sizeof(data), NULL);
+}
+
+static void shm_bench_reader(const char *name, struct shm_bench_reader *res,
+				double *lat)
+{
+	const nrf905_shm_frame_t *f;
+	nrf905_shm_reader_t r;
+	nrf905_shm_frame_t frame;
+	struct timespec now;
+	double start = 0;
+	uint32_t addr;
+
+	if (nrf905_shm_open(&r, name) != 0) {
+		perror("Failed to open ring");
+		_exit(EXIT_FAILURE);
+	}
+
+	// Throughput, zero copy
+	while (true) {
+		f = nrf905_shm_peek(&r);
+		if (f == NULL) {
+			if (errno != EAGAIN) {
+				perror("Failed to map ring");
+				_exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		addr = f->addr;
+		if (nrf905_shm_consume(&r) != 0) {
+			res->torn++;
+			continue;
+		}
+		if (addr == SHM_END_ADDR) {
+			break;
+		}
+		if (res->received++ == 0) {
+			start = nrf905_bench_now();
+		}
+	}
+	res->elapsed = nrf905_bench_now() - start;
+	res->lost = r.lost;
+
+	// Latency, sleeping between frames
+	while (nrf905_shm_read(&r, &frame, NULL) == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (frame.addr == SHM_END_ADDR) {
+			break;
+		}
+		if (res->lat_cnt < SHM_LAT_FRAMES) {
+			lat[res->lat_cnt++] =
+				(now.tv_sec - frame.ts.dr.tv_sec) * 1e6 +
+				(now.tv_nsec - frame.ts.dr.tv_nsec) / 1e3;
+		}
+	}
+
+	nrf905_shm_close(&r);
+	_exit(EXIT_SUCCESS);
+}
+
+static void bench_shm(nrf905_t *nrf, unsigned long iterations)
+{
+	static const unsigned int reader_cnts[] = { 1, 2, 4, 8, 16 };
+	struct shm_bench_reader *res;
+	const struct timespec pace = { 0, SHM_LAT_PACE_US * 1000 };
+	nrf905_shm_writer_t w;
+	nrf905_rx_ts_t ts;
+	uint8_t data[32];
+	double *lat;
+	double start, elapsed;
+	unsigned long received, lost, torn, lat_cnt;
+	double rate;
+	size_t map_len;
+	char name[32];
+	char what[48];
+	unsigned int n, c;
+	unsigned long i;
+	pid_t pid;
+
+	map_len = SHM_MAX_READERS * (sizeof(*res) +
+			SHM_LAT_FRAMES * sizeof(*lat));
+	res = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED) {
+		perror("Failed to map results");
+		exit(EXIT_FAILURE);
+	}
+	lat = (double *) &res[SHM_MAX_READERS];
+
+	snprintf(name, sizeof(name), "bench-%d", (int) getpid());
+	memset(data, 0xa5, sizeof(data));
+	memset(&ts, 0, sizeof(ts));
+	ts.clock = CLOCK_MONOTONIC;
+
+	for (c=0; c < sizeof(reader_cnts) / sizeof(reader_cnts[0]); c++) {
+		if (nrf905_shm_create(&w, name, SHM_SLOTS) != 0) {
+			perror("Failed to create ring");
+			exit(EXIT_FAILURE);
+		}
+		memset(res, 0, map_len);
+
+		for (n=0; n < reader_cnts[c]; n++) {
+			pid = fork();
+			if (pid == -1) {
+				perror("fork");
+				exit(EXIT_FAILURE);
+			}
+			if (pid == 0) {
+				shm_bench_reader(name, &res[n],
+						&lat[n * SHM_LAT_FRAMES]);
+			}
+		}
+		while (w.reader_cnt < reader_cnts[c]) {
+			nrf905_shm_service(&w);
+			usleep(1000);
+		}
+
+		start = nrf905_bench_now();
+		for (i=0; i < iterations; i++) {
+			data[0] = i;
+			nrf905_shm_publish(&w, 0xaa61cc16, data, sizeof(data), NULL);
+		}
+		elapsed = nrf905_bench_now() - start;
+		shm_bench_publish_end(&w);
+
+		// Let readers drain and go to sleep before pacing
+		usleep(100000);
+		for (i=0; i < SHM_LAT_FRAMES; i++) {
+			nanosleep(&pace, NULL);
+			clock_gettime(CLOCK_MONOTONIC, &ts.dr);
+			nrf905_shm_publish(&w, 0xaa61cc16, data, sizeof(data), &ts);
+		}
+		shm_bench_publish_end(&w);
+
+		while (wait(NULL) > 0) {}
+		nrf905_shm_destroy(&w);
+
+		snprintf(what, sizeof(what), "shm publish, %u readers",
+			reader_cnts[c]);
+		report(what, iterations, elapsed);
+
+		received = lost = torn = lat_cnt = 0;
+		rate = 0;
+		for (n=0; n < reader_cnts[c]; n++) {
+			received += res[n].received;
+			lost += res[n].lost;
+			torn += res[n].torn;
+			if (res[n].elapsed > 0) {
+				rate += res[n].received / res[n].elapsed;
+			}
+			// Compact latencies for a combined percentile
+			memmove(&lat[lat_cnt], &lat[n * SHM_LAT_FRAMES],
+				res[n].lat_cnt * sizeof(*lat));
+			lat_cnt += res[n].lat_cnt;
+		}
+		printf("  delivered %.0f frames/s total, lost %.1f%%, torn %lu\n",
+			rate, 100.0 * lost / (received + lost + torn), torn);
+
+		snprintf(what, sizeof(what), "shm wakeup, %u readers",
+			reader_cnts[c]);
+		latency_report(what, lat, lat_cnt);
+	}
+
+	munmap(res, map_len);
+}
+
+/**
+ * Subscription matching throughput
+ *
+ * Subscriptions select frames from sensors by the 4 byte virtual address at
+ * the start of the payload, like Wattcher packets. A quarter also require a
+ * reading range in a following byte, and some a 16-bit range, which isn't
+ * decided by the index alone. The compiled filter is compared against
+ * evaluating every subscription's terms in turn.
+ */
+#define FILTER_MAX_SUBS (4096)
+#define FILTER_FRAMES (4096)
+
+static uint32_t filter_bench_sensor(unsigned int i)
+{
+	return 0x5c27fe22 + i * 0x01000193;
+}
+
+static bool filter_bench_naive(const nrf905_filter_sub_t *sub,
+				const uint8_t *key, unsigned int key_len)
+{
+	const nrf905_filter_term_t *t;
+	unsigned int i, j;
+	uint32_t w;
+
+	for (i=0; i < sub->term_cnt; i++) {
+		t = &sub->terms[i];
+		if (t->pos + t->len > key_len) {
+			return false;
+		}
+		w = 0;
+		for (j=0; j < t->len; j++) {
+			w = (w << 8) | key[t->pos + j];
+		}
+		w &= t->mask;
+		if (t->op == NRF905_FILTER_OP_EQ ? w != t->lo :
+				(w < t->lo || w > t->hi)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void bench_filter(nrf905_t *nrf, unsigned long iterations)
+{
+	static const unsigned int sub_cnts[] = { 1, 10, 100, 1000, 4096 };
+	static nrf905_filter_sub_t subs[FILTER_MAX_SUBS];
+	static uint8_t frames[FILTER_FRAMES][32];
+	static unsigned int ids[FILTER_MAX_SUBS];
+	nrf905_filter_t filter;
+	uint8_t key[NRF905_FILTER_KEY_LEN];
+	uint32_t addr = 0xaa61cc16;
+	uint32_t x = 1;
+	unsigned long matches, naive_matches, wrong;
+	unsigned int c, i, j, n;
+	char expr[96];
+	char what[48];
+	double start, elapsed;
+
+	for (c=0; c < sizeof(sub_cnts) / sizeof(sub_cnts[0]); c++) {
+		n = sub_cnts[c];
+		nrf905_filter_init(&filter, subs, FILTER_MAX_SUBS);
+		for (i=0; i < n; i++) {
+			if (i % 16 == 3) {
+				snprintf(expr, sizeof(expr),
+					"addr=0x%.8x [0:4]=0x%.8x [4:2]=0x0100-0x2fff",
+					addr, filter_bench_sensor(i));
+			} else if (i % 4 == 1) {
+				snprintf(expr, sizeof(expr),
+					"[0:4]=0x%.8x [5]=%u-%u",
+					filter_bench_sensor(i), i % 200, i % 200 + 50);
+			} else {
+				snprintf(expr, sizeof(expr), "[0:4]=0x%.8x",
+					filter_bench_sensor(i));
+			}
+			if (nrf905_filter_add(&filter, expr) < 0) {
+				perror("nrf905_filter_add");
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		start = nrf905_bench_now();
+		nrf905_filter_compile(&filter);
+		elapsed = nrf905_bench_now() - start;
+		printf("%u subscriptions, compiled in %.3f ms, %u index bytes\n",
+			n, elapsed * 1e3, filter.index_cnt);
+
+		// Half the frames are from subscribed sensors
+		for (i=0; i < FILTER_FRAMES; i++) {
+			for (j=0; j < 32; j++) {
+				x ^= x << 13;
+				x ^= x >> 17;
+				x ^= x << 5;
+				frames[i][j] = x;
+			}
+			if (i % 2 == 0) {
+				j = filter_bench_sensor(x % n);
+				frames[i][0] = j >> 24;
+				frames[i][1] = j >> 16;
+				frames[i][2] = j >> 8;
+				frames[i][3] = j;
+			}
+		}
+
+		matches = 0;
+		start = nrf905_bench_now();
+		for (i=0; i < iterations; i++) {
+			matches += nrf905_filter_match(&filter, addr,
+					frames[i % FILTER_FRAMES], 32, ids,
+					FILTER_MAX_SUBS);
+		}
+		elapsed = nrf905_bench_now() - start;
+		snprintf(what, sizeof(what), "compiled, %u subs", n);
+		report(what, iterations, elapsed);
+		printf("  %.0f frames/s, %lu matches, %.2f evaluated per frame\n",
+			iterations / elapsed, matches,
+			(double) filter.evaluated / filter.frames);
+
+		naive_matches = 0;
+		wrong = 0;
+		key[0] = addr >> 24;
+		key[1] = addr >> 16;
+		key[2] = addr >> 8;
+		key[3] = addr;
+		start = nrf905_bench_now();
+		for (i=0; i < iterations; i++) {
+			memcpy(&key[4], frames[i % FILTER_FRAMES], 32);
+			for (j=0; j < n; j++) {
+				if (filter_bench_naive(&subs[j], key, sizeof(key))) {
+					naive_matches++;
+				}
+			}
+		}
+		elapsed = nrf905_bench_now() - start;
+		snprintf(what, sizeof(what), "linear, %u subs", n);
+		report(what, iterations, elapsed);
+		if (naive_matches != matches) {
+			wrong = labs((long) (naive_matches - matches));
+		}
+		printf("  %.0f frames/s, %lu matches, mismatch %lu\n",
+			iterations / elapsed, naive_matches, wrong);
+
+		nrf905_filter_destroy(&filter);
+	}
+}
+
+static const struct benchmark benchmarks[] = {
+	{ "gpio", "GPIO writes per TX/RX cycle", true, bench_gpio },
+	{ "sniff", "Promiscuous frame reconstruction", false, bench_sniff },
+	{ "hop", "Frequency hops per second", true, bench_hop },
+	{ "csma-sim", "Simulated goodput, blind vs. listen before talk", false,
+		bench_csma_sim },
+	{ "tdma-sim", "Simulated TDMA utilization and latency", false,
+		bench_tdma_sim },
+	{ "fanout", "Same payload to many addresses", true, bench_fanout },
+	{ "dedup", "Duplicate suppression per frame cost", false, bench_dedup },
+	{ "frame", "Adaptive payload width air time and throughput", true,
+		bench_frame },
+	{ "latency", "Send and receive latency with/without RT profile", true,
+		bench_latency },
+	{ "shm", "Shared memory fan-out to 1-16 reader processes", false,
+		bench_shm },
+	{ "filter", "Subscription matching throughput", false, bench_filter },
+};
+
+#define BENCHMARK_CNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static void usage(const char *name)
+{
+	unsigned int i;
+
+	fprintf(stderr, "usage: %s BENCHMARK [ITERATIONS]\n\n", name);
+	fprintf(stderr, "Benchmarks:\n");
+	for (i=0; i < BENCHMARK_CNT; i++) {
+		fprintf(stderr, "  %-10s %s%s\n", benchmarks[i].name,
+			benchmarks[i].descr,
+			benchmarks[i].needs_radio ? " (needs radio)" : "");
+	}
+}
+
+int main(int argc, const char *argv[])
+{
+	const struct benchmark *bench = NULL;
+	unsigned long iterations = DEFAULT_ITERATIONS;
+	nrf905_t nrf;
+	unsigned int i;
+	int err;
+
+	if (argc < 2 || argc > 3) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	for (i=0; i < BENCHMARK_CNT; i++) {
+		if (strcmp(argv[1], benchmarks[i].name) == 0) {
+			bench = &benchmarks[i];
+		}
+	}
+	if (bench == NULL) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (argc == 3) {
+		iterations = strtoul(argv[2], NULL, 0);
+		if (iterations == 0) {
+			fprintf(stderr, "Invalid iteration count\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (bench->needs_radio) {
+		err = nrf905_init(&nrf, PIN_PWR, PIN_CE, PIN_TXEN, PIN_DR, SPI_CS);
+		if (err != 0) {
+			fprintf(stderr, "Failed to initialize NRF905, Do you have root permissions?\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	bench->run(&nrf, iterations);
+
+	if (bench->needs_radio) {
+		nrf905_destroy(&nrf);
+	}
+
+	return 0;
+}
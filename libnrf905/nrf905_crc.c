@@ -0,0 +1,471 @@
+/**
+ * nrf905_crc.c - CRC calculation as used by the nRF905
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define NRF905_CRC_CLMUL_X86
+# include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+# define NRF905_CRC_PMULL
+# include <arm_neon.h>
+#endif
+
+#include "nrf905_crc.h"
+
+/**
+ * Buffers from this length on are folded with carry-less multiplication
+ */
+#define CLMUL_MIN_LEN (64)
+
+/*
+ * Slice-by-8 tables, generated at compile time
+ *
+ * Entry [k][v] is the CRC, starting from 0, of byte v followed by k zero
+ * bytes. Table [0] is the classic byte-at-a-time table. The CRC is linear, so
+ * an entry is the XOR of the entries of the bits set in v. Those are
+ * calculated bit by bit as enum constants, to not expand the macros
+ * exponentially.
+ */
+#define _STEP8(x) ((((x) << 1) ^ ((((x) >> 7) & 1) * 0x07)) & 0xff)
+#define _STEP16(x) ((((x) << 1) ^ ((((x) >> 15) & 1) * 0x1021)) & 0xffff)
+#define _BYTE8(x) _STEP8(_STEP8(_STEP8(_STEP8( \
+		  _STEP8(_STEP8(_STEP8(_STEP8(x))))))))
+#define _BYTE16(x) _STEP16(_STEP16(_STEP16(_STEP16( \
+		   _STEP16(_STEP16(_STEP16(_STEP16(x))))))))
+
+#define _BITS(n, f, k, x) \
+	_C##n##_##k##_0 = f(x(0)), _C##n##_##k##_1 = f(x(1)), \
+	_C##n##_##k##_2 = f(x(2)), _C##n##_##k##_3 = f(x(3)), \
+	_C##n##_##k##_4 = f(x(4)), _C##n##_##k##_5 = f(x(5)), \
+	_C##n##_##k##_6 = f(x(6)), _C##n##_##k##_7 = f(x(7))
+#define _X8(i) (1 << (i))
+#define _X16(i) (1 << ((i) + 8))
+#define _P8_0(i) _C8_0_##i
+#define _P8_1(i) _C8_1_##i
+#define _P8_2(i) _C8_2_##i
+#define _P8_3(i) _C8_3_##i
+#define _P8_4(i) _C8_4_##i
+#define _P8_5(i) _C8_5_##i
+#define _P8_6(i) _C8_6_##i
+#define _P16_0(i) _C16_0_##i
+#define _P16_1(i) _C16_1_##i
+#define _P16_2(i) _C16_2_##i
+#define _P16_3(i) _C16_3_##i
+#define _P16_4(i) _C16_4_##i
+#define _P16_5(i) _C16_5_##i
+#define _P16_6(i) _C16_6_##i
+
+enum {
+	_BITS(8, _BYTE8, 0, _X8),
+	_BITS(8, _BYTE8, 1, _P8_0),
+	_BITS(8, _BYTE8, 2, _P8_1),
+	_BITS(8, _BYTE8, 3, _P8_2),
+	_BITS(8, _BYTE8, 4, _P8_3),
+	_BITS(8, _BYTE8, 5, _P8_4),
+	_BITS(8, _BYTE8, 6, _P8_5),
+	_BITS(8, _BYTE8, 7, _P8_6),
+	_BITS(16, _BYTE16, 0, _X16),
+	_BITS(16, _BYTE16, 1, _P16_0),
+	_BITS(16, _BYTE16, 2, _P16_1),
+	_BITS(16, _BYTE16, 3, _P16_2),
+	_BITS(16, _BYTE16, 4, _P16_3),
+	_BITS(16, _BYTE16, 5, _P16_4),
+	_BITS(16, _BYTE16, 6, _P16_5),
+	_BITS(16, _BYTE16, 7, _P16_6),
+};
+
+#define _E(n, k, v) \
+	((((v) & 0x01) ? _C##n##_##k##_0 : 0) ^ \
+	 (((v) & 0x02) ? _C##n##_##k##_1 : 0) ^ \
+	 (((v) & 0x04) ? _C##n##_##k##_2 : 0) ^ \
+	 (((v) & 0x08) ? _C##n##_##k##_3 : 0) ^ \
+	 (((v) & 0x10) ? _C##n##_##k##_4 : 0) ^ \
+	 (((v) & 0x20) ? _C##n##_##k##_5 : 0) ^ \
+	 (((v) & 0x40) ? _C##n##_##k##_6 : 0) ^ \
+	 (((v) & 0x80) ? _C##n##_##k##_7 : 0))
+#define _T4(n, k, i) _E(n, k, i), _E(n, k, i + 1), _E(n, k, i + 2), \
+		     _E(n, k, i + 3)
+#define _T16(n, k, i) _T4(n, k, i), _T4(n, k, i + 4), _T4(n, k, i + 8), \
+		      _T4(n, k, i + 12)
+#define _T64(n, k, i) _T16(n, k, i), _T16(n, k, i + 16), \
+		      _T16(n, k, i + 32), _T16(n, k, i + 48)
+#define _T256(n, k) { _T64(n, k, 0), _T64(n, k, 64), _T64(n, k, 128), \
+		      _T64(n, k, 192) }
+
+/**
+ * CRC-8, polynomial x^8 + x^2 + x + 1 (0x07)
+ */
+static const uint8_t crc8_tab[8][256] = {
+	_T256(8, 0), _T256(8, 1), _T256(8, 2), _T256(8, 3),
+	_T256(8, 4), _T256(8, 5), _T256(8, 6), _T256(8, 7),
+};
+
+/**
+ * CRC-16 CCITT, polynomial x^16 + x^12 + x^5 + 1 (0x1021)
+ */
+static const uint16_t crc16_tab[8][256] = {
+	_T256(16, 0), _T256(16, 1), _T256(16, 2), _T256(16, 3),
+	_T256(16, 4), _T256(16, 5), _T256(16, 6), _T256(16, 7),
+};
+
+#if defined(NRF905_CRC_CLMUL_X86) || defined(NRF905_CRC_PMULL)
+/**
+ * Folding constants
+ *
+ * x^n mod P for n = 128, 192, 256, 320, 384, 448, 512 and 576. Folding a
+ * 128-bit remainder forward by N bits multiplies its high half with
+ * x^(N+64) mod P and its low half with x^N mod P. The polynomials are of
+ * degree 16 or less, so the sum of the products fits in 128 bits again.
+ */
+typedef struct {
+	uint64_t k[8];
+	int width;
+} _nrf905_crc_fold_t;
+
+static const _nrf905_crc_fold_t crc8_fold = {
+	{ 0x02, 0x26, 0x04, 0x4c, 0x08, 0x98, 0x10, 0x37 }, 8
+};
+
+static const _nrf905_crc_fold_t crc16_fold = {
+	{ 0xaefc, 0x650b, 0x8e29, 0x26aa, 0xcde2, 0x2535, 0x13fc, 0x8832 }, 16
+};
+#endif
+
+uint8_t nrf905_crc8_update(uint8_t crc, uint8_t c)
+{
+	return crc8_tab[0][crc ^ c];
+}
+
+uint16_t nrf905_crc16_update(uint16_t crc, uint8_t c)
+{
+	return (crc << 8) ^ crc16_tab[0][(crc >> 8) ^ c];
+}
+
+uint8_t nrf905_crc8_update_slice4(uint8_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len >= 4) {
+		crc = crc8_tab[3][crc ^ p[0]] ^ crc8_tab[2][p[1]] ^
+			crc8_tab[1][p[2]] ^ crc8_tab[0][p[3]];
+		p += 4;
+		len -= 4;
+	}
+	while (len--) {
+		crc = crc8_tab[0][crc ^ *p++];
+	}
+
+	return crc;
+}
+
+uint8_t nrf905_crc8_update_slice8(uint8_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len >= 8) {
+		crc = crc8_tab[7][crc ^ p[0]] ^ crc8_tab[6][p[1]] ^
+			crc8_tab[5][p[2]] ^ crc8_tab[4][p[3]] ^
+			crc8_tab[3][p[4]] ^ crc8_tab[2][p[5]] ^
+			crc8_tab[1][p[6]] ^ crc8_tab[0][p[7]];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = crc8_tab[0][crc ^ *p++];
+	}
+
+	return crc;
+}
+
+uint16_t nrf905_crc16_update_slice4(uint16_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len >= 4) {
+		crc ^= (p[0] << 8) | p[1];
+		crc = crc16_tab[3][crc >> 8] ^ crc16_tab[2][crc & 0xff] ^
+			crc16_tab[1][p[2]] ^ crc16_tab[0][p[3]];
+		p += 4;
+		len -= 4;
+	}
+	while (len--) {
+		crc = (crc << 8) ^ crc16_tab[0][(crc >> 8) ^ *p++];
+	}
+
+	return crc;
+}
+
+uint16_t nrf905_crc16_update_slice8(uint16_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len >= 8) {
+		crc ^= (p[0] << 8) | p[1];
+		crc = crc16_tab[7][crc >> 8] ^ crc16_tab[6][crc & 0xff] ^
+			crc16_tab[5][p[2]] ^ crc16_tab[4][p[3]] ^
+			crc16_tab[3][p[4]] ^ crc16_tab[2][p[5]] ^
+			crc16_tab[1][p[6]] ^ crc16_tab[0][p[7]];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = (crc << 8) ^ crc16_tab[0][(crc >> 8) ^ *p++];
+	}
+
+	return crc;
+}
+
+#if defined(NRF905_CRC_CLMUL_X86)
+/*
+ * Data is loaded byte reversed, so the first byte ends up in the most
+ * significant bits and the 128-bit value is the polynomial of the block.
+ */
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i _nrf905_crc_load(const uint8_t *p)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					   8, 9, 10, 11, 12, 13, 14, 15);
+
+	return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) p), bswap);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i _nrf905_crc_fold(__m128i a, const _nrf905_crc_fold_t *f,
+					int n)
+{
+	const __m128i k = _mm_set_epi64x(f->k[n + 1], f->k[n]);
+
+	return _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x11),
+			     _mm_clmulepi64_si128(a, k, 0x00));
+}
+
+/**
+ * Fold all 16-byte blocks of buffer into a 128-bit remainder
+ *
+ * The remainder is congruent to the buffer, with the CRC XOR-ed into its
+ * first bits, modulo the polynomial. Running the table CRC from 0 over the
+ * remainder gives the CRC of the buffer.
+ *
+ * @param crc	CRC value to continue from
+ * @param f	Folding constants of the CRC
+ * @param p	Data, at least 16 bytes
+ * @param len	Amount of bytes to fold, multiple of 16
+ * @param rem	Returns the remainder as big-endian bytes
+ */
+__attribute__((target("pclmul,ssse3")))
+static void _nrf905_crc_fold_buf(uint16_t crc, const _nrf905_crc_fold_t *f,
+				const uint8_t *p, size_t len, uint8_t rem[16])
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					   8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i init = _mm_set_epi64x(
+				(uint64_t) crc << (64 - f->width), 0);
+	__m128i a0, a1, a2, a3;
+
+	if (len >= 64) {
+		// Four independent chains to hide the multiply latency
+		a0 = _mm_xor_si128(_nrf905_crc_load(p), init);
+		a1 = _nrf905_crc_load(p + 16);
+		a2 = _nrf905_crc_load(p + 32);
+		a3 = _nrf905_crc_load(p + 48);
+		p += 64;
+		len -= 64;
+		while (len >= 64) {
+			a0 = _mm_xor_si128(_nrf905_crc_fold(a0, f, 6),
+					   _nrf905_crc_load(p));
+			a1 = _mm_xor_si128(_nrf905_crc_fold(a1, f, 6),
+					   _nrf905_crc_load(p + 16));
+			a2 = _mm_xor_si128(_nrf905_crc_fold(a2, f, 6),
+					   _nrf905_crc_load(p + 32));
+			a3 = _mm_xor_si128(_nrf905_crc_fold(a3, f, 6),
+					   _nrf905_crc_load(p + 48));
+			p += 64;
+			len -= 64;
+		}
+		a0 = _mm_xor_si128(_mm_xor_si128(_nrf905_crc_fold(a0, f, 4),
+						  _nrf905_crc_fold(a1, f, 2)),
+				   _mm_xor_si128(_nrf905_crc_fold(a2, f, 0),
+						  a3));
+	} else {
+		a0 = _mm_xor_si128(_nrf905_crc_load(p), init);
+		p += 16;
+		len -= 16;
+	}
+	while (len >= 16) {
+		a0 = _mm_xor_si128(_nrf905_crc_fold(a0, f, 0),
+				   _nrf905_crc_load(p));
+		p += 16;
+		len -= 16;
+	}
+
+	_mm_storeu_si128((__m128i *) rem, _mm_shuffle_epi8(a0, bswap));
+}
+
+bool nrf905_crc_clmul_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul") &&
+		__builtin_cpu_supports("ssse3");
+}
+#elif defined(NRF905_CRC_PMULL)
+static inline uint64x2_t _nrf905_crc_load(const uint8_t *p)
+{
+	uint8x16_t v = vrev64q_u8(vld1q_u8(p));
+
+	return vreinterpretq_u64_u8(vextq_u8(v, v, 8));
+}
+
+static inline uint64x2_t _nrf905_crc_fold(uint64x2_t a,
+					const _nrf905_crc_fold_t *f, int n)
+{
+	return veorq_u64(
+		vreinterpretq_u64_p128(vmull_p64(vgetq_lane_u64(a, 1),
+						 f->k[n + 1])),
+		vreinterpretq_u64_p128(vmull_p64(vgetq_lane_u64(a, 0),
+						 f->k[n])));
+}
+
+static void _nrf905_crc_fold_buf(uint16_t crc, const _nrf905_crc_fold_t *f,
+				const uint8_t *p, size_t len, uint8_t rem[16])
+{
+	const uint64x2_t init = vcombine_u64(vcreate_u64(0),
+			vcreate_u64((uint64_t) crc << (64 - f->width)));
+	uint64x2_t a0, a1, a2, a3;
+	uint8x16_t v;
+
+	if (len >= 64) {
+		a0 = veorq_u64(_nrf905_crc_load(p), init);
+		a1 = _nrf905_crc_load(p + 16);
+		a2 = _nrf905_crc_load(p + 32);
+		a3 = _nrf905_crc_load(p + 48);
+		p += 64;
+		len -= 64;
+		while (len >= 64) {
+			a0 = veorq_u64(_nrf905_crc_fold(a0, f, 6),
+				       _nrf905_crc_load(p));
+			a1 = veorq_u64(_nrf905_crc_fold(a1, f, 6),
+				       _nrf905_crc_load(p + 16));
+			a2 = veorq_u64(_nrf905_crc_fold(a2, f, 6),
+				       _nrf905_crc_load(p + 32));
+			a3 = veorq_u64(_nrf905_crc_fold(a3, f, 6),
+				       _nrf905_crc_load(p + 48));
+			p += 64;
+			len -= 64;
+		}
+		a0 = veorq_u64(veorq_u64(_nrf905_crc_fold(a0, f, 4),
+					 _nrf905_crc_fold(a1, f, 2)),
+			       veorq_u64(_nrf905_crc_fold(a2, f, 0), a3));
+	} else {
+		a0 = veorq_u64(_nrf905_crc_load(p), init);
+		p += 16;
+		len -= 16;
+	}
+	while (len >= 16) {
+		a0 = veorq_u64(_nrf905_crc_fold(a0, f, 0),
+			       _nrf905_crc_load(p));
+		p += 16;
+		len -= 16;
+	}
+
+	v = vreinterpretq_u8_u64(a0);
+	vst1q_u8(rem, vrev64q_u8(vextq_u8(v, v, 8)));
+}
+
+bool nrf905_crc_clmul_supported(void)
+{
+	return true;
+}
+#else
+bool nrf905_crc_clmul_supported(void)
+{
+	return false;
+}
+#endif
+
+uint8_t nrf905_crc8_update_clmul(uint8_t crc, const void *data, size_t len)
+{
+#if defined(NRF905_CRC_CLMUL_X86) || defined(NRF905_CRC_PMULL)
+	const uint8_t *p = data;
+	uint8_t rem[16];
+	size_t fold_len = len & ~(size_t) 15;
+
+	if (fold_len > 0 && nrf905_crc_clmul_supported()) {
+		_nrf905_crc_fold_buf(crc, &crc8_fold, p, fold_len, rem);
+		crc = nrf905_crc8_update_slice8(0, rem, sizeof(rem));
+		return nrf905_crc8_update_slice8(crc, p + fold_len,
+						 len - fold_len);
+	}
+#endif
+	return nrf905_crc8_update_slice8(crc, data, len);
+}
+
+uint16_t nrf905_crc16_update_clmul(uint16_t crc, const void *data, size_t len)
+{
+#if defined(NRF905_CRC_CLMUL_X86) || defined(NRF905_CRC_PMULL)
+	const uint8_t *p = data;
+	uint8_t rem[16];
+	size_t fold_len = len & ~(size_t) 15;
+
+	if (fold_len > 0 && nrf905_crc_clmul_supported()) {
+		_nrf905_crc_fold_buf(crc, &crc16_fold, p, fold_len, rem);
+		crc = nrf905_crc16_update_slice8(0, rem, sizeof(rem));
+		return nrf905_crc16_update_slice8(crc, p + fold_len,
+						  len - fold_len);
+	}
+#endif
+	return nrf905_crc16_update_slice8(crc, data, len);
+}
+
+uint8_t nrf905_crc8_update_buf(uint8_t crc, const void *data, size_t len)
+{
+	if (len >= CLMUL_MIN_LEN) {
+		return nrf905_crc8_update_clmul(crc, data, len);
+	}
+	return nrf905_crc8_update_slice8(crc, data, len);
+}
+
+uint16_t nrf905_crc16_update_buf(uint16_t crc, const void *data, size_t len)
+{
+	if (len >= CLMUL_MIN_LEN) {
+		return nrf905_crc16_update_clmul(crc, data, len);
+	}
+	return nrf905_crc16_update_slice8(crc, data, len);
+}
+
+uint8_t nrf905_crc8(const void *data, size_t len)
+{
+	return nrf905_crc8_update_buf(NRF905_CRC8_INIT, data, len);
+}
+
+uint16_t nrf905_crc16(const void *data, size_t len)
+{
+	return nrf905_crc16_update_buf(NRF905_CRC16_INIT, data, len);
+}
@@ -0,0 +1,98 @@
+/**
+ * nrf905_crc.h - CRC calculation as used by the nRF905
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_CRC_H__
+#define __NRF905_CRC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Initial CRC values
+ *
+ * The nRF905 calculates the CRC over the address and payload, MSB first,
+ * and transmits it MSB first. Calculating the CRC over a complete frame,
+ * including the CRC, therefore results in 0 for a valid frame.
+ */
+#define NRF905_CRC8_INIT (0xFF)
+#define NRF905_CRC16_INIT (0xFFFF)
+
+/**
+ * Update CRC with a single byte
+ */
+uint8_t nrf905_crc8_update(uint8_t crc, uint8_t c);
+uint16_t nrf905_crc16_update(uint16_t crc, uint8_t c);
+
+/**
+ * Update CRC with a buffer
+ *
+ * Uses the fastest implementation for the buffer length.
+ */
+uint8_t nrf905_crc8_update_buf(uint8_t crc, const void *data, size_t len);
+uint16_t nrf905_crc16_update_buf(uint16_t crc, const void *data, size_t len);
+
+/**
+ * Calculate CRC over a buffer, starting with the nRF905 initial value
+ */
+uint8_t nrf905_crc8(const void *data, size_t len);
+uint16_t nrf905_crc16(const void *data, size_t len);
+
+/**
+ * Specific implementations, for benchmarking
+ *
+ * The slice-by-4 and slice-by-8 versions process 4 or 8 bytes per table
+ * round. The clmul versions fold 16-byte blocks with carry-less
+ * multiplication, PCLMULQDQ on x86 or PMULL on ARMv8 with the crypto
+ * extension, and fall back to slice-by-8 if that isn't available.
+ */
+uint8_t nrf905_crc8_update_slice4(uint8_t crc, const void *data, size_t len);
+uint8_t nrf905_crc8_update_slice8(uint8_t crc, const void *data, size_t len);
+uint8_t nrf905_crc8_update_clmul(uint8_t crc, const void *data, size_t len);
+uint16_t nrf905_crc16_update_slice4(uint16_t crc, const void *data,
+					size_t len);
+uint16_t nrf905_crc16_update_slice8(uint16_t crc, const void *data,
+					size_t len);
+uint16_t nrf905_crc16_update_clmul(uint16_t crc, const void *data,
+					size_t len);
+
+/**
+ * Check if carry-less multiplication is available on this CPU
+ */
+bool nrf905_crc_clmul_supported(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_CRC_H__
@@ -0,0 +1,187 @@
+/**
+ * nrf905_csma.c - Listen before talk channel access
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "nrf905.h"
+#include "nrf905_csma.h"
+#include "nrf905_time.h"
+
+void nrf905_csma_init(nrf905_csma_t *csma, uint32_t seed)
+{
+	csma->sense_us = NRF905_CSMA_SENSE_US;
+	csma->slot_us = NRF905_CSMA_SENSE_US + NRF905_T_RX_TX_US;
+	csma->min_be = NRF905_CSMA_MIN_BE;
+	csma->max_be = NRF905_CSMA_MAX_BE;
+	csma->max_attempts = NRF905_CSMA_MAX_ATTEMPTS;
+
+	// xorshift32 state may not be 0
+	csma->rng = (seed != 0) ? seed : 0x2545f491;
+
+	nrf905_csma_reset_stats(csma);
+}
+
+void nrf905_csma_reset_stats(nrf905_csma_t *csma)
+{
+	csma->frames = 0;
+	csma->clear = 0;
+	csma->deferrals = 0;
+	csma->drops = 0;
+	csma->sense_us_total = 0;
+	csma->backoff_us_total = 0;
+	csma->bursts = 0;
+}
+
+uint32_t nrf905_csma_backoff(nrf905_csma_t *csma, unsigned int attempt)
+{
+	unsigned int be;
+	uint32_t x;
+
+	be = csma->min_be + attempt - 1;
+	if (be > csma->max_be) {
+		be = csma->max_be;
+	}
+
+	x = csma->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	csma->rng = x;
+
+	return (x & ((1u << be) - 1)) * csma->slot_us;
+}
+
+/**
+ * Sense channel using the status register
+ *
+ * Without the CD pin only a frame to our own address can be noticed, by its
+ * address match while it's being received. Data ready isn't used: it only
+ * says a received frame waits in the RX payload register, which stays set
+ * until the application reads it, long after the channel went idle.
+ *
+ * @returns	true if the channel is busy
+ */
+static bool _nrf905_csma_sense_status(nrf905_t *nrf, uint32_t sense_us,
+					unsigned long *bursts)
+{
+	struct timespec end;
+	struct timespec now;
+	uint8_t status;
+
+	*bursts = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	_timespec_add_us(&end, sense_us);
+	do {
+		status = nrf905_read_status(nrf);
+		if (status & NRF905_STATUS_AM) {
+			*bursts = 1;
+			return true;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (_timespec_cmp(&now, &end) < 0);
+
+	return false;
+}
+
+int nrf905_csma_wait_clear(nrf905_t *nrf, nrf905_csma_t *csma)
+{
+	struct timespec ts;
+	unsigned long busy, bursts;
+	unsigned int attempt;
+	uint32_t backoff_us;
+	long samples;
+	int err;
+
+	err = nrf905_set_mode(nrf, NRF905_MODE_RX);
+	if (err != 0) {
+		return -1;
+	}
+
+	for (attempt=1; attempt <= csma->max_attempts; attempt++) {
+		nrf905_wait_settled(nrf);
+
+		if (nrf->pin_cd != NRF905_PIN_NC) {
+			samples = nrf905_sample_carrier(nrf, csma->sense_us,
+							&busy, &bursts);
+			if (samples < 0) {
+				return -1;
+			}
+		} else {
+			busy = _nrf905_csma_sense_status(nrf, csma->sense_us,
+							&bursts);
+		}
+		csma->sense_us_total += csma->sense_us;
+		csma->bursts += bursts;
+
+		if (busy == 0) {
+			csma->frames++;
+			if (attempt == 1) {
+				csma->clear++;
+			}
+			return 0;
+		}
+
+		csma->deferrals++;
+		if (attempt == csma->max_attempts) {
+			break;
+		}
+
+		// Keep listening during backoff, so no RX settle time is needed
+		// for the next assessment
+		backoff_us = nrf905_csma_backoff(csma, attempt);
+		csma->backoff_us_total += backoff_us;
+		ts.tv_sec = backoff_us / 1000000;
+		ts.tv_nsec = (backoff_us % 1000000) * 1000;
+		while (nanosleep(&ts, &ts) != 0) {
+			if (errno != EINTR) {
+				return -1;
+			}
+		}
+	}
+
+	csma->drops++;
+	errno = EBUSY;
+	return -1;
+}
+
+double nrf905_csma_collision_estimate(nrf905_csma_t *csma)
+{
+	double rate;
+
+	if (csma->sense_us_total == 0) {
+		return 0;
+	}
+
+	// Carriers per microsecond, assuming Poisson arrivals
+	rate = (double) csma->bursts / csma->sense_us_total;
+
+	return csma->frames * (1 - exp(-rate * csma->slot_us));
+}
@@ -0,0 +1,148 @@
+/**
+ * nrf905_csma.h - Listen before talk channel access
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __NRF905_CSMA_H__
+#define __NRF905_CSMA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf905.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Default carrier sense time
+ *
+ * The carrier detect output follows the RF input within a few bit times, so
+ * a frame that is already in the air is seen well within this time.
+ */
+#define NRF905_CSMA_SENSE_US	(5 * NRF905_BIT_TIME_US)
+
+/**
+ * Default backoff exponents and attempt limit
+ */
+#define NRF905_CSMA_MIN_BE	(2)
+#define NRF905_CSMA_MAX_BE	(6)
+#define NRF905_CSMA_MAX_ATTEMPTS (8)
+
+/**
+ * CSMA/CA object
+ *
+ * Attach to a NRF905 object using nrf905_set_csma(). Before every transmit
+ * the receiver is enabled and the channel is sensed for sense_us. If a
+ * carrier is detected the transmit is deferred for a random amount of
+ * backoff slots, from 0 to 2^BE - 1, where the backoff exponent BE starts at
+ * min_be and is incremented after every busy channel up to max_be. After
+ * max_attempts busy channel assessments the frame is dropped.
+ *
+ * A transmission can still collide with a node that keys its transmitter
+ * during the RX -> TX turnaround following a clear channel assessment. This
+ * vulnerable period is the minimum backoff slot length.
+ */
+typedef struct nrf905_csma {
+	// Parameters
+	uint32_t sense_us;	// Carrier sense time per attempt
+	uint32_t slot_us;	// Backoff slot length
+	uint8_t min_be;		// Initial backoff exponent
+	uint8_t max_be;		// Maximum backoff exponent
+	uint8_t max_attempts;	// Busy channel assessments before dropping
+
+	// Statistics
+	unsigned long frames;	// Frames transmitted
+	unsigned long clear;	// Frames transmitted at the first attempt
+	unsigned long deferrals; // Busy channel assessments
+	unsigned long drops;	// Frames dropped because the channel stayed busy
+	uint64_t sense_us_total; // Total time spend sensing the channel
+	uint64_t backoff_us_total; // Total time spend in backoff
+	unsigned long bursts;	// Carriers seen while sensing
+
+	// Internal
+	uint32_t rng;
+} nrf905_csma_t;
+
+/**
+ * Initialize CSMA/CA object with default parameters
+ *
+ * The backoff slot is set to the carrier sense time plus the RX -> TX
+ * turnaround time.
+ *
+ * @param csma	CSMA/CA object to initialize
+ * @param seed	Seed for the backoff random generator, should differ per node
+ */
+void nrf905_csma_init(nrf905_csma_t *csma, uint32_t seed);
+
+/**
+ * Reset statistics
+ */
+void nrf905_csma_reset_stats(nrf905_csma_t *csma);
+
+/**
+ * Draw a random backoff
+ *
+ * @param csma		CSMA/CA object
+ * @param attempt	Amount of busy channel assessments so far, >= 1
+ *
+ * @returns	Backoff time in microseconds
+ */
+uint32_t nrf905_csma_backoff(nrf905_csma_t *csma, unsigned int attempt);
+
+/**
+ * Wait for a clear channel
+ *
+ * Enables the receiver and performs clear channel assessments with random
+ * backoff in between. Uses the carrier detect pin if configured, else only
+ * frames matching our own RX address can be detected, by the address match
+ * status. Called by the send functions if CSMA/CA is enabled.
+ *
+ * @param nrf	NRF905 object
+ * @param csma	CSMA/CA object
+ *
+ * @returns	0 if the channel is clear, the device is left in RX mode. -1
+ *		on error, errno is set to EBUSY if the channel stayed busy.
+ */
+int nrf905_csma_wait_clear(nrf905_t *nrf, nrf905_csma_t *csma);
+
+/**
+ * Estimate amount of collisions
+ *
+ * Estimated from the rate at which carriers appeared while sensing. Every
+ * frame transmitted is assumed to collide with the chance that another
+ * carrier appears during the vulnerable period.
+ *
+ * @returns	Expected amount of collided frames
+ */
+double nrf905_csma_collision_estimate(nrf905_csma_t *csma);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_CSMA_H__
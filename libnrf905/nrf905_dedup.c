@@ -0,0 +1,164 @@
+/**
+ * nrf905_dedup.c - Duplicate frame suppression
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "nrf905_dedup.h"
+
+/**
+ * Fibonacci hashing constant, 2^32 / golden ratio
+ */
+#define DEDUP_HASH_MULT (2654435769u)
+
+/**
+ * FNV-1a parameters
+ */
+#define FNV_OFFSET (2166136261u)
+#define FNV_PRIME (16777619u)
+
+int nrf905_dedup_init(nrf905_dedup_t *d, nrf905_dedup_entry_t *table,
+			unsigned int size, uint32_t ttl_ms)
+{
+	unsigned int bits = 0;
+
+	if (size < 2 || (size & (size - 1)) != 0 || ttl_ms == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	while ((1u << bits) < size) {
+		bits++;
+	}
+
+	d->table = table;
+	d->size = size;
+	d->shift = 32 - bits;
+	d->ttl_ms = ttl_ms;
+
+	nrf905_dedup_clear(d);
+
+	return 0;
+}
+
+void nrf905_dedup_clear(nrf905_dedup_t *d)
+{
+	memset(d->table, 0, d->size * sizeof(d->table[0]));
+
+	d->passed = 0;
+	d->suppressed = 0;
+	d->evicted = 0;
+}
+
+static uint32_t _nrf905_dedup_hash(const uint8_t *data, size_t len)
+{
+	uint32_t h = FNV_OFFSET;
+	size_t i;
+
+	for (i=0; i < len; i++) {
+		h ^= data[i];
+		h *= FNV_PRIME;
+	}
+
+	return h;
+}
+
+bool nrf905_dedup_check_at(nrf905_dedup_t *d, uint32_t addr, const void *data,
+			size_t len, uint32_t now_ms)
+{
+	nrf905_dedup_entry_t *e;
+	nrf905_dedup_entry_t *victim = NULL;
+	uint32_t hash;
+	uint32_t expires;
+	unsigned int probe_len;
+	unsigned int i;
+	unsigned int n;
+
+	hash = _nrf905_dedup_hash(data, len);
+	expires = now_ms + d->ttl_ms;
+	if (expires == 0) {
+		expires = 1;
+	}
+
+	probe_len = (d->size < NRF905_DEDUP_PROBE_LEN) ?
+			d->size : NRF905_DEDUP_PROBE_LEN;
+
+	i = ((hash ^ addr) * DEDUP_HASH_MULT) >> d->shift;
+	for (n=0; n < probe_len; n++) {
+		e = &d->table[i];
+
+		if (e->expires == 0) {
+			// Never used, so the key can't be further on
+			if (victim == NULL || victim->expires != 0) {
+				victim = e;
+			}
+			break;
+		}
+
+		if ((int32_t) (e->expires - now_ms) <= 0) {
+			// Expired, reuse unless an earlier entry is
+			if (victim == NULL ||
+			    (int32_t) (victim->expires - now_ms) > 0)
+			{
+				victim = e;
+			}
+		} else if (e->hash == hash && e->addr == addr) {
+			e->expires = expires;
+			d->suppressed++;
+			return true;
+		} else if (victim == NULL ||
+			   ((int32_t) (victim->expires - now_ms) > 0 &&
+			    (int32_t) (e->expires - victim->expires) < 0))
+		{
+			victim = e;
+		}
+
+		i = (i + 1) & (d->size - 1);
+	}
+
+	if (victim->expires != 0 && (int32_t) (victim->expires - now_ms) > 0) {
+		d->evicted++;
+	}
+	victim->addr = addr;
+	victim->hash = hash;
+	victim->expires = expires;
+	d->passed++;
+
+	return false;
+}
+
+bool nrf905_dedup_check(nrf905_dedup_t *d, uint32_t addr, const void *data,
+			size_t len)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return nrf905_dedup_check_at(d, addr, data, len,
+			now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
@@ -0,0 +1,125 @@
+/**
+ * nrf905_dedup.h - Duplicate frame suppression
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __NRF905_DEDUP_H__
+#define __NRF905_DEDUP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Max. amount of table entries inspected per frame
+ */
+#define NRF905_DEDUP_PROBE_LEN (16)
+
+/**
+ * Duplicate table entry
+ */
+typedef struct {
+	uint32_t addr;		// RX address the frame was received on
+	uint32_t hash;		// Payload hash
+	uint32_t expires;	// Expiry time in ms, 0 if unused
+} nrf905_dedup_entry_t;
+
+/**
+ * Duplicate suppression table
+ *
+ * Open addressing hash table of recently received frames, keyed on RX
+ * address and payload hash, in a caller provided table. An entry expires
+ * ttl_ms after the last copy of the frame was received, so a frame repeated
+ * by auto retransmit is only passed once for as long as the repetition lasts.
+ *
+ * Lookups inspect at most NRF905_DEDUP_PROBE_LEN entries. Expired entries are
+ * reused; if none of the inspected entries is free, the entry closest to
+ * expiry is evicted. Size the table at a few times the amount of distinct
+ * frames expected within ttl_ms.
+ */
+typedef struct nrf905_dedup {
+	nrf905_dedup_entry_t *table;
+	unsigned int size;
+	unsigned int shift;
+	uint32_t ttl_ms;
+
+	// Statistics
+	unsigned long passed;		// Frames passed on
+	unsigned long suppressed;	// Duplicates dropped
+	unsigned long evicted;		// Live entries overwritten
+} nrf905_dedup_t;
+
+/**
+ * Initialize duplicate suppression table
+ *
+ * @param d	Object to initialize
+ * @param table	Storage for the table
+ * @param size	Amount of entries in table, must be a power of 2
+ * @param ttl_ms	Time after the last copy after which a frame is no longer
+ *		considered a duplicate
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if size is not a
+ *		power of 2 or ttl_ms is 0.
+ */
+int nrf905_dedup_init(nrf905_dedup_t *d, nrf905_dedup_entry_t *table,
+			unsigned int size, uint32_t ttl_ms);
+
+/**
+ * Forget all frames and reset statistics
+ */
+void nrf905_dedup_clear(nrf905_dedup_t *d);
+
+/**
+ * Check frame and record it
+ *
+ * @param d	Duplicate suppression table
+ * @param addr	RX address the frame was received on
+ * @param data	Payload
+ * @param len	Payload length
+ *
+ * @returns	true if the frame was already received within ttl_ms
+ */
+bool nrf905_dedup_check(nrf905_dedup_t *d, uint32_t addr, const void *data,
+			size_t len);
+
+/**
+ * Check frame at a given time
+ *
+ * Same as nrf905_dedup_check(), with the current time in ms passed by the
+ * caller.
+ */
+bool nrf905_dedup_check_at(nrf905_dedup_t *d, uint32_t addr, const void *data,
+			size_t len, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_DEDUP_H__
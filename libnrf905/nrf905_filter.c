@@ -0,0 +1,447 @@
+/**
+ * nrf905_filter.c - Compiled receive frame filters
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "nrf905_filter.h"
+
+#define ROW_CNT (257)		// Byte values + byte not in frame
+#define ROW_NONE (256)
+
+/**
+ * Per key byte sets of accepted values of a subscription
+ */
+struct sub_sets {
+	uint64_t set[NRF905_FILTER_KEY_LEN][4];
+	bool constrained[NRF905_FILTER_KEY_LEN];
+	bool decomposable;	// sets are equivalent to the terms
+};
+
+static bool _set_has(const uint64_t *set, unsigned int v)
+{
+	return (set[v >> 6] >> (v & 63)) & 1;
+}
+
+static void _nrf905_filter_sub_sets(const nrf905_filter_sub_t *sub,
+					struct sub_sets *s)
+{
+	const nrf905_filter_term_t *t;
+	unsigned int shift;
+	unsigned int pos;
+	unsigned int i, j, v;
+	uint32_t bmask, bval, blo, bhi;
+	bool accept;
+
+	memset(s->set, 0xff, sizeof(s->set));
+	memset(s->constrained, 0, sizeof(s->constrained));
+	s->decomposable = true;
+
+	for (i=0; i < sub->term_cnt; i++) {
+		t = &sub->terms[i];
+		for (j=0; j < t->len; j++) {
+			shift = 8 * (t->len - 1 - j);
+			pos = t->pos + j;
+			bmask = (t->mask >> shift) & 0xff;
+			bval = (t->lo >> shift) & 0xff;
+			blo = t->lo >> shift;
+			bhi = t->hi >> shift;
+
+			if (t->op == NRF905_FILTER_OP_RANGE && j > 0) {
+				// Lower bytes of a range depend on the higher
+				// ones
+				s->decomposable = false;
+				continue;
+			}
+
+			for (v=0; v < 256; v++) {
+				if (t->op == NRF905_FILTER_OP_EQ) {
+					accept = ((v & bmask) == bval);
+				} else {
+					accept = ((v & bmask) >= blo &&
+						  (v & bmask) <= bhi);
+				}
+				if (!accept) {
+					s->set[pos][v >> 6] &=
+						~((uint64_t) 1 << (v & 63));
+				}
+			}
+			s->constrained[pos] = true;
+		}
+	}
+}
+
+static uint32_t _nrf905_filter_word(const uint8_t *key, unsigned int pos,
+					unsigned int len)
+{
+	uint32_t w = 0;
+	unsigned int i;
+
+	for (i=0; i < len; i++) {
+		w = (w << 8) | key[pos + i];
+	}
+	return w;
+}
+
+static bool _nrf905_filter_eval(const nrf905_filter_sub_t *sub,
+				const uint8_t *key, unsigned int key_len)
+{
+	const nrf905_filter_term_t *t;
+	unsigned int i;
+	uint32_t w;
+
+	for (i=0; i < sub->term_cnt; i++) {
+		t = &sub->terms[i];
+		if (t->pos + t->len > key_len) {
+			return false;
+		}
+		w = _nrf905_filter_word(key, t->pos, t->len) & t->mask;
+		if (t->op == NRF905_FILTER_OP_EQ) {
+			if (w != t->lo) {
+				return false;
+			}
+		} else {
+			if (w < t->lo || w > t->hi) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void nrf905_filter_init(nrf905_filter_t *f, nrf905_filter_sub_t *subs,
+			unsigned int sub_max)
+{
+	memset(f, 0, sizeof(*f));
+	f->subs = subs;
+	f->sub_max = sub_max;
+}
+
+void nrf905_filter_destroy(nrf905_filter_t *f)
+{
+	free(f->index);
+	f->index = NULL;
+	f->exact = NULL;
+	f->all = NULL;
+	f->compiled = false;
+}
+
+static int _nrf905_filter_num(const char **p, uint32_t max, uint32_t *val)
+{
+	unsigned long long v;
+	char *end;
+
+	if (!isdigit((unsigned char) **p)) {
+		return -1;
+	}
+	v = strtoull(*p, &end, 0);
+	if (v > max) {
+		return -1;
+	}
+	*p = end;
+	*val = v;
+	return 0;
+}
+
+int nrf905_filter_add(nrf905_filter_t *f, const char *expr)
+{
+	nrf905_filter_sub_t *sub;
+	nrf905_filter_term_t *t;
+	const char *p = expr;
+	uint32_t off, len, full;
+
+	if (f->sub_cnt >= f->sub_max) {
+		errno = ENOSPC;
+		return -1;
+	}
+	sub = &f->subs[f->sub_cnt];
+	memset(sub, 0, sizeof(*sub));
+
+	while (true) {
+		while (isspace((unsigned char) *p)) {
+			p++;
+		}
+		if (*p == '\0') {
+			break;
+		}
+		if (sub->term_cnt >= NRF905_FILTER_MAX_TERMS) {
+			goto invalid;
+		}
+		t = &sub->terms[sub->term_cnt];
+
+		if (strncmp(p, "addr", 4) == 0) {
+			p += 4;
+			off = 0;
+			len = 4;
+		} else if (*p == '[') {
+			p++;
+			if (_nrf905_filter_num(&p, 31, &off) != 0) {
+				goto invalid;
+			}
+			len = 1;
+			if (*p == ':') {
+				p++;
+				if (_nrf905_filter_num(&p, 4, &len) != 0 ||
+						len == 0 || off + len > 32) {
+					goto invalid;
+				}
+			}
+			if (*p++ != ']') {
+				goto invalid;
+			}
+			off += 4;
+		} else {
+			goto invalid;
+		}
+		t->pos = off;
+		t->len = len;
+		full = (len == 4) ? 0xffffffff : ((uint32_t) 1 << (8 * len)) - 1;
+
+		t->mask = full;
+		if (*p == '&') {
+			p++;
+			if (_nrf905_filter_num(&p, full, &t->mask) != 0) {
+				goto invalid;
+			}
+		}
+		if (*p++ != '=') {
+			goto invalid;
+		}
+		if (_nrf905_filter_num(&p, full, &t->lo) != 0) {
+			goto invalid;
+		}
+		t->op = NRF905_FILTER_OP_EQ;
+		if (*p == '-') {
+			p++;
+			if (_nrf905_filter_num(&p, full, &t->hi) != 0 ||
+					t->hi < t->lo) {
+				goto invalid;
+			}
+			t->op = NRF905_FILTER_OP_RANGE;
+		} else if ((t->lo & ~t->mask) != 0) {
+			// Can never match, most likely a typo
+			goto invalid;
+		}
+		if (*p != '\0' && !isspace((unsigned char) *p)) {
+			goto invalid;
+		}
+		sub->term_cnt++;
+	}
+
+	f->compiled = false;
+	return f->sub_cnt++;
+
+invalid:
+	errno = EINVAL;
+	return -1;
+}
+
+int nrf905_filter_compile(nrf905_filter_t *f)
+{
+	struct sub_sets *s;
+	unsigned long score[NRF905_FILTER_KEY_LEN];
+	bool picked[NRF905_FILTER_KEY_LEN];
+	uint64_t *row;
+	uint64_t bit;
+	unsigned int best;
+	unsigned int pos;
+	unsigned int i, k, v;
+	bool exact;
+
+	nrf905_filter_destroy(f);
+
+	s = malloc(sizeof(*s));
+	if (s == NULL) {
+		return -1;
+	}
+
+	// Score key bytes by the amount of values they reject
+	memset(score, 0, sizeof(score));
+	for (i=0; i < f->sub_cnt; i++) {
+		_nrf905_filter_sub_sets(&f->subs[i], s);
+		for (pos=0; pos < NRF905_FILTER_KEY_LEN; pos++) {
+			if (!s->constrained[pos]) {
+				continue;
+			}
+			score[pos] += 256 -
+				__builtin_popcountll(s->set[pos][0]) -
+				__builtin_popcountll(s->set[pos][1]) -
+				__builtin_popcountll(s->set[pos][2]) -
+				__builtin_popcountll(s->set[pos][3]);
+		}
+	}
+
+	memset(picked, 0, sizeof(picked));
+	f->index_cnt = 0;
+	while (f->index_cnt < NRF905_FILTER_INDEX_CNT) {
+		best = 0;
+		for (pos=1; pos < NRF905_FILTER_KEY_LEN; pos++) {
+			if (score[pos] > score[best]) {
+				best = pos;
+			}
+		}
+		if (score[best] == 0) {
+			break;
+		}
+		picked[best] = true;
+		score[best] = 0;
+		f->index_pos[f->index_cnt++] = best;
+	}
+
+	f->words = (f->sub_cnt + 63) / 64;
+	f->index = calloc((f->index_cnt * ROW_CNT + 2) * f->words + 1,
+				sizeof(uint64_t));
+	if (f->index == NULL) {
+		free(s);
+		errno = ENOMEM;
+		return -1;
+	}
+	f->exact = &f->index[f->index_cnt * ROW_CNT * f->words];
+	f->all = &f->exact[f->words];
+
+	for (i=0; i < f->sub_cnt; i++) {
+		_nrf905_filter_sub_sets(&f->subs[i], s);
+		bit = (uint64_t) 1 << (i & 63);
+
+		for (k=0; k < f->index_cnt; k++) {
+			pos = f->index_pos[k];
+			row = &f->index[k * ROW_CNT * f->words + i / 64];
+			for (v=0; v < 256; v++) {
+				if (_set_has(s->set[pos], v)) {
+					row[v * f->words] |= bit;
+				}
+			}
+			if (!s->constrained[pos]) {
+				row[ROW_NONE * f->words] |= bit;
+			}
+		}
+
+		exact = s->decomposable;
+		for (pos=0; pos < NRF905_FILTER_KEY_LEN; pos++) {
+			if (s->constrained[pos] && !picked[pos]) {
+				exact = false;
+			}
+		}
+		f->subs[i].exact = exact;
+		if (exact) {
+			f->exact[i / 64] |= bit;
+		}
+		f->all[i / 64] |= bit;
+	}
+
+	free(s);
+	f->compiled = true;
+	return 0;
+}
+
+static unsigned int _nrf905_filter_run(nrf905_filter_t *f, uint32_t addr,
+			const void *data, size_t len, unsigned int *ids,
+			unsigned int max, bool first)
+{
+	uint8_t key[NRF905_FILTER_KEY_LEN];
+	unsigned int key_len;
+	unsigned int row[NRF905_FILTER_INDEX_CNT];
+	unsigned int cnt = 0;
+	unsigned int id;
+	unsigned int w, k;
+	uint64_t cand;
+	uint64_t bit;
+
+	if (!f->compiled && nrf905_filter_compile(f) != 0) {
+		return 0;
+	}
+
+	if (len > 32) {
+		len = 32;
+	}
+	key[0] = addr >> 24;
+	key[1] = addr >> 16;
+	key[2] = addr >> 8;
+	key[3] = addr;
+	memcpy(&key[4], data, len);
+	key_len = 4 + len;
+
+	for (k=0; k < f->index_cnt; k++) {
+		if (f->index_pos[k] < key_len) {
+			row[k] = (k * ROW_CNT + key[f->index_pos[k]]) * f->words;
+		} else {
+			row[k] = (k * ROW_CNT + ROW_NONE) * f->words;
+		}
+	}
+
+	f->frames++;
+	for (w=0; w < f->words; w++) {
+		cand = f->all[w];
+		for (k=0; k < f->index_cnt && cand != 0; k++) {
+			cand &= f->index[row[k] + w];
+		}
+
+		while (cand != 0) {
+			bit = cand & -cand;
+			cand ^= bit;
+			id = w * 64 + __builtin_ctzll(bit);
+
+			if ((f->exact[w] & bit) == 0) {
+				f->evaluated++;
+				if (!_nrf905_filter_eval(&f->subs[id], key,
+							key_len)) {
+					continue;
+				}
+			}
+
+			if (cnt < max) {
+				ids[cnt] = id;
+			}
+			cnt++;
+			if (first) {
+				goto done;
+			}
+		}
+	}
+
+done:
+	if (cnt > 0) {
+		f->passed++;
+	}
+	return cnt;
+}
+
+unsigned int nrf905_filter_match(nrf905_filter_t *f, uint32_t addr,
+			const void *data, size_t len, unsigned int *ids,
+			unsigned int max)
+{
+	return _nrf905_filter_run(f, addr, data, len, ids, max, false);
+}
+
+bool nrf905_filter_any(nrf905_filter_t *f, uint32_t addr, const void *data,
+			size_t len)
+{
+	return _nrf905_filter_run(f, addr, data, len, NULL, 0, true) > 0;
+}
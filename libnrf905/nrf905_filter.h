@@ -0,0 +1,193 @@
+/**
+ * nrf905_filter.h - Compiled receive frame filters
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_FILTER_H__
+#define __NRF905_FILTER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Max. amount of terms per subscription
+ */
+#define NRF905_FILTER_MAX_TERMS (8)
+
+/**
+ * Amount of frame bytes used to index subscriptions
+ */
+#define NRF905_FILTER_INDEX_CNT (4)
+
+/**
+ * Size of the key a frame is matched on: RX address, big endian, followed by
+ * the payload
+ */
+#define NRF905_FILTER_KEY_LEN (4 + 32)
+
+enum nrf905_filter_op {
+	NRF905_FILTER_OP_EQ,	// (word & mask) == lo
+	NRF905_FILTER_OP_RANGE,	// lo <= (word & mask) <= hi
+};
+
+/**
+ * Filter term
+ *
+ * Compares the len byte, big endian, word at key offset pos.
+ */
+typedef struct {
+	uint8_t op;
+	uint8_t pos;
+	uint8_t len;
+	uint32_t mask;
+	uint32_t lo;
+	uint32_t hi;
+} nrf905_filter_term_t;
+
+/**
+ * Subscription, matches if all terms match
+ */
+typedef struct {
+	nrf905_filter_term_t terms[NRF905_FILTER_MAX_TERMS];
+	unsigned int term_cnt;
+	bool exact;		// Index decides, terms needn't be evaluated
+} nrf905_filter_sub_t;
+
+/**
+ * Frame filter
+ *
+ * A set of subscriptions in a caller provided array, compiled into a
+ * decision table. The table is indexed on up to NRF905_FILTER_INDEX_CNT key
+ * bytes that best discriminate between subscriptions. For every index byte
+ * and value it holds a bitset of subscriptions accepting that value, so the
+ * candidates for a frame are found by ANDing NRF905_FILTER_INDEX_CNT rows.
+ * Only candidates with terms that aren't fully represented by the index,
+ * like multi byte ranges or bytes outside of the index, have their terms
+ * evaluated.
+ */
+typedef struct nrf905_filter {
+	nrf905_filter_sub_t *subs;
+	unsigned int sub_cnt;
+	unsigned int sub_max;
+
+	// Compiled table
+	bool compiled;
+	unsigned int words;		// Bitset size in 64-bit words
+	unsigned int index_cnt;
+	uint8_t index_pos[NRF905_FILTER_INDEX_CNT];
+	uint64_t *index;		// index_cnt x 257 rows, 256 = no byte
+	uint64_t *exact;		// Subscriptions decided by index
+	uint64_t *all;			// All subscriptions
+
+	// Statistics
+	unsigned long frames;		// Frames matched
+	unsigned long passed;		// Frames with at least one match
+	unsigned long evaluated;	// Subscriptions with terms evaluated
+} nrf905_filter_t;
+
+/**
+ * Initialize filter
+ *
+ * @param f		Filter object to initialize
+ * @param subs		Storage for subscriptions
+ * @param sub_max	Amount of subscriptions fitting in subs
+ */
+void nrf905_filter_init(nrf905_filter_t *f, nrf905_filter_sub_t *subs,
+			unsigned int sub_max);
+
+/**
+ * Free compiled table
+ */
+void nrf905_filter_destroy(nrf905_filter_t *f);
+
+/**
+ * Add subscription
+ *
+ * The expression is a list of whitespace separated terms, that must all
+ * match:
+ *
+ *   addr[&MASK]=VALUE[-HIGH]		RX address
+ *   [OFF][&MASK]=VALUE[-HIGH]		Payload byte at offset OFF
+ *   [OFF:LEN][&MASK]=VALUE[-HIGH]	Big endian payload word of LEN bytes
+ *
+ * Numbers are in C notation, so '[0:4]=0x5c27fe22' matches frames starting
+ * with the Wattcher virtual address. A term with a HIGH value matches a
+ * range. An empty expression matches every frame. Terms on payload bytes
+ * beyond the received payload width don't match.
+ *
+ * @param f	Filter object
+ * @param expr	Expression
+ *
+ * @returns	Subscription id on success, -1 on error. errno is set to
+ *		EINVAL on a syntax error, or ENOSPC if subs is full.
+ */
+int nrf905_filter_add(nrf905_filter_t *f, const char *expr);
+
+/**
+ * Compile subscriptions into decision table
+ *
+ * Must be called after adding subscriptions, else matching compiles on first
+ * use.
+ *
+ * @returns	0 on success, -1 and set errno to ENOMEM on error
+ */
+int nrf905_filter_compile(nrf905_filter_t *f);
+
+/**
+ * Match frame against all subscriptions
+ *
+ * @param f	Filter object
+ * @param addr	RX address the frame was received on
+ * @param data	Payload
+ * @param len	Payload length
+ * @param ids	Returns ids of matching subscriptions
+ * @param max	Size of ids
+ *
+ * @returns	Amount of matching subscriptions, may be larger then max
+ */
+unsigned int nrf905_filter_match(nrf905_filter_t *f, uint32_t addr,
+			const void *data, size_t len, unsigned int *ids,
+			unsigned int max);
+
+/**
+ * Check if any subscription matches frame
+ *
+ * Same as nrf905_filter_match(), but stops at the first match.
+ */
+bool nrf905_filter_any(nrf905_filter_t *f, uint32_t addr, const void *data,
+			size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_FILTER_H__
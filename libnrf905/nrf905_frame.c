@@ -0,0 +1,321 @@
+/**
+ * nrf905_frame.c - Variable length framing with adaptive payload width
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "nrf905.h"
+#include "nrf905_frame.h"
+#include "nrf905_time.h"
+
+#define FRAME_HDR_LEN_MASK	(0x3f)
+#define FRAME_HDR_NEXT_SHIFT	(6)
+
+/**
+ * Data ready poll interval
+ */
+#define FRAME_POLL_US (100)
+
+int nrf905_frame_init(nrf905_frame_t *f, nrf905_t *nrf, const uint8_t *widths,
+			unsigned int width_cnt, uint32_t resync_ms)
+{
+	unsigned int i;
+	int err;
+
+	if (width_cnt == 0 || width_cnt > NRF905_FRAME_MAX_WIDTHS ||
+	    resync_ms <= NRF905_FRAME_RESYNC_MARGIN_MS)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	for (i=0; i < width_cnt; i++) {
+		if (widths[i] < 2 || widths[i] > 32 ||
+		    (i > 0 && widths[i] <= widths[i - 1]))
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		f->widths[i] = widths[i];
+	}
+
+	f->nrf = nrf;
+	f->width_cnt = width_cnt;
+	f->cur = width_cnt - 1;
+	f->resync_ms = resync_ms;
+	f->active = false;
+
+	f->frames = 0;
+	f->switches = 0;
+	f->resyncs = 0;
+	f->pw_writes = 0;
+	f->errors = 0;
+	f->msg_bytes = 0;
+	f->air_us = 0;
+	f->base_air_us = 0;
+
+	nrf905_wait_ready(nrf);
+	err = nrf905_set_pw(nrf, widths[width_cnt - 1]);
+	if (err == 0) {
+		err = nrf905_write_config_bytes(nrf, NRF905_CONF_RX_PW, 2);
+	}
+
+	return err;
+}
+
+/**
+ * Change RX or TX payload width with a single byte config write
+ */
+static int _nrf905_frame_set_pw(nrf905_frame_t *f, bool tx, uint8_t pw)
+{
+	nrf905_t *nrf = f->nrf;
+
+	if (pw == (tx ? nrf905_get_tx_pw(nrf) : nrf905_get_rx_pw(nrf))) {
+		return 0;
+	}
+
+	// Don't change the width of a frame that is in the air
+	nrf905_wait_ready(nrf);
+
+	f->pw_writes++;
+	if (tx) {
+		nrf905_set_tx_pw(nrf, pw);
+		return nrf905_write_config_bytes(nrf, NRF905_CONF_TX_PW, 1);
+	}
+	nrf905_set_rx_pw(nrf, pw);
+	return nrf905_write_config_bytes(nrf, NRF905_CONF_RX_PW, 1);
+}
+
+/**
+ * Account air time of a frame of the current width
+ */
+static void _nrf905_frame_account(nrf905_frame_t *f, uint32_t airtime_us,
+				bool msg)
+{
+	f->air_us += airtime_us;
+	if (msg) {
+		f->base_air_us += airtime_us + (f->widths[f->width_cnt - 1] -
+				f->widths[f->cur]) * 8 * NRF905_BIT_TIME_US;
+	}
+}
+
+static int _nrf905_frame_send(nrf905_frame_t *f, unsigned int next,
+				const void *data, size_t len)
+{
+	nrf905_t *nrf = f->nrf;
+	uint8_t buf[32];
+	int err;
+
+	err = _nrf905_frame_set_pw(f, true, f->widths[f->cur]);
+	if (err != 0) {
+		return -1;
+	}
+
+	buf[0] = len | (next << FRAME_HDR_NEXT_SHIFT);
+	memcpy(&buf[1], data, len);
+
+	err = nrf905_send(nrf, buf, 1 + len);
+	if (err != 0) {
+		return -1;
+	}
+
+	_nrf905_frame_account(f, nrf905_get_tx_airtime(nrf), len != 0);
+	clock_gettime(CLOCK_MONOTONIC, &f->last);
+	if (f->cur == f->width_cnt - 1) {
+		f->base_last = f->last;
+	}
+	f->active = true;
+	f->cur = next;
+
+	return 0;
+}
+
+int nrf905_frame_send(nrf905_frame_t *f, const void *data, size_t len)
+{
+	struct timespec now;
+	struct timespec resync_end;
+	int64_t idle_ms;
+	unsigned int need;
+	unsigned int next;
+	int err;
+
+	if (len + 1 > f->widths[f->width_cnt - 1]) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (f->active) {
+		idle_ms = _timespec_diff_us(&now, &f->last) / 1000;
+
+		// Close to the receiver's resync moment it is unknown which
+		// width it uses, wait until it surely returned to the base.
+		if (idle_ms + NRF905_FRAME_RESYNC_MARGIN_MS >= f->resync_ms &&
+		    idle_ms < f->resync_ms + NRF905_FRAME_RESYNC_MARGIN_MS)
+		{
+			resync_end = f->last;
+			_timespec_add_us(&resync_end, (uint64_t) (f->resync_ms +
+					NRF905_FRAME_RESYNC_MARGIN_MS) * 1000);
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&resync_end, NULL);
+			idle_ms = f->resync_ms + NRF905_FRAME_RESYNC_MARGIN_MS;
+		}
+		if (idle_ms >= f->resync_ms) {
+			f->cur = f->width_cnt - 1;
+			f->active = false;
+		}
+	}
+
+	for (need=0; f->widths[need] < len + 1; need++) {
+		;
+	}
+
+	if (need > f->cur) {
+		// Announced width too small, announce a larger one first
+		err = _nrf905_frame_send(f, need, NULL, 0);
+		if (err != 0) {
+			return -1;
+		}
+		f->switches++;
+	}
+
+	// Expect the next message to have a similar size. Shrink one step
+	// at a time, as a too small width costs a switch frame.
+	next = need;
+	if (next + 1 < f->cur) {
+		next = f->cur - 1;
+	}
+
+	// A receiver that missed a width announcement only returns to the
+	// base width after resync_ms without frames. Go back to the base
+	// width periodically, so it catches up even if traffic never pauses.
+	if (f->active && next != f->width_cnt - 1 &&
+	    _timespec_diff_us(&now, &f->base_last) / 1000 >=
+	    f->resync_ms + NRF905_FRAME_RESYNC_MARGIN_MS)
+	{
+		next = f->width_cnt - 1;
+		f->resyncs++;
+	}
+	err = _nrf905_frame_send(f, next, data, len);
+	if (err != 0) {
+		return -1;
+	}
+	f->frames++;
+	f->msg_bytes += len;
+
+	return 0;
+}
+
+int nrf905_frame_recv(nrf905_frame_t *f, void *data, const struct timespec *to)
+{
+	const struct timespec poll_ts = { 0, FRAME_POLL_US * 1000 };
+	nrf905_t *nrf = f->nrf;
+	struct timespec deadline;
+	struct timespec now;
+	uint8_t buf[32];
+	unsigned int next;
+	unsigned int len;
+	int err;
+
+	err = _nrf905_frame_set_pw(f, false, f->widths[f->cur]);
+	if (err == 0) {
+		err = nrf905_recv_enable(nrf);
+	}
+	if (err != 0) {
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (to != NULL) {
+		deadline = now;
+		_timespec_add_us(&deadline,
+				(uint64_t) to->tv_sec * 1000000 + to->tv_nsec / 1000);
+	}
+
+	while (true) {
+		err = nrf905_recv_nb(nrf, buf, sizeof(buf));
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		if (err == 0) {
+			len = buf[0] & FRAME_HDR_LEN_MASK;
+			next = buf[0] >> FRAME_HDR_NEXT_SHIFT;
+
+			_nrf905_frame_account(f, nrf905_get_rx_airtime(nrf),
+					len != 0);
+
+			if (next >= f->width_cnt ||
+			    len + 1 > f->widths[f->cur])
+			{
+				// Not our framing, drop it and start over from
+				// the base width
+				f->errors++;
+				next = f->width_cnt - 1;
+				len = 0;
+			} else if (len == 0) {
+				f->switches++;
+			}
+
+			f->cur = next;
+			f->last = now;
+			f->active = true;
+
+			err = _nrf905_frame_set_pw(f, false, f->widths[next]);
+			if (err != 0) {
+				return -1;
+			}
+
+			if (len != 0) {
+				f->frames++;
+				f->msg_bytes += len;
+				memcpy(data, &buf[1], len);
+				return len;
+			}
+			continue;
+		} else if (errno != EWOULDBLOCK) {
+			return -1;
+		}
+
+		if (f->active &&
+		    _timespec_diff_us(&now, &f->last) / 1000 >= f->resync_ms)
+		{
+			f->cur = f->width_cnt - 1;
+			f->active = false;
+			err = _nrf905_frame_set_pw(f, false, f->widths[f->cur]);
+			if (err != 0) {
+				return -1;
+			}
+		}
+
+		if (to != NULL && _timespec_diff_us(&now, &deadline) >= 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		nanosleep(&poll_ts, NULL);
+	}
+}
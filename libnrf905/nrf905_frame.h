@@ -0,0 +1,155 @@
+/**
+ * nrf905_frame.h - Variable length framing with adaptive payload width
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __NRF905_FRAME_H__
+#define __NRF905_FRAME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "nrf905.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Max. amount of payload widths in a width set
+ */
+#define NRF905_FRAME_MAX_WIDTHS (4)
+
+/**
+ * Max. message length, a 32 byte payload minus the header
+ */
+#define NRF905_FRAME_MAX_LEN (31)
+
+/**
+ * Uncertainty in the idle time seen by sender and receiver
+ */
+#define NRF905_FRAME_RESYNC_MARGIN_MS (20)
+
+/**
+ * Variable length framing
+ *
+ * Messages are send with a one byte header, followed by the message and
+ * padding up to the payload width:
+ *   bit 0-5	Message length, 0 for a width switch frame
+ *   bit 6-7	Index of the payload width of the next frame
+ *
+ * Sender and receiver share an ordered set of payload widths, the last and
+ * largest width being the base width. Every frame announces the width of
+ * the next frame: the smallest width that fits the current message, but
+ * shrinking at most one step per frame.
+ * The receiver reconfigures its RX payload width accordingly after every
+ * frame. If the next message doesn't fit the announced width, a switch frame
+ * announcing a larger width is send first. A width change only takes a
+ * single byte configuration write.
+ *
+ * After resync_ms without frames both sides return to the base width. To
+ * recover from a lost frame while traffic never pauses, the sender also
+ * returns to the base width once resync_ms + NRF905_FRAME_RESYNC_MARGIN_MS
+ * passed since its last frame at the base width. A single lost frame thus
+ * disturbs the link for at most twice that period plus two message
+ * intervals. This requires a point to point link: one sender per receiver
+ * address.
+ */
+typedef struct {
+	nrf905_t *nrf;
+	uint8_t widths[NRF905_FRAME_MAX_WIDTHS];
+	unsigned int width_cnt;
+	unsigned int cur;		// Index of width of next frame
+	uint32_t resync_ms;
+	struct timespec last;		// Time of last frame
+	struct timespec base_last;	// Time of last frame send at base width
+	bool active;			// A frame was send or received
+
+	// Statistics
+	unsigned long frames;		// Message frames
+	unsigned long switches;		// Width switch frames
+	unsigned long resyncs;		// Periodic returns to the base width
+	unsigned long pw_writes;	// Payload width configuration writes
+	unsigned long errors;		// Received frames with invalid header
+	uint64_t msg_bytes;		// Message bytes
+	uint64_t air_us;		// Air time of all frames
+	uint64_t base_air_us;		// Air time if messages used base width
+} nrf905_frame_t;
+
+/**
+ * Initialize framing
+ *
+ * Configures the base width for both RX and TX. Must be called with the
+ * same width set on both sides of the link.
+ *
+ * @param f		Object to initialize
+ * @param nrf		NRF905 object
+ * @param widths	Payload widths in ascending order, 2 to 32 bytes
+ * @param width_cnt	Amount of widths, 1 to NRF905_FRAME_MAX_WIDTHS
+ * @param resync_ms	Idle time after which the base width is used again,
+ *			also bounds the time a lost frame disturbs the link
+ *
+ * @returns	0 on success, -1 on error. errno is set to EINVAL if the width
+ *		set is invalid.
+ */
+int nrf905_frame_init(nrf905_frame_t *f, nrf905_t *nrf, const uint8_t *widths,
+			unsigned int width_cnt, uint32_t resync_ms);
+
+/**
+ * Send message
+ *
+ * @param f	Framing object
+ * @param data	Message
+ * @param len	Message length, at most the base width minus 1
+ *
+ * @returns	0 on success, -1 on error. errno is set to EMSGSIZE if the
+ *		message doesn't fit the base width.
+ */
+int nrf905_frame_send(nrf905_frame_t *f, const void *data, size_t len);
+
+/**
+ * Receive message
+ *
+ * Enables the receiver and waits for a message frame, processing switch
+ * frames along the way. The receiver is left enabled.
+ *
+ * @param f	Framing object
+ * @param data	Buffer to return the message in, at least the base width
+ *		minus 1 bytes
+ * @param to	Timeout, NULL to block until a message is received
+ *
+ * @returns	Message length, or -1 on error. errno is set to ETIMEDOUT if
+ *		the timeout expired.
+ */
+int nrf905_frame_recv(nrf905_frame_t *f, void *data, const struct timespec *to);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_FRAME_H__
@@ -0,0 +1,169 @@
+/**
+ * nrf905_hop.c - Fast frequency agility using precomputed channel tables
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <bcm2835.h>
+#include <errno.h>
+
+#include "nrf905.h"
+#include "nrf905_hop.h"
+
+/**
+ * CHANNEL_CONFIG instruction: 1000pphc cccccccc
+ */
+#define CHANNEL_CONFIG		(0x8000)
+#define CHANNEL_CONFIG_PA_SHIFT	(10)
+#define CHANNEL_CONFIG_PA_MASK	(0x3 << CHANNEL_CONFIG_PA_SHIFT)
+#define CHANNEL_CONFIG_HFREQ	(1 << 9)
+#define CHANNEL_CONFIG_CH_MASK	(0x1ff)
+
+static uint16_t _nrf905_hop_cmd(uint8_t pa_pwr, bool hfreq_pll, uint16_t ch_no)
+{
+	return CHANNEL_CONFIG |
+		((pa_pwr & 0x3) << CHANNEL_CONFIG_PA_SHIFT) |
+		(hfreq_pll ? CHANNEL_CONFIG_HFREQ : 0) |
+		(ch_no & CHANNEL_CONFIG_CH_MASK);
+}
+
+int nrf905_hop_init(nrf905_hop_t *hop, nrf905_t *nrf, uint16_t *table,
+			const uint32_t *freqs, unsigned int cnt)
+{
+	uint16_t ch_no;
+	bool hfreq_pll;
+	unsigned int i;
+
+	for (i=0; i < cnt; i++) {
+		if (nrf905_freq_to_channel(freqs[i], &ch_no, &hfreq_pll) != 0) {
+			return -1;
+		}
+		table[i] = _nrf905_hop_cmd(nrf905_get_pa_pwr(nrf), hfreq_pll,
+						ch_no);
+	}
+
+	hop->cmds = table;
+	hop->cnt = cnt;
+	// The device isn't retuned yet, start with the first entry
+	hop->cur = cnt - 1;
+
+	return 0;
+}
+
+int nrf905_hop_init_channels(nrf905_hop_t *hop, nrf905_t *nrf, uint16_t *table,
+			bool hfreq_pll, uint16_t ch_no, unsigned int cnt)
+{
+	unsigned int i;
+
+	if (ch_no + cnt > CHANNEL_CONFIG_CH_MASK + 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i=0; i < cnt; i++) {
+		table[i] = _nrf905_hop_cmd(nrf905_get_pa_pwr(nrf), hfreq_pll,
+						ch_no + i);
+	}
+
+	hop->cmds = table;
+	hop->cnt = cnt;
+	// The device isn't retuned yet, start with the first entry
+	hop->cur = cnt - 1;
+
+	return 0;
+}
+
+void nrf905_hop_set_pa_pwr(nrf905_hop_t *hop, uint8_t pa_pwr)
+{
+	unsigned int i;
+
+	for (i=0; i < hop->cnt; i++) {
+		hop->cmds[i] = (hop->cmds[i] & ~CHANNEL_CONFIG_PA_MASK) |
+				((pa_pwr & 0x3) << CHANNEL_CONFIG_PA_SHIFT);
+	}
+}
+
+uint32_t nrf905_hop_get_freq(nrf905_hop_t *hop, unsigned int idx)
+{
+	uint32_t freq;
+
+	freq = 422400000 + (hop->cmds[idx] & CHANNEL_CONFIG_CH_MASK) * 100000;
+	if (hop->cmds[idx] & CHANNEL_CONFIG_HFREQ) {
+		freq = freq * 2;
+	}
+
+	return freq;
+}
+
+int nrf905_hop_to(nrf905_t *nrf, nrf905_hop_t *hop, unsigned int idx)
+{
+	uint8_t transfer_buf[2];
+	uint8_t old_mode;
+	uint16_t cmd;
+	int err;
+
+	if (idx >= hop->cnt) {
+		errno = EINVAL;
+		return -1;
+	}
+	cmd = hop->cmds[idx];
+
+	// The PLL locks on entering RX or TX, so retune from standby
+	old_mode = nrf905_get_mode(nrf);
+	if (old_mode == NRF905_MODE_RX || old_mode == NRF905_MODE_TX) {
+		err = nrf905_set_mode(nrf, NRF905_MODE_STANDBY);
+		if (err != 0) {
+			return -1;
+		}
+	}
+	nrf905_wait_ready(nrf);
+
+	transfer_buf[0] = cmd >> 8;
+	transfer_buf[1] = cmd & 0xff;
+	bcm2835_spi_transfern((char *) transfer_buf, sizeof(transfer_buf));
+	nrf->status = transfer_buf[0];
+
+	nrf->ch_no = cmd & CHANNEL_CONFIG_CH_MASK;
+	nrf->hfreq_pll = (cmd & CHANNEL_CONFIG_HFREQ) != 0;
+	nrf->pa_pwr = (cmd & CHANNEL_CONFIG_PA_MASK) >> CHANNEL_CONFIG_PA_SHIFT;
+	hop->cur = idx;
+
+	if (old_mode == NRF905_MODE_RX) {
+		return nrf905_set_mode(nrf, NRF905_MODE_RX);
+	}
+
+	return 0;
+}
+
+int nrf905_hop_next(nrf905_t *nrf, nrf905_hop_t *hop)
+{
+	unsigned int idx = hop->cur + 1;
+
+	if (idx >= hop->cnt) {
+		idx = 0;
+	}
+
+	return nrf905_hop_to(nrf, hop, idx);
+}
@@ -0,0 +1,131 @@
+/**
+ * nrf905_hop.h - Fast frequency agility using precomputed channel tables
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_HOP_H__
+#define __NRF905_HOP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf905.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Hop list
+ *
+ * A list of channels, each stored as a ready to send CHANNEL_CONFIG
+ * instruction. This instruction sets ch_no, hfreq_pll and pa_pwr, the
+ * contents of configuration bytes 0 and 1 except for rx_red_pwr and
+ * auto_retran, in a single 2 byte SPI transfer.
+ */
+typedef struct {
+	uint16_t *cmds;
+	unsigned int cnt;
+	unsigned int cur;	// Last entry retuned to
+} nrf905_hop_t;
+
+/**
+ * Initialize hop list from list of frequencies
+ *
+ * The PA power level in the current configuration cache is included in the
+ * hop list.
+ *
+ * @param hop	Hop list to initialize
+ * @param nrf	NRF905 object
+ * @param table	Storage for the hop list, must contain cnt entries
+ * @param freqs	Frequencies in Hz
+ * @param cnt	Amount of frequencies
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if one of the
+ *		frequencies is outside of the tuneable range
+ */
+int nrf905_hop_init(nrf905_hop_t *hop, nrf905_t *nrf, uint16_t *table,
+			const uint32_t *freqs, unsigned int cnt);
+
+/**
+ * Initialize hop list from consecutive channel numbers
+ *
+ * @param hop		Hop list to initialize
+ * @param nrf		NRF905 object
+ * @param table		Storage for the hop list, must contain cnt entries
+ * @param hfreq_pll	PLL band
+ * @param ch_no		First channel
+ * @param cnt		Amount of channels
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if a channel number
+ *		is out of range
+ */
+int nrf905_hop_init_channels(nrf905_hop_t *hop, nrf905_t *nrf, uint16_t *table,
+			bool hfreq_pll, uint16_t ch_no, unsigned int cnt);
+
+/**
+ * Set PA power level of all hop list entries
+ */
+void nrf905_hop_set_pa_pwr(nrf905_hop_t *hop, uint8_t pa_pwr);
+
+/**
+ * Get frequency of hop list entry
+ *
+ * @returns	Frequency in Hz
+ */
+uint32_t nrf905_hop_get_freq(nrf905_hop_t *hop, unsigned int idx);
+
+/**
+ * Retune to hop list entry
+ *
+ * Writes the CHANNEL_CONFIG instruction and updates the configuration
+ * cache. The PLL only locks to a new channel when entering RX or TX mode,
+ * so if the receiver is enabled it is restarted from standby; use
+ * nrf905_wait_settled() to wait until it is active on the new channel. If
+ * transmitting, the device is left in standby after the current frame.
+ *
+ * @param nrf	NRF905 object
+ * @param hop	Hop list
+ * @param idx	Index of entry to retune to
+ *
+ * @returns	0 on success, -1 on error
+ */
+int nrf905_hop_to(nrf905_t *nrf, nrf905_hop_t *hop, unsigned int idx);
+
+/**
+ * Retune to next hop list entry
+ *
+ * Same as nrf905_hop_to(), wrapping around at the end of the list. The first
+ * call after initialization retunes to entry 0.
+ */
+int nrf905_hop_next(nrf905_t *nrf, nrf905_hop_t *hop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_HOP_H__
@@ -0,0 +1,302 @@
+/**
+ * nrf905_listen.c - Time-division multi-address listening
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "nrf905.h"
+#include "nrf905_listen.h"
+#include "nrf905_time.h"
+
+/**
+ * Air time from start of frame until the address has been matched
+ */
+static uint32_t _nrf905_listen_match_us(nrf905_t *nrf)
+{
+	return (NRF905_PREAMBLE_BITS + nrf->rx_afw * 8) * NRF905_BIT_TIME_US;
+}
+
+int nrf905_listen_init(nrf905_listen_t *l, nrf905_t *nrf,
+			nrf905_listen_slot_t *slots, unsigned int slot_cnt)
+{
+	uint16_t ch_no;
+	bool hfreq_pll;
+	unsigned int i;
+
+	if (slot_cnt == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i=0; i < slot_cnt; i++) {
+		if (slots[i].dwell_us == 0 || slots[i].share == 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (slots[i].freq != 0 &&
+		    nrf905_freq_to_channel(slots[i].freq, &ch_no,
+					&hfreq_pll) != 0)
+		{
+			return -1;
+		}
+		slots[i].current_weight = 0;
+	}
+
+	l->nrf = nrf;
+	l->slots = slots;
+	l->slot_cnt = slot_cnt;
+	l->cur = slot_cnt;
+	l->am_extend_us = nrf905_get_rx_airtime(nrf);
+	l->extending = false;
+
+	nrf905_listen_reset_stats(l);
+
+	return 0;
+}
+
+void nrf905_listen_reset_stats(nrf905_listen_t *l)
+{
+	unsigned int i;
+
+	for (i=0; i < l->slot_cnt; i++) {
+		l->slots[i].windows = 0;
+		l->slots[i].extended = 0;
+		l->slots[i].frames = 0;
+		l->slots[i].listen_us = 0;
+	}
+}
+
+/**
+ * Pick next slot using smooth weighted round robin
+ */
+static unsigned int _nrf905_listen_pick(nrf905_listen_t *l)
+{
+	unsigned int best = 0;
+	int total = 0;
+	unsigned int i;
+
+	for (i=0; i < l->slot_cnt; i++) {
+		l->slots[i].current_weight += l->slots[i].share;
+		total += l->slots[i].share;
+		if (l->slots[i].current_weight > l->slots[best].current_weight) {
+			best = i;
+		}
+	}
+	l->slots[best].current_weight -= total;
+
+	return best;
+}
+
+/**
+ * Retune to a slot
+ *
+ * Changing the RX address only requires writing the address bytes of the
+ * configuration register and can be done while receiving. A frequency change
+ * requires the PLL to relock, so the receiver is restarted from standby.
+ */
+static int _nrf905_listen_tune(nrf905_listen_t *l, nrf905_listen_slot_t *slot)
+{
+	nrf905_t *nrf = l->nrf;
+	int err;
+
+	if (slot->freq != 0 && slot->freq != nrf905_get_freq(nrf)) {
+		err = nrf905_set_freq(nrf, slot->freq);
+		if (err == 0) {
+			err = nrf905_set_mode(nrf, NRF905_MODE_STANDBY);
+		}
+		if (err == 0) {
+			err = nrf905_write_config_bytes(nrf, NRF905_CONF_CH_NO, 2);
+		}
+		if (err != 0) {
+			return -1;
+		}
+	}
+
+	if (slot->rx_addr != nrf905_get_rx_addr(nrf)) {
+		nrf905_set_rx_addr(nrf, slot->rx_addr);
+		err = nrf905_write_config_bytes(nrf, NRF905_CONF_RX_ADDR, 4);
+		if (err != 0) {
+			return -1;
+		}
+	}
+
+	return nrf905_set_mode(nrf, NRF905_MODE_RX);
+}
+
+static int _nrf905_listen_next_window(nrf905_listen_t *l,
+					const struct timespec *now)
+{
+	nrf905_listen_slot_t *slot;
+	int err;
+
+	if (l->cur < l->slot_cnt) {
+		l->slots[l->cur].listen_us +=
+			_timespec_diff_us(now, &l->window_start);
+	}
+
+	l->cur = _nrf905_listen_pick(l);
+	slot = &l->slots[l->cur];
+
+	err = _nrf905_listen_tune(l, slot);
+	if (err != 0) {
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &l->window_start);
+	l->window_end = l->window_start;
+	_timespec_add_us(&l->window_end, slot->dwell_us);
+	l->extending = false;
+	slot->windows++;
+
+	return 0;
+}
+
+int nrf905_listen_recv(nrf905_listen_t *l, void *data, size_t len,
+			uint32_t *addr, const struct timespec *to)
+{
+	const struct timespec poll_ts = { 0, NRF905_LISTEN_POLL_US * 1000 };
+	struct timespec deadline;
+	struct timespec now;
+	int err;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (to != NULL) {
+		deadline.tv_sec = now.tv_sec + to->tv_sec;
+		deadline.tv_nsec = now.tv_nsec;
+		_timespec_add_us(&deadline, to->tv_nsec / 1000);
+	}
+
+	if (l->cur >= l->slot_cnt ||
+	    nrf905_get_mode(l->nrf) != NRF905_MODE_RX)
+	{
+		err = _nrf905_listen_next_window(l, &now);
+		if (err != 0) {
+			return -1;
+		}
+	}
+
+	while (true) {
+		err = nrf905_recv_nb(l->nrf, data, len);
+		if (err == 0) {
+			l->slots[l->cur].frames++;
+			if (addr != NULL) {
+				*addr = l->slots[l->cur].rx_addr;
+			}
+			return 0;
+		} else if (errno != EWOULDBLOCK) {
+			return -1;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		if (_timespec_diff_us(&now, &l->window_end) >= 0) {
+			if (!l->extending && l->am_extend_us != 0 &&
+			    nrf905_address_match(l->nrf))
+			{
+				// Frame in flight, give it time to complete
+				l->extending = true;
+				_timespec_add_us(&l->window_end, l->am_extend_us);
+				l->slots[l->cur].extended++;
+				continue;
+			}
+
+			// Only rotate if there is something to rotate to
+			if (l->slot_cnt > 1 ||
+			    l->slots[0].freq != 0 ||
+			    l->slots[0].rx_addr != nrf905_get_rx_addr(l->nrf))
+			{
+				err = _nrf905_listen_next_window(l, &now);
+				if (err != 0) {
+					return -1;
+				}
+			} else {
+				l->slots[0].listen_us +=
+					_timespec_diff_us(&now, &l->window_start);
+				l->window_start = now;
+				l->window_end = now;
+				_timespec_add_us(&l->window_end,
+						l->slots[0].dwell_us);
+			}
+			continue;
+		}
+
+		if (to != NULL && _timespec_diff_us(&now, &deadline) >= 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		nanosleep(&poll_ts, NULL);
+	}
+}
+
+double nrf905_listen_capture_prob(nrf905_listen_t *l, unsigned int idx,
+			uint32_t frame_us, uint32_t repeat_us)
+{
+	nrf905_listen_slot_t *slot;
+	uint64_t rotation_us = 0;
+	uint32_t settle_us;
+	uint32_t match_us;
+	uint64_t accept_us;
+	uint64_t covered_us;
+	unsigned int repeats;
+	unsigned int i;
+
+	if (idx >= l->slot_cnt) {
+		return 0;
+	}
+	slot = &l->slots[idx];
+
+	for (i=0; i < l->slot_cnt; i++) {
+		rotation_us += (uint64_t) l->slots[i].share * l->slots[i].dwell_us;
+	}
+
+	// Part of the window in which an address match can start. Frames
+	// matched before the window ends are completed by the extension.
+	settle_us = (slot->freq != 0) ? NRF905_T_STBY_TRX_US : 0;
+	match_us = _nrf905_listen_match_us(l->nrf);
+	if (slot->dwell_us <= settle_us + match_us) {
+		return 0;
+	}
+	accept_us = slot->dwell_us - settle_us - match_us;
+
+	// Range of transmission start times that hit one window
+	repeats = (frame_us != 0) ? repeat_us / frame_us : 0;
+	if (frame_us <= accept_us) {
+		covered_us = accept_us + (uint64_t) repeats * frame_us;
+	} else {
+		covered_us = (uint64_t) (repeats + 1) * accept_us;
+	}
+	covered_us *= slot->share;
+
+	if (covered_us >= rotation_us) {
+		return 1.0;
+	}
+	return (double) covered_us / rotation_us;
+}
@@ -0,0 +1,158 @@
+/**
+ * nrf905_listen.h - Time-division multi-address listening
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_LISTEN_H__
+#define __NRF905_LISTEN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "nrf905.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Poll interval for the data ready and address match status
+ */
+#define NRF905_LISTEN_POLL_US (100)
+
+/**
+ * Listen slot
+ *
+ * Describes one RX address to listen on, and collects the statistics for it.
+ * Slots are visited using smooth weighted round robin; every visit lasts
+ * dwell_us microseconds and per rotation a slot is visited share times, so
+ * the slots are interleaved as evenly as possible.
+ */
+typedef struct {
+	// Schedule
+	uint32_t rx_addr;	// RX address to listen on
+	uint32_t freq;		// Carrier frequency in Hz, 0 to not retune
+	uint32_t dwell_us;	// Length of a listen window
+	unsigned int share;	// Windows per rotation, must be >= 1
+
+	// Statistics
+	unsigned long windows;	// Amount of listen windows
+	unsigned long extended;	// Windows extended because of address match
+	unsigned long frames;	// Frames received
+	uint64_t listen_us;	// Total time listened
+
+	// Internal
+	int current_weight;
+} nrf905_listen_slot_t;
+
+/**
+ * Listen scheduler object
+ */
+typedef struct {
+	nrf905_t *nrf;
+	nrf905_listen_slot_t *slots;
+	unsigned int slot_cnt;
+	unsigned int cur;
+
+	uint32_t am_extend_us;		// Max. window extension on address match
+	struct timespec window_start;
+	struct timespec window_end;
+	bool extending;
+} nrf905_listen_t;
+
+/**
+ * Initialize listen scheduler
+ *
+ * The slots array is used in place and must stay valid during the lifetime
+ * of the scheduler. The window extension on address match defaults to the RX
+ * air time of a frame with the current configuration.
+ *
+ * @param l		Scheduler object to initialize
+ * @param nrf		NRF905 object, with the configuration already written
+ * @param slots		Array of slots to listen on
+ * @param slot_cnt	Amount of slots
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if a slot has a zero
+ *		dwell time or share, or a frequency outside of the tunable range.
+ */
+int nrf905_listen_init(nrf905_listen_t *l, nrf905_t *nrf,
+			nrf905_listen_slot_t *slots, unsigned int slot_cnt);
+
+/**
+ * Receive data on any of the scheduled addresses
+ *
+ * Enables the receiver and rotates the RX address, and if configured the
+ * carrier frequency, according to the schedule until a frame is received. If
+ * the address match status is raised at the end of a window, the window is
+ * extended until the frame is received or am_extend_us expires. Only the RX
+ * address bytes of the configuration register are written on a retune,
+ * unless the frequency changes as well.
+ *
+ * The receiver is left enabled, so the schedule continues where it left off
+ * on the next call.
+ *
+ * @param l	Scheduler object
+ * @param data	Buffer to return data in
+ * @param len	Length of data buffer. If buffer is smaller then RX payload
+ *		width, the received data is silently truncated
+ * @param addr	If not NULL, returns the RX address the frame was received on
+ * @param to	Timeout, NULL to block until a frame is received
+ *
+ * @returns	0 on success, -1 and set errno to ETIMEDOUT if timeout expired.
+ */
+int nrf905_listen_recv(nrf905_listen_t *l, void *data, size_t len,
+			uint32_t *addr, const struct timespec *to);
+
+/**
+ * Estimate capture probability of a slot
+ *
+ * Estimate the probability that a transmission to the slot's address is
+ * received, assuming it starts at a random moment. The transmission consists
+ * of a frame of frame_us, that is repeated for repeat_us, as done by
+ * nrf905_send_for(). Use repeat_us = 0 for a single frame.
+ *
+ * @param l		Scheduler object
+ * @param idx		Slot index
+ * @param frame_us	Air time of a single frame
+ * @param repeat_us	Duration the frame is repeated
+ *
+ * @returns	Capture probability between 0 and 1
+ */
+double nrf905_listen_capture_prob(nrf905_listen_t *l, unsigned int idx,
+			uint32_t frame_us, uint32_t repeat_us);
+
+/**
+ * Reset statistics of all slots
+ */
+void nrf905_listen_reset_stats(nrf905_listen_t *l);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_LISTEN_H__
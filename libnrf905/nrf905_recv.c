@@ -30,9 +30,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <time.h>
 
 #include "nrf905.h"
+#include "nrf905_listen.h"
+#include "nrf905_rt.h"
+#include "nrf905_shm.h"
+#include "nrf905_filter.h"
 #include "bcm2835.h"
 
 #define PIN_PWR	(22)
@@ -43,16 +48,82 @@
 #define PIN_CD (24)
 #define SPI_CS	(BCM2835_SPI_CS0)
 
-int main(int argc, const char *argv[])
+#define MAX_ADDRS (8)
+#define LISTEN_DWELL_US (20000)
+#define SENDER_REPEAT_US (20000)
+#define SHM_SLOTS (1024)
+#define MAX_FILTERS (64)
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-r] [-c CPU] [-s NAME] [-f EXPR]... [RX_ADDR...]\n\n", name);
+	fprintf(stderr, "  -r      Run with real-time priority and locked memory\n");
+	fprintf(stderr, "  -c CPU  Pin to CPU, implies -r\n");
+	fprintf(stderr, "  -s NAME Publish frames to shared memory ring NAME\n");
+	fprintf(stderr, "  -f EXPR Only pass frames matching EXPR, e.g. '[0:4]=0x5c27fe22'.\n");
+	fprintf(stderr, "          Frames matching any of multiple filters are passed\n");
+	fprintf(stderr, "  RX_ADDR Up to %d hex addresses to listen on\n", MAX_ADDRS);
+}
+
+int main(int argc, char *argv[])
 {
 	nrf905_t nrf;
+	nrf905_rt_profile_t rt;
+	bool rt_enable = false;
+	nrf905_shm_writer_t shm;
+	const char *shm_name = NULL;
+	nrf905_rx_ts_t ts;
+	nrf905_rx_ts_t *tsp;
+	nrf905_filter_sub_t subs[MAX_FILTERS];
+	nrf905_filter_t filter;
+	int opt;
 	int err;
 	uint32_t addr = 0x11223344;
+	nrf905_listen_slot_t slots[MAX_ADDRS];
+	nrf905_listen_t listen;
+	int addr_cnt = 0;
 	uint8_t buf[32];
 	int i;
 
-	if (argc == 2) {
-		addr = strtoll(argv[1], NULL, 16);
+	nrf905_rt_profile_init(&rt);
+	nrf905_filter_init(&filter, subs, MAX_FILTERS);
+	while ((opt = getopt(argc, argv, "rc:s:f:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			rt_enable = true;
+			break;
+		case 'c':
+			rt_enable = true;
+			rt.cpu = atoi(optarg);
+			break;
+		case 's':
+			shm_name = optarg;
+			break;
+		case 'f':
+			if (nrf905_filter_add(&filter, optarg) == -1) {
+				perror("Invalid filter");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (argc - optind > MAX_ADDRS) {
+		fprintf(stderr, "Too many addresses, max. %d\n", MAX_ADDRS);
+		exit(EXIT_FAILURE);
+	}
+	for (i=optind; i < argc; i++) {
+		memset(&slots[addr_cnt], 0, sizeof(slots[addr_cnt]));
+		slots[addr_cnt].rx_addr = strtoll(argv[i], NULL, 16);
+		slots[addr_cnt].dwell_us = LISTEN_DWELL_US;
+		slots[addr_cnt].share = 1;
+		addr_cnt++;
+	}
+	if (addr_cnt > 0) {
+		addr = slots[0].rx_addr;
 	}
 
 	err = nrf905_init(&nrf, PIN_PWR, PIN_CE, PIN_TXEN, PIN_DR, SPI_CS);
@@ -91,10 +162,75 @@ int main(int argc, const char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	if (addr_cnt > 1) {
+		// Time share the receiver between the addresses
+		nrf905_set_pin_am(&nrf, PIN_AM);
+
+		err = nrf905_listen_init(&listen, &nrf, slots, addr_cnt);
+		if (err != 0) {
+			fprintf(stderr, "Failed to initialize listen schedule\n");
+			exit(EXIT_FAILURE);
+		}
+
+		for (i=0; i < addr_cnt; i++) {
+			fprintf(stderr, "0x%.8x: capture probability %.1f%%\n",
+				slots[i].rx_addr,
+				100 * nrf905_listen_capture_prob(&listen, i,
+					nrf905_get_rx_airtime(&nrf),
+					SENDER_REPEAT_US));
+		}
+	}
+
+	if (filter.sub_cnt > 0) {
+		// Compile before going real-time, it allocates memory
+		err = nrf905_filter_compile(&filter);
+		if (err != 0) {
+			perror("Failed to compile filters");
+			exit(EXIT_FAILURE);
+		}
+		nrf905_set_filter(&nrf, &filter);
+	}
+
+	if (shm_name != NULL) {
+		err = nrf905_shm_create(&shm, shm_name, SHM_SLOTS);
+		if (err != 0) {
+			perror("Failed to create shared memory ring");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (rt_enable) {
+		err = nrf905_rt_apply(&rt);
+		if (err != 0) {
+			perror("Failed to apply real-time profile");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	err = nrf905_recv_enable(&nrf);
+	if (err != 0) {
+		fprintf(stderr, "Failed to enable receiver\n");
+		exit(EXIT_FAILURE);
+	}
+
 	while (true) {
-		nrf905_recv_enable(&nrf);
-		nrf905_recv(&nrf, buf, sizeof(buf));
-		nrf905_recv_disable(&nrf);
+		if (addr_cnt > 1) {
+			nrf905_listen_recv(&listen, buf, sizeof(buf), &addr, NULL);
+			tsp = NULL;
+		} else {
+			nrf905_recv_ts(&nrf, buf, sizeof(buf), &ts, NULL);
+			tsp = &ts;
+		}
+
+		if (shm_name != NULL) {
+			nrf905_shm_publish(&shm, addr, buf, nrf905_get_rx_pw(&nrf),
+					tsp);
+			continue;
+		}
+
+		if (addr_cnt > 1) {
+			printf("%.8x: ", addr);
+		}
 
 		for (i=0; i<16; i++) {
 			printf("%.2x ", buf[i]);
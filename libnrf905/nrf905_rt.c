@@ -0,0 +1,111 @@
+/**
+ * nrf905_rt.c - Real-time execution profile for radio threads
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "nrf905_rt.h"
+
+void nrf905_rt_profile_init(nrf905_rt_profile_t *p)
+{
+	p->priority = NRF905_RT_PRIORITY;
+	p->cpu = -1;
+	p->lock_memory = true;
+	p->stack_size = NRF905_RT_STACK_SIZE;
+}
+
+void nrf905_rt_prefault(void *buf, size_t len)
+{
+	volatile char *p = buf;
+	long page_size = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	for (i=0; i < len; i += page_size) {
+		p[i] = p[i];
+	}
+	if (len > 0) {
+		p[len - 1] = p[len - 1];
+	}
+}
+
+/**
+ * Grow the stack to its working size
+ *
+ * Not inlined, so the array really is on the stack below the caller.
+ */
+static void __attribute__((noinline)) _nrf905_rt_prefault_stack(size_t size)
+{
+	volatile char stack[size];
+
+	memset((char *) stack, 0, size);
+}
+
+int nrf905_rt_apply(const nrf905_rt_profile_t *p)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	int retval = 0;
+	int err;
+
+	if (p->cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(p->cpu, &cpus);
+		err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (err != 0) {
+			errno = err;
+			retval = -1;
+		}
+	}
+
+	if (p->priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = p->priority;
+		err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (err != 0) {
+			errno = err;
+			retval = -1;
+		}
+	}
+
+	if (p->lock_memory) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+			retval = -1;
+		}
+	}
+
+	if (p->stack_size > 0) {
+		_nrf905_rt_prefault_stack(p->stack_size);
+	}
+
+	return retval;
+}
@@ -0,0 +1,98 @@
+/**
+ * nrf905_rt.h - Real-time execution profile for radio threads
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __NRF905_RT_H__
+#define __NRF905_RT_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Default SCHED_FIFO priority
+ *
+ * Above the default priority of threaded interrupt handlers (50) would
+ * starve the GPIO interrupt delivering the DR edge, so stay below it.
+ */
+#define NRF905_RT_PRIORITY	(40)
+
+/**
+ * Default amount of stack to prefault
+ */
+#define NRF905_RT_STACK_SIZE	(64 * 1024)
+
+/**
+ * Real-time profile
+ *
+ * The library itself doesn't allocate memory in the send and receive
+ * functions, so after applying the profile the radio thread only takes
+ * page faults on memory the application didn't prefault.
+ */
+typedef struct {
+	int priority;		// SCHED_FIFO priority, 0 to keep the policy
+	int cpu;		// CPU to pin the thread to, -1 to not pin
+	bool lock_memory;	// Lock current and future memory in RAM
+	size_t stack_size;	// Stack to prefault, 0 to skip
+} nrf905_rt_profile_t;
+
+/**
+ * Initialize profile with defaults
+ *
+ * SCHED_FIFO at NRF905_RT_PRIORITY, no CPU pinning, memory locked and
+ * NRF905_RT_STACK_SIZE of stack prefaulted.
+ */
+void nrf905_rt_profile_init(nrf905_rt_profile_t *p);
+
+/**
+ * Apply profile to calling thread
+ *
+ * Memory locking applies to the whole process.
+ *
+ * @param p	Profile
+ *
+ * @returns	0 on success, -1 on error. The profile may be partially
+ *		applied. Without CAP_SYS_NICE and CAP_IPC_LOCK errno is EPERM.
+ */
+int nrf905_rt_apply(const nrf905_rt_profile_t *p);
+
+/**
+ * Prefault buffer
+ *
+ * Touch every page of a buffer, so it is mapped before use on the hot path.
+ * Combined with locked memory it stays mapped.
+ */
+void nrf905_rt_prefault(void *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_RT_H__
@@ -0,0 +1,265 @@
+/**
+ * nrf905_scan.c - Carrier detect spectrum scanner
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "nrf905.h"
+#include "nrf905_hop.h"
+#include "bcm2835.h"
+
+#define PIN_PWR	(22)
+#define PIN_CE	(23)
+#define PIN_TXEN (27)
+#define PIN_DR (25)
+#define PIN_AM (7)
+#define PIN_CD (24)
+#define SPI_CS	(BCM2835_SPI_CS0)
+
+#define CHANNELS_PER_BAND (512)
+#define DEFAULT_DWELL_US (2000)
+
+struct channel_stats {
+	unsigned long samples;
+	unsigned long busy;
+	unsigned long bursts;
+	double max_duty;
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b BAND] [-d DWELL] [-n SWEEPS] [-f FORMAT] [-o FILE]\n\n", name);
+	fprintf(stderr, "  -b BAND    433 (422.4-473.5 MHz), 868 (844.8-947 MHz) or all (default)\n");
+	fprintf(stderr, "  -d DWELL   Carrier detect sample time per channel in us (default %d)\n", DEFAULT_DWELL_US);
+	fprintf(stderr, "  -n SWEEPS  Amount of sweeps (default 1)\n");
+	fprintf(stderr, "  -f FORMAT  Output format, csv (default) or json\n");
+	fprintf(stderr, "  -o FILE    Write occupancy map to FILE instead of stdout\n");
+}
+
+static void write_csv(FILE *out, nrf905_hop_t *hop, struct channel_stats *stats)
+{
+	unsigned int i;
+
+	fprintf(out, "freq_hz,hfreq_pll,ch_no,samples,busy,duty,max_duty,bursts\n");
+	for (i=0; i < hop->cnt; i++) {
+		fprintf(out, "%u,%d,%u,%lu,%lu,%.6f,%.6f,%lu\n",
+			nrf905_hop_get_freq(hop, i),
+			nrf905_hop_get_freq(hop, i) > 473500000,
+			i % CHANNELS_PER_BAND,
+			stats[i].samples, stats[i].busy,
+			stats[i].samples ? (double) stats[i].busy / stats[i].samples : 0,
+			stats[i].max_duty, stats[i].bursts);
+	}
+}
+
+static void write_json(FILE *out, nrf905_hop_t *hop, struct channel_stats *stats)
+{
+	unsigned int i;
+
+	fprintf(out, "[\n");
+	for (i=0; i < hop->cnt; i++) {
+		fprintf(out, "  {\"freq_hz\": %u, \"hfreq_pll\": %s, \"ch_no\": %u, "
+			"\"samples\": %lu, \"busy\": %lu, \"duty\": %.6f, "
+			"\"max_duty\": %.6f, \"bursts\": %lu}%s\n",
+			nrf905_hop_get_freq(hop, i),
+			nrf905_hop_get_freq(hop, i) > 473500000 ? "true" : "false",
+			i % CHANNELS_PER_BAND,
+			stats[i].samples, stats[i].busy,
+			stats[i].samples ? (double) stats[i].busy / stats[i].samples : 0,
+			stats[i].max_duty, stats[i].bursts,
+			(i + 1 < hop->cnt) ? "," : "");
+	}
+	fprintf(out, "]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	nrf905_t nrf;
+	int err;
+	int opt;
+	bool band_433 = true;
+	bool band_868 = true;
+	uint32_t dwell_us = DEFAULT_DWELL_US;
+	unsigned long sweeps = 1;
+	bool json = false;
+	const char *out_path = NULL;
+	FILE *out = stdout;
+	static uint16_t table[2 * CHANNELS_PER_BAND];
+	static struct channel_stats stats[2 * CHANNELS_PER_BAND];
+	nrf905_hop_t hop;
+	struct timespec start, end;
+	double elapsed;
+	unsigned long sweep;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "b:d:n:f:o:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			band_433 = (strcmp(optarg, "433") == 0 ||
+					strcmp(optarg, "all") == 0);
+			band_868 = (strcmp(optarg, "868") == 0 ||
+					strcmp(optarg, "all") == 0);
+			if (!band_433 && !band_868) {
+				fprintf(stderr, "Unknown band: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'd':
+			dwell_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			sweeps = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			if (strcmp(optarg, "json") == 0) {
+				json = true;
+			} else if (strcmp(optarg, "csv") == 0) {
+				json = false;
+			} else {
+				fprintf(stderr, "Unknown format: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (sweeps == 0 || dwell_us == 0) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	// Configure module
+	err = nrf905_init(&nrf, PIN_PWR, PIN_CE, PIN_TXEN, PIN_DR, SPI_CS);
+	if (err != 0) {
+		fprintf(stderr, "Failed to initialize NRF905, Do you have root permissions?\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Retunes are SPI bound, so use a faster clock. 250MHz / 64 = 3.9 MHz,
+	// which is still within spec. on later models with a faster core clock.
+	bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_64);
+
+	nrf905_set_pin_cd(&nrf, PIN_CD);
+
+	err = nrf905_set_xof(&nrf, NRF905_XOF_16MHZ);
+	if (err != 0) {
+		fprintf(stderr, "Failed to set crystal frequency\n");
+		exit(EXIT_FAILURE);
+	}
+
+	err = nrf905_write_config(&nrf);
+	if (err != 0) {
+		fprintf(stderr, "Failed to write config\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Build hop list of all channels to scan
+	if (band_433 && band_868) {
+		nrf905_hop_init_channels(&hop, &nrf, table, false, 0, CHANNELS_PER_BAND);
+		nrf905_hop_init_channels(&hop, &nrf, &table[CHANNELS_PER_BAND],
+					true, 0, CHANNELS_PER_BAND);
+		hop.cmds = table;
+		hop.cnt = 2 * CHANNELS_PER_BAND;
+	} else {
+		nrf905_hop_init_channels(&hop, &nrf, table, band_868, 0,
+					CHANNELS_PER_BAND);
+	}
+	memset(stats, 0, sizeof(stats));
+
+	err = nrf905_recv_enable(&nrf);
+	if (err != 0) {
+		fprintf(stderr, "Failed to enable receiver\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Sweep
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (sweep=0; sweep < sweeps; sweep++) {
+		for (i=0; i < hop.cnt; i++) {
+			unsigned long busy, bursts;
+			long samples;
+			double duty;
+
+			err = nrf905_hop_to(&nrf, &hop, i);
+			if (err != 0) {
+				fprintf(stderr, "Failed to retune\n");
+				exit(EXIT_FAILURE);
+			}
+
+			samples = nrf905_sample_carrier(&nrf, dwell_us, &busy, &bursts);
+			if (samples < 0) {
+				fprintf(stderr, "Failed to sample carrier detect\n");
+				exit(EXIT_FAILURE);
+			}
+
+			stats[i].samples += samples;
+			stats[i].busy += busy;
+			stats[i].bursts += bursts;
+			duty = samples ? (double) busy / samples : 0;
+			if (duty > stats[i].max_duty) {
+				stats[i].max_duty = duty;
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	nrf905_recv_disable(&nrf);
+	nrf905_destroy(&nrf);
+
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "Scanned %lu channels in %.3f s: %.1f channels/s\n",
+		sweeps * hop.cnt, elapsed, sweeps * hop.cnt / elapsed);
+
+	// Write occupancy map
+	if (out_path != NULL) {
+		out = fopen(out_path, "w");
+		if (out == NULL) {
+			perror("Failed to open output file");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (json) {
+		write_json(out, &hop, stats);
+	} else {
+		write_csv(out, &hop, stats);
+	}
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	return 0;
+}
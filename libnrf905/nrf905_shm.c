@@ -0,0 +1,740 @@
+/**
+ * nrf905_shm.c - Shared memory frame distribution
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#include "nrf905_shm.h"
+#include "nrf905_time.h"
+
+/**
+ * Reply of the writer to a new reader, sent along with the ring memfd
+ */
+struct _nrf905_shm_hello {
+	uint64_t head;		// Frame to start reading at
+	uint32_t slot;		// Wakeup flag of the reader
+	uint32_t pad;
+};
+
+static socklen_t _nrf905_shm_sockaddr(struct sockaddr_un *sa, const char *name)
+{
+	int len;
+
+	// Abstract namespace, so no stale socket files are left behind
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	len = snprintf(&sa->sun_path[1], sizeof(sa->sun_path) - 1,
+			"nrf905-shm-%s", name);
+	if (len < 0 || (size_t) len >= sizeof(sa->sun_path) - 1) {
+		return 0;
+	}
+
+	return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+/**
+ * Send message of len bytes together with a file descriptor
+ */
+static int _nrf905_shm_send_fd(int sock, int fd, const void *data, size_t len)
+{
+	struct iovec iov = { (void *) data, len };
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} ctl;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	if (sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t) len) {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Receive message of len bytes together with a file descriptor
+ *
+ * @returns	The file descriptor, or -1 on error. errno is set to
+ *		ECONNRESET if the connection was closed, or EPROTO if the
+ *		message is malformed.
+ */
+static int _nrf905_shm_recv_fd(int sock, void *data, size_t len, int flags)
+{
+	struct iovec iov = { data, len };
+	ssize_t ret;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} ctl;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	int fd;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+	ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | flags);
+	if (ret == -1) {
+		return -1;
+	}
+	if (ret == 0) {
+		errno = ECONNRESET;
+		return -1;
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+			cmsg->cmsg_type != SCM_RIGHTS ||
+			cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+		errno = EPROTO;
+		return -1;
+	}
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	if ((size_t) ret != len) {
+		close(fd);
+		errno = EPROTO;
+		return -1;
+	}
+
+	return fd;
+}
+
+int nrf905_shm_create(nrf905_shm_writer_t *w, const char *name,
+			unsigned int slot_cnt)
+{
+	struct sockaddr_un sa;
+	socklen_t sa_len;
+	size_t wake_offset;
+	size_t page_size;
+	void *map;
+	int err;
+
+	if (slot_cnt == 0 || (slot_cnt & (slot_cnt - 1)) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	sa_len = _nrf905_shm_sockaddr(&sa, name);
+	if (sa_len == 0) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(w, 0, sizeof(*w));
+	w->listen_fd = -1;
+	w->mem_fd = -1;
+	// Wakeup flags on their own pages, readers map them writable
+	page_size = sysconf(_SC_PAGESIZE);
+	wake_offset = sizeof(nrf905_shm_hdr_t) +
+			(size_t) slot_cnt * sizeof(nrf905_shm_frame_t);
+	wake_offset = (wake_offset + page_size - 1) & ~(page_size - 1);
+	w->map_len = wake_offset +
+			NRF905_SHM_MAX_READERS * sizeof(nrf905_shm_wake_t);
+
+	// The bound socket marks the ring name as taken, readers can only
+	// connect once listen() is called with the ring ready
+	w->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK |
+				SOCK_CLOEXEC, 0);
+	if (w->listen_fd == -1) {
+		goto fail;
+	}
+	if (bind(w->listen_fd, (struct sockaddr *) &sa, sa_len) != 0) {
+		goto fail;
+	}
+
+	// Anonymous, readers only get it through the socket
+	w->mem_fd = memfd_create("nrf905-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (w->mem_fd == -1) {
+		goto fail;
+	}
+	if (ftruncate(w->mem_fd, w->map_len) != 0) {
+		goto fail;
+	}
+	// Readers can rely on the size
+	fcntl(w->mem_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+	map = mmap(NULL, w->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			w->mem_fd, 0);
+	if (map == MAP_FAILED) {
+		goto fail;
+	}
+	w->hdr = map;
+	w->frames = (nrf905_shm_frame_t *) (w->hdr + 1);
+	w->wake = (nrf905_shm_wake_t *) ((char *) map + wake_offset);
+
+	w->hdr->magic = NRF905_SHM_MAGIC;
+	w->hdr->version = NRF905_SHM_VERSION;
+	w->hdr->slot_cnt = slot_cnt;
+	w->hdr->frame_size = sizeof(nrf905_shm_frame_t);
+	w->hdr->wake_offset = wake_offset;
+	__atomic_store_n(&w->hdr->head, 0, __ATOMIC_RELEASE);
+
+	if (listen(w->listen_fd, NRF905_SHM_MAX_READERS) != 0) {
+		goto fail;
+	}
+
+	return 0;
+fail:
+	err = errno;
+	nrf905_shm_destroy(w);
+	errno = err;
+	return -1;
+}
+
+static void _nrf905_shm_drop_reader(nrf905_shm_writer_t *w, unsigned int i)
+{
+	close(w->reader_conn[i]);
+	close(w->reader_efd[i]);
+	w->slot_used &= ~((uint64_t) 1 << w->reader_slot[i]);
+	w->reader_cnt--;
+	w->reader_conn[i] = w->reader_conn[w->reader_cnt];
+	w->reader_efd[i] = w->reader_efd[w->reader_cnt];
+	w->reader_slot[i] = w->reader_slot[w->reader_cnt];
+}
+
+static void _nrf905_shm_drop_pending(nrf905_shm_writer_t *w, unsigned int i)
+{
+	close(w->pending_conn[i]);
+	w->pending_cnt--;
+	w->pending_conn[i] = w->pending_conn[w->pending_cnt];
+}
+
+void nrf905_shm_destroy(nrf905_shm_writer_t *w)
+{
+	while (w->reader_cnt > 0) {
+		_nrf905_shm_drop_reader(w, 0);
+	}
+	while (w->pending_cnt > 0) {
+		_nrf905_shm_drop_pending(w, 0);
+	}
+	if (w->hdr != NULL) {
+		munmap(w->hdr, w->map_len);
+		w->hdr = NULL;
+		w->frames = NULL;
+	}
+	if (w->mem_fd != -1) {
+		// Readers keep their mapping
+		close(w->mem_fd);
+		w->mem_fd = -1;
+	}
+	if (w->listen_fd != -1) {
+		close(w->listen_fd);
+		w->listen_fd = -1;
+	}
+}
+
+/**
+ * Check if the peer may read the ring
+ *
+ * The abstract socket has no file permissions, so check the credentials of
+ * the reader instead: it must run as the same user or group, or as root.
+ */
+static bool _nrf905_shm_allowed(int conn)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+		return false;
+	}
+
+	return cred.uid == 0 || cred.uid == geteuid() || cred.gid == getegid();
+}
+
+/**
+ * Take the eventfd of a pending connection and hand over the ring
+ *
+ * @returns	1 if the reader was added, 0 if its eventfd didn't arrive
+ *		yet, -1 if the connection must be dropped
+ */
+static int _nrf905_shm_handshake(nrf905_shm_writer_t *w, int conn)
+{
+	struct _nrf905_shm_hello hello;
+	unsigned int slot;
+	char c;
+	int efd;
+
+	efd = _nrf905_shm_recv_fd(conn, &c, sizeof(c), 0);
+	if (efd == -1) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	}
+	if (w->reader_cnt >= NRF905_SHM_MAX_READERS) {
+		close(efd);
+		return -1;
+	}
+
+	slot = __builtin_ctzll(~w->slot_used);
+	__atomic_store_n(&w->wake[slot].sleeping, 0, __ATOMIC_RELAXED);
+
+	// The reader starts at the next frame. The connection is empty, so
+	// this small message doesn't block.
+	hello.head = w->hdr->head;
+	hello.slot = slot;
+	if (_nrf905_shm_send_fd(conn, w->mem_fd, &hello, sizeof(hello)) != 0) {
+		close(efd);
+		return -1;
+	}
+
+	w->slot_used |= (uint64_t) 1 << slot;
+	w->reader_conn[w->reader_cnt] = conn;
+	w->reader_efd[w->reader_cnt] = efd;
+	w->reader_slot[w->reader_cnt] = slot;
+	w->reader_cnt++;
+
+	return 1;
+}
+
+void nrf905_shm_service(nrf905_shm_writer_t *w)
+{
+	struct pollfd pfds[1 + 2 * NRF905_SHM_MAX_READERS];
+	unsigned int reader_cnt = w->reader_cnt;
+	unsigned int pending_cnt = w->pending_cnt;
+	unsigned int i;
+	int conn;
+
+	pfds[0].fd = w->listen_fd;
+	pfds[0].events = POLLIN;
+	for (i=0; i < reader_cnt; i++) {
+		pfds[1 + i].fd = w->reader_conn[i];
+		pfds[1 + i].events = POLLIN;
+	}
+	for (i=0; i < pending_cnt; i++) {
+		pfds[1 + reader_cnt + i].fd = w->pending_conn[i];
+		pfds[1 + reader_cnt + i].events = POLLIN;
+	}
+	if (poll(pfds, 1 + reader_cnt + pending_cnt, 0) <= 0) {
+		return;
+	}
+
+	// Readers only send their eventfd, anything else on the connection
+	// means it was closed. Backwards, dropping moves the last one in.
+	for (i=reader_cnt; i-- > 0; ) {
+		if (pfds[1 + i].revents != 0) {
+			_nrf905_shm_drop_reader(w, i);
+		}
+	}
+	for (i=pending_cnt; i-- > 0; ) {
+		if (pfds[1 + reader_cnt + i].revents == 0) {
+			continue;
+		}
+		switch (_nrf905_shm_handshake(w, w->pending_conn[i])) {
+		case 1:
+			w->pending_cnt--;
+			w->pending_conn[i] = w->pending_conn[w->pending_cnt];
+			break;
+		case -1:
+			_nrf905_shm_drop_pending(w, i);
+			break;
+		}
+	}
+
+	if (pfds[0].revents == 0) {
+		return;
+	}
+	while ((conn = accept4(w->listen_fd, NULL, NULL,
+				SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		if (w->reader_cnt + w->pending_cnt >= NRF905_SHM_MAX_READERS ||
+		    !_nrf905_shm_allowed(conn))
+		{
+			close(conn);
+			continue;
+		}
+		// The reader sends its eventfd right after connecting, so
+		// it's usually there already
+		switch (_nrf905_shm_handshake(w, conn)) {
+		case 0:
+			w->pending_conn[w->pending_cnt++] = conn;
+			break;
+		case -1:
+			close(conn);
+			break;
+		}
+	}
+}
+
+int nrf905_shm_publish(nrf905_shm_writer_t *w, uint32_t addr, const void *data,
+			size_t len, const nrf905_rx_ts_t *ts)
+{
+	nrf905_shm_frame_t *f;
+	nrf905_shm_wake_t *wake;
+	struct timespec now;
+	uint64_t head;
+	uint64_t one = 1;
+	unsigned int i;
+
+	if (len > sizeof(f->data)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	head = w->hdr->head;
+	f = &w->frames[head & (w->hdr->slot_cnt - 1)];
+
+	__atomic_store_n(&f->seq, 2 * head + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	f->addr = addr;
+	f->len = len;
+	if (ts != NULL) {
+		f->ts = *ts;
+	} else {
+		memset(&f->ts, 0, sizeof(f->ts));
+	}
+	memcpy(f->data, data, len);
+	__atomic_store_n(&f->seq, 2 * head + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&w->hdr->head, head + 1, __ATOMIC_RELEASE);
+
+	// Pairs with the fence in nrf905_shm_wait(): either the reader sees
+	// the new head, or we see it sleeping
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (i=0; i < w->reader_cnt; i++) {
+		wake = &w->wake[w->reader_slot[i]];
+		if (__atomic_load_n(&wake->sleeping, __ATOMIC_RELAXED) == 0 ||
+		    __atomic_exchange_n(&wake->sleeping, 0,
+					__ATOMIC_RELAXED) == 0)
+		{
+			continue;
+		}
+		if (write(w->reader_efd[i], &one, sizeof(one)) != sizeof(one)) {
+			// Counter overflow, retry on the next publish
+			__atomic_store_n(&wake->sleeping, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	if (_timespec_diff_us(&now, &w->last_service) >=
+			NRF905_SHM_SERVICE_MS * 1000) {
+		w->last_service = now;
+		nrf905_shm_service(w);
+	}
+
+	return 0;
+}
+
+int nrf905_shm_open(nrf905_shm_reader_t *r, const char *name)
+{
+	struct sockaddr_un sa;
+	socklen_t sa_len;
+	char c = 0;
+	int err;
+
+	memset(r, 0, sizeof(*r));
+	r->conn_fd = -1;
+	r->efd = -1;
+
+	sa_len = _nrf905_shm_sockaddr(&sa, name);
+	if (sa_len == 0) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	r->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (r->efd == -1) {
+		goto fail;
+	}
+	r->conn_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (r->conn_fd == -1) {
+		goto fail;
+	}
+	if (connect(r->conn_fd, (struct sockaddr *) &sa, sa_len) != 0) {
+		goto fail;
+	}
+	// Picked up by the writer on its next service, which replies with
+	// the ring
+	if (_nrf905_shm_send_fd(r->conn_fd, r->efd, &c, sizeof(c)) != 0) {
+		goto fail;
+	}
+
+	return 0;
+fail:
+	err = errno;
+	nrf905_shm_close(r);
+	errno = err;
+	return -1;
+}
+
+/**
+ * Map the ring once the writer handed it over
+ *
+ * @returns	1 if the ring is mapped, 0 and set errno to EAGAIN if it
+ *		didn't arrive yet, -1 on error
+ */
+static int _nrf905_shm_attach(nrf905_shm_reader_t *r)
+{
+	struct _nrf905_shm_hello hello;
+	nrf905_shm_hdr_t hdr;
+	void *map;
+	int mem_fd;
+
+	mem_fd = _nrf905_shm_recv_fd(r->conn_fd, &hello, sizeof(hello),
+					MSG_DONTWAIT);
+	if (mem_fd == -1) {
+		if (errno == EWOULDBLOCK) {
+			errno = EAGAIN;
+			return 0;
+		}
+		return -1;
+	}
+
+	if (pread(mem_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+			hdr.magic != NRF905_SHM_MAGIC ||
+			hdr.version != NRF905_SHM_VERSION ||
+			hdr.frame_size != sizeof(nrf905_shm_frame_t) ||
+			hello.slot >= NRF905_SHM_MAX_READERS) {
+		close(mem_fd);
+		errno = EPROTO;
+		return -1;
+	}
+	r->map_len = sizeof(nrf905_shm_hdr_t) +
+			(size_t) hdr.slot_cnt * sizeof(nrf905_shm_frame_t);
+
+	r->wake_map = mmap(NULL,
+			NRF905_SHM_MAX_READERS * sizeof(nrf905_shm_wake_t),
+			PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd,
+			hdr.wake_offset);
+	if (r->wake_map == MAP_FAILED) {
+		r->wake_map = NULL;
+		close(mem_fd);
+		return -1;
+	}
+	r->wake = (nrf905_shm_wake_t *) r->wake_map + hello.slot;
+
+	map = mmap(NULL, r->map_len, PROT_READ, MAP_SHARED, mem_fd, 0);
+	close(mem_fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	r->hdr = map;
+	r->frames = (const nrf905_shm_frame_t *) (r->hdr + 1);
+	r->next = hello.head;
+
+	return 1;
+}
+
+void nrf905_shm_close(nrf905_shm_reader_t *r)
+{
+	if (r->hdr != NULL) {
+		munmap((void *) r->hdr, r->map_len);
+		r->hdr = NULL;
+		r->frames = NULL;
+	}
+	if (r->wake_map != NULL) {
+		munmap(r->wake_map,
+			NRF905_SHM_MAX_READERS * sizeof(nrf905_shm_wake_t));
+		r->wake_map = NULL;
+		r->wake = NULL;
+	}
+	if (r->conn_fd != -1) {
+		close(r->conn_fd);
+		r->conn_fd = -1;
+	}
+	if (r->efd != -1) {
+		close(r->efd);
+		r->efd = -1;
+	}
+}
+
+const nrf905_shm_frame_t *nrf905_shm_peek(nrf905_shm_reader_t *r)
+{
+	const nrf905_shm_frame_t *f;
+	uint32_t slot_cnt;
+	uint64_t head;
+	uint64_t seq;
+
+	if (r->hdr == NULL && _nrf905_shm_attach(r) != 1) {
+		return NULL;
+	}
+	slot_cnt = r->hdr->slot_cnt;
+
+	while (true) {
+		head = __atomic_load_n(&r->hdr->head, __ATOMIC_ACQUIRE);
+		if (r->next >= head) {
+			errno = EAGAIN;
+			return NULL;
+		}
+		if (head - r->next > slot_cnt) {
+			// Overrun, skip to oldest frame still in the ring
+			r->lost += head - slot_cnt - r->next;
+			r->next = head - slot_cnt;
+		}
+
+		f = &r->frames[r->next & (slot_cnt - 1)];
+		seq = __atomic_load_n(&f->seq, __ATOMIC_ACQUIRE);
+		if (seq == 2 * r->next + 2) {
+			r->cur_seq = seq;
+			return f;
+		}
+
+		// Slot is being reused for a newer frame, so we were overrun
+		// after loading head
+		r->lost++;
+		r->next++;
+	}
+}
+
+int nrf905_shm_consume(nrf905_shm_reader_t *r)
+{
+	const nrf905_shm_frame_t *f;
+	uint64_t seq;
+
+	f = &r->frames[r->next & (r->hdr->slot_cnt - 1)];
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	seq = __atomic_load_n(&f->seq, __ATOMIC_RELAXED);
+	r->next++;
+
+	if (seq != r->cur_seq) {
+		r->lost++;
+		errno = ESTALE;
+		return -1;
+	}
+
+	return 0;
+}
+
+int nrf905_shm_wait(nrf905_shm_reader_t *r, const struct timespec *to)
+{
+	struct pollfd pfds[2];
+	struct timespec deadline;
+	struct timespec now;
+	int64_t remaining;
+	uint64_t cnt;
+	int timeout_ms;
+	int ret;
+
+	if (to != NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		_timespec_add_us(&deadline,
+				(uint64_t) to->tv_sec * 1000000 + to->tv_nsec / 1000);
+	}
+
+	while (true) {
+		if (r->hdr == NULL && _nrf905_shm_attach(r) == -1) {
+			return -1;
+		}
+
+		// Flag that we sleep before checking the ring. The writer
+		// checks the flag after publishing, so a wakeup can't be
+		// missed.
+		if (r->hdr != NULL) {
+			if (read(r->efd, &cnt, sizeof(cnt)) < 0 &&
+			    errno != EAGAIN)
+			{
+				return -1;
+			}
+			__atomic_store_n(&r->wake->sleeping, 1,
+					__ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&r->hdr->head, __ATOMIC_ACQUIRE) >
+					r->next) {
+				__atomic_store_n(&r->wake->sleeping, 0,
+						__ATOMIC_RELAXED);
+				return 0;
+			}
+		}
+
+		timeout_ms = -1;
+		if (to != NULL) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			remaining = _timespec_diff_ns(&deadline, &now);
+			if (remaining <= 0) {
+				if (r->hdr != NULL) {
+					__atomic_store_n(&r->wake->sleeping, 0,
+							__ATOMIC_RELAXED);
+				}
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			remaining = (remaining + 999999) / 1000000;
+			timeout_ms = (remaining > INT_MAX) ? INT_MAX : remaining;
+		}
+
+		// After handing over the ring the writer never sends, so the
+		// connection then only becomes readable when it's closed
+		pfds[0].fd = r->efd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = r->conn_fd;
+		pfds[1].events = POLLIN;
+		ret = poll(pfds, 2, timeout_ms);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (r->hdr != NULL && pfds[1].revents != 0 &&
+				pfds[0].revents == 0 &&
+				__atomic_load_n(&r->hdr->head,
+					__ATOMIC_ACQUIRE) <= r->next) {
+			errno = ECONNRESET;
+			return -1;
+		}
+	}
+}
+
+int nrf905_shm_read(nrf905_shm_reader_t *r, nrf905_shm_frame_t *frame,
+			const struct timespec *to)
+{
+	const nrf905_shm_frame_t *f;
+
+	while (true) {
+		f = nrf905_shm_peek(r);
+		if (f != NULL) {
+			memcpy(frame, f, sizeof(*frame));
+			if (nrf905_shm_consume(r) == 0) {
+				return 0;
+			}
+			continue;
+		}
+
+		if (nrf905_shm_wait(r, to) != 0) {
+			return -1;
+		}
+	}
+}
@@ -0,0 +1,275 @@
+/**
+ * nrf905_shm.h - Shared memory frame distribution
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_SHM_H__
+#define __NRF905_SHM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "nrf905.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NRF905_SHM_MAGIC	(0x4e523935)	// "NR95"
+#define NRF905_SHM_VERSION	(2)
+
+/**
+ * Max. amount of connected readers per ring, at most 64
+ */
+#define NRF905_SHM_MAX_READERS	(64)
+
+/**
+ * Min. interval between connection servicing by nrf905_shm_publish()
+ */
+#define NRF905_SHM_SERVICE_MS	(50)
+
+/**
+ * Frame slot in the shared ring
+ *
+ * seq is a seqlock: odd while the slot is being written, 2 * (n + 1) once
+ * frame n is complete.
+ */
+typedef struct {
+	uint64_t seq;
+	uint32_t addr;		// RX address the frame was received on
+	uint8_t len;		// Payload length
+	uint8_t pad[3];
+	nrf905_rx_ts_t ts;	// Arrival time, zero if unknown
+	uint8_t data[32];
+} __attribute__((aligned(64))) nrf905_shm_frame_t;
+
+/**
+ * Ring header, followed by slot_cnt frames
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_cnt;
+	uint32_t frame_size;
+	uint64_t wake_offset;	// Page aligned offset of the wakeup flags
+	uint64_t head __attribute__((aligned(64)));	// Frames published
+} __attribute__((aligned(64))) nrf905_shm_hdr_t;
+
+/**
+ * Wakeup flag of a reader
+ *
+ * Set by the reader before it sleeps, the writer only signals the eventfd
+ * of readers that have it set. Readers map these writable, separately from
+ * the read-only ring.
+ */
+typedef struct {
+	uint32_t sleeping;
+} __attribute__((aligned(64))) nrf905_shm_wake_t;
+
+/**
+ * Publishing side of a ring
+ *
+ * The ring lives in an anonymous memfd. Readers connect to an abstract unix
+ * socket named after the ring, hand over their own eventfd and receive the
+ * memfd in return, which they map read-only. The bound socket also makes
+ * the ring name unique.
+ *
+ * An abstract socket has no file permissions, so the writer checks the
+ * credentials of every reader: it must run as root, as the same user as
+ * the writer, or with the effective group of the writer as its group. To
+ * give a group of users access, run the writer with that group, e.g. using
+ * sg(1) or a setgid executable.
+ *
+ * Readers only sleep on their eventfd when the ring is empty, and flag this
+ * in their nrf905_shm_wake_t. After publishing a frame only the eventfds of
+ * sleeping readers are signaled, so a publish doesn't make system calls
+ * while all readers keep up.
+ */
+typedef struct {
+	nrf905_shm_hdr_t *hdr;
+	nrf905_shm_frame_t *frames;
+	size_t map_len;
+	int mem_fd;
+	int listen_fd;
+
+	// Connections that didn't send their eventfd yet
+	unsigned int pending_cnt;
+	int pending_conn[NRF905_SHM_MAX_READERS];
+
+	unsigned int reader_cnt;
+	int reader_conn[NRF905_SHM_MAX_READERS];
+	int reader_efd[NRF905_SHM_MAX_READERS];
+	unsigned int reader_slot[NRF905_SHM_MAX_READERS];
+
+	nrf905_shm_wake_t *wake;	// Wakeup flag per reader slot
+	uint64_t slot_used;		// Bit per reader slot in use
+	struct timespec last_service;
+} nrf905_shm_writer_t;
+
+/**
+ * Consuming side of a ring
+ */
+typedef struct {
+	const nrf905_shm_hdr_t *hdr;
+	const nrf905_shm_frame_t *frames;
+	size_t map_len;
+	nrf905_shm_wake_t *wake;	// Own wakeup flag
+	void *wake_map;
+	int conn_fd;
+	int efd;
+
+	uint64_t next;		// Next frame to consume
+	uint64_t cur_seq;	// Seqlock value of peeked frame
+	unsigned long lost;	// Frames lost to overruns
+} nrf905_shm_reader_t;
+
+/**
+ * Create ring
+ *
+ * @param w		Writer object to initialize
+ * @param name		Ring name, used to find the ring by readers
+ * @param slot_cnt	Ring size in frames, must be a power of 2
+ *
+ * @returns	0 on success, -1 on error. errno is set to EINVAL if slot_cnt
+ *		is not a power of 2, or EADDRINUSE if a ring with this name
+ *		already exists.
+ */
+int nrf905_shm_create(nrf905_shm_writer_t *w, const char *name,
+			unsigned int slot_cnt);
+
+/**
+ * Destroy ring
+ *
+ * Connected readers can still drain the frames in the ring.
+ */
+void nrf905_shm_destroy(nrf905_shm_writer_t *w);
+
+/**
+ * Accept new readers and drop disconnected ones
+ *
+ * Doesn't block, a reader is added once its eventfd has arrived. Costs a
+ * single poll() if nothing changed. nrf905_shm_publish() calls this at most
+ * every NRF905_SHM_SERVICE_MS, call it periodically to also accept readers
+ * while no frames are published.
+ */
+void nrf905_shm_service(nrf905_shm_writer_t *w);
+
+/**
+ * Publish frame
+ *
+ * Never blocks on readers, slow readers will notice an overrun.
+ *
+ * @param w	Writer object
+ * @param addr	RX address the frame was received on
+ * @param data	Payload
+ * @param len	Payload length, at most 32
+ * @param ts	Arrival time, NULL if unknown
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if len is too large
+ */
+int nrf905_shm_publish(nrf905_shm_writer_t *w, uint32_t addr, const void *data,
+			size_t len, const nrf905_rx_ts_t *ts);
+
+/**
+ * Connect to ring
+ *
+ * Returns right away, without waiting for the writer. The ring is mapped
+ * once the writer has serviced the connection, see nrf905_shm_service(),
+ * and reading starts at the frame published after that.
+ * nrf905_shm_peek() finds no frames until then, nrf905_shm_wait() waits for
+ * the ring as well.
+ *
+ * @param r	Reader object to initialize
+ * @param name	Ring name
+ *
+ * @returns	0 on success, -1 on error. errno is set to ECONNREFUSED if
+ *		there is no ring with this name.
+ */
+int nrf905_shm_open(nrf905_shm_reader_t *r, const char *name);
+
+/**
+ * Disconnect from ring
+ */
+void nrf905_shm_close(nrf905_shm_reader_t *r);
+
+/**
+ * Get next frame in place
+ *
+ * Returns a pointer to the next frame in the shared ring without copying
+ * it. If frames were overwritten before they could be read, reading skips
+ * to the oldest frame in the ring and the amount of lost frames is added to
+ * r->lost. The frame must be released using nrf905_shm_consume(), which
+ * tells if the frame was overwritten while it was in use.
+ *
+ * @returns	Frame, or NULL and set errno to EAGAIN if there is none. If the
+ *		writer refused the reader or went away before handing over
+ *		the ring, errno is set to ECONNRESET.
+ */
+const nrf905_shm_frame_t *nrf905_shm_peek(nrf905_shm_reader_t *r);
+
+/**
+ * Release peeked frame
+ *
+ * @returns	0 if the frame was intact during use, -1 and set errno to
+ *		ESTALE if it was overwritten and must be discarded.
+ */
+int nrf905_shm_consume(nrf905_shm_reader_t *r);
+
+/**
+ * Wait until frames are available
+ *
+ * @param r	Reader object
+ * @param to	Timeout, NULL to wait forever
+ *
+ * @returns	0 if frames are available, -1 on error. errno is set to
+ *		ETIMEDOUT if the timeout expired, or ECONNRESET if the writer
+ *		is gone or dropped this reader and the ring is drained.
+ */
+int nrf905_shm_wait(nrf905_shm_reader_t *r, const struct timespec *to);
+
+/**
+ * Read copy of next frame
+ *
+ * Combines nrf905_shm_peek(), nrf905_shm_consume() and nrf905_shm_wait().
+ *
+ * @param r	Reader object
+ * @param frame	Returns the frame
+ * @param to	Timeout, NULL to wait forever
+ *
+ * @returns	0 on success, -1 on error. errno is set to ETIMEDOUT if the
+ *		timeout expired.
+ */
+int nrf905_shm_read(nrf905_shm_reader_t *r, nrf905_shm_frame_t *frame,
+			const struct timespec *to);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_SHM_H__
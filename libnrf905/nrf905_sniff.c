@@ -0,0 +1,276 @@
+/**
+ * nrf905_sniff.c - Promiscuous frame capture
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#include <errno.h>
+
+#include "nrf905.h"
+#include "nrf905_crc.h"
+#include "nrf905_sniff.h"
+
+/**
+ * Fibonacci hashing constant, 2^32 / golden ratio
+ */
+#define ADDR_HASH_MULT (2654435769u)
+
+int nrf905_addr_set_init(nrf905_addr_set_t *set, uint32_t *table,
+			unsigned int size)
+{
+	unsigned int bits = 0;
+
+	if (size < 2 || (size & (size - 1)) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	while ((1u << bits) < size) {
+		bits++;
+	}
+
+	set->table = table;
+	set->size = size;
+	set->shift = 32 - bits;
+	set->cnt = 0;
+	set->has_zero = false;
+
+	// 0 marks an empty entry, address 0 is tracked separately
+	memset(table, 0, size * sizeof(uint32_t));
+
+	return 0;
+}
+
+int nrf905_addr_set_add(nrf905_addr_set_t *set, uint32_t addr)
+{
+	unsigned int i;
+
+	if (addr == 0) {
+		set->has_zero = true;
+		return 0;
+	}
+
+	i = (addr * ADDR_HASH_MULT) >> set->shift;
+	while (set->table[i] != 0) {
+		if (set->table[i] == addr) {
+			return 0;
+		}
+		i = (i + 1) & (set->size - 1);
+	}
+
+	if (set->cnt + 1 > set->size / 4 * 3) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	set->table[i] = addr;
+	set->cnt++;
+
+	return 0;
+}
+
+bool nrf905_addr_set_contains(const nrf905_addr_set_t *set, uint32_t addr)
+{
+	unsigned int i;
+
+	if (addr == 0) {
+		return set->has_zero;
+	}
+
+	i = (addr * ADDR_HASH_MULT) >> set->shift;
+	while (set->table[i] != 0) {
+		if (set->table[i] == addr) {
+			return true;
+		}
+		i = (i + 1) & (set->size - 1);
+	}
+
+	return false;
+}
+
+int nrf905_sniff_start(nrf905_sniff_t *s, nrf905_t *nrf, uint8_t match_byte,
+			uint8_t afw, uint8_t pw, uint8_t crc_mode)
+{
+	unsigned int crc_len = (crc_mode == NRF905_CRC_MODE_CRC8) ? 1 : 2;
+	int err;
+
+	if (afw < 1 || afw > 4 ||
+	    (crc_mode != NRF905_CRC_MODE_CRC8 &&
+	     crc_mode != NRF905_CRC_MODE_CRC16 &&
+	     crc_mode != NRF905_SNIFF_CRC_AUTO))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	// The device captures at most NRF905_SNIFF_RAW_LEN bytes, longer
+	// frames would be truncated and never pass the CRC check.
+	if (pw < 1 || pw > NRF905_SNIFF_MAX_PW(afw, crc_len)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	s->nrf = nrf;
+	s->afw = afw;
+	s->pw = pw;
+	s->crc_mode = crc_mode;
+	s->match_byte = match_byte;
+	s->filter = NULL;
+
+	s->frames = 0;
+	s->crc_ok = 0;
+	s->crc_err = 0;
+	s->filtered = 0;
+
+	s->saved_rx_afw = nrf905_get_rx_afw(nrf);
+	s->saved_rx_pw = nrf905_get_rx_pw(nrf);
+	s->saved_crc_en = nrf905_get_crc_en(nrf);
+	s->saved_rx_addr = nrf905_get_rx_addr(nrf);
+
+	nrf905_set_rx_afw(nrf, 1);
+	nrf905_set_rx_pw(nrf, 32);
+	nrf905_set_crc_en(nrf, false);
+	nrf905_set_rx_addr(nrf, (s->saved_rx_addr & ~0xff) | match_byte);
+
+	err = nrf905_set_mode(nrf, NRF905_MODE_STANDBY);
+	if (err == 0) {
+		err = nrf905_write_config(nrf);
+	}
+	if (err == 0) {
+		err = nrf905_recv_enable(nrf);
+	}
+
+	return err;
+}
+
+int nrf905_sniff_stop(nrf905_sniff_t *s)
+{
+	nrf905_t *nrf = s->nrf;
+	int err;
+
+	err = nrf905_recv_disable(nrf);
+	if (err != 0) {
+		return -1;
+	}
+
+	nrf905_set_rx_afw(nrf, s->saved_rx_afw);
+	nrf905_set_rx_pw(nrf, s->saved_rx_pw);
+	nrf905_set_crc_en(nrf, s->saved_crc_en);
+	nrf905_set_rx_addr(nrf, s->saved_rx_addr);
+
+	return nrf905_write_config(nrf);
+}
+
+void nrf905_sniff_set_filter(nrf905_sniff_t *s, const nrf905_addr_set_t *filter)
+{
+	s->filter = filter;
+}
+
+int nrf905_sniff_decode(nrf905_sniff_t *s, const uint8_t *raw,
+			nrf905_sniff_frame_t *frame)
+{
+	bool try_crc8 = (s->crc_mode != NRF905_CRC_MODE_CRC16);
+	bool try_crc16 = (s->crc_mode != NRF905_CRC_MODE_CRC8);
+	uint16_t crc16 = NRF905_CRC16_INIT;
+	uint8_t crc8 = NRF905_CRC8_INIT;
+	unsigned int crc8_len = 0;
+	unsigned int len = 0;
+	uint8_t crc_mode = NRF905_CRC_MODE_CRC16;
+	uint32_t addr = 0;
+	unsigned int i;
+
+	s->frames++;
+
+	// Single pass over the data. Before adding byte i to the CRC, check if
+	// the CRC up to here matches the bytes at i; if so the frame consists
+	// of i bytes of address and payload.
+	for (i=0; i <= s->afw + s->pw && i < NRF905_SNIFF_RAW_LEN; i++) {
+		if (i > s->afw) {
+			if (try_crc16 && i + 2 <= NRF905_SNIFF_RAW_LEN &&
+			    crc16 == ((raw[i] << 8) | raw[i + 1]))
+			{
+				len = i - s->afw;
+				break;
+			}
+			if (try_crc8 && crc8_len == 0 && crc8 == raw[i]) {
+				crc8_len = i - s->afw;
+				if (!try_crc16) {
+					break;
+				}
+			}
+		}
+		crc16 = nrf905_crc16_update(crc16, raw[i]);
+		crc8 = nrf905_crc8_update(crc8, raw[i]);
+	}
+
+	if (len == 0) {
+		if (crc8_len == 0) {
+			s->crc_err++;
+			errno = EBADMSG;
+			return -1;
+		}
+		len = crc8_len;
+		crc_mode = NRF905_CRC_MODE_CRC8;
+	}
+	s->crc_ok++;
+
+	for (i=0; i < s->afw; i++) {
+		addr |= (uint32_t) raw[i] << (i * 8);
+	}
+
+	if (s->filter != NULL && !nrf905_addr_set_contains(s->filter, addr)) {
+		s->filtered++;
+		errno = ENOENT;
+		return -1;
+	}
+
+	frame->addr = addr;
+	frame->afw = s->afw;
+	frame->crc_mode = crc_mode;
+	frame->len = len;
+	memcpy(frame->payload, &raw[s->afw], len);
+
+	return 0;
+}
+
+int nrf905_sniff_recv(nrf905_sniff_t *s, nrf905_sniff_frame_t *frame)
+{
+	uint8_t raw[NRF905_SNIFF_RAW_LEN];
+	int err;
+
+	raw[0] = s->match_byte;
+
+	while (true) {
+		err = nrf905_recv(s->nrf, &raw[1], sizeof(raw) - 1);
+		if (err != 0) {
+			return -1;
+		}
+
+		err = nrf905_sniff_decode(s, raw, frame);
+		if (err == 0) {
+			return 0;
+		}
+	}
+}
@@ -0,0 +1,218 @@
+/**
+ * nrf905_sniff.h - Promiscuous frame capture
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __NRF905_SNIFF_H__
+#define __NRF905_SNIFF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf905.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * CRC mode used by the senders, in addition to NRF905_CRC_MODE_*
+ */
+#define NRF905_SNIFF_CRC_AUTO (0xFF)
+
+/**
+ * Max. amount of bytes captured, the matched address byte plus payload
+ */
+#define NRF905_SNIFF_RAW_LEN (1 + 32)
+
+/**
+ * Max. payload width that can be reconstructed
+ *
+ * The device captures at most NRF905_SNIFF_RAW_LEN bytes of address, payload
+ * and CRC, so senders using longer frames can't be sniffed.
+ *
+ * @param afw		Address width used by the senders
+ * @param crc_len	CRC length in bytes, 1 for CRC-8, 2 for CRC-16
+ */
+#define NRF905_SNIFF_MAX_PW(afw, crc_len) \
+	(NRF905_SNIFF_RAW_LEN - (afw) - (crc_len))
+
+/**
+ * Address set
+ *
+ * Open addressing hash set of 32-bit addresses in a caller provided table.
+ */
+typedef struct {
+	uint32_t *table;
+	unsigned int size;
+	unsigned int shift;
+	unsigned int cnt;
+	bool has_zero;
+} nrf905_addr_set_t;
+
+/**
+ * Reconstructed frame
+ */
+typedef struct {
+	uint32_t addr;		// Sender address, first byte on air in LSB
+	uint8_t afw;		// Address width
+	uint8_t crc_mode;	// NRF905_CRC_MODE_* that validated the frame
+	uint8_t len;		// Payload length
+	uint8_t payload[32];
+} nrf905_sniff_frame_t;
+
+/**
+ * Sniffer object
+ */
+typedef struct {
+	nrf905_t *nrf;
+	uint8_t afw;
+	uint8_t pw;
+	uint8_t crc_mode;
+	uint8_t match_byte;
+	const nrf905_addr_set_t *filter;
+
+	// Statistics
+	unsigned long frames;	// Frames received from device
+	unsigned long crc_ok;	// Frames with a valid CRC
+	unsigned long crc_err;	// Frames without a valid CRC
+	unsigned long filtered;	// Valid frames dropped by filter
+
+	// Configuration to restore on stop
+	uint8_t saved_rx_afw;
+	uint8_t saved_rx_pw;
+	bool saved_crc_en;
+	uint32_t saved_rx_addr;
+} nrf905_sniff_t;
+
+/**
+ * Initialize address set
+ *
+ * @param set	Set to initialize
+ * @param table	Storage for the set
+ * @param size	Amount of entries in table, must be a power of 2. At most
+ *		3/4 of the entries can be used.
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if size is not a
+ *		power of 2.
+ */
+int nrf905_addr_set_init(nrf905_addr_set_t *set, uint32_t *table,
+			unsigned int size);
+
+/**
+ * Add address to set
+ *
+ * @returns	0 on success, -1 and set errno to ENOSPC if the set is full.
+ */
+int nrf905_addr_set_add(nrf905_addr_set_t *set, uint32_t addr);
+
+/**
+ * Check if address is in set
+ */
+bool nrf905_addr_set_contains(const nrf905_addr_set_t *set, uint32_t addr);
+
+/**
+ * Start promiscuous capture
+ *
+ * Configure the device for the shortest address width of one byte, disable
+ * the hardware CRC and use the max. payload width. This way every frame of
+ * which the first address byte matches match_byte is received, together
+ * with the remaining address bytes, the payload and the CRC of the sender.
+ * The frames are then reconstructed and validated in software.
+ *
+ * It is assumed the address is transmitted in the same order as it is stored
+ * in the configuration register, so match_byte corresponds to the least
+ * significant byte of the address.
+ *
+ * Only NRF905_SNIFF_RAW_LEN bytes are captured, so afw + pw + CRC length
+ * may not exceed that, see NRF905_SNIFF_MAX_PW(). With NRF905_SNIFF_CRC_AUTO
+ * the CRC-16 length is assumed.
+ *
+ * @param s		Sniffer object to initialize
+ * @param nrf		NRF905 object
+ * @param match_byte	First address byte to match
+ * @param afw		Address width used by the senders
+ * @param pw		Max. payload width used by the senders
+ * @param crc_mode	CRC mode used by the senders, NRF905_CRC_MODE_* or
+ *			NRF905_SNIFF_CRC_AUTO to try both.
+ *
+ * @returns	0 on success, -1 on error. errno is set to EINVAL if the
+ *		frames don't fit in NRF905_SNIFF_RAW_LEN bytes.
+ */
+int nrf905_sniff_start(nrf905_sniff_t *s, nrf905_t *nrf, uint8_t match_byte,
+			uint8_t afw, uint8_t pw, uint8_t crc_mode);
+
+/**
+ * Stop promiscuous capture
+ *
+ * Disables the receiver and restores the original configuration.
+ */
+int nrf905_sniff_stop(nrf905_sniff_t *s);
+
+/**
+ * Only return frames from addresses in the set
+ *
+ * @param s		Sniffer object
+ * @param filter	Set of addresses to accept, NULL to accept all
+ */
+void nrf905_sniff_set_filter(nrf905_sniff_t *s, const nrf905_addr_set_t *filter);
+
+/**
+ * Reconstruct frame from captured data
+ *
+ * Finds the shortest payload length, up to the payload width given to
+ * nrf905_sniff_start(), for which the CRC matches. If both CRC
+ * modes are allowed, a CRC-16 match is preferred over a CRC-8 match. Note
+ * that with CRC-8 every payload length has a 1 in 256 chance of a false
+ * match, so a CRC-8 frame might be reported too short. The statistics are
+ * updated.
+ *
+ * @param s	Sniffer object
+ * @param raw	NRF905_SNIFF_RAW_LEN bytes: matched address byte + payload
+ * @param frame	Returns the reconstructed frame
+ *
+ * @returns	0 on success, -1 and set errno to EBADMSG if no valid CRC was
+ *		found, or ENOENT if the address was rejected by the filter.
+ */
+int nrf905_sniff_decode(nrf905_sniff_t *s, const uint8_t *raw,
+			nrf905_sniff_frame_t *frame);
+
+/**
+ * Receive frame
+ *
+ * Block until a valid frame, accepted by the filter, is received.
+ *
+ * @param s	Sniffer object
+ * @param frame	Returns the reconstructed frame
+ */
+int nrf905_sniff_recv(nrf905_sniff_t *s, nrf905_sniff_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_SNIFF_H__
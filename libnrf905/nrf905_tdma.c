@@ -0,0 +1,521 @@
+/**
+ * nrf905_tdma.c - Beacon synchronized TDMA slot scheduler
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "nrf905.h"
+#include "nrf905_tdma.h"
+#include "nrf905_time.h"
+
+static void _put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+}
+
+static void _put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = v >> 24;
+}
+
+static uint16_t _get_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t _get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+uint32_t nrf905_tdma_guard_us(uint32_t airtime_us, unsigned int node_cnt,
+				double drift_ppm, uint32_t jitter_us)
+{
+	double d = fabs(drift_ppm) / 1e6 * (node_cnt + 1);
+
+	// The last slot starts (node_cnt + 1) * (airtime + 2 * guard) after
+	// the beacon, so: guard >= d * (airtime + 2 * guard) + jitter
+	if (2 * d >= 1) {
+		errno = ERANGE;
+		return 0;
+	}
+
+	return ceil((d * airtime_us + jitter_us) / (1 - 2 * d));
+}
+
+uint64_t nrf905_tdma_superframe_us(unsigned int node_cnt, uint32_t slot_us)
+{
+	return (uint64_t) (node_cnt + 1) * slot_us;
+}
+
+/*
+ * Gateway
+ */
+static int _nrf905_tdma_addr_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a;
+	uint32_t y = *(const uint32_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+int nrf905_tdma_gw_init(nrf905_tdma_gw_t *gw, nrf905_t *nrf,
+			uint32_t net_addr, uint32_t *nodes,
+			unsigned int node_cnt, uint32_t guard_us)
+{
+	unsigned int i;
+
+	if (node_cnt == 0 || node_cnt > NRF905_TDMA_MAX_NODES ||
+	    nrf905_get_tx_pw(nrf) < NRF905_TDMA_BEACON_HDR_LEN +
+					NRF905_TDMA_BEACON_ENTRY_LEN)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	qsort(nodes, node_cnt, sizeof(nodes[0]), _nrf905_tdma_addr_cmp);
+	for (i=1; i < node_cnt; i++) {
+		if (nodes[i] == nodes[i - 1]) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	// Written to the device when the schedule starts
+	nrf905_set_rx_addr(nrf, net_addr);
+
+	gw->nrf = nrf;
+	gw->net_addr = net_addr;
+	gw->nodes = nodes;
+	gw->node_cnt = node_cnt;
+	gw->guard_us = guard_us;
+	gw->slot_us = nrf905_get_tx_airtime(nrf) + 2 * guard_us;
+	gw->seq = 0;
+	gw->next_entry = 0;
+	gw->started = false;
+	memset(&gw->stats, 0, sizeof(gw->stats));
+
+	return 0;
+}
+
+int nrf905_tdma_gw_slot(nrf905_tdma_gw_t *gw, uint32_t addr)
+{
+	uint32_t *p;
+
+	p = bsearch(&addr, gw->nodes, gw->node_cnt, sizeof(gw->nodes[0]),
+			_nrf905_tdma_addr_cmp);
+	if (p == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return 1 + (p - gw->nodes);
+}
+
+/**
+ * Load beacon for the superframe starting at gw->next_beacon
+ */
+static int _nrf905_tdma_gw_load_beacon(nrf905_tdma_gw_t *gw)
+{
+	nrf905_t *nrf = gw->nrf;
+	uint8_t buf[32];
+	unsigned int entries;
+	unsigned int i;
+
+	entries = (nrf905_get_tx_pw(nrf) - NRF905_TDMA_BEACON_HDR_LEN) /
+			NRF905_TDMA_BEACON_ENTRY_LEN;
+	if (entries > gw->node_cnt - gw->next_entry) {
+		entries = gw->node_cnt - gw->next_entry;
+	}
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = NRF905_TDMA_BEACON_TYPE;
+	buf[1] = entries;
+	_put_le16(&buf[2], gw->seq);
+	_put_le16(&buf[4], gw->node_cnt);
+	_put_le32(&buf[6], gw->slot_us);
+	_put_le16(&buf[10], 1 + gw->next_entry);
+	for (i=0; i < entries; i++) {
+		_put_le32(&buf[NRF905_TDMA_BEACON_HDR_LEN +
+				i * NRF905_TDMA_BEACON_ENTRY_LEN],
+			gw->nodes[gw->next_entry + i]);
+	}
+
+	gw->next_entry = (gw->next_entry + entries) % gw->node_cnt;
+
+	return nrf905_write_tx_payload(nrf, buf, nrf905_get_tx_pw(nrf));
+}
+
+int nrf905_tdma_gw_beacon(nrf905_tdma_gw_t *gw)
+{
+	nrf905_t *nrf = gw->nrf;
+	uint64_t sf_us = nrf905_tdma_superframe_us(gw->node_cnt, gw->slot_us);
+	int err;
+
+	if (!gw->started) {
+		// Listen on the network address for the node frames
+		nrf905_set_rx_addr(nrf, gw->net_addr);
+		err = nrf905_write_config_bytes(nrf, NRF905_CONF_RX_ADDR, 4);
+		if (err != 0) {
+			return -1;
+		}
+		err = nrf905_write_tx_addr(nrf, gw->net_addr);
+		if (err != 0) {
+			return -1;
+		}
+		err = _nrf905_tdma_gw_load_beacon(gw);
+		if (err != 0) {
+			return -1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &gw->next_beacon);
+		_timespec_add_us(&gw->next_beacon,
+				NRF905_T_PWR_UP_US + NRF905_T_STBY_TRX_US);
+		gw->started = true;
+	}
+
+	// The beacon payload is loaded in advance, so keying the transmitter
+	// is all that is left to do.
+	while ((err = nrf905_transmit_at(nrf, &gw->next_beacon)) != 0) {
+		if (errno != ETIME) {
+			return -1;
+		}
+
+		// Too late, skip the superframe
+		_timespec_add_us(&gw->next_beacon, sf_us);
+		gw->seq++;
+		err = _nrf905_tdma_gw_load_beacon(gw);
+		if (err != 0) {
+			return -1;
+		}
+	}
+	gw->stats.beacons++;
+
+	gw->sf_start = gw->next_beacon;
+	_timespec_add_us(&gw->next_beacon, sf_us);
+	gw->seq++;
+
+	err = _nrf905_tdma_gw_load_beacon(gw);
+	if (err != 0) {
+		return -1;
+	}
+
+	return nrf905_recv_enable(nrf);
+}
+
+int nrf905_tdma_gw_recv(nrf905_tdma_gw_t *gw, void *data, size_t len,
+			uint32_t *addr)
+{
+	const struct timespec poll_ts = { 0, NRF905_TDMA_POLL_US * 1000 };
+	nrf905_t *nrf = gw->nrf;
+	uint8_t buf[32];
+	struct timespec deadline;
+	struct timespec now;
+	int64_t offset_us;
+	unsigned int slot;
+	size_t n;
+	int err;
+
+	// Leave time to key the transmitter for the next beacon
+	deadline = gw->next_beacon;
+	_timespec_sub_us(&deadline, NRF905_T_RX_TX_US + NRF905_TDMA_POLL_US);
+
+	while (true) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		if (nrf905_data_ready(nrf)) {
+			err = nrf905_recv_nb(nrf, buf, sizeof(buf));
+			if (err != 0) {
+				return -1;
+			}
+			if (buf[0] != NRF905_TDMA_DATA_TYPE) {
+				gw->stats.invalid++;
+				continue;
+			}
+
+			// Data ready is raised at the end of the frame
+			offset_us = _timespec_diff_us(&now, &gw->sf_start) -
+					nrf905_get_rx_airtime(nrf) -
+					NRF905_TDMA_POLL_US / 2;
+			slot = (offset_us > 0) ? offset_us / gw->slot_us : 0;
+			if (slot == 0 || slot > gw->node_cnt) {
+				gw->stats.misplaced++;
+				continue;
+			}
+
+			gw->stats.frames++;
+			*addr = gw->nodes[slot - 1];
+			n = nrf905_get_rx_pw(nrf) - 1;
+			memcpy(data, &buf[1], (len < n) ? len : n);
+			return 0;
+		}
+
+		if (_timespec_diff_us(&now, &deadline) >= 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		nanosleep(&poll_ts, NULL);
+	}
+}
+
+/*
+ * Node
+ */
+int nrf905_tdma_node_init(nrf905_tdma_node_t *node, nrf905_t *nrf,
+			uint32_t net_addr, uint32_t addr)
+{
+	if (nrf905_get_rx_pw(nrf) < NRF905_TDMA_BEACON_HDR_LEN) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(node, 0, sizeof(*node));
+	node->nrf = nrf;
+	node->net_addr = net_addr;
+	node->addr = addr;
+	node->jitter_us = NRF905_TDMA_JITTER_US;
+
+	return 0;
+}
+
+/**
+ * Process received beacon
+ *
+ * @param node		Node object
+ * @param buf		Beacon payload
+ * @param len		Payload length
+ * @param start		Local time at which the beacon frame started
+ *
+ * @returns	true if the frame is a valid beacon
+ */
+static bool _nrf905_tdma_node_beacon(nrf905_tdma_node_t *node,
+				const uint8_t *buf, size_t len,
+				const struct timespec *start)
+{
+	unsigned int entries;
+	uint16_t first;
+	uint16_t seq;
+	uint16_t seq_diff;
+	double nominal_us;
+	double meas_ppm;
+	unsigned int i;
+
+	if (buf[0] != NRF905_TDMA_BEACON_TYPE) {
+		return false;
+	}
+	entries = buf[1];
+	if (NRF905_TDMA_BEACON_HDR_LEN +
+			entries * NRF905_TDMA_BEACON_ENTRY_LEN > len)
+	{
+		return false;
+	}
+
+	seq = _get_le16(&buf[2]);
+
+	// Measure drift against the previous beacon. Only the gateway's
+	// nominal superframe length is used as reference, so this is the
+	// drift of our clock relative to the gateway clock.
+	if (node->synced && node->slot_us == _get_le32(&buf[6]) &&
+	    node->node_cnt == _get_le16(&buf[4]))
+	{
+		seq_diff = seq - node->seq;
+		if (seq_diff != 0) {
+			nominal_us = (double) seq_diff *
+				nrf905_tdma_superframe_us(node->node_cnt,
+							node->slot_us);
+			meas_ppm = (_timespec_diff_us(start, &node->sf_start) -
+					nominal_us) / nominal_us * 1e6;
+			if (node->drift_valid) {
+				node->drift_ppm += (meas_ppm - node->drift_ppm) / 8;
+			} else {
+				node->drift_ppm = meas_ppm;
+				node->drift_valid = true;
+			}
+			node->stats.missed += seq_diff - 1;
+		}
+	}
+
+	node->seq = seq;
+	node->node_cnt = _get_le16(&buf[4]);
+	node->slot_us = _get_le32(&buf[6]);
+	node->sf_start = *start;
+	node->synced = true;
+	node->slot_used = false;
+	node->stats.beacons++;
+
+	first = _get_le16(&buf[10]);
+	for (i=0; i < entries; i++) {
+		if (_get_le32(&buf[NRF905_TDMA_BEACON_HDR_LEN +
+				i * NRF905_TDMA_BEACON_ENTRY_LEN]) == node->addr)
+		{
+			node->slot = first + i;
+		}
+	}
+	if (node->slot > node->node_cnt) {
+		// Network shrunk
+		node->slot = 0;
+	}
+
+	return true;
+}
+
+int nrf905_tdma_node_sync(nrf905_tdma_node_t *node, const struct timespec *to)
+{
+	const struct timespec poll_ts = { 0, NRF905_TDMA_POLL_US * 1000 };
+	nrf905_t *nrf = node->nrf;
+	uint8_t buf[32];
+	struct timespec deadline;
+	struct timespec now;
+	int err;
+
+	if (nrf905_get_rx_addr(nrf) != node->net_addr) {
+		nrf905_set_rx_addr(nrf, node->net_addr);
+		err = nrf905_write_config_bytes(nrf, NRF905_CONF_RX_ADDR, 4);
+		if (err != 0) {
+			return -1;
+		}
+	}
+
+	err = nrf905_recv_enable(nrf);
+	if (err != 0) {
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (to != NULL) {
+		deadline = now;
+		_timespec_add_us(&deadline,
+				(uint64_t) to->tv_sec * 1000000 + to->tv_nsec / 1000);
+	}
+
+	while (true) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		if (nrf905_data_ready(nrf)) {
+			err = nrf905_recv_nb(nrf, buf, sizeof(buf));
+			if (err != 0) {
+				return -1;
+			}
+
+			// Data ready is raised at the end of the frame, on
+			// average half a poll interval ago
+			_timespec_sub_us(&now, nrf905_get_rx_airtime(nrf) +
+						NRF905_TDMA_POLL_US / 2);
+			if (_nrf905_tdma_node_beacon(node, buf,
+						nrf905_get_rx_pw(nrf), &now))
+			{
+				return 0;
+			}
+			continue;
+		}
+
+		if (to != NULL && _timespec_diff_us(&now, &deadline) >= 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		nanosleep(&poll_ts, NULL);
+	}
+}
+
+void nrf905_tdma_node_slot_start(nrf905_tdma_node_t *node, unsigned int slot,
+				struct timespec *ts)
+{
+	double offset_us;
+
+	// Scale the gateway's slot offset to our clock
+	offset_us = (double) slot * node->slot_us;
+	if (node->drift_valid) {
+		offset_us *= 1 + node->drift_ppm / 1e6;
+	}
+
+	*ts = node->sf_start;
+	_timespec_add_us(ts, llround(offset_us));
+}
+
+int nrf905_tdma_node_send(nrf905_tdma_node_t *node, const void *data,
+			size_t len)
+{
+	nrf905_t *nrf = node->nrf;
+	uint8_t buf[32];
+	struct timespec start;
+	int err;
+
+	if (len + 1 > nrf905_get_tx_pw(nrf)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!node->synced || node->slot_used) {
+		errno = ETIME;
+		return -1;
+	}
+	if (node->slot == 0) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	// The type byte keeps data frames from being taken for beacons
+	buf[0] = NRF905_TDMA_DATA_TYPE;
+	memcpy(&buf[1], data, len);
+	memset(&buf[1 + len], 0, sizeof(buf) - 1 - len);
+
+	err = nrf905_write_tx_addr(nrf, node->net_addr);
+	if (err == 0) {
+		err = nrf905_write_tx_payload(nrf, buf,
+				nrf905_get_tx_pw(nrf));
+	}
+	if (err != 0) {
+		return -1;
+	}
+
+	// Center the frame in the slot
+	nrf905_tdma_node_slot_start(node, node->slot, &start);
+	_timespec_add_us(&start,
+			(node->slot_us - nrf905_get_tx_airtime(nrf)) / 2);
+
+	// One frame per superframe, the next needs a new beacon
+	node->slot_used = true;
+
+	err = nrf905_transmit_at(nrf, &start);
+	if (err != 0) {
+		if (errno == ETIME) {
+			node->stats.late++;
+		}
+		return -1;
+	}
+	node->stats.frames++;
+
+	return 0;
+}
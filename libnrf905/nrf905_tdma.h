@@ -0,0 +1,304 @@
+/**
+ * nrf905_tdma.h - Beacon synchronized TDMA slot scheduler
+ *
+ * Copyright (c) 2014, David Imhoff <dimhoff.devel@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the author nor the names of its contributors may
+ *       be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __NRF905_TDMA_H__
+#define __NRF905_TDMA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "nrf905.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Superframe layout
+ *
+ * A superframe starts with a beacon from the gateway in slot 0, followed by
+ * one slot per node. Nodes are assigned slots 1..node_cnt in order of their
+ * address. All slots have the same length: the frame air time with a guard
+ * interval on both sides. The beacon and the node frames are send to the
+ * same network address, which is the RX address of the gateway and, while
+ * synchronizing, of the nodes.
+ *
+ * Beacon payload, multi byte values are little endian:
+ *   0     NRF905_TDMA_BEACON_TYPE
+ *   1     Amount of slot assignment entries
+ *   2-3   Superframe sequence number
+ *   4-5   Amount of node slots
+ *   6-9   Slot length in us
+ *   10-11 Slot of first assignment entry
+ *   12-   Node addresses of consecutive slots, 4 bytes each
+ *
+ * The assignment entries rotate through the node list, so a node joining
+ * the network learns its slot within node_cnt / entries beacons.
+ *
+ * Node frames start with NRF905_TDMA_DATA_TYPE, followed by the data. The
+ * first byte of every frame in the network is reserved for the type.
+ */
+#define NRF905_TDMA_BEACON_TYPE		(0xB7)
+#define NRF905_TDMA_DATA_TYPE		(0xD7)
+#define NRF905_TDMA_BEACON_HDR_LEN	(12)
+#define NRF905_TDMA_BEACON_ENTRY_LEN	(4)
+#define NRF905_TDMA_MAX_NODES		(65535)
+
+/**
+ * Data ready poll interval
+ */
+#define NRF905_TDMA_POLL_US		(100)
+
+/**
+ * Default timing uncertainty, excluding clock drift
+ *
+ * Covers the data ready poll interval at both ends and the wakeup latency
+ * of a process without real-time priority.
+ */
+#define NRF905_TDMA_JITTER_US		(500)
+
+/**
+ * Gateway statistics
+ */
+typedef struct {
+	unsigned long beacons;		// Beacons send
+	unsigned long frames;		// Frames received in a node slot
+	unsigned long misplaced;	// Frames received in the beacon slot
+	unsigned long invalid;		// Frames that aren't node frames
+} nrf905_tdma_gw_stats_t;
+
+/**
+ * Gateway object
+ */
+typedef struct {
+	nrf905_t *nrf;
+	uint32_t net_addr;
+	uint32_t *nodes;		// Sorted node addresses
+	unsigned int node_cnt;
+	uint32_t guard_us;
+	uint32_t slot_us;
+
+	uint16_t seq;
+	unsigned int next_entry;	// Next assignment entry in beacon
+	bool started;
+	struct timespec sf_start;	// Start of current superframe
+	struct timespec next_beacon;	// Start of next superframe
+
+	nrf905_tdma_gw_stats_t stats;
+} nrf905_tdma_gw_t;
+
+/**
+ * Node statistics
+ */
+typedef struct {
+	unsigned long beacons;		// Beacons received
+	unsigned long missed;		// Beacons missed according to sequence
+	unsigned long frames;		// Frames send in our slot
+	unsigned long late;		// Send attempts after our slot passed
+} nrf905_tdma_node_stats_t;
+
+/**
+ * Node object
+ */
+typedef struct {
+	nrf905_t *nrf;
+	uint32_t net_addr;
+	uint32_t addr;			// Own address, used for slot assignment
+	uint32_t jitter_us;
+
+	// From last beacon
+	bool synced;
+	uint16_t seq;
+	uint16_t slot;			// Own slot, 0 if not yet assigned
+	uint16_t node_cnt;
+	uint32_t slot_us;
+	struct timespec sf_start;	// Local start of synchronized superframe
+	bool slot_used;			// Frame send in synchronized superframe
+
+	// Clock drift relative to the gateway, positive if the local clock
+	// runs fast.
+	double drift_ppm;
+	bool drift_valid;
+
+	nrf905_tdma_node_stats_t stats;
+} nrf905_tdma_node_t;
+
+/**
+ * Calculate guard interval
+ *
+ * Size the guard interval so that a node synchronized to a beacon stays
+ * within its slot until the next beacon, with the given clock drift between
+ * gateway and node. The superframe length itself depends on the guard
+ * interval, this is taken into account.
+ *
+ * @param airtime_us	Frame air time
+ * @param node_cnt	Amount of node slots
+ * @param drift_ppm	Max. clock drift between gateway and nodes, for
+ *			example the largest nrf905_tdma_node_t::drift_ppm
+ *			measured in the network.
+ * @param jitter_us	Timing uncertainty besides drift
+ *
+ * @returns	Guard interval in us, or 0 and set errno to ERANGE if the drift
+ *		is too large to ever fit a superframe.
+ */
+uint32_t nrf905_tdma_guard_us(uint32_t airtime_us, unsigned int node_cnt,
+				double drift_ppm, uint32_t jitter_us);
+
+/**
+ * Superframe length
+ *
+ * @returns	Length of a superframe, beacon slot included, in us
+ */
+uint64_t nrf905_tdma_superframe_us(unsigned int node_cnt, uint32_t slot_us);
+
+/**
+ * Initialize gateway
+ *
+ * The node address array is sorted in place and must stay valid during the
+ * lifetime of the gateway object. The TX payload width, used for the beacon
+ * and the node frames, must be at least NRF905_TDMA_BEACON_HDR_LEN +
+ * NRF905_TDMA_BEACON_ENTRY_LEN. The RX and TX configuration should be equal
+ * for all devices in the network. The RX address is set to the network
+ * address, it's written to the device by the first nrf905_tdma_gw_beacon().
+ *
+ * @param gw		Gateway object to initialize
+ * @param nrf		NRF905 object
+ * @param net_addr	Network address
+ * @param nodes		Node addresses
+ * @param node_cnt	Amount of nodes
+ * @param guard_us	Guard interval, see nrf905_tdma_guard_us()
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if a node address is
+ *		listed twice, there are too many nodes or the payload width is
+ *		too small.
+ */
+int nrf905_tdma_gw_init(nrf905_tdma_gw_t *gw, nrf905_t *nrf,
+			uint32_t net_addr, uint32_t *nodes,
+			unsigned int node_cnt, uint32_t guard_us);
+
+/**
+ * Look up slot of a node
+ *
+ * @returns	Slot number, or -1 and set errno to ENOENT if the node is not
+ *		part of the network.
+ */
+int nrf905_tdma_gw_slot(nrf905_tdma_gw_t *gw, uint32_t addr);
+
+/**
+ * Send beacon
+ *
+ * Waits until the start of the next superframe, transmits the beacon and
+ * enables the receiver. The first call starts the schedule.
+ *
+ * @returns	0 on success, -1 on error
+ */
+int nrf905_tdma_gw_beacon(nrf905_tdma_gw_t *gw);
+
+/**
+ * Receive frame during the current superframe
+ *
+ * The sender is derived from the slot in which the frame was received.
+ * Frames without the data type byte are skipped.
+ *
+ * @param gw	Gateway object
+ * @param data	Buffer to return data in, without the type byte
+ * @param len	Length of data buffer
+ * @param addr	Returns address of the node owning the slot
+ *
+ * @returns	0 on success, -1 and set errno to ETIMEDOUT if the superframe
+ *		is over and the next beacon must be send.
+ */
+int nrf905_tdma_gw_recv(nrf905_tdma_gw_t *gw, void *data, size_t len,
+			uint32_t *addr);
+
+/**
+ * Initialize node
+ *
+ * @param node		Node object to initialize
+ * @param nrf		NRF905 object
+ * @param net_addr	Network address
+ * @param addr		Own address, as known by the gateway
+ *
+ * @returns	0 on success, -1 and set errno to EINVAL if the payload width
+ *		is too small for a beacon.
+ */
+int nrf905_tdma_node_init(nrf905_tdma_node_t *node, nrf905_t *nrf,
+			uint32_t net_addr, uint32_t addr);
+
+/**
+ * Synchronize to beacon
+ *
+ * Listens on the network address until a beacon is received. The start of
+ * the superframe is derived from the data ready time minus the frame air
+ * time. Successive beacons are used to measure the clock drift, which is
+ * compensated when calculating slot deadlines.
+ *
+ * @param node	Node object
+ * @param to	Timeout, NULL to wait forever
+ *
+ * @returns	0 on success, -1 and set errno to ETIMEDOUT if no beacon was
+ *		received.
+ */
+int nrf905_tdma_node_sync(nrf905_tdma_node_t *node, const struct timespec *to);
+
+/**
+ * Send frame in own slot
+ *
+ * Sleeps until the own slot of the superframe of the last received beacon
+ * and transmits the frame, keying the transmitter so the frame starts one
+ * guard interval into the slot. The data is prefixed with the data type
+ * byte and padded to the TX payload width.
+ *
+ * @param node	Node object
+ * @param data	Data to send
+ * @param len	Length of data, at most the TX payload width minus 1
+ *
+ * @returns	0 on success, -1 on error. errno is set to EINVAL if the data
+ *		is too long, ENOENT if no slot is assigned yet, or ETIME if
+ *		our slot already passed or was already used and the node
+ *		must resynchronize first.
+ */
+int nrf905_tdma_node_send(nrf905_tdma_node_t *node, const void *data,
+			size_t len);
+
+/**
+ * Calculate local start of a slot in the synchronized superframe
+ *
+ * @param node	Node object
+ * @param slot	Slot number
+ * @param ts	Returns start of the slot on the local clock
+ */
+void nrf905_tdma_node_slot_start(nrf905_tdma_node_t *node, unsigned int slot,
+				struct timespec *ts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NRF905_TDMA_H__